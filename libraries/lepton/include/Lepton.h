@@ -33,6 +33,7 @@
  * -------------------------------------------------------------------------- */
 
 #include "lepton/CustomFunction.h"
+#include "lepton/CompiledExpression.h"
 #include "lepton/ExpressionProgram.h"
 #include "lepton/ExpressionTreeNode.h"
 #include "lepton/Operation.h"
@@ -0,0 +1,146 @@
+#ifndef LEPTON_COMPILED_EXPRESSION_H_
+#define LEPTON_COMPILED_EXPRESSION_H_
+
+/* -------------------------------------------------------------------------- *
+ *                                   Lepton                                   *
+ * -------------------------------------------------------------------------- *
+ * This is part of the Lepton expression parser originating from              *
+ * Simbios, the NIH National Center for Physics-Based Simulation of           *
+ * Biological Structures at Stanford, funded under the NIH Roadmap for        *
+ * Medical Research, grant U54 GM072970. See https://simtk.org.               *
+ *                                                                            *
+ * Portions copyright (c) 2013 Stanford University and the Authors.           *
+ * Authors: Peter Eastman                                                     *
+ * Contributors:                                                              *
+ *                                                                            *
+ * Permission is hereby granted, free of charge, to any person obtaining a    *
+ * copy of this software and associated documentation files (the "Software"), *
+ * to deal in the Software without restriction, including without limitation  *
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,   *
+ * and/or sell copies of the Software, and to permit persons to whom the      *
+ * Software is furnished to do so, subject to the following conditions:       *
+ *                                                                            *
+ * The above copyright notice and this permission notice shall be included in *
+ * all copies or substantial portions of the Software.                        *
+ *                                                                            *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR *
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,   *
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL    *
+ * THE AUTHORS, CONTRIBUTORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,    *
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR      *
+ * OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE  *
+ * USE OR OTHER DEALINGS IN THE SOFTWARE.                                     *
+ * -------------------------------------------------------------------------- */
+
+#include "ExpressionTreeNode.h"
+#include "windowsIncludes.h"
+#include <map>
+#include <set>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace Lepton {
+
+class ParsedExpression;
+
+/**
+ * A CompiledExpression is a highly optimized representation of an expression for cases when you want to evaluate
+ * it many times as quickly as possible.  You should treat it as an opaque object; none of the internal representation
+ * is visible.
+ *
+ * A CompiledExpression is created by calling createCompiledExpression() on a ParsedExpression.  Every variable,
+ * constant, and intermediate value is assigned a fixed slot in a flat array of doubles, and identical subexpressions
+ * share a single slot, so each one is only computed once.  To set the value of a variable, call getVariableReference()
+ * once to get a reference to its slot, then assign values to it directly before each call to evaluate().  Evaluating
+ * the expression does not look up any names and does not allocate memory.
+ *
+ * A CompiledExpression can also be created from several ParsedExpressions, such as an energy and its derivatives.
+ * Subexpressions they have in common are then computed only once, and a single call to evaluate() computes all of
+ * them.  Use getResult() to retrieve the value of each one.
+ *
+ * When Lepton is built with LEPTON_USE_JIT on a 64 bit x86 processor, the expression is also translated into native
+ * machine code.  Operations with no native implementation are still evaluated by calling the Operation.  Expressions
+ * that use custom functions, which may throw exceptions, are always interpreted, as is any expression for which
+ * executable memory cannot be allocated.
+ *
+ * References returned by getVariableReference() refer to memory owned by this object.  They remain valid until the
+ * CompiledExpression is deleted or assigned to.  A CompiledExpression therefore may not be evaluated by more than one
+ * thread at a time.
+ */
+
+class LEPTON_EXPORT CompiledExpression {
+public:
+    CompiledExpression();
+    /**
+     * Create a CompiledExpression that evaluates several expressions at once, sharing any subexpressions they
+     * have in common.
+     *
+     * @param expressions   the expressions to evaluate.  Their values are retrieved with getResult().
+     */
+    CompiledExpression(const std::vector<ParsedExpression>& expressions);
+    CompiledExpression(const CompiledExpression& expression);
+    ~CompiledExpression();
+    CompiledExpression& operator=(const CompiledExpression& expression);
+    /**
+     * Get the names of all variables used by this expression.
+     */
+    const std::set<std::string>& getVariables() const;
+    /**
+     * Get a reference to the memory location where the value of a particular variable is stored.  This throws
+     * an exception if the expression does not depend on the variable, so use getVariables() to check first.
+     */
+    double& getVariableReference(const std::string& name);
+    /**
+     * Evaluate the expression, using the values currently stored in the variable locations.  If this object was
+     * created from several expressions, all of them are evaluated and the value of the first one is returned.
+     */
+    double evaluate() const;
+    /**
+     * Get the number of expressions computed by evaluate().
+     */
+    int getNumResults() const;
+    /**
+     * Get the value of one expression as computed by the most recent call to evaluate().
+     *
+     * @param index   the index of the expression, in the order they were passed to the constructor
+     */
+    double getResult(int index) const;
+    /**
+     * Evaluate the expression for many sets of variable values at once.  The sets are processed in blocks, and each
+     * operation is applied to a whole block with a simple loop the compiler can vectorize.
+     *
+     * @param numValues  the number of sets of values to evaluate the expression for
+     * @param names      the names of the variables whose values differ between sets.  Any other variable takes the
+     *                   value currently stored in its location (see getVariableReference()).
+     * @param values     values[i][j] is the value of the variable names[i] in set j
+     * @param results    on exit, results[k][j] contains the value of expression k for set j.  This may contain fewer
+     *                   elements than getNumResults(), and any element may be NULL, to skip storing those values.
+     */
+    void evaluateBatch(int numValues, const std::vector<std::string>& names, const std::vector<const double*>& values, const std::vector<double*>& results) const;
+private:
+    friend class ParsedExpression;
+    CompiledExpression(const ParsedExpression& expression);
+    void compileExpressions(const std::vector<ParsedExpression>& expressions);
+    int compileExpression(const ExpressionTreeNode& node, std::vector<std::pair<ExpressionTreeNode, int> >& temps);
+    void evaluateBlock(int step, int count) const;
+    void generateJitCode();
+    void freeJitCode();
+    std::map<std::string, int> variableIndices;
+    std::set<std::string> variableNames;
+    mutable std::vector<double> workspace;
+    mutable std::vector<double> argValues;
+    mutable std::vector<double> batchWorkspace;
+    std::map<std::string, double> dummyVariables;
+    std::vector<std::vector<int> > arguments;
+    std::vector<int> target;
+    std::vector<Operation*> operation;
+    std::vector<int> resultIndices;
+    void* jitCode;
+    size_t jitCodeSize;
+    std::vector<double> jitConstants;
+};
+
+} // namespace Lepton
+
+#endif /*LEPTON_COMPILED_EXPRESSION_H_*/
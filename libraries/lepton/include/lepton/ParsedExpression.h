@@ -39,6 +39,7 @@
 
 namespace Lepton {
 
+class CompiledExpression;
 class ExpressionProgram;
 
 /**
@@ -97,6 +98,10 @@ public:
      * Create an ExpressionProgram that represents the same calculation as this expression.
      */
     ExpressionProgram createProgram() const;
+    /**
+     * Create a CompiledExpression that represents the same calculation as this expression.
+     */
+    CompiledExpression createCompiledExpression() const;
     /**
      * Create a new ParsedExpression which is identical to this one, except that the names of some
      * variables have been changed.
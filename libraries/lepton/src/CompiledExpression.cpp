@@ -0,0 +1,559 @@
+/* -------------------------------------------------------------------------- *
+ *                                   Lepton                                   *
+ * -------------------------------------------------------------------------- *
+ * This is part of the Lepton expression parser originating from              *
+ * Simbios, the NIH National Center for Physics-Based Simulation of           *
+ * Biological Structures at Stanford, funded under the NIH Roadmap for        *
+ * Medical Research, grant U54 GM072970. See https://simtk.org.               *
+ *                                                                            *
+ * Portions copyright (c) 2013 Stanford University and the Authors.           *
+ * Authors: Peter Eastman                                                     *
+ * Contributors:                                                              *
+ *                                                                            *
+ * Permission is hereby granted, free of charge, to any person obtaining a    *
+ * copy of this software and associated documentation files (the "Software"), *
+ * to deal in the Software without restriction, including without limitation  *
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,   *
+ * and/or sell copies of the Software, and to permit persons to whom the      *
+ * Software is furnished to do so, subject to the following conditions:       *
+ *                                                                            *
+ * The above copyright notice and this permission notice shall be included in *
+ * all copies or substantial portions of the Software.                        *
+ *                                                                            *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR *
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,   *
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL    *
+ * THE AUTHORS, CONTRIBUTORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,    *
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR      *
+ * OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE  *
+ * USE OR OTHER DEALINGS IN THE SOFTWARE.                                     *
+ * -------------------------------------------------------------------------- */
+
+#include "lepton/CompiledExpression.h"
+#include "lepton/Exception.h"
+#include "lepton/Operation.h"
+#include "lepton/ParsedExpression.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+#if defined(LEPTON_USE_JIT) && defined(__x86_64__) && !defined(_WIN32)
+    #define LEPTON_JIT_X86_64
+    #include <sys/mman.h>
+#endif
+
+using namespace Lepton;
+using namespace std;
+
+static const int BatchSize = 64;
+
+CompiledExpression::CompiledExpression() : resultIndices(1, 0), jitCode(NULL), jitCodeSize(0) {
+    workspace.resize(1);
+}
+
+CompiledExpression::CompiledExpression(const ParsedExpression& expression) : jitCode(NULL), jitCodeSize(0) {
+    compileExpressions(vector<ParsedExpression>(1, expression));
+}
+
+CompiledExpression::CompiledExpression(const vector<ParsedExpression>& expressions) : jitCode(NULL), jitCodeSize(0) {
+    if (expressions.size() == 0)
+        throw Exception("CompiledExpression: no expressions specified");
+    compileExpressions(expressions);
+}
+
+void CompiledExpression::compileExpressions(const vector<ParsedExpression>& expressions) {
+    // Compile all the expressions together, so any subexpression they share is only computed once.
+
+    vector<pair<ExpressionTreeNode, int> > temps;
+    for (int i = 0; i < (int) expressions.size(); i++)
+        resultIndices.push_back(compileExpression(expressions[i].getRootNode(), temps));
+    int maxArgs = 1;
+    for (int i = 0; i < (int) arguments.size(); i++)
+        if (arguments[i].size() > maxArgs)
+            maxArgs = arguments[i].size();
+    argValues.resize(maxArgs);
+    generateJitCode();
+}
+
+CompiledExpression::~CompiledExpression() {
+    for (int i = 0; i < (int) operation.size(); i++)
+        delete operation[i];
+    freeJitCode();
+}
+
+CompiledExpression::CompiledExpression(const CompiledExpression& expression) : jitCode(NULL), jitCodeSize(0) {
+    *this = expression;
+}
+
+CompiledExpression& CompiledExpression::operator=(const CompiledExpression& expression) {
+    if (this == &expression)
+        return *this;
+    for (int i = 0; i < (int) operation.size(); i++)
+        delete operation[i];
+    variableIndices = expression.variableIndices;
+    variableNames = expression.variableNames;
+    workspace = expression.workspace;
+    argValues = expression.argValues;
+    arguments = expression.arguments;
+    target = expression.target;
+    resultIndices = expression.resultIndices;
+    operation.resize(expression.operation.size());
+    for (int i = 0; i < (int) operation.size(); i++)
+        operation[i] = expression.operation[i]->clone();
+
+    // The generated code contains the addresses of this object's operations and buffers, so it cannot be shared.
+
+    generateJitCode();
+    return *this;
+}
+
+int CompiledExpression::compileExpression(const ExpressionTreeNode& node, vector<pair<ExpressionTreeNode, int> >& temps) {
+    // If this subexpression has already been compiled, reuse its value.
+
+    for (int i = 0; i < (int) temps.size(); i++)
+        if (temps[i].first == node)
+            return temps[i].second;
+    const Operation& op = node.getOperation();
+    int index;
+    if (op.getId() == Operation::VARIABLE) {
+        index = workspace.size();
+        workspace.push_back(0.0);
+        variableIndices[op.getName()] = index;
+        variableNames.insert(op.getName());
+    }
+    else if (op.getId() == Operation::CONSTANT) {
+        index = workspace.size();
+        workspace.push_back(dynamic_cast<const Operation::Constant&>(op).getValue());
+    }
+    else {
+        vector<int> args;
+        for (int i = 0; i < (int) node.getChildren().size(); i++)
+            args.push_back(compileExpression(node.getChildren()[i], temps));
+        index = workspace.size();
+        workspace.push_back(0.0);
+        arguments.push_back(args);
+        target.push_back(index);
+        operation.push_back(op.clone());
+    }
+    temps.push_back(make_pair(node, index));
+    return index;
+}
+
+const set<string>& CompiledExpression::getVariables() const {
+    return variableNames;
+}
+
+double& CompiledExpression::getVariableReference(const string& name) {
+    map<string, int>::const_iterator index = variableIndices.find(name);
+    if (index == variableIndices.end())
+        throw Exception("getVariableReference: Unknown variable '"+name+"'");
+    return workspace[index->second];
+}
+
+double CompiledExpression::evaluate() const {
+    if (jitCode != NULL) {
+        typedef void (*JitFunction)(double*);
+        reinterpret_cast<JitFunction>(jitCode)(&workspace[0]);
+        return workspace[resultIndices[0]];
+    }
+    for (int i = 0; i < (int) operation.size(); i++) {
+        const vector<int>& args = arguments[i];
+        if (args.size() == 1)
+            workspace[target[i]] = operation[i]->evaluate(&workspace[args[0]], dummyVariables);
+        else {
+            for (int j = 0; j < (int) args.size(); j++)
+                argValues[j] = workspace[args[j]];
+            workspace[target[i]] = operation[i]->evaluate(&argValues[0], dummyVariables);
+        }
+    }
+    return workspace[resultIndices[0]];
+}
+
+int CompiledExpression::getNumResults() const {
+    return resultIndices.size();
+}
+
+double CompiledExpression::getResult(int index) const {
+    return workspace[resultIndices[index]];
+}
+
+void CompiledExpression::evaluateBatch(int numValues, const vector<string>& names, const vector<const double*>& values, const vector<double*>& results) const {
+    // Every slot holds BatchSize values.  Start by filling each one with its current value, so constants and
+    // variables that are not being varied need no further work.
+
+    int numSlots = workspace.size();
+    batchWorkspace.resize(numSlots*BatchSize);
+    for (int i = 0; i < numSlots; i++)
+        for (int j = 0; j < BatchSize; j++)
+            batchWorkspace[i*BatchSize+j] = workspace[i];
+    vector<pair<int, const double*> > inputs;
+    for (int i = 0; i < (int) names.size(); i++) {
+        map<string, int>::const_iterator index = variableIndices.find(names[i]);
+        if (index != variableIndices.end())
+            inputs.push_back(make_pair(index->second, values[i]));
+    }
+    for (int start = 0; start < numValues; start += BatchSize) {
+        int count = (numValues-start < BatchSize ? numValues-start : BatchSize);
+        for (int i = 0; i < (int) inputs.size(); i++)
+            memcpy(&batchWorkspace[inputs[i].first*BatchSize], inputs[i].second+start, count*sizeof(double));
+        for (int step = 0; step < (int) operation.size(); step++)
+            evaluateBlock(step, count);
+        for (int i = 0; i < (int) results.size() && i < (int) resultIndices.size(); i++)
+            if (results[i] != NULL)
+                memcpy(results[i]+start, &batchWorkspace[resultIndices[i]*BatchSize], count*sizeof(double));
+    }
+}
+
+void CompiledExpression::evaluateBlock(int step, int count) const {
+    const Operation& op = *operation[step];
+    const vector<int>& args = arguments[step];
+    double* dest = &batchWorkspace[target[step]*BatchSize];
+    const double* arg1 = &batchWorkspace[args[0]*BatchSize];
+    const double* arg2 = (args.size() > 1 ? &batchWorkspace[args[1]*BatchSize] : NULL);
+    switch (op.getId()) {
+        case Operation::ADD:
+            for (int i = 0; i < count; i++)
+                dest[i] = arg1[i]+arg2[i];
+            break;
+        case Operation::SUBTRACT:
+            for (int i = 0; i < count; i++)
+                dest[i] = arg1[i]-arg2[i];
+            break;
+        case Operation::MULTIPLY:
+            for (int i = 0; i < count; i++)
+                dest[i] = arg1[i]*arg2[i];
+            break;
+        case Operation::DIVIDE:
+            for (int i = 0; i < count; i++)
+                dest[i] = arg1[i]/arg2[i];
+            break;
+        case Operation::NEGATE:
+            for (int i = 0; i < count; i++)
+                dest[i] = -arg1[i];
+            break;
+        case Operation::SQRT:
+            for (int i = 0; i < count; i++)
+                dest[i] = std::sqrt(arg1[i]);
+            break;
+        case Operation::SQUARE:
+            for (int i = 0; i < count; i++)
+                dest[i] = arg1[i]*arg1[i];
+            break;
+        case Operation::CUBE:
+            for (int i = 0; i < count; i++)
+                dest[i] = arg1[i]*arg1[i]*arg1[i];
+            break;
+        case Operation::RECIPROCAL:
+            for (int i = 0; i < count; i++)
+                dest[i] = 1.0/arg1[i];
+            break;
+        case Operation::ADD_CONSTANT: {
+            double value = dynamic_cast<const Operation::AddConstant&>(op).getValue();
+            for (int i = 0; i < count; i++)
+                dest[i] = arg1[i]+value;
+            break;
+        }
+        case Operation::MULTIPLY_CONSTANT: {
+            double value = dynamic_cast<const Operation::MultiplyConstant&>(op).getValue();
+            for (int i = 0; i < count; i++)
+                dest[i] = arg1[i]*value;
+            break;
+        }
+        case Operation::POWER_CONSTANT: {
+            double value = dynamic_cast<const Operation::PowerConstant&>(op).getValue();
+            for (int i = 0; i < count; i++)
+                dest[i] = std::pow(arg1[i], value);
+            break;
+        }
+        case Operation::POWER:
+            for (int i = 0; i < count; i++)
+                dest[i] = std::pow(arg1[i], arg2[i]);
+            break;
+        case Operation::EXP:
+            for (int i = 0; i < count; i++)
+                dest[i] = std::exp(arg1[i]);
+            break;
+        case Operation::LOG:
+            for (int i = 0; i < count; i++)
+                dest[i] = std::log(arg1[i]);
+            break;
+        case Operation::MIN:
+            for (int i = 0; i < count; i++)
+                dest[i] = (std::min)(arg1[i], arg2[i]);
+            break;
+        case Operation::MAX:
+            for (int i = 0; i < count; i++)
+                dest[i] = (std::max)(arg1[i], arg2[i]);
+            break;
+        case Operation::ABS:
+            for (int i = 0; i < count; i++)
+                dest[i] = std::abs(arg1[i]);
+            break;
+        default:
+            // Let the Operation evaluate itself one set at a time.
+
+            for (int i = 0; i < count; i++) {
+                for (int j = 0; j < (int) args.size(); j++)
+                    argValues[j] = batchWorkspace[args[j]*BatchSize+i];
+                dest[i] = op.evaluate(&argValues[0], dummyVariables);
+            }
+    }
+}
+
+#ifdef LEPTON_JIT_X86_64
+
+/**
+ * This is called by generated code to evaluate operations that have no native implementation, such as
+ * custom functions.
+ */
+static double evaluateOperation(const Operation* op, const double* args, const map<string, double>* variables) {
+    return op->evaluate(const_cast<double*>(args), *variables);
+}
+
+/**
+ * This class emits x86-64 instructions using SSE2 scalar arithmetic and the System V calling convention.
+ * Register rbx holds the address of the workspace throughout the generated function.
+ */
+
+class CodeBuffer {
+public:
+    vector<unsigned char> code;
+    void emit(int byte) {
+        code.push_back((unsigned char) byte);
+    }
+    void emitInt(int value) {
+        for (int i = 0; i < 4; i++)
+            emit((value >> (8*i)) & 0xFF);
+    }
+    void emitPointer(const void* pointer) {
+        size_t value = (size_t) pointer;
+        for (int i = 0; i < 8; i++)
+            emit((int) ((value >> (8*i)) & 0xFF));
+    }
+    /**
+     * movsd xmm[reg], [rbx+8*slot]
+     */
+    void loadSlot(int reg, int slot) {
+        emit(0xF2); emit(0x0F); emit(0x10); emit(0x83 | (reg << 3)); emitInt(8*slot);
+    }
+    /**
+     * movsd [rbx+8*slot], xmm[reg]
+     */
+    void storeSlot(int reg, int slot) {
+        emit(0xF2); emit(0x0F); emit(0x11); emit(0x83 | (reg << 3)); emitInt(8*slot);
+    }
+    /**
+     * mov rax, address; movsd xmm[reg], [rax]
+     */
+    void loadAddress(int reg, const double* address) {
+        emit(0x48); emit(0xB8); emitPointer(address);
+        emit(0xF2); emit(0x0F); emit(0x10); emit(reg << 3);
+    }
+    /**
+     * mov rax, address; movsd [rax], xmm[reg]
+     */
+    void storeAddress(int reg, double* address) {
+        emit(0x48); emit(0xB8); emitPointer(address);
+        emit(0xF2); emit(0x0F); emit(0x11); emit(reg << 3);
+    }
+    /**
+     * A scalar double instruction (addsd, subsd, mulsd, divsd, minsd, maxsd, sqrtsd) on two registers.
+     */
+    void scalarOp(int opcode, int dest, int source) {
+        emit(0xF2); emit(0x0F); emit(opcode); emit(0xC0 | (dest << 3) | source);
+    }
+    /**
+     * A packed double instruction (andpd, xorpd) on two registers.
+     */
+    void packedOp(int opcode, int dest, int source) {
+        emit(0x66); emit(0x0F); emit(opcode); emit(0xC0 | (dest << 3) | source);
+    }
+    /**
+     * mov rax, function; call rax
+     */
+    void call(const void* function) {
+        emit(0x48); emit(0xB8); emitPointer(function);
+        emit(0xFF); emit(0xD0);
+    }
+};
+
+static const void* getMathFunction(Operation::Id id) {
+    typedef double (*UnaryFunction)(double);
+    switch (id) {
+        case Operation::EXP:
+            return (const void*) static_cast<UnaryFunction>(std::exp);
+        case Operation::LOG:
+            return (const void*) static_cast<UnaryFunction>(std::log);
+        case Operation::SIN:
+            return (const void*) static_cast<UnaryFunction>(std::sin);
+        case Operation::COS:
+            return (const void*) static_cast<UnaryFunction>(std::cos);
+        case Operation::TAN:
+            return (const void*) static_cast<UnaryFunction>(std::tan);
+        case Operation::ASIN:
+            return (const void*) static_cast<UnaryFunction>(std::asin);
+        case Operation::ACOS:
+            return (const void*) static_cast<UnaryFunction>(std::acos);
+        case Operation::ATAN:
+            return (const void*) static_cast<UnaryFunction>(std::atan);
+        case Operation::SINH:
+            return (const void*) static_cast<UnaryFunction>(std::sinh);
+        case Operation::COSH:
+            return (const void*) static_cast<UnaryFunction>(std::cosh);
+        case Operation::TANH:
+            return (const void*) static_cast<UnaryFunction>(std::tanh);
+        default:
+            return NULL;
+    }
+}
+
+void CompiledExpression::generateJitCode() {
+    freeJitCode();
+
+    // The generated code has no unwind information, so an exception thrown by a custom function could not
+    // propagate through it.  Expressions that call one are always interpreted.
+
+    for (int i = 0; i < (int) operation.size(); i++)
+        if (operation[i]->getId() == Operation::CUSTOM)
+            return;
+
+    // Every operation needs at most two constants.  Reserve space up front so their addresses stay fixed.
+
+    jitConstants.clear();
+    jitConstants.reserve(2*operation.size());
+    double signMask, absMask;
+    long long signBits = 0x8000000000000000LL, absBits = 0x7FFFFFFFFFFFFFFFLL;
+    memcpy(&signMask, &signBits, sizeof(double));
+    memcpy(&absMask, &absBits, sizeof(double));
+    CodeBuffer c;
+    c.emit(0x53);                           // push rbx
+    c.emit(0x48); c.emit(0x89); c.emit(0xFB); // mov rbx, rdi
+    for (int step = 0; step < (int) operation.size(); step++) {
+        const Operation& op = *operation[step];
+        const vector<int>& args = arguments[step];
+        Operation::Id id = op.getId();
+        int resultReg = 0;
+        if (id == Operation::ADD || id == Operation::SUBTRACT || id == Operation::MULTIPLY || id == Operation::DIVIDE) {
+            c.loadSlot(0, args[0]);
+            c.loadSlot(1, args[1]);
+            int opcode = (id == Operation::ADD ? 0x58 : id == Operation::SUBTRACT ? 0x5C : id == Operation::MULTIPLY ? 0x59 : 0x5E);
+            c.scalarOp(opcode, 0, 1);
+        }
+        else if (id == Operation::MIN || id == Operation::MAX) {
+            // minsd and maxsd return the second operand when the comparison fails, which matches std::min and std::max
+            // when the arguments are reversed.
+
+            c.loadSlot(0, args[0]);
+            c.loadSlot(1, args[1]);
+            c.scalarOp(id == Operation::MIN ? 0x5D : 0x5F, 1, 0);
+            resultReg = 1;
+        }
+        else if (id == Operation::SQRT) {
+            c.loadSlot(0, args[0]);
+            c.scalarOp(0x51, 0, 0);
+        }
+        else if (id == Operation::SQUARE) {
+            c.loadSlot(0, args[0]);
+            c.scalarOp(0x59, 0, 0);
+        }
+        else if (id == Operation::CUBE) {
+            c.loadSlot(0, args[0]);
+            c.loadSlot(1, args[0]);
+            c.scalarOp(0x59, 0, 0);
+            c.scalarOp(0x59, 0, 1);
+        }
+        else if (id == Operation::RECIPROCAL) {
+            jitConstants.push_back(1.0);
+            c.loadAddress(1, &jitConstants.back());
+            c.loadSlot(0, args[0]);
+            c.scalarOp(0x5E, 1, 0);
+            resultReg = 1;
+        }
+        else if (id == Operation::NEGATE || id == Operation::ABS) {
+            jitConstants.push_back(id == Operation::NEGATE ? signMask : absMask);
+            c.loadAddress(1, &jitConstants.back());
+            c.loadSlot(0, args[0]);
+            c.packedOp(id == Operation::NEGATE ? 0x57 : 0x54, 0, 1);
+        }
+        else if (id == Operation::ADD_CONSTANT || id == Operation::MULTIPLY_CONSTANT) {
+            double value = (id == Operation::ADD_CONSTANT ? dynamic_cast<const Operation::AddConstant&>(op).getValue() :
+                    dynamic_cast<const Operation::MultiplyConstant&>(op).getValue());
+            jitConstants.push_back(value);
+            c.loadAddress(1, &jitConstants.back());
+            c.loadSlot(0, args[0]);
+            c.scalarOp(id == Operation::ADD_CONSTANT ? 0x58 : 0x59, 0, 1);
+        }
+        else if (id == Operation::POWER || id == Operation::POWER_CONSTANT) {
+            typedef double (*BinaryFunction)(double, double);
+            c.loadSlot(0, args[0]);
+            if (id == Operation::POWER)
+                c.loadSlot(1, args[1]);
+            else {
+                jitConstants.push_back(dynamic_cast<const Operation::PowerConstant&>(op).getValue());
+                c.loadAddress(1, &jitConstants.back());
+            }
+            c.call((const void*) static_cast<BinaryFunction>(std::pow));
+        }
+        else if (getMathFunction(id) != NULL) {
+            c.loadSlot(0, args[0]);
+            c.call(getMathFunction(id));
+        }
+        else {
+            // Let the Operation evaluate itself.  Arguments that are not already contiguous are first copied
+            // into argValues.
+
+            const double* argPointer;
+            if (args.size() == 1)
+                argPointer = NULL;
+            else {
+                for (int i = 0; i < (int) args.size(); i++) {
+                    c.loadSlot(0, args[i]);
+                    c.storeAddress(0, &argValues[i]);
+                }
+                argPointer = &argValues[0];
+            }
+            c.emit(0x48); c.emit(0xBF); c.emitPointer(&op);               // mov rdi, op
+            if (argPointer == NULL) {
+                c.emit(0x48); c.emit(0x8D); c.emit(0xB3); c.emitInt(8*args[0]); // lea rsi, [rbx+8*arg]
+            }
+            else {
+                c.emit(0x48); c.emit(0xBE); c.emitPointer(argPointer);    // mov rsi, argValues
+            }
+            c.emit(0x48); c.emit(0xBA); c.emitPointer(&dummyVariables);   // mov rdx, dummyVariables
+            c.call((const void*) evaluateOperation);
+        }
+        c.storeSlot(resultReg, target[step]);
+    }
+    c.emit(0x5B);                           // pop rbx
+    c.emit(0xC3);                           // ret
+
+    // Copy the code into executable memory.  If that is not allowed, evaluate() falls back to the interpreter.
+
+    void* memory = mmap(NULL, c.code.size(), PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (memory == MAP_FAILED)
+        return;
+    memcpy(memory, &c.code[0], c.code.size());
+    if (mprotect(memory, c.code.size(), PROT_READ | PROT_EXEC) != 0) {
+        munmap(memory, c.code.size());
+        return;
+    }
+    jitCode = memory;
+    jitCodeSize = c.code.size();
+}
+
+void CompiledExpression::freeJitCode() {
+    if (jitCode != NULL)
+        munmap(jitCode, jitCodeSize);
+    jitCode = NULL;
+    jitCodeSize = 0;
+}
+
+#else
+
+void CompiledExpression::generateJitCode() {
+}
+
+void CompiledExpression::freeJitCode() {
+}
+
+#endif
@@ -741,6 +741,9 @@ void ValidateOpenMM::writeNonbondedForce( FILE* filePtr, const NonbondedForce &
         case NonbondedForce::PME:
             nonbondedForceMethod = "PME";
             break;
+        case NonbondedForce::LJPME:
+            nonbondedForceMethod = "LJPME";
+            break;
         default:
             nonbondedForceMethod = "Unknown";
     }
@@ -51,10 +51,12 @@
 #include "openmm/HarmonicBondForce.h"
 #include "openmm/KernelImpl.h"
 #include "openmm/LangevinIntegrator.h"
+#include "openmm/MTSIntegrator.h"
 #include "openmm/MonteCarloBarostat.h"
 #include "openmm/PeriodicTorsionForce.h"
 #include "openmm/RBTorsionForce.h"
 #include "openmm/NonbondedForce.h"
+#include "openmm/OpenMMException.h"
 #include "openmm/System.h"
 #include "openmm/VariableLangevinIntegrator.h"
 #include "openmm/VariableVerletIntegrator.h"
@@ -538,7 +540,8 @@ public:
         CutoffNonPeriodic = 1,
         CutoffPeriodic = 2,
         Ewald = 3,
-        PME = 4
+        PME = 4,
+        LJPME = 5
     };
     static std::string Name() {
         return "CalcNonbondedForce";
@@ -552,6 +555,19 @@ public:
      * @param force      the NonbondedForce this kernel will be used for
      */
     virtual void initialize(const System& system, const NonbondedForce& force) = 0;
+    /**
+     * This is called before execute(), and before any other force is computed.  A kernel that can compute
+     * part of the interaction in the background (such as PME reciprocal space) may start doing so here.
+     * execute() must then wait for it to finish.  The default implementation does nothing.
+     *
+     * @param context        the context in which to execute this kernel
+     * @param includeForces  true if forces should be calculated
+     * @param includeEnergy  true if the energy should be calculated
+     * @param includeDirect  true if direct space interactions should be included
+     * @param includeReciprocal  true if reciprocal space interactions should be included
+     */
+    virtual void beginComputation(ContextImpl& context, bool includeForces, bool includeEnergy, bool includeDirect, bool includeReciprocal) {
+    }
     /**
      * Execute the kernel to calculate the forces and/or energy.
      *
@@ -995,6 +1011,43 @@ public:
     virtual double computeKineticEnergy(ContextImpl& context, const VariableVerletIntegrator& integrator) = 0;
 };
 
+/**
+ * This kernel is invoked by MTSIntegrator to take one time step.
+ */
+class IntegrateMTSStepKernel : public KernelImpl {
+public:
+    static std::string Name() {
+        return "IntegrateMTSStep";
+    }
+    IntegrateMTSStepKernel(std::string name, const Platform& platform) : KernelImpl(name, platform) {
+    }
+    /**
+     * Initialize the kernel.
+     * 
+     * @param system     the System this kernel will be applied to
+     * @param integrator the MTSIntegrator this kernel will be used for
+     */
+    virtual void initialize(const System& system, const MTSIntegrator& integrator) = 0;
+    /**
+     * Execute the kernel.
+     * 
+     * @param context        the context in which to execute this kernel
+     * @param integrator     the MTSIntegrator this kernel is being used for
+     * @param forcesAreValid if the context has been modified since the last time step, this will be
+     *                       false to show that cached forces are invalid and must be recalculated.
+     *                       On exit, this should specify whether the cached forces are valid at the
+     *                       end of the step.
+     */
+    virtual void execute(ContextImpl& context, const MTSIntegrator& integrator, bool& forcesAreValid) = 0;
+    /**
+     * Compute the kinetic energy.
+     * 
+     * @param context    the context in which to execute this kernel
+     * @param integrator the MTSIntegrator this kernel is being used for
+     */
+    virtual double computeKineticEnergy(ContextImpl& context, const MTSIntegrator& integrator) = 0;
+};
+
 /**
  * This kernel is invoked by CustomIntegrator to take one time step.
  */
@@ -1165,6 +1218,25 @@ public:
 class CalcPmeReciprocalForceKernel : public KernelImpl {
 public:
     class IO;
+    /**
+     * This is an enumeration of the numerical precisions a kernel may use.
+     */
+    enum Precision {
+        /**
+         * Positions, grids, and forces are all stored in single precision.
+         */
+        SinglePrecision = 0,
+        /**
+         * Positions and grids are stored in single precision, but forces and energy are accumulated in
+         * double precision.  Forces are returned through IO::setForceDouble().
+         */
+        MixedPrecision = 1,
+        /**
+         * Everything is done in double precision.  Positions are retrieved with IO::getPosqDouble(), and
+         * forces are returned through IO::setForceDouble().
+         */
+        DoublePrecision = 2
+    };
     static std::string Name() {
         return "CalcPmeReciprocalForce";
     }
@@ -1180,6 +1252,29 @@ public:
      * @param alpha        the Ewald blending parameter
      */
     virtual void initialize(int gridx, int gridy, int gridz, int numParticles, double alpha) = 0;
+    /**
+     * Initialize the kernel to use a particular precision.  The default implementation only supports
+     * single precision.
+     * 
+     * @param gridx        the x size of the PME grid
+     * @param gridy        the y size of the PME grid
+     * @param gridz        the z size of the PME grid
+     * @param numParticles the number of particles in the system
+     * @param alpha        the Ewald blending parameter
+     * @param precision    the precision to perform the calculation in
+     */
+    virtual void initialize(int gridx, int gridy, int gridz, int numParticles, double alpha, Precision precision) {
+        if (precision != SinglePrecision)
+            throw OpenMMException("This CalcPmeReciprocalForceKernel only supports single precision");
+        initialize(gridx, gridy, gridz, numParticles, alpha);
+    }
+    /**
+     * Get whether this kernel can be initialized with a particular precision.  The default implementation
+     * only supports single precision.
+     */
+    virtual bool supportsPrecision(Precision precision) const {
+        return (precision == SinglePrecision);
+    }
     /**
      * Begin computing the force and energy.
      * 
@@ -1216,6 +1311,25 @@ public:
      *                 should be ignored.
      */
     virtual void setForce(float* force) = 0;
+    /**
+     * Get a pointer to the atom charges and positions in double precision.  This is called instead of
+     * getPosq() when the kernel uses DoublePrecision.  The array has the same layout as the one
+     * returned by getPosq().
+     */
+    virtual double* getPosqDouble() {
+        throw OpenMMException("This IO does not support double precision positions");
+    }
+    /**
+     * Record forces calculated in double precision.  This is called instead of setForce() when the
+     * kernel uses MixedPrecision or DoublePrecision.
+     * 
+     * @param force    an array containing four elements for each atom.  The first three
+     *                 are the x, y, and z components of the force, while the fourth element
+     *                 should be ignored.
+     */
+    virtual void setForceDouble(double* force) {
+        throw OpenMMException("This IO does not support double precision forces");
+    }
 };
 
 
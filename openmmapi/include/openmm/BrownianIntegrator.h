@@ -129,6 +129,12 @@ protected:
      * Compute the kinetic energy of the system at the current time.
      */
     double computeKineticEnergy();
+    /**
+     * The kinetic energy is computed from the current velocities, so it does not depend on the forces.
+     */
+    bool kineticEnergyRequiresForce() const {
+        return false;
+    }
 private:
     double temperature, friction;
     int randomNumberSeed;
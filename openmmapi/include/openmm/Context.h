@@ -115,6 +115,8 @@ public:
     Platform& getPlatform();
     /**
      * Get a State object recording the current state information stored in this context.
+     * If the energy is requested but the forces are not, and the Integrator can compute the
+     * kinetic energy without them, only the energy is computed, which is usually faster.
      * 
      * @param types the set of data types which should be stored in the State object.  This
      * should be a union of DataType values, e.g. (State::Positions | State::Velocities).
@@ -125,6 +127,15 @@ public:
      * and energies.  Group i will be included if (groups&(1<<i)) != 0.  The default value includes all groups.
      */
     State getState(int types, bool enforcePeriodicBox=false, int groups=0xFFFFFFFF) const;
+    /**
+     * Get the potential energy of each force group.  This is equivalent to calling getState(State::Energy, false, 1<<i)
+     * for every group i, but on platforms that support it, all groups are evaluated together in a single pass.
+     *
+     * @param groups a set of bit flags for which force groups to include.  Group i will be included if (groups&(1<<i)) != 0.
+     * The default value includes all groups.
+     * @return a vector with 32 elements.  Element i is the potential energy of force group i, or 0 if that group is not included.
+     */
+    std::vector<double> getEnergyByGroup(int groups=0xFFFFFFFF) const;
     /**
      * Copy information from a State object into this Context.  This restores the Context to
      * approximately the same state it was in when the State was created.  If the State does not include
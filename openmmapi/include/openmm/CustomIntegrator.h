@@ -463,6 +463,12 @@ protected:
      * Compute the kinetic energy of the system at the current time.
      */
     double computeKineticEnergy();
+    /**
+     * If the kinetic energy expression depends on the forces, the kernel computes them itself.
+     */
+    bool kineticEnergyRequiresForce() const {
+        return false;
+    }
 private:
     class ComputationInfo;
     std::vector<std::string> globalNames;
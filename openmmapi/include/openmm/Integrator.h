@@ -129,6 +129,14 @@ protected:
      * but the kinetic energy should be computed at the current time, not delayed by half a step.
      */
     virtual double computeKineticEnergy() = 0;
+    /**
+     * Get whether computeKineticEnergy() expects forces to have been computed for the current positions.
+     * If this returns true, Context::getState() computes forces whenever it computes the energy, even if
+     * forces were not requested.
+     */
+    virtual bool kineticEnergyRequiresForce() const {
+        return true;
+    }
 private:
     double stepSize, constraintTol;
 };
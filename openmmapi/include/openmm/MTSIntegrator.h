@@ -0,0 +1,140 @@
+#ifndef OPENMM_MTSINTEGRATOR_H_
+#define OPENMM_MTSINTEGRATOR_H_
+
+
+/* -------------------------------------------------------------------------- *
+ *                                   OpenMM                                   *
+ * -------------------------------------------------------------------------- *
+ * This is part of the OpenMM molecular simulation toolkit originating from   *
+ * Simbios, the NIH National Center for Physics-Based Simulation of           *
+ * Biological Structures at Stanford, funded under the NIH Roadmap for        *
+ * Medical Research, grant U54 GM072970. See https://simtk.org.               *
+ *                                                                            *
+ * Portions copyright (c) 2013 Stanford University and the Authors.           *
+ * Authors: Peter Eastman                                                     *
+ * Contributors:                                                              *
+ *                                                                            *
+ * Permission is hereby granted, free of charge, to any person obtaining a    *
+ * copy of this software and associated documentation files (the "Software"), *
+ * to deal in the Software without restriction, including without limitation  *
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,   *
+ * and/or sell copies of the Software, and to permit persons to whom the      *
+ * Software is furnished to do so, subject to the following conditions:       *
+ *                                                                            *
+ * The above copyright notice and this permission notice shall be included in *
+ * all copies or substantial portions of the Software.                        *
+ *                                                                            *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR *
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,   *
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL    *
+ * THE AUTHORS, CONTRIBUTORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,    *
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR      *
+ * OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE  *
+ * USE OR OTHER DEALINGS IN THE SOFTWARE.                                     *
+ * -------------------------------------------------------------------------- */
+
+#include "Integrator.h"
+#include "openmm/Kernel.h"
+#include "internal/windowsExport.h"
+#include <utility>
+#include <vector>
+
+namespace OpenMM {
+
+/**
+ * This is an Integrator that uses the r-RESPA multiple time step algorithm to
+ * evaluate slowly changing forces less often than rapidly changing ones.
+ * 
+ * The forces in the System are divided into force groups (see Force::setForceGroup()),
+ * and each group is assigned a number of substeps to take per time step.  A group with
+ * one substep is evaluated once per time step, while a group with four substeps is
+ * evaluated four times per time step, using a step size one quarter as large.  For
+ * example, if you set the reciprocal space part of a NonbondedForce to group 1 and
+ * put all other forces in group 0, you might create the integrator as follows:
+ * 
+ * <tt><pre>
+ * vector<pair<int, int> > groups;
+ * groups.push_back(make_pair(1, 1));
+ * groups.push_back(make_pair(0, 2));
+ * MTSIntegrator integrator(0.004, groups);
+ * </pre></tt>
+ * 
+ * This evaluates reciprocal space once every 4 fs, and all other forces every 2 fs.
+ * 
+ * When several groups are specified, the number of substeps for each one must be a
+ * multiple of the number of substeps for every slower group.  Groups that have the same
+ * number of substeps are evaluated together.  Every force group used by a Force in the
+ * System must appear in the list.
+ * 
+ * Velocities are updated with the velocity Verlet form of the algorithm, so they are
+ * known at the same time as the positions.
+ */
+
+class OPENMM_EXPORT MTSIntegrator : public Integrator {
+public:
+    /**
+     * Create an MTSIntegrator.
+     * 
+     * @param stepSize  the step size with which to integrate the system (in picoseconds).  This is the
+     *                  step size for the slowest group.
+     * @param groups    a list of (force group, substeps) pairs.  Each one specifies a force group,
+     *                  and how many times forces in that group should be evaluated per time step.
+     */
+    MTSIntegrator(double stepSize, const std::vector<std::pair<int, int> >& groups);
+    /**
+     * Get the number of force groups whose substeps have been specified.
+     */
+    int getNumGroups() const {
+        return groups.size();
+    }
+    /**
+     * Get the list of (force group, substeps) pairs this integrator was created with.
+     */
+    const std::vector<std::pair<int, int> >& getGroups() const {
+        return groups;
+    }
+   /**
+     * Advance a simulation through time by taking a series of time steps.
+     * 
+     * @param steps   the number of time steps to take
+     */
+    void step(int steps);
+protected:
+    /**
+     * This will be called by the Context when it is created.  It informs the Integrator
+     * of what context it will be integrating, and gives it a chance to do any necessary initialization.
+     * It will also get called again if the application calls reinitialize() on the Context.
+     */
+    void initialize(ContextImpl& context);
+    /**
+     * This will be called by the Context when it is destroyed to let the Integrator do any necessary
+     * cleanup.  It will also get called again if the application calls reinitialize() on the Context.
+     */
+    void cleanup();
+    /**
+     * When the user modifies the state, we need to mark that the forces need to be recalculated.
+     */
+    void stateChanged(State::DataType changed);
+    /**
+     * Get the names of all Kernels used by this Integrator.
+     */
+    std::vector<std::string> getKernelNames();
+    /**
+     * Compute the kinetic energy of the system at the current time.
+     */
+    double computeKineticEnergy();
+    /**
+     * The kinetic energy is computed from the current velocities, so it does not depend on the forces.
+     */
+    bool kineticEnergyRequiresForce() const {
+        return false;
+    }
+private:
+    std::vector<std::pair<int, int> > groups;
+    bool forcesAreValid;
+    Kernel kernel;
+};
+
+} // namespace OpenMM
+
+#endif /*OPENMM_MTSINTEGRATOR_H_*/
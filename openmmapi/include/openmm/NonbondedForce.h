@@ -36,6 +36,7 @@
 #include "Force.h"
 #include <map>
 #include <set>
+#include <string>
 #include <utility>
 #include <vector>
 #include "internal/windowsExport.h"
@@ -109,7 +110,14 @@ public:
          * Periodic boundary conditions are used, and Particle-Mesh Ewald (PME) summation is used to compute the interaction of each particle
          * with all periodic copies of every other particle.
          */
-        PME = 4
+        PME = 4,
+        /**
+         * Periodic boundary conditions are used, and Particle-Mesh Ewald (PME) summation is used to compute the interaction of each particle
+         * with all periodic copies of every other particle, for both the Coulomb interaction and the r^-6 dispersion part of the
+         * Lennard-Jones interaction.  The reciprocal space dispersion sum uses geometric combining rules for sigma.  Within the
+         * cutoff distance the exact Lennard-Jones interaction is used, so only the long range part is affected by the approximation.
+         */
+        LJPME = 5
     };
     /**
      * Create a NonbondedForce.
@@ -191,6 +199,74 @@ public:
      * rigorous guarantee that all forces on all atoms will be less than the tolerance, however.
      */
     void setEwaldErrorTolerance(double tol);
+    /**
+     * Get the parameters to use for PME calculations.  If alpha is 0 (the default), these parameters are
+     * ignored and instead their values are chosen based on the Ewald error tolerance.
+     *
+     * @param alpha   the separation parameter
+     * @param nx      the number of grid points along the X axis
+     * @param ny      the number of grid points along the Y axis
+     * @param nz      the number of grid points along the Z axis
+     */
+    void getPMEParameters(double& alpha, int& nx, int& ny, int& nz) const;
+    /**
+     * Set the parameters to use for PME calculations.  If alpha is 0 (the default), these parameters are
+     * ignored and instead their values are chosen based on the Ewald error tolerance.
+     *
+     * @param alpha   the separation parameter
+     * @param nx      the number of grid points along the X axis
+     * @param ny      the number of grid points along the Y axis
+     * @param nz      the number of grid points along the Z axis
+     */
+    void setPMEParameters(double alpha, int nx, int ny, int nz);
+    /**
+     * Get the parameters to use for the dispersion term in LJPME calculations.  If alpha is 0 (the default),
+     * these parameters are ignored and instead their values are chosen based on the Ewald error tolerance.
+     *
+     * @param alpha   the separation parameter
+     * @param nx      the number of grid points along the X axis
+     * @param ny      the number of grid points along the Y axis
+     * @param nz      the number of grid points along the Z axis
+     */
+    void getLJPMEParameters(double& alpha, int& nx, int& ny, int& nz) const;
+    /**
+     * Set the parameters to use for the dispersion term in LJPME calculations.  If alpha is 0 (the default),
+     * these parameters are ignored and instead their values are chosen based on the Ewald error tolerance.
+     *
+     * @param alpha   the separation parameter
+     * @param nx      the number of grid points along the X axis
+     * @param ny      the number of grid points along the Y axis
+     * @param nz      the number of grid points along the Z axis
+     */
+    void setLJPMEParameters(double alpha, int nx, int ny, int nz);
+    /**
+     * Get whether PME parameters should be tuned for speed when a Context is created.  If this is true
+     * and the PME parameters have not been set explicitly, the Context times several combinations of
+     * alpha and grid size that all have the same estimated error, and uses the fastest one.  The default
+     * value is false.
+     */
+    bool getUsePMETuning() const;
+    /**
+     * Set whether PME parameters should be tuned for speed when a Context is created.  If this is true
+     * and the PME parameters have not been set explicitly, the Context times several combinations of
+     * alpha and grid size that all have the same estimated error, and uses the fastest one.  The default
+     * value is false.
+     */
+    void setUsePMETuning(bool use);
+    /**
+     * Get the file in which tuned PME parameters are cached.  Results are keyed by the platform, number of
+     * particles, box size, cutoff, and error tolerance, so later Contexts for the same system can skip
+     * tuning.  If this is an empty string (the default), results are not cached.  The file may be shared by
+     * several processes: access to it is serialized by locking a second file whose name has ".lock" appended.
+     */
+    const std::string& getPMETuningCacheFile() const;
+    /**
+     * Set the file in which tuned PME parameters are cached.  Results are keyed by the platform, number of
+     * particles, box size, cutoff, and error tolerance, so later Contexts for the same system can skip
+     * tuning.  If this is an empty string (the default), results are not cached.  The file may be shared by
+     * several processes: access to it is serialized by locking a second file whose name has ".lock" appended.
+     */
+    void setPMETuningCacheFile(const std::string& file);
     /**
      * Add the nonbonded force parameters for a particle.  This should be called once for each particle
      * in the System.  When it is called for the i'th time, it specifies the parameters for the i'th particle.
@@ -282,7 +358,8 @@ public:
      * Get whether to add a contribution to the energy that approximately represents the effect of Lennard-Jones
      * interactions beyond the cutoff distance.  The energy depends on the volume of the periodic box, and is only
      * applicable when periodic boundary conditions are used.  When running simulations at constant pressure, adding
-     * this contribution can improve the quality of results.
+     * this contribution can improve the quality of results.  It is not used with LJPME, which computes the long range
+     * dispersion interaction explicitly.
      */
     bool getUseDispersionCorrection() const {
         return useDispersionCorrection;
@@ -291,7 +368,8 @@ public:
      * Set whether to add a contribution to the energy that approximately represents the effect of Lennard-Jones
      * interactions beyond the cutoff distance.  The energy depends on the volume of the periodic box, and is only
      * applicable when periodic boundary conditions are used.  When running simulations at constant pressure, adding
-     * this contribution can improve the quality of results.
+     * this contribution can improve the quality of results.  It is not used with LJPME, which computes the long range
+     * dispersion interaction explicitly.
      */
     void setUseDispersionCorrection(bool useCorrection) {
         useDispersionCorrection = useCorrection;
@@ -332,9 +410,10 @@ private:
     class ParticleInfo;
     class ExceptionInfo;
     NonbondedMethod nonbondedMethod;
-    double cutoffDistance, switchingDistance, rfDielectric, ewaldErrorTol;
-    bool useSwitchingFunction, useDispersionCorrection;
-    int recipForceGroup;
+    double cutoffDistance, switchingDistance, rfDielectric, ewaldErrorTol, alpha, dalpha;
+    bool useSwitchingFunction, useDispersionCorrection, usePMETuning;
+    int recipForceGroup, nx, ny, nz, dnx, dny, dnz;
+    std::string pmeTuningCacheFile;
     void addExclusionsToSet(const std::vector<std::set<int> >& bonded12, std::set<int>& exclusions, int baseParticle, int fromParticle, int currentLevel) const;
     std::vector<ParticleInfo> particles;
     std::vector<ExceptionInfo> exceptions;
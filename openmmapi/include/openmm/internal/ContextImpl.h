@@ -193,10 +193,30 @@ public:
      * @return the potential energy of the system, or 0 if includeEnergy is false
      */
     double calcForcesAndEnergy(bool includeForces, bool includeEnergy, int groups=0xFFFFFFFF);
+    /**
+     * Calculate the potential energy of every force group (in kJ/mol).  Each ForceImpl reports its energy
+     * through ForceImpl::calcEnergyByGroup(), so this takes a single pass over the forces.  If the platform
+     * accumulates energy in its own buffers and more than one group is included, that energy cannot be
+     * attributed, so the energy of each group that contains at least one force is computed with a separate
+     * call to calcForcesAndEnergy().
+     *
+     * @param energies  on exit, this contains 32 elements.  Element i is the energy of force group i, or 0 if
+     *                  that group is not included in groups.
+     * @param groups    a set of bit flags for which force groups to include.  Group i will be included
+     *                  if (groups&(1<<i)) != 0.  The default value includes all groups.
+     * @return the total potential energy of the included groups
+     */
+    double calcEnergyByGroup(std::vector<double>& energies, int groups=0xFFFFFFFF);
     /**
      * Get the set of force group flags that were passed to the most recent call to calcForcesAndEnergy().
      */
     int getLastForceGroups() const;
+    /**
+     * Tell the Integrator that any forces it computed earlier are no longer valid.  Call this after changing
+     * the positions or box directly through a kernel, or after calling calcForcesAndEnergy() without computing
+     * forces, so the Integrator does not reuse stale forces for the groups in getLastForceGroups().
+     */
+    void invalidateForces();
     /**
      * Calculate the kinetic energy of the system (in kJ/mol).
      */
@@ -222,6 +242,12 @@ public:
      * Get the platform-specific data stored in this context.
      */
     const void* getPlatformData() const;
+    /**
+     * Get the platform-specific properties that were specified when the Context was created.
+     */
+    const std::map<std::string, std::string>& getPlatformProperties() const {
+        return platformProperties;
+    }
     /**
      * Set the platform-specific data stored in this context.
      */
@@ -268,6 +294,11 @@ private:
     Platform* platform;
     Kernel initializeForcesKernel, updateStateDataKernel, applyConstraintsKernel, virtualSitesKernel;
     void* platformData;
+    std::map<std::string, std::string> platformProperties;
+    /**
+     * Clean up after a force throws an exception partway through calcForcesAndEnergy().
+     */
+    void abortComputation(bool includeForces, bool includeEnergy, int groups);
 };
 
 } // namespace OpenMM
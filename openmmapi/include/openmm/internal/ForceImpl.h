@@ -75,6 +75,21 @@ public:
      * @param context     the context in which the system is being simulated
      */
     virtual void updateContextState(ContextImpl& context) = 0;
+    /**
+     * This is called at the start of every force and energy calculation, before calcForcesAndEnergy() is
+     * called on any ForceImpl.  A ForceImpl whose kernels can do part of their work in the background
+     * (for example, on other threads) can start it here, so it overlaps with the work done by other
+     * ForceImpls.  It must then be finished by the time calcForcesAndEnergy() returns.  The default
+     * implementation does nothing.
+     *
+     * @param context        the context in which the system is being simulated
+     * @param includeForces  true if forces should be calculated
+     * @param includeEnergy  true if the energy should be calculated
+     * @param groups         a set of bit flags for which force groups to include.  Group i should be included
+     *                       if (groups&(1<<i)) != 0.
+     */
+    virtual void beginCalcForcesAndEnergy(ContextImpl& context, bool includeForces, bool includeEnergy, int groups) {
+    }
     /**
      * Calculate the force on each particle generated by this ForceImpl and/or this ForceImpl's
      * contribution to the potential energy of the system.
@@ -88,6 +103,21 @@ public:
      * force does not contribute to potential energy (or if includeEnergy is false)
      */
     virtual double calcForcesAndEnergy(ContextImpl& context, bool includeForces, bool includeEnergy, int groups) = 0;
+    /**
+     * Calculate this ForceImpl's contribution to the potential energy of each force group.  This is called by
+     * ContextImpl::calcEnergyByGroup() in place of calcForcesAndEnergy(), so the energy of every group can be
+     * found with a single evaluation.  The default implementation adds the energy returned by
+     * calcForcesAndEnergy() to the group of the Force that owns this ForceImpl.  A ForceImpl that puts parts
+     * of its energy in different groups should override it.
+     *
+     * @param context   the context in which the system is being simulated
+     * @param energies  a vector with 32 elements.  The energy of group i should be added to element i.
+     * @param groups    a set of bit flags for which force groups to include.  Group i should be included
+     *                  if (groups&(1<<i)) != 0.
+     * @return a set of bit flags for all force groups this ForceImpl contributes to, whether or not they
+     * were included in groups
+     */
+    virtual int calcEnergyByGroup(ContextImpl& context, std::vector<double>& energies, int groups);
     /**
      * Get a map containing the default values for all adjustable parameters defined by this ForceImpl.  These
      * parameters and their default values will automatically be added to the Context.
@@ -60,7 +60,7 @@ public:
     std::vector<std::string> getKernelNames();
 private:
     const MonteCarloAnisotropicBarostat& owner;
-    int step, numAttempted[3], numAccepted[3];
+    int step, numAttempted[3], numAccepted[3], groupsAffected;
     double volumeScale[3];
     OpenMM_SFMT::SFMT random;
     Kernel kernel;
@@ -58,9 +58,20 @@ public:
     }
     std::map<std::string, double> getDefaultParameters();
     std::vector<std::string> getKernelNames();
+    /**
+     * Find the force groups whose energy may change when the periodic box is scaled.  A barostat
+     * scales the center of each molecule, which leaves the relative positions of particles within
+     * a molecule unchanged.  Bonded forces whose interactions each involve particles from only
+     * one molecule therefore have exactly the same energy before and after the move, and do not
+     * need to be evaluated when computing the energy difference.
+     *
+     * @param context    the context in which the barostat is being applied
+     * @return the force groups containing at least one Force that must be evaluated, as a bitmask
+     */
+    static int getGroupsAffectedByScaling(ContextImpl& context);
 private:
     const MonteCarloBarostat& owner;
-    int step, numAttempted, numAccepted;
+    int step, numAttempted, numAccepted, groupsAffected;
     double volumeScale;
     OpenMM_SFMT::SFMT random;
     Kernel kernel;
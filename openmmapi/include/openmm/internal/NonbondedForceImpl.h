@@ -58,7 +58,9 @@ public:
     void updateContextState(ContextImpl& context) {
         // This force field doesn't update the state directly.
     }
+    void beginCalcForcesAndEnergy(ContextImpl& context, bool includeForces, bool includeEnergy, int groups);
     double calcForcesAndEnergy(ContextImpl& context, bool includeForces, bool includeEnergy, int groups);
+    int calcEnergyByGroup(ContextImpl& context, std::vector<double>& energies, int groups);
     std::map<std::string, double> getDefaultParameters() {
         return std::map<std::string, double>(); // This force field doesn't define any parameters.
     }
@@ -71,9 +73,20 @@ public:
     static void calcEwaldParameters(const System& system, const NonbondedForce& force, double& alpha, int& kmaxx, int& kmaxy, int& kmaxz);
     /**
      * This is a utility routine that calculates the values to use for alpha and grid size when using
-     * Particle Mesh Ewald.
+     * Particle Mesh Ewald.  If the force specifies them explicitly, those values are returned.
      */
     static void calcPMEParameters(const System& system, const NonbondedForce& force, double& alpha, int& xsize, int& ysize, int& zsize);
+    /**
+     * Calculate the values to use for alpha and grid size when using Particle Mesh Ewald, given separate
+     * error tolerances for direct and reciprocal space.  calcPMEParameters() uses the force's Ewald error
+     * tolerance for both.
+     */
+    static void calcPMEParameters(const System& system, const NonbondedForce& force, double directTol, double reciprocalTol, double& alpha, int& xsize, int& ysize, int& zsize);
+    /**
+     * This is a utility routine that calculates the values to use for alpha and grid size for the dispersion
+     * term when using LJPME.  If the force specifies them explicitly, those values are returned.
+     */
+    static void calcLJPMEParameters(const System& system, const NonbondedForce& force, double& alpha, int& xsize, int& ysize, int& zsize);
     /**
      * Compute the coefficient which, when divided by the periodic box volume, gives the
      * long range dispersion correction to the energy.
@@ -84,7 +97,13 @@ private:
     class EwaldErrorFunction;
     static int findZero(const ErrorFunction& f, int initialGuess);
     static double evalIntegral(double r, double rs, double rc, double sigma);
+    /**
+     * Select the fastest PME parameters on the Context's platform, either by looking them up in the cache
+     * file or by timing several candidates.
+     */
+    void tunePMEParameters(ContextImpl& context, double& alpha, int& xsize, int& ysize, int& zsize);
     const NonbondedForce& owner;
+    NonbondedForce* tunedForce;
     Kernel kernel;
 };
 
@@ -0,0 +1,90 @@
+#ifndef OPENMM_THREADBARRIER_H_
+#define OPENMM_THREADBARRIER_H_
+
+/* -------------------------------------------------------------------------- *
+ *                                   OpenMM                                   *
+ * -------------------------------------------------------------------------- *
+ * This is part of the OpenMM molecular simulation toolkit originating from   *
+ * Simbios, the NIH National Center for Physics-Based Simulation of           *
+ * Biological Structures at Stanford, funded under the NIH Roadmap for        *
+ * Medical Research, grant U54 GM072970. See https://simtk.org.               *
+ *                                                                            *
+ * Portions copyright (c) 2013 Stanford University and the Authors.           *
+ * Authors: Peter Eastman                                                     *
+ * Contributors:                                                              *
+ *                                                                            *
+ * Permission is hereby granted, free of charge, to any person obtaining a    *
+ * copy of this software and associated documentation files (the "Software"), *
+ * to deal in the Software without restriction, including without limitation  *
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,   *
+ * and/or sell copies of the Software, and to permit persons to whom the      *
+ * Software is furnished to do so, subject to the following conditions:       *
+ *                                                                            *
+ * The above copyright notice and this permission notice shall be included in *
+ * all copies or substantial portions of the Software.                        *
+ *                                                                            *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR *
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,   *
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL    *
+ * THE AUTHORS, CONTRIBUTORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,    *
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR      *
+ * OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE  *
+ * USE OR OTHER DEALINGS IN THE SOFTWARE.                                     *
+ * -------------------------------------------------------------------------- */
+
+#include "windowsExport.h"
+#include <pthread.h>
+
+namespace OpenMM {
+
+/**
+ * A ThreadBarrier blocks a fixed number of threads until all of them have reached it.
+ * It is intended for parallel calculations that are divided into many short phases,
+ * where the latency of waking threads through a condition variable would be comparable
+ * to the work done in each phase.
+ *
+ * Arriving threads are counted with an atomic increment.  The last thread to arrive
+ * resets the count and advances a phase counter, which releases the others.  Waiting
+ * threads first spin on the phase counter for a bounded number of iterations, and only
+ * if that fails do they go to sleep on a condition variable.  The mutex is never touched
+ * unless some thread actually went to sleep, so a barrier whose threads all arrive
+ * within the spin interval costs only a few atomic operations.
+ *
+ * The same barrier may be reused any number of times, provided every participating
+ * thread calls wait() the same number of times.
+ */
+
+class OPENMM_EXPORT ThreadBarrier {
+public:
+    /**
+     * Create a ThreadBarrier.
+     *
+     * @param numThreads  the number of threads that must call wait() before any of them is released
+     * @param spinCount   the number of times a waiting thread polls the barrier before going to sleep
+     */
+    ThreadBarrier(int numThreads, int spinCount=4000);
+    ~ThreadBarrier();
+    /**
+     * Get the number of threads that participate in the barrier.
+     */
+    int getNumThreads() const {
+        return numThreads;
+    }
+    /**
+     * Block until all threads have called this method.
+     *
+     * @return true for exactly one thread (the last one to arrive), false for all others
+     */
+    bool wait();
+private:
+    ThreadBarrier(const ThreadBarrier&);
+    ThreadBarrier& operator=(const ThreadBarrier&);
+    int numThreads, spinCount;
+    volatile int count, phase, numSleeping;
+    pthread_cond_t condition;
+    pthread_mutex_t lock;
+};
+
+} // namespace OpenMM
+
+#endif /*OPENMM_THREADBARRIER_H_*/
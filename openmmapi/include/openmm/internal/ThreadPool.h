@@ -0,0 +1,115 @@
+#ifndef OPENMM_THREADPOOL_H_
+#define OPENMM_THREADPOOL_H_
+
+/* -------------------------------------------------------------------------- *
+ *                                   OpenMM                                   *
+ * -------------------------------------------------------------------------- *
+ * This is part of the OpenMM molecular simulation toolkit originating from   *
+ * Simbios, the NIH National Center for Physics-Based Simulation of           *
+ * Biological Structures at Stanford, funded under the NIH Roadmap for        *
+ * Medical Research, grant U54 GM072970. See https://simtk.org.               *
+ *                                                                            *
+ * Portions copyright (c) 2013 Stanford University and the Authors.           *
+ * Authors: Peter Eastman                                                     *
+ * Contributors:                                                              *
+ *                                                                            *
+ * Permission is hereby granted, free of charge, to any person obtaining a    *
+ * copy of this software and associated documentation files (the "Software"), *
+ * to deal in the Software without restriction, including without limitation  *
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,   *
+ * and/or sell copies of the Software, and to permit persons to whom the      *
+ * Software is furnished to do so, subject to the following conditions:       *
+ *                                                                            *
+ * The above copyright notice and this permission notice shall be included in *
+ * all copies or substantial portions of the Software.                        *
+ *                                                                            *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR *
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,   *
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL    *
+ * THE AUTHORS, CONTRIBUTORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,    *
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR      *
+ * OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE  *
+ * USE OR OTHER DEALINGS IN THE SOFTWARE.                                     *
+ * -------------------------------------------------------------------------- */
+
+#include "windowsExport.h"
+#include "ThreadBarrier.h"
+#include <pthread.h>
+#include <vector>
+
+namespace OpenMM {
+
+/**
+ * A ThreadPool owns a set of worker threads that can be used to execute a Task in parallel.
+ * The threads are created once when the pool is constructed, then wait until a Task is
+ * submitted.  Every thread executes the Task once, and execute() returns only after all of
+ * them have finished.  Threads are handed work through a ThreadBarrier, so a pool that is
+ * used many times in quick succession does not pay the cost of waking sleeping threads.
+ */
+
+class OPENMM_EXPORT ThreadPool {
+public:
+    class Task;
+    class ThreadData;
+    /**
+     * Create a ThreadPool.
+     *
+     * @param numThreads  the number of worker threads to create.  If this is 0 (the default),
+     *                    the number of threads is set to the number of logical processors.
+     */
+    ThreadPool(int numThreads=0);
+    ~ThreadPool();
+    /**
+     * Get the number of worker threads in the pool.
+     */
+    int getNumThreads() const {
+        return numThreads;
+    }
+    /**
+     * Execute a Task in parallel on all the worker threads, and block until every thread
+     * has finished executing it.  If the calling thread's part of the Task throws an exception,
+     * this still waits for the other threads before rethrowing it.
+     */
+    void execute(Task& task);
+    /**
+     * Block until every thread in the pool has called this method.  This may be called from
+     * within Task::execute() to divide a Task into phases that must not overlap.  Every thread
+     * must call it the same number of times.
+     */
+    void syncThreads();
+    /**
+     * Get the number of logical processors available on this computer.
+     */
+    static int getNumProcessors();
+private:
+    friend class ThreadData;
+    void runThread(int index);
+    volatile bool isDeleted;
+    int numThreads;
+    Task* volatile currentTask;
+    std::vector<pthread_t> thread;
+    std::vector<ThreadData*> threadData;
+    ThreadBarrier* barrier;
+    pthread_mutex_t startLock;
+};
+
+/**
+ * This interface defines a unit of work to be executed by a ThreadPool.
+ */
+
+class OPENMM_EXPORT ThreadPool::Task {
+public:
+    virtual ~Task() {
+    }
+    /**
+     * Execute the task on one thread.  This is called once by each thread in the pool.
+     *
+     * @param pool         the ThreadPool executing the task
+     * @param threadIndex  the index of the thread invoking this method, between 0 and pool.getNumThreads()-1
+     */
+    virtual void execute(ThreadPool& pool, int threadIndex) = 0;
+};
+
+} // namespace OpenMM
+
+#endif /*OPENMM_THREADPOOL_H_*/
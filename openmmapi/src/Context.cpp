@@ -85,7 +85,16 @@ State Context::getState(int types, bool enforcePeriodicBox, int groups) const {
     bool includeForces = types&State::Forces;
     bool includeEnergy = types&State::Energy;
     if (includeForces || includeEnergy) {
-        double energy = impl->calcForcesAndEnergy(includeForces || includeEnergy, includeEnergy, groups);
+        // Most integrators need the current forces to compute the kinetic energy, so only skip them when it
+        // does not.
+
+        bool computeForces = (includeForces || impl->integrator.kineticEnergyRequiresForce());
+        double energy = impl->calcForcesAndEnergy(computeForces, includeEnergy, groups);
+        if (!computeForces) {
+            // The integrator may be caching forces, which are no longer associated with the last force groups.
+
+            impl->integrator.stateChanged(State::Forces);
+        }
         if (includeEnergy)
             builder.setEnergy(impl->calcKineticEnergy(), energy);
         if (includeForces) {
@@ -142,6 +151,13 @@ State Context::getState(int types, bool enforcePeriodicBox, int groups) const {
     return builder.getState();
 }
 
+vector<double> Context::getEnergyByGroup(int groups) const {
+    vector<double> energies;
+    impl->calcEnergyByGroup(energies, groups);
+    impl->integrator.stateChanged(State::Forces);
+    return energies;
+}
+
 void Context::setState(const State& state) {
     // Determine what information the state contains.
     
@@ -49,7 +49,7 @@ using namespace std;
 
 ContextImpl::ContextImpl(Context& owner, const System& system, Integrator& integrator, Platform* platform, const map<string, string>& properties) :
         owner(owner), system(system), integrator(integrator), hasInitializedForces(false), hasSetPositions(false), integratorIsDeleted(false),
-        lastForceGroups(-1), platform(platform), platformData(NULL) {
+        lastForceGroups(-1), platform(platform), platformData(NULL), platformProperties(properties) {
     if (system.getNumParticles() == 0)
         throw OpenMMException("Cannot create a Context for a System with no particles");
     
@@ -213,16 +213,86 @@ double ContextImpl::calcForcesAndEnergy(bool includeForces, bool includeEnergy,
     CalcForcesAndEnergyKernel& kernel = initializeForcesKernel.getAs<CalcForcesAndEnergyKernel>();
     double energy = 0.0;
     kernel.beginComputation(*this, includeForces, includeEnergy, groups);
-    for (int i = 0; i < (int) forceImpls.size(); ++i)
-        energy += forceImpls[i]->calcForcesAndEnergy(*this, includeForces, includeEnergy, groups);
+    try {
+        // Give every force a chance to start background work before any of them does its main calculation.
+
+        for (int i = 0; i < (int) forceImpls.size(); ++i)
+            forceImpls[i]->beginCalcForcesAndEnergy(*this, includeForces, includeEnergy, groups);
+        for (int i = 0; i < (int) forceImpls.size(); ++i)
+            energy += forceImpls[i]->calcForcesAndEnergy(*this, includeForces, includeEnergy, groups);
+    }
+    catch (...) {
+        abortComputation(includeForces, includeEnergy, groups);
+        throw;
+    }
     energy += kernel.finishComputation(*this, includeForces, includeEnergy, groups);
     return energy;
 }
 
+double ContextImpl::calcEnergyByGroup(vector<double>& energies, int groups) {
+    if (!hasSetPositions)
+        throw OpenMMException("Particle positions have not been set");
+    lastForceGroups = groups;
+    energies.assign(32, 0.0);
+    CalcForcesAndEnergyKernel& kernel = initializeForcesKernel.getAs<CalcForcesAndEnergyKernel>();
+    int groupsPresent = 0;
+    kernel.beginComputation(*this, false, true, groups);
+    try {
+        for (int i = 0; i < (int) forceImpls.size(); ++i)
+            forceImpls[i]->beginCalcForcesAndEnergy(*this, false, true, groups);
+        for (int i = 0; i < (int) forceImpls.size(); ++i)
+            groupsPresent |= forceImpls[i]->calcEnergyByGroup(*this, energies, groups);
+    }
+    catch (...) {
+        abortComputation(false, true, groups);
+        throw;
+    }
+    double bufferedEnergy = kernel.finishComputation(*this, false, true, groups);
+    if (bufferedEnergy != 0.0) {
+        // The platform accumulated some of the energy in its own buffers, so it cannot be attributed
+        // to individual ForceImpls.  If only one group was evaluated it all belongs to that group.
+        // Otherwise evaluate each group on its own.
+
+        int included = groups&groupsPresent;
+        if ((included&(included-1)) == 0) {
+            for (int i = 0; i < 32; i++)
+                if (included == 1<<i)
+                    energies[i] += bufferedEnergy;
+        }
+        else {
+            for (int i = 0; i < 32; i++)
+                energies[i] = ((included&(1<<i)) == 0 ? 0.0 : calcForcesAndEnergy(false, true, 1<<i));
+            lastForceGroups = groups;
+        }
+    }
+    double energy = 0.0;
+    for (int i = 0; i < 32; i++)
+        energy += energies[i];
+    return energy;
+}
+
+void ContextImpl::abortComputation(bool includeForces, bool includeEnergy, int groups) {
+    // Let the platform restore anything it changed in beginComputation() (for example, the Reference platform
+    // moves the forces aside when they are not requested).  The forces are no longer valid either way, so make
+    // sure the integrator does not reuse them.
+
+    try {
+        initializeForcesKernel.getAs<CalcForcesAndEnergyKernel>().finishComputation(*this, includeForces, includeEnergy, groups);
+    }
+    catch (...) {
+        // Report the original exception, not this one.
+    }
+    invalidateForces();
+}
+
 int ContextImpl::getLastForceGroups() const {
     return lastForceGroups;
 }
 
+void ContextImpl::invalidateForces() {
+    integrator.stateChanged(State::Forces);
+}
+
 double ContextImpl::calcKineticEnergy() {
     return integrator.computeKineticEnergy();
 }
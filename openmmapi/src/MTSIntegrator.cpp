@@ -0,0 +1,122 @@
+
+/* -------------------------------------------------------------------------- *
+ *                                   OpenMM                                   *
+ * -------------------------------------------------------------------------- *
+ * This is part of the OpenMM molecular simulation toolkit originating from   *
+ * Simbios, the NIH National Center for Physics-Based Simulation of           *
+ * Biological Structures at Stanford, funded under the NIH Roadmap for        *
+ * Medical Research, grant U54 GM072970. See https://simtk.org.               *
+ *                                                                            *
+ * Portions copyright (c) 2013 Stanford University and the Authors.           *
+ * Authors: Peter Eastman                                                     *
+ * Contributors:                                                              *
+ *                                                                            *
+ * Permission is hereby granted, free of charge, to any person obtaining a    *
+ * copy of this software and associated documentation files (the "Software"), *
+ * to deal in the Software without restriction, including without limitation  *
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,   *
+ * and/or sell copies of the Software, and to permit persons to whom the      *
+ * Software is furnished to do so, subject to the following conditions:       *
+ *                                                                            *
+ * The above copyright notice and this permission notice shall be included in *
+ * all copies or substantial portions of the Software.                        *
+ *                                                                            *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR *
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,   *
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL    *
+ * THE AUTHORS, CONTRIBUTORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,    *
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR      *
+ * OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE  *
+ * USE OR OTHER DEALINGS IN THE SOFTWARE.                                     *
+ * -------------------------------------------------------------------------- */
+
+#include "openmm/MTSIntegrator.h"
+#include "openmm/Context.h"
+#include "openmm/NonbondedForce.h"
+#include "openmm/OpenMMException.h"
+#include "openmm/internal/ContextImpl.h"
+#include "openmm/kernels.h"
+#include <algorithm>
+#include <sstream>
+#include <string>
+
+using namespace OpenMM;
+using std::pair;
+using std::string;
+using std::stringstream;
+using std::vector;
+
+MTSIntegrator::MTSIntegrator(double stepSize, const vector<pair<int, int> >& groups) : groups(groups), forcesAreValid(false) {
+    setStepSize(stepSize);
+    setConstraintTolerance(1e-5);
+    if (groups.size() == 0)
+        throw OpenMMException("MTSIntegrator: No force groups specified");
+    vector<int> substeps;
+    int usedGroups = 0;
+    for (int i = 0; i < (int) groups.size(); i++) {
+        if (groups[i].first < 0 || groups[i].first > 31)
+            throw OpenMMException("MTSIntegrator: Force group must be between 0 and 31");
+        if (groups[i].second < 1)
+            throw OpenMMException("MTSIntegrator: Number of substeps must be at least 1");
+        if ((usedGroups & (1<<groups[i].first)) != 0)
+            throw OpenMMException("MTSIntegrator: A force group appears more than once");
+        usedGroups |= 1<<groups[i].first;
+        substeps.push_back(groups[i].second);
+    }
+    sort(substeps.begin(), substeps.end());
+    for (int i = 1; i < (int) substeps.size(); i++)
+        if (substeps[i]%substeps[i-1] != 0)
+            throw OpenMMException("MTSIntegrator: The number of substeps for each group must be a multiple of the number for every slower group");
+}
+
+void MTSIntegrator::initialize(ContextImpl& contextRef) {
+    if (owner != NULL && &contextRef.getOwner() != owner)
+        throw OpenMMException("This Integrator is already bound to a context");
+    int usedGroups = 0;
+    for (int i = 0; i < (int) groups.size(); i++)
+        usedGroups |= 1<<groups[i].first;
+    const System& system = contextRef.getSystem();
+    for (int i = 0; i < system.getNumForces(); i++) {
+        const Force& force = system.getForce(i);
+        vector<int> forceGroups(1, force.getForceGroup());
+        const NonbondedForce* nonbonded = dynamic_cast<const NonbondedForce*>(&force);
+        if (nonbonded != NULL && nonbonded->getReciprocalSpaceForceGroup() >= 0)
+            forceGroups.push_back(nonbonded->getReciprocalSpaceForceGroup());
+        for (int j = 0; j < (int) forceGroups.size(); j++)
+            if ((usedGroups & (1<<forceGroups[j])) == 0) {
+                stringstream msg;
+                msg << "MTSIntegrator: No substeps were specified for force group " << forceGroups[j];
+                throw OpenMMException(msg.str());
+            }
+    }
+    context = &contextRef;
+    owner = &contextRef.getOwner();
+    kernel = context->getPlatform().createKernel(IntegrateMTSStepKernel::Name(), contextRef);
+    kernel.getAs<IntegrateMTSStepKernel>().initialize(contextRef.getSystem(), *this);
+    forcesAreValid = false;
+}
+
+void MTSIntegrator::cleanup() {
+    kernel = Kernel();
+}
+
+void MTSIntegrator::stateChanged(State::DataType changed) {
+    forcesAreValid = false;
+}
+
+vector<string> MTSIntegrator::getKernelNames() {
+    vector<string> names;
+    names.push_back(IntegrateMTSStepKernel::Name());
+    return names;
+}
+
+double MTSIntegrator::computeKineticEnergy() {
+    return kernel.getAs<IntegrateMTSStepKernel>().computeKineticEnergy(*context, *this);
+}
+
+void MTSIntegrator::step(int steps) {
+    for (int i = 0; i < steps; ++i) {
+        context->updateContextState();
+        kernel.getAs<IntegrateMTSStepKernel>().execute(*context, *this, forcesAreValid);
+    }
+}
@@ -30,6 +30,7 @@
  * -------------------------------------------------------------------------- */
 
 #include "openmm/internal/MonteCarloAnisotropicBarostatImpl.h"
+#include "openmm/internal/MonteCarloBarostatImpl.h"
 #include "openmm/internal/ContextImpl.h"
 #include "openmm/Context.h"
 #include "openmm/kernels.h"
@@ -59,6 +60,7 @@ void MonteCarloAnisotropicBarostatImpl::initialize(ContextImpl& context) {
         numAttempted[i] = 0;
         numAccepted[i] = 0;
     }
+    groupsAffected = MonteCarloBarostatImpl::getGroupsAffectedByScaling(context);
     init_gen_rand(owner.getRandomNumberSeed(), random);
 }
 
@@ -69,9 +71,10 @@ void MonteCarloAnisotropicBarostatImpl::updateContextState(ContextImpl& context)
         return;
     step = 0;
     
-    // Compute the current potential energy.
+    // Compute the current potential energy.  Only the energy difference matters, so skip any
+    // forces that are unaffected by scaling, and don't compute forces.
     
-    double initialEnergy = context.getOwner().getState(State::Energy).getPotentialEnergy();
+    double initialEnergy = context.calcForcesAndEnergy(false, true, groupsAffected);
     double pressure;
     
     // Choose which axis to modify at random.
@@ -111,7 +114,7 @@ void MonteCarloAnisotropicBarostatImpl::updateContextState(ContextImpl& context)
     
     // Compute the energy of the modified system.
     
-    double finalEnergy = context.getOwner().getState(State::Energy).getPotentialEnergy();
+    double finalEnergy = context.calcForcesAndEnergy(false, true, groupsAffected);
     double kT = BOLTZ*owner.getTemperature();
     double w = finalEnergy-initialEnergy + pressure*deltaVolume - context.getMolecules().size()*kT*std::log(newVolume/volume);
     if (w > 0 && genrand_real2(random) > std::exp(-w/kT)) {
@@ -124,6 +127,11 @@ void MonteCarloAnisotropicBarostatImpl::updateContextState(ContextImpl& context)
     else
         numAccepted[axis]++;
     numAttempted[axis]++;
+
+    // The trial evaluations did not compute forces, and the coordinates may have been scaled, so the
+    // integrator must not reuse the forces it computed before.
+
+    context.invalidateForces();
     if (numAttempted[axis] >= 10) {
         if (numAccepted[axis] < 0.25*numAttempted[axis]) {
             volumeScale[axis] /= 1.1;
@@ -32,6 +32,14 @@
 #include "openmm/internal/MonteCarloBarostatImpl.h"
 #include "openmm/internal/ContextImpl.h"
 #include "openmm/Context.h"
+#include "openmm/CMAPTorsionForce.h"
+#include "openmm/CustomAngleForce.h"
+#include "openmm/CustomBondForce.h"
+#include "openmm/CustomTorsionForce.h"
+#include "openmm/HarmonicAngleForce.h"
+#include "openmm/HarmonicBondForce.h"
+#include "openmm/PeriodicTorsionForce.h"
+#include "openmm/RBTorsionForce.h"
 #include "openmm/kernels.h"
 #include <cmath>
 #include <vector>
@@ -57,6 +65,7 @@ void MonteCarloBarostatImpl::initialize(ContextImpl& context) {
     volumeScale = 0.01*volume;
     numAttempted = 0;
     numAccepted = 0;
+    groupsAffected = getGroupsAffectedByScaling(context);
     init_gen_rand(owner.getRandomNumberSeed(), random);
 }
 
@@ -65,9 +74,10 @@ void MonteCarloBarostatImpl::updateContextState(ContextImpl& context) {
         return;
     step = 0;
 
-    // Compute the current potential energy.
+    // Compute the current potential energy.  Only the energy difference matters, so skip any
+    // forces that are unaffected by scaling, and don't compute forces.
 
-    double initialEnergy = context.getOwner().getState(State::Energy).getPotentialEnergy();
+    double initialEnergy = context.calcForcesAndEnergy(false, true, groupsAffected);
 
     // Modify the periodic box size.
 
@@ -82,7 +92,7 @@ void MonteCarloBarostatImpl::updateContextState(ContextImpl& context) {
 
     // Compute the energy of the modified system.
     
-    double finalEnergy = context.getOwner().getState(State::Energy).getPotentialEnergy();
+    double finalEnergy = context.calcForcesAndEnergy(false, true, groupsAffected);
     double pressure = context.getParameter(MonteCarloBarostat::Pressure())*(AVOGADRO*1e-25);
     double kT = BOLTZ*owner.getTemperature();
     double w = finalEnergy-initialEnergy + pressure*deltaVolume - context.getMolecules().size()*kT*std::log(newVolume/volume);
@@ -96,6 +106,11 @@ void MonteCarloBarostatImpl::updateContextState(ContextImpl& context) {
     else
         numAccepted++;
     numAttempted++;
+
+    // The trial evaluations did not compute forces, and the coordinates may have been scaled, so the
+    // integrator must not reuse the forces it computed before.
+
+    context.invalidateForces();
     if (numAttempted >= 10) {
         if (numAccepted < 0.25*numAttempted) {
             volumeScale /= 1.1;
@@ -116,6 +131,95 @@ std::map<std::string, double> MonteCarloBarostatImpl::getDefaultParameters() {
     return parameters;
 }
 
+/**
+ * Determine whether every interaction of a bonded force involves particles from only one molecule.
+ * This returns false for any Force that is not recognized as a bonded force.
+ */
+static bool isIntramolecular(const Force& force, const vector<int>& particleMolecule) {
+    vector<vector<int> > interactions;
+    if (dynamic_cast<const HarmonicBondForce*>(&force) != NULL) {
+        const HarmonicBondForce& f = dynamic_cast<const HarmonicBondForce&>(force);
+        interactions.resize(f.getNumBonds(), vector<int>(2));
+        double length, k;
+        for (int i = 0; i < f.getNumBonds(); i++)
+            f.getBondParameters(i, interactions[i][0], interactions[i][1], length, k);
+    }
+    else if (dynamic_cast<const HarmonicAngleForce*>(&force) != NULL) {
+        const HarmonicAngleForce& f = dynamic_cast<const HarmonicAngleForce&>(force);
+        interactions.resize(f.getNumAngles(), vector<int>(3));
+        double angle, k;
+        for (int i = 0; i < f.getNumAngles(); i++)
+            f.getAngleParameters(i, interactions[i][0], interactions[i][1], interactions[i][2], angle, k);
+    }
+    else if (dynamic_cast<const PeriodicTorsionForce*>(&force) != NULL) {
+        const PeriodicTorsionForce& f = dynamic_cast<const PeriodicTorsionForce&>(force);
+        interactions.resize(f.getNumTorsions(), vector<int>(4));
+        int periodicity;
+        double phase, k;
+        for (int i = 0; i < f.getNumTorsions(); i++)
+            f.getTorsionParameters(i, interactions[i][0], interactions[i][1], interactions[i][2], interactions[i][3], periodicity, phase, k);
+    }
+    else if (dynamic_cast<const RBTorsionForce*>(&force) != NULL) {
+        const RBTorsionForce& f = dynamic_cast<const RBTorsionForce&>(force);
+        interactions.resize(f.getNumTorsions(), vector<int>(4));
+        double c0, c1, c2, c3, c4, c5;
+        for (int i = 0; i < f.getNumTorsions(); i++)
+            f.getTorsionParameters(i, interactions[i][0], interactions[i][1], interactions[i][2], interactions[i][3], c0, c1, c2, c3, c4, c5);
+    }
+    else if (dynamic_cast<const CMAPTorsionForce*>(&force) != NULL) {
+        const CMAPTorsionForce& f = dynamic_cast<const CMAPTorsionForce&>(force);
+        interactions.resize(f.getNumTorsions(), vector<int>(8));
+        int map;
+        for (int i = 0; i < f.getNumTorsions(); i++)
+            f.getTorsionParameters(i, map, interactions[i][0], interactions[i][1], interactions[i][2], interactions[i][3],
+                    interactions[i][4], interactions[i][5], interactions[i][6], interactions[i][7]);
+    }
+    else if (dynamic_cast<const CustomBondForce*>(&force) != NULL) {
+        const CustomBondForce& f = dynamic_cast<const CustomBondForce&>(force);
+        interactions.resize(f.getNumBonds(), vector<int>(2));
+        vector<double> params;
+        for (int i = 0; i < f.getNumBonds(); i++)
+            f.getBondParameters(i, interactions[i][0], interactions[i][1], params);
+    }
+    else if (dynamic_cast<const CustomAngleForce*>(&force) != NULL) {
+        const CustomAngleForce& f = dynamic_cast<const CustomAngleForce&>(force);
+        interactions.resize(f.getNumAngles(), vector<int>(3));
+        vector<double> params;
+        for (int i = 0; i < f.getNumAngles(); i++)
+            f.getAngleParameters(i, interactions[i][0], interactions[i][1], interactions[i][2], params);
+    }
+    else if (dynamic_cast<const CustomTorsionForce*>(&force) != NULL) {
+        const CustomTorsionForce& f = dynamic_cast<const CustomTorsionForce&>(force);
+        interactions.resize(f.getNumTorsions(), vector<int>(4));
+        vector<double> params;
+        for (int i = 0; i < f.getNumTorsions(); i++)
+            f.getTorsionParameters(i, interactions[i][0], interactions[i][1], interactions[i][2], interactions[i][3], params);
+    }
+    else
+        return false;
+    for (int i = 0; i < (int) interactions.size(); i++)
+        for (int j = 1; j < (int) interactions[i].size(); j++)
+            if (particleMolecule[interactions[i][j]] != particleMolecule[interactions[i][0]])
+                return false;
+    return true;
+}
+
+int MonteCarloBarostatImpl::getGroupsAffectedByScaling(ContextImpl& context) {
+    const System& system = context.getSystem();
+    const vector<vector<int> >& molecules = context.getMolecules();
+    vector<int> particleMolecule(system.getNumParticles());
+    for (int i = 0; i < (int) molecules.size(); i++)
+        for (int j = 0; j < (int) molecules[i].size(); j++)
+            particleMolecule[molecules[i][j]] = i;
+    int groups = 0;
+    for (int i = 0; i < system.getNumForces(); i++) {
+        const Force& force = system.getForce(i);
+        if (!isIntramolecular(force, particleMolecule))
+            groups |= 1<<force.getForceGroup();
+    }
+    return groups;
+}
+
 std::vector<std::string> MonteCarloBarostatImpl::getKernelNames() {
     std::vector<std::string> names;
     names.push_back(ApplyMonteCarloBarostatKernel::Name());
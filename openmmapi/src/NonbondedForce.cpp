@@ -48,7 +48,8 @@ using std::stringstream;
 using std::vector;
 
 NonbondedForce::NonbondedForce() : nonbondedMethod(NoCutoff), cutoffDistance(1.0), switchingDistance(-1.0), rfDielectric(78.3),
-        ewaldErrorTol(5e-4), useSwitchingFunction(false), useDispersionCorrection(true), recipForceGroup(-1) {
+        ewaldErrorTol(5e-4), alpha(0.0), dalpha(0.0), useSwitchingFunction(false), useDispersionCorrection(true), usePMETuning(false), recipForceGroup(-1),
+        nx(0), ny(0), nz(0), dnx(0), dny(0), dnz(0) {
 }
 
 NonbondedForce::NonbondedMethod NonbondedForce::getNonbondedMethod() const {
@@ -100,6 +101,50 @@ void NonbondedForce::setEwaldErrorTolerance(double tol)
     ewaldErrorTol = tol;
 }
 
+void NonbondedForce::getPMEParameters(double& alpha, int& nx, int& ny, int& nz) const {
+    alpha = this->alpha;
+    nx = this->nx;
+    ny = this->ny;
+    nz = this->nz;
+}
+
+void NonbondedForce::setPMEParameters(double alpha, int nx, int ny, int nz) {
+    this->alpha = alpha;
+    this->nx = nx;
+    this->ny = ny;
+    this->nz = nz;
+}
+
+void NonbondedForce::getLJPMEParameters(double& alpha, int& nx, int& ny, int& nz) const {
+    alpha = dalpha;
+    nx = dnx;
+    ny = dny;
+    nz = dnz;
+}
+
+void NonbondedForce::setLJPMEParameters(double alpha, int nx, int ny, int nz) {
+    dalpha = alpha;
+    dnx = nx;
+    dny = ny;
+    dnz = nz;
+}
+
+bool NonbondedForce::getUsePMETuning() const {
+    return usePMETuning;
+}
+
+void NonbondedForce::setUsePMETuning(bool use) {
+    usePMETuning = use;
+}
+
+const string& NonbondedForce::getPMETuningCacheFile() const {
+    return pmeTuningCacheFile;
+}
+
+void NonbondedForce::setPMETuningCacheFile(const string& file) {
+    pmeTuningCacheFile = file;
+}
+
 int NonbondedForce::addParticle(double charge, double sigma, double epsilon) {
     particles.push_back(ParticleInfo(charge, sigma, epsilon));
     return particles.size()-1;
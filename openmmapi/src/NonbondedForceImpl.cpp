@@ -32,21 +32,55 @@
 #ifdef WIN32
   #define _USE_MATH_DEFINES // Needed to get M_PI
 #endif
+#include "openmm/Context.h"
 #include "openmm/OpenMMException.h"
+#include "openmm/State.h"
+#include "openmm/VerletIntegrator.h"
 #include "openmm/internal/ContextImpl.h"
 #include "openmm/internal/NonbondedForceImpl.h"
 #include "openmm/kernels.h"
+#include "sfmt/SFMT.h"
 #include <cmath>
+#include <cstring>
+#include <fstream>
 #include <map>
 #include <sstream>
 
 using namespace OpenMM;
 using namespace std;
 
-NonbondedForceImpl::NonbondedForceImpl(const NonbondedForce& owner) : owner(owner) {
+/**
+ * Get the current clock time, measured in microseconds.
+ */
+#ifdef _MSC_VER
+    #include <Windows.h>
+    static long long getTime() {
+        FILETIME ft;
+        GetSystemTimeAsFileTime(&ft); // 100-nanoseconds since 1-1-1601
+        ULARGE_INTEGER result;
+        result.LowPart = ft.dwLowDateTime;
+        result.HighPart = ft.dwHighDateTime;
+        return result.QuadPart/10;
+    }
+#else
+    #include <cerrno>
+    #include <fcntl.h>
+    #include <sys/file.h>
+    #include <sys/time.h> 
+    #include <unistd.h>
+    static long long getTime() {
+        struct timeval tod;
+        gettimeofday(&tod, 0);
+        return 1000000*tod.tv_sec+tod.tv_usec;
+    }
+#endif
+
+NonbondedForceImpl::NonbondedForceImpl(const NonbondedForce& owner) : owner(owner), tunedForce(NULL) {
 }
 
 NonbondedForceImpl::~NonbondedForceImpl() {
+    if (tunedForce != NULL)
+        delete tunedForce;
 }
 
 void NonbondedForceImpl::initialize(ContextImpl& context) {
@@ -91,16 +125,40 @@ void NonbondedForceImpl::initialize(ContextImpl& context) {
     }
     if (owner.getNonbondedMethod() == NonbondedForce::CutoffPeriodic ||
             owner.getNonbondedMethod() == NonbondedForce::Ewald ||
-            owner.getNonbondedMethod() == NonbondedForce::PME) {
+            owner.getNonbondedMethod() == NonbondedForce::PME ||
+            owner.getNonbondedMethod() == NonbondedForce::LJPME) {
         Vec3 boxVectors[3];
         system.getDefaultPeriodicBoxVectors(boxVectors[0], boxVectors[1], boxVectors[2]);
         double cutoff = owner.getCutoffDistance();
         if (cutoff > 0.5*boxVectors[0][0] || cutoff > 0.5*boxVectors[1][1] || cutoff > 0.5*boxVectors[2][2])
             throw OpenMMException("NonbondedForce: The cutoff distance cannot be greater than half the periodic box size.");
     }
+    if (owner.getNonbondedMethod() == NonbondedForce::PME && owner.getUsePMETuning()) {
+        double alpha;
+        int xsize, ysize, zsize;
+        owner.getPMEParameters(alpha, xsize, ysize, zsize);
+        if (alpha == 0.0) {
+            // Give the kernel a copy of the force that specifies the tuned parameters explicitly.  Kernels
+            // may keep a reference to the force, so it must live as long as this object.
+
+            tunePMEParameters(context, alpha, xsize, ysize, zsize);
+            tunedForce = new NonbondedForce(owner);
+            tunedForce->setPMEParameters(alpha, xsize, ysize, zsize);
+            kernel.getAs<CalcNonbondedForceKernel>().initialize(context.getSystem(), *tunedForce);
+            return;
+        }
+    }
     kernel.getAs<CalcNonbondedForceKernel>().initialize(context.getSystem(), owner);
 }
 
+void NonbondedForceImpl::beginCalcForcesAndEnergy(ContextImpl& context, bool includeForces, bool includeEnergy, int groups) {
+    bool includeDirect = ((groups&(1<<owner.getForceGroup())) != 0);
+    bool includeReciprocal = includeDirect;
+    if (owner.getReciprocalSpaceForceGroup() >= 0)
+        includeReciprocal = ((groups&(1<<owner.getReciprocalSpaceForceGroup())) != 0);
+    kernel.getAs<CalcNonbondedForceKernel>().beginComputation(context, includeForces, includeEnergy, includeDirect, includeReciprocal);
+}
+
 double NonbondedForceImpl::calcForcesAndEnergy(ContextImpl& context, bool includeForces, bool includeEnergy, int groups) {
     bool includeDirect = ((groups&(1<<owner.getForceGroup())) != 0);
     bool includeReciprocal = includeDirect;
@@ -109,6 +167,23 @@ double NonbondedForceImpl::calcForcesAndEnergy(ContextImpl& context, bool includ
     return kernel.getAs<CalcNonbondedForceKernel>().execute(context, includeForces, includeEnergy, includeDirect, includeReciprocal);
 }
 
+int NonbondedForceImpl::calcEnergyByGroup(ContextImpl& context, vector<double>& energies, int groups) {
+    int directGroup = owner.getForceGroup();
+    int reciprocalGroup = owner.getReciprocalSpaceForceGroup();
+    if (reciprocalGroup < 0 || reciprocalGroup == directGroup)
+        return ForceImpl::calcEnergyByGroup(context, energies, groups);
+
+    // Compute each part once and report it in its own group.  Reciprocal space goes first, since it may already
+    // have been started by beginCalcForcesAndEnergy().
+
+    CalcNonbondedForceKernel& nonbonded = kernel.getAs<CalcNonbondedForceKernel>();
+    if ((groups&(1<<reciprocalGroup)) != 0)
+        energies[reciprocalGroup] += nonbonded.execute(context, false, true, false, true);
+    if ((groups&(1<<directGroup)) != 0)
+        energies[directGroup] += nonbonded.execute(context, false, true, true, false);
+    return (1<<directGroup) | (1<<reciprocalGroup);
+}
+
 std::vector<std::string> NonbondedForceImpl::getKernelNames() {
     std::vector<std::string> names;
     names.push_back(CalcNonbondedForceKernel::Name());
@@ -149,18 +224,184 @@ void NonbondedForceImpl::calcEwaldParameters(const System& system, const Nonbond
 }
 
 void NonbondedForceImpl::calcPMEParameters(const System& system, const NonbondedForce& force, double& alpha, int& xsize, int& ysize, int& zsize) {
+    force.getPMEParameters(alpha, xsize, ysize, zsize);
+    if (alpha != 0.0)
+        return;
+    double tol = force.getEwaldErrorTolerance();
+    calcPMEParameters(system, force, tol, tol, alpha, xsize, ysize, zsize);
+}
+
+void NonbondedForceImpl::calcPMEParameters(const System& system, const NonbondedForce& force, double directTol, double reciprocalTol, double& alpha, int& xsize, int& ysize, int& zsize) {
     Vec3 boxVectors[3];
     system.getDefaultPeriodicBoxVectors(boxVectors[0], boxVectors[1], boxVectors[2]);
-    double tol = force.getEwaldErrorTolerance();
-    alpha = (1.0/force.getCutoffDistance())*std::sqrt(-log(2.0*tol));
-    xsize = (int) ceil(2*alpha*boxVectors[0][0]/(3*pow(tol, 0.2)));
-    ysize = (int) ceil(2*alpha*boxVectors[1][1]/(3*pow(tol, 0.2)));
-    zsize = (int) ceil(2*alpha*boxVectors[2][2]/(3*pow(tol, 0.2)));
+    alpha = (1.0/force.getCutoffDistance())*std::sqrt(-log(2.0*directTol));
+    xsize = (int) ceil(2*alpha*boxVectors[0][0]/(3*pow(reciprocalTol, 0.2)));
+    ysize = (int) ceil(2*alpha*boxVectors[1][1]/(3*pow(reciprocalTol, 0.2)));
+    zsize = (int) ceil(2*alpha*boxVectors[2][2]/(3*pow(reciprocalTol, 0.2)));
     xsize = max(xsize, 5);
     ysize = max(ysize, 5);
     zsize = max(zsize, 5);
 }
 
+void NonbondedForceImpl::calcLJPMEParameters(const System& system, const NonbondedForce& force, double& alpha, int& xsize, int& ysize, int& zsize) {
+    force.getLJPMEParameters(alpha, xsize, ysize, zsize);
+    if (alpha != 0.0)
+        return;
+
+    // The fraction of the dispersion interaction at the cutoff that is left in direct space is
+    // exp(-x^2)*(1+x^2+x^4/2), where x = alpha*cutoff.  Choose alpha to make it equal the tolerance.
+
+    double tol = force.getEwaldErrorTolerance();
+    double low = 0.0, high = 20.0;
+    for (int i = 0; i < 60; i++) {
+        double x = 0.5*(low+high);
+        double x2 = x*x;
+        if (exp(-x2)*(1.0+x2+0.5*x2*x2) > tol)
+            low = x;
+        else
+            high = x;
+    }
+    alpha = 0.5*(low+high)/force.getCutoffDistance();
+    Vec3 boxVectors[3];
+    system.getDefaultPeriodicBoxVectors(boxVectors[0], boxVectors[1], boxVectors[2]);
+    xsize = max((int) ceil(2*alpha*boxVectors[0][0]/(3*pow(tol, 0.2))), 5);
+    ysize = max((int) ceil(2*alpha*boxVectors[1][1]/(3*pow(tol, 0.2))), 5);
+    zsize = max((int) ceil(2*alpha*boxVectors[2][2]/(3*pow(tol, 0.2))), 5);
+}
+
+/**
+ * Holds an exclusive lock on a file for as long as it exists.  The tuning cache is shared between processes,
+ * so it is locked while reading and appending to keep records from being interleaved or read half written.
+ */
+class CacheFileLock {
+public:
+    CacheFileLock(const string& filename) {
+#ifdef _MSC_VER
+        handle = CreateFileA(filename.c_str(), GENERIC_READ|GENERIC_WRITE, FILE_SHARE_READ|FILE_SHARE_WRITE, NULL, OPEN_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+        if (handle != INVALID_HANDLE_VALUE) {
+            OVERLAPPED overlapped;
+            memset(&overlapped, 0, sizeof(overlapped));
+            LockFileEx(handle, LOCKFILE_EXCLUSIVE_LOCK, 0, 1, 0, &overlapped);
+        }
+#else
+        fd = open(filename.c_str(), O_RDWR|O_CREAT, 0666);
+        if (fd != -1)
+            while (flock(fd, LOCK_EX) == -1 && errno == EINTR)
+                ;
+#endif
+    }
+    ~CacheFileLock() {
+        // Closing the file releases the lock.
+#ifdef _MSC_VER
+        if (handle != INVALID_HANDLE_VALUE)
+            CloseHandle(handle);
+#else
+        if (fd != -1)
+            close(fd);
+#endif
+    }
+private:
+#ifdef _MSC_VER
+    HANDLE handle;
+#else
+    int fd;
+#endif
+};
+
+/**
+ * Look up tuned PME parameters in a cache file.  Each line contains a key followed by alpha and the grid size.
+ */
+static bool loadTunedPMEParameters(const string& file, const string& key, double& alpha, int& xsize, int& ysize, int& zsize) {
+    ifstream in(file.c_str());
+    string line;
+    while (getline(in, line)) {
+        if (line.size() > key.size() && line.compare(0, key.size(), key) == 0 && line[key.size()] == ' ') {
+            stringstream values(line.substr(key.size()));
+            if (values >> alpha >> xsize >> ysize >> zsize)
+                return true;
+        }
+    }
+    return false;
+}
+
+void NonbondedForceImpl::tunePMEParameters(ContextImpl& context, double& alpha, int& xsize, int& ysize, int& zsize) {
+    const System& system = context.getSystem();
+    Vec3 boxVectors[3];
+    system.getDefaultPeriodicBoxVectors(boxVectors[0], boxVectors[1], boxVectors[2]);
+    stringstream key;
+    key.precision(10);
+    key << context.getPlatform().getName() << " " << system.getNumParticles() << " " << boxVectors[0][0] << " " << boxVectors[1][1] << " " << boxVectors[2][2];
+    key << " " << owner.getCutoffDistance() << " " << owner.getEwaldErrorTolerance();
+    const string& cacheFile = owner.getPMETuningCacheFile();
+    if (cacheFile != "") {
+        CacheFileLock lock(cacheFile+".lock");
+        if (loadTunedPMEParameters(cacheFile, key.str(), alpha, xsize, ysize, zsize))
+            return;
+    }
+
+    // The error estimates for direct and reciprocal space are added together.  Each candidate shifts part of
+    // the error budget from one to the other, so they all have the same estimated total error.  A fraction
+    // of 1 gives the parameters calcPMEParameters() would select.
+
+    const double directFractions[] = {0.25, 0.5, 1.0, 1.5, 1.75};
+    const int numCandidates = sizeof(directFractions)/sizeof(directFractions[0]);
+    const int numTimingSteps = 3;
+    double tol = owner.getEwaldErrorTolerance();
+
+    // Time the candidates on a copy of this force with particles randomly distributed through the box.
+
+    int numParticles = system.getNumParticles();
+    vector<Vec3> positions(numParticles);
+    OpenMM_SFMT::SFMT sfmt;
+    init_gen_rand(0, sfmt);
+    for (int i = 0; i < numParticles; i++)
+        positions[i] = Vec3(boxVectors[0][0]*genrand_real2(sfmt), boxVectors[1][1]*genrand_real2(sfmt), boxVectors[2][2]*genrand_real2(sfmt));
+    long long bestTime = 0;
+    for (int candidate = 0; candidate < numCandidates; candidate++) {
+        double candidateAlpha;
+        int candidateX, candidateY, candidateZ;
+        double directTol = tol*directFractions[candidate];
+        calcPMEParameters(system, owner, directTol, 2*tol-directTol, candidateAlpha, candidateX, candidateY, candidateZ);
+        System tuningSystem;
+        for (int i = 0; i < numParticles; i++)
+            tuningSystem.addParticle(system.getParticleMass(i));
+        tuningSystem.setDefaultPeriodicBoxVectors(boxVectors[0], boxVectors[1], boxVectors[2]);
+        NonbondedForce* force = new NonbondedForce(owner);
+        force->setUsePMETuning(false);
+        force->setPMEParameters(candidateAlpha, candidateX, candidateY, candidateZ);
+        force->setForceGroup(0);
+        force->setReciprocalSpaceForceGroup(-1);
+        tuningSystem.addForce(force);
+        VerletIntegrator integrator(0.001);
+        Context tuningContext(tuningSystem, integrator, context.getPlatform(), context.getPlatformProperties());
+        tuningContext.setPositions(positions);
+        tuningContext.getState(State::Forces);
+        long long candidateTime = 0;
+        for (int step = 0; step < numTimingSteps; step++) {
+            long long startTime = getTime();
+            tuningContext.getState(State::Forces);
+            long long elapsed = getTime()-startTime;
+            if (step == 0 || elapsed < candidateTime)
+                candidateTime = elapsed;
+        }
+        if (candidate == 0 || candidateTime < bestTime) {
+            bestTime = candidateTime;
+            alpha = candidateAlpha;
+            xsize = candidateX;
+            ysize = candidateY;
+            zsize = candidateZ;
+        }
+    }
+    if (cacheFile != "") {
+        stringstream record;
+        record.precision(17);
+        record << key.str() << " " << alpha << " " << xsize << " " << ysize << " " << zsize << endl;
+        CacheFileLock lock(cacheFile+".lock");
+        ofstream out(cacheFile.c_str(), ios::app);
+        out << record.str();
+    }
+}
+
 int NonbondedForceImpl::findZero(const NonbondedForceImpl::ErrorFunction& f, int initialGuess) {
     int arg = initialGuess;
     double value = f.getValue(arg);
@@ -212,7 +453,8 @@ double NonbondedForceImpl::evalIntegral(double r, double rs, double rc, double s
 }
 
 double NonbondedForceImpl::calcDispersionCorrection(const System& system, const NonbondedForce& force) {
-    if (force.getNonbondedMethod() == NonbondedForce::NoCutoff || force.getNonbondedMethod() == NonbondedForce::CutoffNonPeriodic)
+    if (force.getNonbondedMethod() == NonbondedForce::NoCutoff || force.getNonbondedMethod() == NonbondedForce::CutoffNonPeriodic ||
+            force.getNonbondedMethod() == NonbondedForce::LJPME)
         return 0.0;
     
     // Identify all particle classes (defined by sigma and epsilon), and count the number of
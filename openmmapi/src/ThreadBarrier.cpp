@@ -0,0 +1,137 @@
+/* -------------------------------------------------------------------------- *
+ *                                   OpenMM                                   *
+ * -------------------------------------------------------------------------- *
+ * This is part of the OpenMM molecular simulation toolkit originating from   *
+ * Simbios, the NIH National Center for Physics-Based Simulation of           *
+ * Biological Structures at Stanford, funded under the NIH Roadmap for        *
+ * Medical Research, grant U54 GM072970. See https://simtk.org.               *
+ *                                                                            *
+ * Portions copyright (c) 2013 Stanford University and the Authors.           *
+ * Authors: Peter Eastman                                                     *
+ * Contributors:                                                              *
+ *                                                                            *
+ * Permission is hereby granted, free of charge, to any person obtaining a    *
+ * copy of this software and associated documentation files (the "Software"), *
+ * to deal in the Software without restriction, including without limitation  *
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,   *
+ * and/or sell copies of the Software, and to permit persons to whom the      *
+ * Software is furnished to do so, subject to the following conditions:       *
+ *                                                                            *
+ * The above copyright notice and this permission notice shall be included in *
+ * all copies or substantial portions of the Software.                        *
+ *                                                                            *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR *
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,   *
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL    *
+ * THE AUTHORS, CONTRIBUTORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,    *
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR      *
+ * OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE  *
+ * USE OR OTHER DEALINGS IN THE SOFTWARE.                                     *
+ * -------------------------------------------------------------------------- */
+
+
+#include "openmm/internal/ThreadBarrier.h"
+
+#ifdef _MSC_VER
+    #include <windows.h>
+    #include <intrin.h>
+#endif
+
+using namespace OpenMM;
+
+/**
+ * Atomically add 1 to a value and return the new value.  This acts as a full memory barrier.
+ */
+static inline int atomicIncrement(volatile int* value) {
+#ifdef _MSC_VER
+    return InterlockedIncrement(reinterpret_cast<volatile long*>(value));
+#else
+    return __sync_add_and_fetch(value, 1);
+#endif
+}
+
+/**
+ * Atomically subtract 1 from a value and return the new value.  This acts as a full memory barrier.
+ */
+static inline int atomicDecrement(volatile int* value) {
+#ifdef _MSC_VER
+    return InterlockedDecrement(reinterpret_cast<volatile long*>(value));
+#else
+    return __sync_sub_and_fetch(value, 1);
+#endif
+}
+
+/**
+ * Read a value with acquire semantics, so that everything written before it was last modified is visible.
+ */
+static inline int atomicRead(volatile int* value) {
+    int result = *value;
+#ifdef _MSC_VER
+    MemoryBarrier();
+#else
+    __sync_synchronize();
+#endif
+    return result;
+}
+
+/**
+ * Tell the processor we are in a spin loop.  On hyperthreaded cores this yields execution resources to the other thread.
+ */
+static inline void spinPause() {
+#if defined(_MSC_VER)
+    YieldProcessor();
+#elif defined(__i386__) || defined(__x86_64__)
+    __asm__ __volatile__("pause");
+#endif
+}
+
+ThreadBarrier::ThreadBarrier(int numThreads, int spinCount) : numThreads(numThreads), spinCount(spinCount), count(0), phase(0), numSleeping(0) {
+    pthread_cond_init(&condition, NULL);
+    pthread_mutex_init(&lock, NULL);
+}
+
+ThreadBarrier::~ThreadBarrier() {
+    pthread_mutex_destroy(&lock);
+    pthread_cond_destroy(&condition);
+}
+
+bool ThreadBarrier::wait() {
+    if (numThreads < 2)
+        return true;
+    int myPhase = atomicRead(&phase);
+    if (atomicIncrement(&count) == numThreads) {
+        // This is the last thread to arrive.  Reset the count before advancing the phase, since
+        // no other thread can arrive at the next use of the barrier until the phase has changed.
+
+        count = 0;
+        atomicIncrement(&phase);
+
+        // Both the increment above and the one made by a thread going to sleep are full barriers,
+        // so either we see that it is sleeping or it sees that the phase has changed.
+
+        if (atomicRead(&numSleeping) > 0) {
+            pthread_mutex_lock(&lock);
+            pthread_cond_broadcast(&condition);
+            pthread_mutex_unlock(&lock);
+        }
+        return true;
+    }
+
+    // Spin for a while in the hope that the other threads will arrive soon.
+
+    for (int i = 0; i < spinCount; i++) {
+        if (atomicRead(&phase) != myPhase)
+            return false;
+        spinPause();
+    }
+
+    // Go to sleep until the last thread arrives.
+
+    pthread_mutex_lock(&lock);
+    atomicIncrement(&numSleeping);
+    while (atomicRead(&phase) == myPhase)
+        pthread_cond_wait(&condition, &lock);
+    atomicDecrement(&numSleeping);
+    pthread_mutex_unlock(&lock);
+    return false;
+}
@@ -0,0 +1,181 @@
+/* -------------------------------------------------------------------------- *
+ *                                   OpenMM                                   *
+ * -------------------------------------------------------------------------- *
+ * This is part of the OpenMM molecular simulation toolkit originating from   *
+ * Simbios, the NIH National Center for Physics-Based Simulation of           *
+ * Biological Structures at Stanford, funded under the NIH Roadmap for        *
+ * Medical Research, grant U54 GM072970. See https://simtk.org.               *
+ *                                                                            *
+ * Portions copyright (c) 2013 Stanford University and the Authors.           *
+ * Authors: Peter Eastman                                                     *
+ * Contributors:                                                              *
+ *                                                                            *
+ * Permission is hereby granted, free of charge, to any person obtaining a    *
+ * copy of this software and associated documentation files (the "Software"), *
+ * to deal in the Software without restriction, including without limitation  *
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,   *
+ * and/or sell copies of the Software, and to permit persons to whom the      *
+ * Software is furnished to do so, subject to the following conditions:       *
+ *                                                                            *
+ * The above copyright notice and this permission notice shall be included in *
+ * all copies or substantial portions of the Software.                        *
+ *                                                                            *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR *
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,   *
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL    *
+ * THE AUTHORS, CONTRIBUTORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,    *
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR      *
+ * OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE  *
+ * USE OR OTHER DEALINGS IN THE SOFTWARE.                                     *
+ * -------------------------------------------------------------------------- */
+
+
+#include "openmm/internal/ThreadPool.h"
+#include "openmm/OpenMMException.h"
+
+#ifdef __APPLE__
+   #include <sys/sysctl.h>
+#else
+   #ifdef WIN32
+      #include <windows.h>
+   #else
+      #include <unistd.h>
+   #endif
+#endif
+
+using namespace OpenMM;
+using namespace std;
+
+class ThreadPool::ThreadData {
+public:
+    ThreadData(ThreadPool& owner, int index) : owner(owner), index(index) {
+    }
+    void run() {
+        owner.runThread(index);
+    }
+    ThreadPool& owner;
+    int index;
+};
+
+static void* threadBody(void* args) {
+    reinterpret_cast<ThreadPool::ThreadData*>(args)->run();
+    return 0;
+}
+
+ThreadPool::ThreadPool(int numThreads) : isDeleted(false), numThreads(numThreads), currentTask(NULL), barrier(NULL) {
+    if (this->numThreads <= 0)
+        this->numThreads = getNumProcessors();
+
+    // The calling thread acts as thread 0, so we only need to create the others.  They wait on startLock
+    // until all of them exist, so if one cannot be created the barrier can be sized for the ones that were.
+
+    pthread_mutex_init(&startLock, NULL);
+    pthread_mutex_lock(&startLock);
+    thread.reserve(this->numThreads-1);
+    for (int i = 1; i < this->numThreads; i++) {
+        ThreadData* data = new ThreadData(*this, i);
+        threadData.push_back(data);
+        pthread_t newThread;
+        if (pthread_create(&newThread, NULL, threadBody, data) != 0)
+            break;
+        thread.push_back(newThread);
+    }
+    barrier = new ThreadBarrier(thread.size()+1);
+    if ((int) thread.size() == this->numThreads-1) {
+        pthread_mutex_unlock(&startLock);
+        return;
+    }
+
+    // Release the threads that were created, wait for them to exit, and report the error.
+
+    isDeleted = true;
+    pthread_mutex_unlock(&startLock);
+    barrier->wait();
+    for (int i = 0; i < (int) thread.size(); i++)
+        pthread_join(thread[i], NULL);
+    for (int i = 0; i < (int) threadData.size(); i++)
+        delete threadData[i];
+    delete barrier;
+    pthread_mutex_destroy(&startLock);
+    throw OpenMMException("ThreadPool: Failed to create worker thread");
+}
+
+ThreadPool::~ThreadPool() {
+    isDeleted = true;
+    if (numThreads > 1)
+        barrier->wait();
+    for (int i = 0; i < (int) thread.size(); i++)
+        pthread_join(thread[i], NULL);
+    for (int i = 0; i < (int) threadData.size(); i++)
+        delete threadData[i];
+    delete barrier;
+    pthread_mutex_destroy(&startLock);
+}
+
+void ThreadPool::execute(Task& task) {
+    if (numThreads == 1) {
+        task.execute(*this, 0);
+        return;
+    }
+
+    // The first use of the barrier releases the worker threads, and the second one waits
+    // for all of them to finish.
+
+    // If this thread's part throws, it must still wait for the others before returning.  Otherwise
+    // they would still be running the Task after it was destroyed, and every later use of the barrier
+    // would be out of step.
+
+    currentTask = &task;
+    barrier->wait();
+    try {
+        task.execute(*this, 0);
+    }
+    catch (...) {
+        barrier->wait();
+        throw;
+    }
+    barrier->wait();
+}
+
+void ThreadPool::syncThreads() {
+    barrier->wait();
+}
+
+void ThreadPool::runThread(int index) {
+    pthread_mutex_lock(&startLock);
+    pthread_mutex_unlock(&startLock);
+    while (true) {
+        barrier->wait();
+        if (isDeleted)
+            break;
+        currentTask->execute(*this, index);
+        barrier->wait();
+    }
+}
+
+int ThreadPool::getNumProcessors() {
+#ifdef __APPLE__
+    int ncpu;
+    size_t len = 4;
+    if (sysctlbyname("hw.logicalcpu", &ncpu, &len, NULL, 0) == 0)
+       return ncpu;
+    else
+       return 1;
+#else
+#ifdef WIN32
+    SYSTEM_INFO siSysInfo;
+    int ncpu;
+    GetSystemInfo(&siSysInfo);
+    ncpu = siSysInfo.dwNumberOfProcessors;
+    if (ncpu < 1)
+        ncpu = 1;
+    return ncpu;
+#else
+    long nProcessorsOnline = sysconf(_SC_NPROCESSORS_ONLN);
+    if (nProcessorsOnline == -1)
+        return 1;
+    else
+        return (int) nProcessorsOnline;
+#endif
+#endif
+}
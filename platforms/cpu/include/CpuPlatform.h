@@ -0,0 +1,105 @@
+#ifndef OPENMM_CPUPLATFORM_H_
+#define OPENMM_CPUPLATFORM_H_
+
+/* -------------------------------------------------------------------------- *
+ *                                   OpenMM                                   *
+ * -------------------------------------------------------------------------- *
+ * This is part of the OpenMM molecular simulation toolkit originating from   *
+ * Simbios, the NIH National Center for Physics-Based Simulation of           *
+ * Biological Structures at Stanford, funded under the NIH Roadmap for        *
+ * Medical Research, grant U54 GM072970. See https://simtk.org.               *
+ *                                                                            *
+ * Portions copyright (c) 2013 Stanford University and the Authors.           *
+ * Authors: Peter Eastman                                                     *
+ * Contributors:                                                              *
+ *                                                                            *
+ * Permission is hereby granted, free of charge, to any person obtaining a    *
+ * copy of this software and associated documentation files (the "Software"), *
+ * to deal in the Software without restriction, including without limitation  *
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,   *
+ * and/or sell copies of the Software, and to permit persons to whom the      *
+ * Software is furnished to do so, subject to the following conditions:       *
+ *                                                                            *
+ * The above copyright notice and this permission notice shall be included in *
+ * all copies or substantial portions of the Software.                        *
+ *                                                                            *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR *
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,   *
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL    *
+ * THE AUTHORS, CONTRIBUTORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,    *
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR      *
+ * OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE  *
+ * USE OR OTHER DEALINGS IN THE SOFTWARE.                                     *
+ * -------------------------------------------------------------------------- */
+
+#include "ReferencePlatform.h"
+#include "RealVec.h"
+#include "openmm/internal/ThreadPool.h"
+#include "windowsExportCpu.h"
+#include <map>
+#include <vector>
+
+namespace OpenMM {
+
+/**
+ * This Platform subclass uses multithreaded CPU implementations of the OpenMM kernels.  It is built
+ * on top of the reference platform: forces that do not have a multithreaded implementation fall back
+ * to the reference kernels.
+ */
+
+class OPENMM_EXPORT_CPU CpuPlatform : public ReferencePlatform {
+public:
+    class PlatformData;
+    CpuPlatform();
+    const std::string& getName() const {
+        static const std::string name = "CPU";
+        return name;
+    }
+    double getSpeed() const;
+    const std::string& getPropertyValue(const Context& context, const std::string& property) const;
+    void contextCreated(ContextImpl& context, const std::map<std::string, std::string>& properties) const;
+    void contextDestroyed(ContextImpl& context) const;
+    /**
+     * This is the name of the parameter for selecting the number of threads to use.
+     */
+    static const std::string& CpuThreads() {
+        static const std::string key = "CpuThreads";
+        return key;
+    }
+    /**
+     * This is the name of the parameter for selecting whether to compute nonbonded interactions with
+     * SIMD instructions.  Allowed values are "true" and "false".
+     */
+    static const std::string& CpuVectorizeNonbonded() {
+        static const std::string key = "CpuVectorizeNonbonded";
+        return key;
+    }
+    /**
+     * Get the CPU specific data for a context.
+     */
+    static PlatformData& getPlatformData(ContextImpl& context);
+private:
+    static std::map<const ContextImpl*, PlatformData*> contextData;
+};
+
+class OPENMM_EXPORT_CPU CpuPlatform::PlatformData {
+public:
+    PlatformData(int numParticles, int numThreads, bool vectorizeNonbonded);
+    /**
+     * Set every thread's force buffer to zero.
+     */
+    void clearThreadForces();
+    /**
+     * Add the contents of every thread's force buffer to an array of forces.
+     */
+    void sumThreadForces(std::vector<RealVec>& forces);
+    ThreadPool threads;
+    std::vector<std::vector<RealVec> > threadForce;
+    std::vector<RealOpenMM> threadEnergy;
+    bool vectorizeNonbonded;
+    std::map<std::string, std::string> propertyValues;
+};
+
+} // namespace OpenMM
+
+#endif /*OPENMM_CPUPLATFORM_H_*/
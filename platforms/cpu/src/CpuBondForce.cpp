@@ -0,0 +1,70 @@
+/* -------------------------------------------------------------------------- *
+ *                                   OpenMM                                   *
+ * -------------------------------------------------------------------------- *
+ * This is part of the OpenMM molecular simulation toolkit originating from   *
+ * Simbios, the NIH National Center for Physics-Based Simulation of           *
+ * Biological Structures at Stanford, funded under the NIH Roadmap for        *
+ * Medical Research, grant U54 GM072970. See https://simtk.org.               *
+ *                                                                            *
+ * Portions copyright (c) 2013 Stanford University and the Authors.           *
+ * Authors: Peter Eastman                                                     *
+ * Contributors:                                                              *
+ *                                                                            *
+ * Permission is hereby granted, free of charge, to any person obtaining a    *
+ * copy of this software and associated documentation files (the "Software"), *
+ * to deal in the Software without restriction, including without limitation  *
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,   *
+ * and/or sell copies of the Software, and to permit persons to whom the      *
+ * Software is furnished to do so, subject to the following conditions:       *
+ *                                                                            *
+ * The above copyright notice and this permission notice shall be included in *
+ * all copies or substantial portions of the Software.                        *
+ *                                                                            *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR *
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,   *
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL    *
+ * THE AUTHORS, CONTRIBUTORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,    *
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR      *
+ * OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE  *
+ * USE OR OTHER DEALINGS IN THE SOFTWARE.                                     *
+ * -------------------------------------------------------------------------- */
+
+#include "CpuBondForce.h"
+
+using namespace OpenMM;
+using namespace std;
+
+class CpuBondForceTask : public ThreadPool::Task {
+public:
+    CpuBondForceTask(CpuPlatform::PlatformData& data, int numBonds, int** atomIndices, vector<RealVec>& atomCoordinates,
+            RealOpenMM** parameters, bool includeEnergy, ReferenceBondIxn& ixn) : data(data), numBonds(numBonds),
+            atomIndices(atomIndices), atomCoordinates(atomCoordinates), parameters(parameters), includeEnergy(includeEnergy), ixn(ixn) {
+    }
+    void execute(ThreadPool& threads, int threadIndex) {
+        int numThreads = threads.getNumThreads();
+        int start = (threadIndex*numBonds)/numThreads;
+        int end = ((threadIndex+1)*numBonds)/numThreads;
+        RealOpenMM* energy = &data.threadEnergy[threadIndex];
+        *energy = 0;
+        vector<RealVec>& forces = data.threadForce[threadIndex];
+        for (int i = start; i < end; i++)
+            ixn.calculateBondIxn(atomIndices[i], atomCoordinates, parameters[i], forces, includeEnergy ? energy : NULL);
+    }
+    CpuPlatform::PlatformData& data;
+    int numBonds;
+    int** atomIndices;
+    vector<RealVec>& atomCoordinates;
+    RealOpenMM** parameters;
+    bool includeEnergy;
+    ReferenceBondIxn& ixn;
+};
+
+RealOpenMM CpuBondForce::calculateForce(CpuPlatform::PlatformData& data, int numBonds, int** atomIndices, vector<RealVec>& atomCoordinates,
+        RealOpenMM** parameters, bool includeEnergy, ReferenceBondIxn& ixn) {
+    CpuBondForceTask task(data, numBonds, atomIndices, atomCoordinates, parameters, includeEnergy, ixn);
+    data.threads.execute(task);
+    RealOpenMM energy = 0;
+    for (int i = 0; i < (int) data.threadEnergy.size(); i++)
+        energy += data.threadEnergy[i];
+    return energy;
+}
@@ -0,0 +1,66 @@
+#ifndef OPENMM_CPUBONDFORCE_H_
+#define OPENMM_CPUBONDFORCE_H_
+
+/* -------------------------------------------------------------------------- *
+ *                                   OpenMM                                   *
+ * -------------------------------------------------------------------------- *
+ * This is part of the OpenMM molecular simulation toolkit originating from   *
+ * Simbios, the NIH National Center for Physics-Based Simulation of           *
+ * Biological Structures at Stanford, funded under the NIH Roadmap for        *
+ * Medical Research, grant U54 GM072970. See https://simtk.org.               *
+ *                                                                            *
+ * Portions copyright (c) 2013 Stanford University and the Authors.           *
+ * Authors: Peter Eastman                                                     *
+ * Contributors:                                                              *
+ *                                                                            *
+ * Permission is hereby granted, free of charge, to any person obtaining a    *
+ * copy of this software and associated documentation files (the "Software"), *
+ * to deal in the Software without restriction, including without limitation  *
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,   *
+ * and/or sell copies of the Software, and to permit persons to whom the      *
+ * Software is furnished to do so, subject to the following conditions:       *
+ *                                                                            *
+ * The above copyright notice and this permission notice shall be included in *
+ * all copies or substantial portions of the Software.                        *
+ *                                                                            *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR *
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,   *
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL    *
+ * THE AUTHORS, CONTRIBUTORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,    *
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR      *
+ * OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE  *
+ * USE OR OTHER DEALINGS IN THE SOFTWARE.                                     *
+ * -------------------------------------------------------------------------- */
+
+#include "CpuPlatform.h"
+#include "ReferenceBondIxn.h"
+
+namespace OpenMM {
+
+/**
+ * This class computes bonded interactions, dividing the bonds between the threads of a
+ * CpuPlatform.  Each thread accumulates forces into its own force buffer.
+ */
+
+class CpuBondForce {
+public:
+    /**
+     * Calculate the interaction for every bond.
+     *
+     * @param data             the platform data for the context
+     * @param numBonds         the number of bonds
+     * @param atomIndices      the indices of the atoms in each bond
+     * @param atomCoordinates  atom coordinates
+     * @param parameters       the parameters of each bond
+     * @param includeEnergy    whether to compute the energy
+     * @param ixn              the object that computes the interaction for a single bond.  It must
+     *                         not store any state, since it is called from multiple threads at once.
+     * @return the total energy of all the bonds
+     */
+    RealOpenMM calculateForce(CpuPlatform::PlatformData& data, int numBonds, int** atomIndices, std::vector<RealVec>& atomCoordinates,
+                              RealOpenMM** parameters, bool includeEnergy, ReferenceBondIxn& ixn);
+};
+
+} // namespace OpenMM
+
+#endif /*OPENMM_CPUBONDFORCE_H_*/
@@ -0,0 +1,85 @@
+/* -------------------------------------------------------------------------- *
+ *                                   OpenMM                                   *
+ * -------------------------------------------------------------------------- *
+ * This is part of the OpenMM molecular simulation toolkit originating from   *
+ * Simbios, the NIH National Center for Physics-Based Simulation of           *
+ * Biological Structures at Stanford, funded under the NIH Roadmap for        *
+ * Medical Research, grant U54 GM072970. See https://simtk.org.               *
+ *                                                                            *
+ * Portions copyright (c) 2013 Stanford University and the Authors.           *
+ * Authors: Peter Eastman                                                     *
+ * Contributors:                                                              *
+ *                                                                            *
+ * Permission is hereby granted, free of charge, to any person obtaining a    *
+ * copy of this software and associated documentation files (the "Software"), *
+ * to deal in the Software without restriction, including without limitation  *
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,   *
+ * and/or sell copies of the Software, and to permit persons to whom the      *
+ * Software is furnished to do so, subject to the following conditions:       *
+ *                                                                            *
+ * The above copyright notice and this permission notice shall be included in *
+ * all copies or substantial portions of the Software.                        *
+ *                                                                            *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR *
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,   *
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL    *
+ * THE AUTHORS, CONTRIBUTORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,    *
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR      *
+ * OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE  *
+ * USE OR OTHER DEALINGS IN THE SOFTWARE.                                     *
+ * -------------------------------------------------------------------------- */
+
+#include "CpuVerletDynamics.h"
+#include "ReferenceConstraintAlgorithm.h"
+
+#include "CpuCustomDynamics.h"
+#include <set>
+
+using namespace OpenMM;
+using namespace std;
+
+class CpuCustomDynamics::EvaluateTask : public ThreadPool::Task {
+public:
+    EvaluateTask(vector<Lepton::CompiledExpression>& expressions, int numValues, const vector<string>& names,
+            const vector<const double*>& values, double* results) : expressions(expressions), numValues(numValues),
+            names(names), values(values), results(results) {
+    }
+    void execute(ThreadPool& threads, int threadIndex) {
+        int start = (threadIndex*numValues)/threads.getNumThreads();
+        int end = ((threadIndex+1)*numValues)/threads.getNumThreads();
+        if (start == end)
+            return;
+        vector<const double*> threadValues(values.size());
+        for (int i = 0; i < (int) values.size(); i++)
+            threadValues[i] = values[i]+start;
+        expressions[threadIndex].evaluateBatch(end-start, names, threadValues, vector<double*>(1, results+start));
+    }
+    vector<Lepton::CompiledExpression>& expressions;
+    int numValues;
+    const vector<string>& names;
+    const vector<const double*>& values;
+    double* results;
+};
+
+CpuCustomDynamics::CpuCustomDynamics(int numberOfAtoms, const CustomIntegrator& integrator, CpuPlatform::PlatformData& data) :
+        ReferenceCustomDynamics(numberOfAtoms, integrator), data(data) {
+}
+
+void CpuCustomDynamics::evaluatePerDof(Lepton::CompiledExpression& expression, int numValues, const vector<string>& names,
+        const vector<const double*>& values, double* results) {
+    // Each thread needs its own copy of the expression, since evaluating one modifies its workspace.
+    // Copy the current values of global variables into all of them.
+
+    int numThreads = data.threads.getNumThreads();
+    vector<Lepton::CompiledExpression>& expressions = threadExpressions[&expression];
+    if (expressions.size() == 0)
+        expressions.resize(numThreads, expression);
+    const set<string>& variables = expression.getVariables();
+    for (set<string>::const_iterator name = variables.begin(); name != variables.end(); ++name) {
+        double value = expression.getVariableReference(*name);
+        for (int i = 0; i < numThreads; i++)
+            expressions[i].getVariableReference(*name) = value;
+    }
+    EvaluateTask task(expressions, numValues, names, values, results);
+    data.threads.execute(task);
+}
@@ -0,0 +1,71 @@
+#ifndef OPENMM_CPUCUSTOMDYNAMICS_H_
+#define OPENMM_CPUCUSTOMDYNAMICS_H_
+
+/* -------------------------------------------------------------------------- *
+ *                                   OpenMM                                   *
+ * -------------------------------------------------------------------------- *
+ * This is part of the OpenMM molecular simulation toolkit originating from   *
+ * Simbios, the NIH National Center for Physics-Based Simulation of           *
+ * Biological Structures at Stanford, funded under the NIH Roadmap for        *
+ * Medical Research, grant U54 GM072970. See https://simtk.org.               *
+ *                                                                            *
+ * Portions copyright (c) 2013 Stanford University and the Authors.           *
+ * Authors: Peter Eastman                                                     *
+ * Contributors:                                                              *
+ *                                                                            *
+ * Permission is hereby granted, free of charge, to any person obtaining a    *
+ * copy of this software and associated documentation files (the "Software"), *
+ * to deal in the Software without restriction, including without limitation  *
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,   *
+ * and/or sell copies of the Software, and to permit persons to whom the      *
+ * Software is furnished to do so, subject to the following conditions:       *
+ *                                                                            *
+ * The above copyright notice and this permission notice shall be included in *
+ * all copies or substantial portions of the Software.                        *
+ *                                                                            *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR *
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,   *
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL    *
+ * THE AUTHORS, CONTRIBUTORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,    *
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR      *
+ * OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE  *
+ * USE OR OTHER DEALINGS IN THE SOFTWARE.                                     *
+ * -------------------------------------------------------------------------- */
+
+#include "CpuPlatform.h"
+#include "ReferenceCustomDynamics.h"
+#include <map>
+#include <string>
+#include <vector>
+
+namespace OpenMM {
+
+/**
+ * This class performs the same integration as ReferenceCustomDynamics, but divides the degrees of
+ * freedom between the threads of a CpuPlatform when evaluating per-DOF computations.  Every thread
+ * evaluates its own copy of each compiled expression.  Global computations and constraints are still
+ * performed on a single thread.
+ */
+
+class CpuCustomDynamics : public ReferenceCustomDynamics {
+public:
+    class EvaluateTask;
+    /**
+     * Create a CpuCustomDynamics.
+     *
+     * @param numberOfAtoms  number of atoms
+     * @param integrator     the integrator definition to use
+     * @param data           the platform data for the context
+     */
+    CpuCustomDynamics(int numberOfAtoms, const CustomIntegrator& integrator, CpuPlatform::PlatformData& data);
+protected:
+    void evaluatePerDof(Lepton::CompiledExpression& expression, int numValues, const std::vector<std::string>& names,
+                        const std::vector<const double*>& values, double* results);
+private:
+    CpuPlatform::PlatformData& data;
+    std::map<const Lepton::CompiledExpression*, std::vector<Lepton::CompiledExpression> > threadExpressions;
+};
+
+} // namespace OpenMM
+
+#endif /*OPENMM_CPUCUSTOMDYNAMICS_H_*/
@@ -0,0 +1,262 @@
+/* -------------------------------------------------------------------------- *
+ *                                   OpenMM                                   *
+ * -------------------------------------------------------------------------- *
+ * This is part of the OpenMM molecular simulation toolkit originating from   *
+ * Simbios, the NIH National Center for Physics-Based Simulation of           *
+ * Biological Structures at Stanford, funded under the NIH Roadmap for        *
+ * Medical Research, grant U54 GM072970. See https://simtk.org.               *
+ *                                                                            *
+ * Portions copyright (c) 2013 Stanford University and the Authors.           *
+ * Authors: Peter Eastman                                                     *
+ * Contributors:                                                              *
+ *                                                                            *
+ * Permission is hereby granted, free of charge, to any person obtaining a    *
+ * copy of this software and associated documentation files (the "Software"), *
+ * to deal in the Software without restriction, including without limitation  *
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,   *
+ * and/or sell copies of the Software, and to permit persons to whom the      *
+ * Software is furnished to do so, subject to the following conditions:       *
+ *                                                                            *
+ * The above copyright notice and this permission notice shall be included in *
+ * all copies or substantial portions of the Software.                        *
+ *                                                                            *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR *
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,   *
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL    *
+ * THE AUTHORS, CONTRIBUTORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,    *
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR      *
+ * OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE  *
+ * USE OR OTHER DEALINGS IN THE SOFTWARE.                                     *
+ * -------------------------------------------------------------------------- */
+
+#include "CpuGBSAOBCForce.h"
+#include "ReferenceForce.h"
+#include "SimTKOpenMMRealType.h"
+#include <cmath>
+
+using namespace OpenMM;
+using namespace std;
+
+class CpuGBSAOBCForce::ComputeTask : public ThreadPool::Task {
+public:
+    ComputeTask(CpuGBSAOBCForce& owner, CpuPlatform::PlatformData& data) : owner(owner), data(data), stage(0) {
+    }
+    void execute(ThreadPool& threads, int threadIndex) {
+        int numThreads = threads.getNumThreads();
+        int numAtoms = owner.bornRadii.size();
+        int start = (threadIndex*numAtoms)/numThreads;
+        int end = ((threadIndex+1)*numAtoms)/numThreads;
+        if (stage == 0)
+            owner.computeBornRadii(start, end);
+        else if (stage == 1)
+            data.threadEnergy[threadIndex] = owner.computeBornEnergy(threadIndex, numThreads, data.threadForce[threadIndex]);
+        else if (stage == 2)
+            owner.sumBornForces(start, end);
+        else
+            owner.computeChainRuleForces(start, end, data.threadForce[threadIndex]);
+    }
+    CpuGBSAOBCForce& owner;
+    CpuPlatform::PlatformData& data;
+    int stage;
+};
+
+CpuGBSAOBCForce::CpuGBSAOBCForce(ObcParameters* obcParameters) : obcParameters(obcParameters) {
+}
+
+RealOpenMM CpuGBSAOBCForce::computeBornEnergyForces(CpuPlatform::PlatformData& data, const vector<RealVec>& atomCoordinates,
+        const vector<RealOpenMM>& partialCharges) {
+    int numAtoms = obcParameters->getNumberOfAtoms();
+    int numThreads = data.threads.getNumThreads();
+    this->atomCoordinates = &atomCoordinates;
+    this->partialCharges = &partialCharges;
+    bornRadii.resize(numAtoms);
+    obcChain.resize(numAtoms);
+    bornForces.resize(numAtoms);
+    threadBornForces.resize(numThreads);
+    for (int i = 0; i < numThreads; i++)
+        threadBornForces[i].resize(numAtoms);
+
+    // The Born radii must all be known before the energy can be computed, and the Born forces must all
+    // be summed before applying the chain rule, so the calculation is done in stages.
+
+    ComputeTask task(*this, data);
+    for (task.stage = 0; task.stage < 4; task.stage++)
+        data.threads.execute(task);
+    RealOpenMM energy = 0;
+    for (int i = 0; i < numThreads; i++)
+        energy += data.threadEnergy[i];
+    return energy;
+}
+
+void CpuGBSAOBCForce::getDeltaR(int atomI, int atomJ, RealOpenMM* deltaR) const {
+    const vector<RealVec>& pos = *atomCoordinates;
+    if (obcParameters->getPeriodic())
+        ReferenceForce::getDeltaRPeriodic(pos[atomI], pos[atomJ], obcParameters->getPeriodicBox(), deltaR);
+    else
+        ReferenceForce::getDeltaR(pos[atomI], pos[atomJ], deltaR);
+}
+
+void CpuGBSAOBCForce::computeBornRadii(int start, int end) {
+    int numAtoms = obcParameters->getNumberOfAtoms();
+    const vector<RealOpenMM>& atomicRadii = obcParameters->getAtomicRadii();
+    const vector<RealOpenMM>& scaledRadiusFactor = obcParameters->getScaledRadiusFactors();
+    RealOpenMM dielectricOffset = obcParameters->getDielectricOffset();
+    RealOpenMM alphaObc = obcParameters->getAlphaObc();
+    RealOpenMM betaObc = obcParameters->getBetaObc();
+    RealOpenMM gammaObc = obcParameters->getGammaObc();
+    bool useCutoff = obcParameters->getUseCutoff();
+    RealOpenMM cutoff = obcParameters->getCutoffDistance();
+    for (int atomI = start; atomI < end; atomI++) {
+        RealOpenMM radiusI = atomicRadii[atomI];
+        RealOpenMM offsetRadiusI = radiusI-dielectricOffset;
+        RealOpenMM radiusIInverse = 1/offsetRadiusI;
+        RealOpenMM sum = 0;
+        for (int atomJ = 0; atomJ < numAtoms; atomJ++) {
+            if (atomJ == atomI)
+                continue;
+            RealOpenMM deltaR[ReferenceForce::LastDeltaRIndex];
+            getDeltaR(atomI, atomJ, deltaR);
+            RealOpenMM r = deltaR[ReferenceForce::RIndex];
+            if (useCutoff && r > cutoff)
+                continue;
+            RealOpenMM offsetRadiusJ = atomicRadii[atomJ]-dielectricOffset;
+            RealOpenMM scaledRadiusJ = offsetRadiusJ*scaledRadiusFactor[atomJ];
+            RealOpenMM rScaledRadiusJ = r+scaledRadiusJ;
+            if (offsetRadiusI < rScaledRadiusJ) {
+                RealOpenMM rInverse = 1/r;
+                RealOpenMM l_ij = 1/(offsetRadiusI > FABS(r-scaledRadiusJ) ? offsetRadiusI : FABS(r-scaledRadiusJ));
+                RealOpenMM u_ij = 1/rScaledRadiusJ;
+                RealOpenMM l_ij2 = l_ij*l_ij;
+                RealOpenMM u_ij2 = u_ij*u_ij;
+                RealOpenMM ratio = LN(u_ij/l_ij);
+                RealOpenMM term = l_ij-u_ij+0.25f*r*(u_ij2-l_ij2)+(0.5f*rInverse*ratio)+(0.25f*scaledRadiusJ*scaledRadiusJ*rInverse)*(l_ij2-u_ij2);
+                if (offsetRadiusI < scaledRadiusJ-r)
+                    term += 2*(radiusIInverse-l_ij);
+                sum += term;
+            }
+        }
+        sum *= 0.5f*offsetRadiusI;
+        RealOpenMM sum2 = sum*sum;
+        RealOpenMM sum3 = sum*sum2;
+        RealOpenMM tanhSum = TANH(alphaObc*sum-betaObc*sum2+gammaObc*sum3);
+        bornRadii[atomI] = 1/(1/offsetRadiusI-tanhSum/radiusI);
+        obcChain[atomI] = offsetRadiusI*(alphaObc-2*betaObc*sum+3*gammaObc*sum2);
+        obcChain[atomI] = (1-tanhSum*tanhSum)*obcChain[atomI]/radiusI;
+    }
+}
+
+RealOpenMM CpuGBSAOBCForce::computeBornEnergy(int threadIndex, int numThreads, vector<RealVec>& forces) {
+    int numAtoms = obcParameters->getNumberOfAtoms();
+    const vector<RealOpenMM>& charges = *partialCharges;
+    const vector<RealOpenMM>& atomicRadii = obcParameters->getAtomicRadii();
+    RealOpenMM soluteDielectric = obcParameters->getSoluteDielectric();
+    RealOpenMM solventDielectric = obcParameters->getSolventDielectric();
+    bool useCutoff = obcParameters->getUseCutoff();
+    RealOpenMM cutoff = obcParameters->getCutoffDistance();
+    RealOpenMM preFactor = 0;
+    if (soluteDielectric != 0 && solventDielectric != 0)
+        preFactor = 2*obcParameters->getElectricConstant()*((1/soluteDielectric)-(1/solventDielectric));
+    vector<RealOpenMM>& threadBornForce = threadBornForces[threadIndex];
+    for (int i = 0; i < numAtoms; i++)
+        threadBornForce[i] = 0;
+    RealOpenMM energy = 0;
+
+    // Atoms are assigned to threads in an interleaved pattern, since the inner loop gets shorter
+    // as atomI increases.
+
+    for (int atomI = threadIndex; atomI < numAtoms; atomI += numThreads) {
+        // Nonpolar (ACE) term.
+
+        if (bornRadii[atomI] > 0) {
+            RealOpenMM r = atomicRadii[atomI]+obcParameters->getProbeRadius();
+            RealOpenMM ratio6 = POW(atomicRadii[atomI]/bornRadii[atomI], (RealOpenMM) 6);
+            RealOpenMM saTerm = obcParameters->getPi4Asolv()*r*r*ratio6;
+            energy += saTerm;
+            threadBornForce[atomI] -= 6*saTerm/bornRadii[atomI];
+        }
+
+        // Polar term.
+
+        RealOpenMM partialChargeI = preFactor*charges[atomI];
+        for (int atomJ = atomI; atomJ < numAtoms; atomJ++) {
+            RealOpenMM deltaR[ReferenceForce::LastDeltaRIndex];
+            getDeltaR(atomI, atomJ, deltaR);
+            if (useCutoff && deltaR[ReferenceForce::RIndex] > cutoff)
+                continue;
+            RealOpenMM r2 = deltaR[ReferenceForce::R2Index];
+            RealOpenMM alpha2_ij = bornRadii[atomI]*bornRadii[atomJ];
+            RealOpenMM D_ij = r2/(4*alpha2_ij);
+            RealOpenMM expTerm = EXP(-D_ij);
+            RealOpenMM denominator2 = r2+alpha2_ij*expTerm;
+            RealOpenMM denominator = SQRT(denominator2);
+            RealOpenMM Gpol = (partialChargeI*charges[atomJ])/denominator;
+            RealOpenMM dGpol_dr = -Gpol*(1-0.25f*expTerm)/denominator2;
+            RealOpenMM dGpol_dalpha2_ij = -0.5f*Gpol*expTerm*(1+D_ij)/denominator2;
+            RealOpenMM pairEnergy = Gpol;
+            if (atomI != atomJ) {
+                if (useCutoff)
+                    pairEnergy -= partialChargeI*charges[atomJ]/cutoff;
+                threadBornForce[atomJ] += dGpol_dalpha2_ij*bornRadii[atomI];
+                for (int k = 0; k < 3; k++) {
+                    RealOpenMM f = deltaR[k]*dGpol_dr;
+                    forces[atomI][k] += f;
+                    forces[atomJ][k] -= f;
+                }
+            }
+            else
+                pairEnergy *= 0.5f;
+            energy += pairEnergy;
+            threadBornForce[atomI] += dGpol_dalpha2_ij*bornRadii[atomJ];
+        }
+    }
+    return energy;
+}
+
+void CpuGBSAOBCForce::sumBornForces(int start, int end) {
+    for (int i = start; i < end; i++) {
+        RealOpenMM sum = 0;
+        for (int j = 0; j < (int) threadBornForces.size(); j++)
+            sum += threadBornForces[j][i];
+        bornForces[i] = sum*bornRadii[i]*bornRadii[i]*obcChain[i];
+    }
+}
+
+void CpuGBSAOBCForce::computeChainRuleForces(int start, int end, vector<RealVec>& forces) {
+    int numAtoms = obcParameters->getNumberOfAtoms();
+    const vector<RealOpenMM>& atomicRadii = obcParameters->getAtomicRadii();
+    const vector<RealOpenMM>& scaledRadiusFactor = obcParameters->getScaledRadiusFactors();
+    RealOpenMM dielectricOffset = obcParameters->getDielectricOffset();
+    bool useCutoff = obcParameters->getUseCutoff();
+    RealOpenMM cutoff = obcParameters->getCutoffDistance();
+    for (int atomI = start; atomI < end; atomI++) {
+        RealOpenMM offsetRadiusI = atomicRadii[atomI]-dielectricOffset;
+        for (int atomJ = 0; atomJ < numAtoms; atomJ++) {
+            if (atomJ == atomI)
+                continue;
+            RealOpenMM deltaR[ReferenceForce::LastDeltaRIndex];
+            getDeltaR(atomI, atomJ, deltaR);
+            RealOpenMM r = deltaR[ReferenceForce::RIndex];
+            if (useCutoff && r > cutoff)
+                continue;
+            RealOpenMM offsetRadiusJ = atomicRadii[atomJ]-dielectricOffset;
+            RealOpenMM scaledRadiusJ = offsetRadiusJ*scaledRadiusFactor[atomJ];
+            RealOpenMM scaledRadiusJ2 = scaledRadiusJ*scaledRadiusJ;
+            RealOpenMM rScaledRadiusJ = r+scaledRadiusJ;
+            if (offsetRadiusI < rScaledRadiusJ) {
+                RealOpenMM l_ij = 1/(offsetRadiusI > FABS(r-scaledRadiusJ) ? offsetRadiusI : FABS(r-scaledRadiusJ));
+                RealOpenMM u_ij = 1/rScaledRadiusJ;
+                RealOpenMM l_ij2 = l_ij*l_ij;
+                RealOpenMM u_ij2 = u_ij*u_ij;
+                RealOpenMM rInverse = 1/r;
+                RealOpenMM r2Inverse = rInverse*rInverse;
+                RealOpenMM t3 = 0.125f*(1+scaledRadiusJ2*r2Inverse)*(l_ij2-u_ij2)+0.25f*LN(u_ij/l_ij)*r2Inverse;
+                RealOpenMM de = bornForces[atomI]*t3*rInverse;
+                for (int k = 0; k < 3; k++) {
+                    RealOpenMM f = deltaR[k]*de;
+                    forces[atomI][k] -= f;
+                    forces[atomJ][k] += f;
+                }
+            }
+        }
+    }
+}
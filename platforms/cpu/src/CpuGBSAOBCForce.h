@@ -0,0 +1,79 @@
+#ifndef OPENMM_CPUGBSAOBCFORCE_H_
+#define OPENMM_CPUGBSAOBCFORCE_H_
+
+/* -------------------------------------------------------------------------- *
+ *                                   OpenMM                                   *
+ * -------------------------------------------------------------------------- *
+ * This is part of the OpenMM molecular simulation toolkit originating from   *
+ * Simbios, the NIH National Center for Physics-Based Simulation of           *
+ * Biological Structures at Stanford, funded under the NIH Roadmap for        *
+ * Medical Research, grant U54 GM072970. See https://simtk.org.               *
+ *                                                                            *
+ * Portions copyright (c) 2013 Stanford University and the Authors.           *
+ * Authors: Peter Eastman                                                     *
+ * Contributors:                                                              *
+ *                                                                            *
+ * Permission is hereby granted, free of charge, to any person obtaining a    *
+ * copy of this software and associated documentation files (the "Software"), *
+ * to deal in the Software without restriction, including without limitation  *
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,   *
+ * and/or sell copies of the Software, and to permit persons to whom the      *
+ * Software is furnished to do so, subject to the following conditions:       *
+ *                                                                            *
+ * The above copyright notice and this permission notice shall be included in *
+ * all copies or substantial portions of the Software.                        *
+ *                                                                            *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR *
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,   *
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL    *
+ * THE AUTHORS, CONTRIBUTORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,    *
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR      *
+ * OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE  *
+ * USE OR OTHER DEALINGS IN THE SOFTWARE.                                     *
+ * -------------------------------------------------------------------------- */
+
+#include "CpuPlatform.h"
+#include "ObcParameters.h"
+
+namespace OpenMM {
+
+/**
+ * This class computes the GBSA OBC implicit solvent force, dividing the work between the threads
+ * of a CpuPlatform.  It performs the same calculation as CpuObc in the reference platform.
+ */
+
+class CpuGBSAOBCForce {
+public:
+    class ComputeTask;
+    /**
+     * Create a CpuGBSAOBCForce.
+     *
+     * @param obcParameters    the parameters for the calculation.  This object does not take ownership of them.
+     */
+    CpuGBSAOBCForce(ObcParameters* obcParameters);
+    /**
+     * Compute the energy and forces.  Forces are added to each thread's force buffer.
+     *
+     * @param data             the platform data for the context
+     * @param atomCoordinates  atom coordinates
+     * @param partialCharges   the charge of each atom
+     * @return the energy
+     */
+    RealOpenMM computeBornEnergyForces(CpuPlatform::PlatformData& data, const std::vector<RealVec>& atomCoordinates,
+                                       const std::vector<RealOpenMM>& partialCharges);
+private:
+    void computeBornRadii(int start, int end);
+    RealOpenMM computeBornEnergy(int threadIndex, int numThreads, std::vector<RealVec>& forces);
+    void sumBornForces(int start, int end);
+    void computeChainRuleForces(int start, int end, std::vector<RealVec>& forces);
+    void getDeltaR(int atomI, int atomJ, RealOpenMM* deltaR) const;
+    ObcParameters* obcParameters;
+    const std::vector<RealVec>* atomCoordinates;
+    const std::vector<RealOpenMM>* partialCharges;
+    std::vector<RealOpenMM> bornRadii, obcChain, bornForces;
+    std::vector<std::vector<RealOpenMM> > threadBornForces;
+};
+
+} // namespace OpenMM
+
+#endif /*OPENMM_CPUGBSAOBCFORCE_H_*/
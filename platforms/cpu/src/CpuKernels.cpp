@@ -0,0 +1,293 @@
+/* -------------------------------------------------------------------------- *
+ *                                   OpenMM                                   *
+ * -------------------------------------------------------------------------- *
+ * This is part of the OpenMM molecular simulation toolkit originating from   *
+ * Simbios, the NIH National Center for Physics-Based Simulation of           *
+ * Biological Structures at Stanford, funded under the NIH Roadmap for        *
+ * Medical Research, grant U54 GM072970. See https://simtk.org.               *
+ *                                                                            *
+ * Portions copyright (c) 2013 Stanford University and the Authors.           *
+ * Authors: Peter Eastman                                                     *
+ * Contributors:                                                              *
+ *                                                                            *
+ * Permission is hereby granted, free of charge, to any person obtaining a    *
+ * copy of this software and associated documentation files (the "Software"), *
+ * to deal in the Software without restriction, including without limitation  *
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,   *
+ * and/or sell copies of the Software, and to permit persons to whom the      *
+ * Software is furnished to do so, subject to the following conditions:       *
+ *                                                                            *
+ * The above copyright notice and this permission notice shall be included in *
+ * all copies or substantial portions of the Software.                        *
+ *                                                                            *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR *
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,   *
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL    *
+ * THE AUTHORS, CONTRIBUTORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,    *
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR      *
+ * OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE  *
+ * USE OR OTHER DEALINGS IN THE SOFTWARE.                                     *
+ * -------------------------------------------------------------------------- */
+
+#include "CpuKernels.h"
+#include "CpuBondForce.h"
+#include "CpuGBSAOBCForce.h"
+#include "CpuCustomDynamics.h"
+#include "CpuVerletDynamics.h"
+#include "ReferenceAngleBondIxn.h"
+#include "ReferenceBondForce.h"
+#include "ReferenceConstraintAlgorithm.h"
+#include "ReferenceConstraints.h"
+#include "ReferenceHarmonicBondIxn.h"
+#include "ReferenceLJCoulomb14.h"
+#include "ReferenceLJCoulombIxn.h"
+#include "ReferenceProperDihedralBond.h"
+#include "ReferenceRbDihedralBond.h"
+#include "CpuObc.h"
+#include "openmm/OpenMMException.h"
+#include "openmm/internal/ContextImpl.h"
+
+using namespace OpenMM;
+using namespace std;
+
+static vector<RealVec>& extractPositions(ContextImpl& context) {
+    ReferencePlatform::PlatformData* data = reinterpret_cast<ReferencePlatform::PlatformData*>(context.getPlatformData());
+    return *((vector<RealVec>*) data->positions);
+}
+
+static vector<RealVec>& extractVelocities(ContextImpl& context) {
+    ReferencePlatform::PlatformData* data = reinterpret_cast<ReferencePlatform::PlatformData*>(context.getPlatformData());
+    return *((vector<RealVec>*) data->velocities);
+}
+
+static vector<RealVec>& extractForces(ContextImpl& context) {
+    ReferencePlatform::PlatformData* data = reinterpret_cast<ReferencePlatform::PlatformData*>(context.getPlatformData());
+    return *((vector<RealVec>*) data->forces);
+}
+
+static RealVec& extractBoxSize(ContextImpl& context) {
+    ReferencePlatform::PlatformData* data = reinterpret_cast<ReferencePlatform::PlatformData*>(context.getPlatformData());
+    return *(RealVec*) data->periodicBoxSize;
+}
+
+void CpuCalcForcesAndEnergyKernel::beginComputation(ContextImpl& context, bool includeForce, bool includeEnergy, int groups) {
+    ReferenceCalcForcesAndEnergyKernel::beginComputation(context, includeForce, includeEnergy, groups);
+    data.clearThreadForces();
+}
+
+double CpuCalcForcesAndEnergyKernel::finishComputation(ContextImpl& context, bool includeForce, bool includeEnergy, int groups) {
+    if (includeForce)
+        data.sumThreadForces(extractForces(context));
+    return ReferenceCalcForcesAndEnergyKernel::finishComputation(context, includeForce, includeEnergy, groups);
+}
+
+double CpuCalcHarmonicBondForceKernel::execute(ContextImpl& context, bool includeForces, bool includeEnergy) {
+    CpuBondForce bondForce;
+    ReferenceHarmonicBondIxn harmonicBond;
+    return bondForce.calculateForce(data, numBonds, bondIndexArray, extractPositions(context), bondParamArray, includeEnergy, harmonicBond);
+}
+
+double CpuCalcHarmonicAngleForceKernel::execute(ContextImpl& context, bool includeForces, bool includeEnergy) {
+    CpuBondForce bondForce;
+    ReferenceAngleBondIxn angleBond;
+    return bondForce.calculateForce(data, numAngles, angleIndexArray, extractPositions(context), angleParamArray, includeEnergy, angleBond);
+}
+
+double CpuCalcPeriodicTorsionForceKernel::execute(ContextImpl& context, bool includeForces, bool includeEnergy) {
+    CpuBondForce bondForce;
+    ReferenceProperDihedralBond periodicTorsionBond;
+    return bondForce.calculateForce(data, numTorsions, torsionIndexArray, extractPositions(context), torsionParamArray, includeEnergy, periodicTorsionBond);
+}
+
+double CpuCalcRBTorsionForceKernel::execute(ContextImpl& context, bool includeForces, bool includeEnergy) {
+    CpuBondForce bondForce;
+    ReferenceRbDihedralBond rbTorsionBond;
+    return bondForce.calculateForce(data, numTorsions, torsionIndexArray, extractPositions(context), torsionParamArray, includeEnergy, rbTorsionBond);
+}
+
+class CpuCalcNonbondedForceKernel::NonbondedTask : public ThreadPool::Task {
+public:
+    NonbondedTask(CpuCalcNonbondedForceKernel& owner, vector<RealVec>& posData, RealVec& boxSize, bool includeForces, bool includeEnergy) :
+            owner(owner), posData(posData), boxSize(boxSize), includeForces(includeForces), includeEnergy(includeEnergy) {
+    }
+    void execute(ThreadPool& threads, int threadIndex) {
+        RealOpenMM* energy = &owner.data.threadEnergy[threadIndex];
+        *energy = 0;
+        NonbondedMethod method = owner.nonbondedMethod;
+        if (owner.data.vectorizeNonbonded) {
+            *energy = owner.vecForce.calculateDirectIxn(threadIndex, owner.data.threadForce[threadIndex], includeForces, includeEnergy);
+            if (threadIndex != 0 || (method != Ewald && method != PME && method != LJPME))
+                return;
+        }
+        ReferenceLJCoulombIxn clj;
+        const NeighborList& neighbors = (owner.data.vectorizeNonbonded ? owner.emptyNeighborList : owner.threadNeighborList[threadIndex]);
+        clj.setUseCutoff(owner.nonbondedCutoff, neighbors, owner.rfDielectric);
+        if (method == CutoffPeriodic || method == Ewald || method == PME || method == LJPME)
+            clj.setPeriodic(boxSize);
+        if (method == Ewald)
+            clj.setUseEwald(owner.ewaldAlpha, owner.kmax[0], owner.kmax[1], owner.kmax[2]);
+        if (method == PME || method == LJPME)
+            clj.setUsePME(owner.ewaldAlpha, owner.gridSize);
+        if (method == LJPME)
+            clj.setUseLJPME(owner.ewaldDispersionAlpha, owner.dispersionGridSize);
+        if (owner.useSwitchingFunction)
+            clj.setUseSwitchingFunction(owner.switchingDistance);
+        clj.setIncludeForces(includeForces);
+
+        // Only the first thread subtracts off the excluded interactions for Ewald, PME, and LJPME.  When the
+        // vectorized code has already computed the neighbors, that is all it does.
+
+        vector<set<int> >& exclusions = (threadIndex == 0 ? owner.exclusions : owner.noExclusions);
+        clj.calculatePairIxn(owner.numParticles, posData, owner.particleParamArray, exclusions, 0, owner.data.threadForce[threadIndex],
+                0, includeEnergy ? energy : NULL, true, false);
+    }
+    CpuCalcNonbondedForceKernel& owner;
+    vector<RealVec>& posData;
+    RealVec& boxSize;
+    bool includeForces, includeEnergy;
+};
+
+double CpuCalcNonbondedForceKernel::execute(ContextImpl& context, bool includeForces, bool includeEnergy, bool includeDirect, bool includeReciprocal) {
+    // If this throws after reciprocal space was started in the background, wait for it and discard the results.
+    // Otherwise the next evaluation would pick them up even though they were computed from stale coordinates.
+
+    try {
+        if (nonbondedMethod == NoCutoff)
+            return ReferenceCalcNonbondedForceKernel::execute(context, includeForces, includeEnergy, includeDirect, includeReciprocal);
+        vector<RealVec>& posData = extractPositions(context);
+        vector<RealVec>& forceData = extractForces(context);
+        RealVec& box = extractBoxSize(context);
+        RealOpenMM energy = 0;
+        bool periodic = (nonbondedMethod == CutoffPeriodic);
+        bool ewald  = (nonbondedMethod == Ewald);
+        bool pme  = (nonbondedMethod == PME || nonbondedMethod == LJPME);
+        bool ljpme = (nonbondedMethod == LJPME);
+        if (periodic || ewald || pme) {
+            double minAllowedSize = 1.999999*nonbondedCutoff;
+            if (box[0] < minAllowedSize || box[1] < minAllowedSize || box[2] < minAllowedSize)
+                throw OpenMMException("The periodic box size has decreased to less than twice the nonbonded cutoff.");
+        }
+
+        // Update the neighbor list, and divide it between threads whenever it changes.
+
+        ReferencePlatform::PlatformData* referenceData = reinterpret_cast<ReferencePlatform::PlatformData*>(context.getPlatformData());
+        if (neighborList->update(numParticles, posData, exclusions, box, periodic || ewald || pme, nonbondedCutoff, referenceData->neighborListSkin)) {
+            referenceData->neighborListRebuilds++;
+            const NeighborList& fullList = neighborList->getNeighborList();
+            int numThreads = data.threads.getNumThreads();
+            if (data.vectorizeNonbonded)
+                vecForce.setNeighborList(numParticles, fullList, numThreads);
+            else {
+                threadNeighborList.resize(numThreads);
+                for (int i = 0; i < numThreads; i++) {
+                    int start = (i*fullList.size())/numThreads;
+                    int end = ((i+1)*fullList.size())/numThreads;
+                    threadNeighborList[i].assign(fullList.begin()+start, fullList.begin()+end);
+                }
+            }
+            noExclusions.resize(numParticles);
+        }
+        // The optimized PME kernel is normally started by beginComputation().  If it was not, start it now so it
+        // still runs at the same time as direct space.
+
+        bool useOptimizedPme = (pme && includeReciprocal && beginOptimizedPme(context, includeForces, includeEnergy));
+        if (includeDirect) {
+            if (data.vectorizeNonbonded) {
+                vecForce.setUseCutoff(nonbondedCutoff, rfDielectric);
+                if (periodic || ewald || pme)
+                    vecForce.setPeriodic(box);
+                if (ewald || pme)
+                    vecForce.setUseEwald(ewaldAlpha);
+                if (ljpme)
+                    vecForce.setUseLJPME(ewaldDispersionAlpha);
+                if (useSwitchingFunction)
+                    vecForce.setUseSwitchingFunction(switchingDistance);
+                vecForce.setAtomData(posData, particleParamArray);
+            }
+            NonbondedTask task(*this, posData, box, includeForces, includeEnergy);
+            data.threads.execute(task);
+            for (int i = 0; i < (int) data.threadEnergy.size(); i++)
+                energy += data.threadEnergy[i];
+        }
+        if (includeReciprocal && (ewald || pme)) {
+            ReferenceLJCoulombIxn clj;
+            clj.setUseCutoff(nonbondedCutoff, neighborList->getNeighborList(), rfDielectric);
+            clj.setPeriodic(box);
+            if (ewald)
+                clj.setUseEwald(ewaldAlpha, kmax[0], kmax[1], kmax[2]);
+            if (pme)
+                clj.setUsePME(ewaldAlpha, gridSize);
+            if (ljpme) {
+                clj.setUseLJPME(ewaldDispersionAlpha, dispersionGridSize);
+                clj.setDispersionPme(dispersionPme);
+            }
+            clj.setIncludeForces(includeForces);
+            if (!useOptimizedPme)
+                clj.calculatePairIxn(numParticles, posData, particleParamArray, exclusions, 0, forceData, 0, includeEnergy ? &energy : NULL, false, true);
+            else {
+                // The optimized kernel only handles the Coulomb interaction, so the dispersion part of LJPME is still computed here.
+
+                if (ljpme)
+                    clj.calculateDispersionReciprocalIxn(numParticles, posData, particleParamArray, forceData, 0, includeEnergy ? &energy : NULL);
+                energy += finishOptimizedPme(context, includeEnergy);
+            }
+        }
+        if (includeDirect) {
+            CpuBondForce bondForce;
+            ReferenceLJCoulomb14 nonbonded14;
+            energy += bondForce.calculateForce(data, num14, bonded14IndexArray, posData, bonded14ParamArray, includeEnergy, nonbonded14);
+            if (periodic || ewald || pme)
+                energy += dispersionCoefficient/(box[0]*box[1]*box[2]);
+        }
+        return energy;
+    }
+    catch (...) {
+        abortOptimizedPme();
+        throw;
+    }
+}
+
+CpuCalcGBSAOBCForceKernel::~CpuCalcGBSAOBCForceKernel() {
+    if (cpuObc != NULL)
+        delete cpuObc;
+}
+
+void CpuCalcGBSAOBCForceKernel::initialize(const System& system, const GBSAOBCForce& force) {
+    ReferenceCalcGBSAOBCForceKernel::initialize(system, force);
+    cpuObc = new CpuGBSAOBCForce(obc->getObcParameters());
+}
+
+double CpuCalcGBSAOBCForceKernel::execute(ContextImpl& context, bool includeForces, bool includeEnergy) {
+    if (isPeriodic)
+        obc->getObcParameters()->setPeriodic(extractBoxSize(context));
+    return cpuObc->computeBornEnergyForces(data, extractPositions(context), charges);
+}
+
+void CpuIntegrateVerletStepKernel::execute(ContextImpl& context, const VerletIntegrator& integrator) {
+    double stepSize = integrator.getStepSize();
+    vector<RealVec>& posData = extractPositions(context);
+    vector<RealVec>& velData = extractVelocities(context);
+    vector<RealVec>& forceData = extractForces(context);
+    if (dynamics == 0 || stepSize != prevStepSize) {
+        // Recreate the computation objects with the new parameters.
+
+        if (dynamics)
+            delete dynamics;
+        dynamics = new CpuVerletDynamics(context.getSystem().getNumParticles(), static_cast<RealOpenMM>(stepSize), cpuData);
+        dynamics->setReferenceConstraintAlgorithm(constraints);
+        static_cast<ReferenceConstraints*>(constraints)->setThreadPool(&cpuData.threads);
+        prevStepSize = stepSize;
+    }
+    constraints->setTolerance(integrator.getConstraintTolerance());
+    dynamics->update(context.getSystem(), posData, velData, forceData, masses);
+    data.time += stepSize;
+    data.stepCount++;
+}
+
+void CpuIntegrateCustomStepKernel::initialize(const System& system, const CustomIntegrator& integrator) {
+    ReferenceIntegrateCustomStepKernel::initialize(system, integrator);
+    delete dynamics;
+    dynamics = new CpuCustomDynamics(system.getNumParticles(), integrator, cpuData);
+    dynamics->setReferenceConstraintAlgorithm(constraints);
+    static_cast<ReferenceConstraints*>(constraints)->setThreadPool(&cpuData.threads);
+}
@@ -0,0 +1,266 @@
+#ifndef OPENMM_CPUKERNELS_H_
+#define OPENMM_CPUKERNELS_H_
+
+/* -------------------------------------------------------------------------- *
+ *                                   OpenMM                                   *
+ * -------------------------------------------------------------------------- *
+ * This is part of the OpenMM molecular simulation toolkit originating from   *
+ * Simbios, the NIH National Center for Physics-Based Simulation of           *
+ * Biological Structures at Stanford, funded under the NIH Roadmap for        *
+ * Medical Research, grant U54 GM072970. See https://simtk.org.               *
+ *                                                                            *
+ * Portions copyright (c) 2013 Stanford University and the Authors.           *
+ * Authors: Peter Eastman                                                     *
+ * Contributors:                                                              *
+ *                                                                            *
+ * Permission is hereby granted, free of charge, to any person obtaining a    *
+ * copy of this software and associated documentation files (the "Software"), *
+ * to deal in the Software without restriction, including without limitation  *
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,   *
+ * and/or sell copies of the Software, and to permit persons to whom the      *
+ * Software is furnished to do so, subject to the following conditions:       *
+ *                                                                            *
+ * The above copyright notice and this permission notice shall be included in *
+ * all copies or substantial portions of the Software.                        *
+ *                                                                            *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR *
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,   *
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL    *
+ * THE AUTHORS, CONTRIBUTORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,    *
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR      *
+ * OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE  *
+ * USE OR OTHER DEALINGS IN THE SOFTWARE.                                     *
+ * -------------------------------------------------------------------------- */
+
+#include "CpuPlatform.h"
+#include "CpuNonbondedForceVec.h"
+#include "ReferenceKernels.h"
+
+namespace OpenMM {
+
+class CpuGBSAOBCForce;
+
+/**
+ * This kernel is invoked at the beginning and end of force and energy computations.  It clears the
+ * per-thread force buffers before the computation, and adds them to the context's forces after it.
+ */
+class CpuCalcForcesAndEnergyKernel : public ReferenceCalcForcesAndEnergyKernel {
+public:
+    CpuCalcForcesAndEnergyKernel(std::string name, const Platform& platform, CpuPlatform::PlatformData& data) : ReferenceCalcForcesAndEnergyKernel(name, platform),
+        data(data) {
+    }
+    /**
+     * This is called at the beginning of each force/energy computation, before calcForcesAndEnergy() has been called on
+     * any ForceImpl.
+     *
+     * @param context       the context in which to execute this kernel
+     * @param includeForces  true if forces should be computed
+     * @param includeEnergy  true if potential energy should be computed
+     * @param groups        a set of bit flags for which force groups to include
+     */
+    void beginComputation(ContextImpl& context, bool includeForce, bool includeEnergy, int groups);
+    /**
+     * This is called at the end of each force/energy computation, after calcForcesAndEnergy() has been called on
+     * every ForceImpl.
+     *
+     * @param context       the context in which to execute this kernel
+     * @param includeForces  true if forces should be computed
+     * @param includeEnergy  true if potential energy should be computed
+     * @param groups        a set of bit flags for which force groups to include
+     * @return the potential energy of the system.  This value is added to all values returned by ForceImpls'
+     * calcForcesAndEnergy() methods.  That is, each force kernel may <i>either</i> return its contribution to the
+     * energy directly, <i>or</i> add it to an internal buffer so that it will be included here.
+     */
+    double finishComputation(ContextImpl& context, bool includeForce, bool includeEnergy, int groups);
+private:
+    CpuPlatform::PlatformData& data;
+};
+
+/**
+ * This kernel is invoked by HarmonicBondForce to calculate the forces acting on the system and the energy of the system.
+ */
+class CpuCalcHarmonicBondForceKernel : public ReferenceCalcHarmonicBondForceKernel {
+public:
+    CpuCalcHarmonicBondForceKernel(std::string name, const Platform& platform, CpuPlatform::PlatformData& data) : ReferenceCalcHarmonicBondForceKernel(name, platform),
+        data(data) {
+    }
+    /**
+     * Execute the kernel to calculate the forces and/or energy.
+     *
+     * @param context        the context in which to execute this kernel
+     * @param includeForces  true if forces should be calculated
+     * @param includeEnergy  true if the energy should be calculated
+     * @return the potential energy due to the force
+     */
+    double execute(ContextImpl& context, bool includeForces, bool includeEnergy);
+private:
+    CpuPlatform::PlatformData& data;
+};
+
+/**
+ * This kernel is invoked by HarmonicAngleForce to calculate the forces acting on the system and the energy of the system.
+ */
+class CpuCalcHarmonicAngleForceKernel : public ReferenceCalcHarmonicAngleForceKernel {
+public:
+    CpuCalcHarmonicAngleForceKernel(std::string name, const Platform& platform, CpuPlatform::PlatformData& data) : ReferenceCalcHarmonicAngleForceKernel(name, platform),
+        data(data) {
+    }
+    /**
+     * Execute the kernel to calculate the forces and/or energy.
+     *
+     * @param context        the context in which to execute this kernel
+     * @param includeForces  true if forces should be calculated
+     * @param includeEnergy  true if the energy should be calculated
+     * @return the potential energy due to the force
+     */
+    double execute(ContextImpl& context, bool includeForces, bool includeEnergy);
+private:
+    CpuPlatform::PlatformData& data;
+};
+
+/**
+ * This kernel is invoked by PeriodicTorsionForce to calculate the forces acting on the system and the energy of the system.
+ */
+class CpuCalcPeriodicTorsionForceKernel : public ReferenceCalcPeriodicTorsionForceKernel {
+public:
+    CpuCalcPeriodicTorsionForceKernel(std::string name, const Platform& platform, CpuPlatform::PlatformData& data) : ReferenceCalcPeriodicTorsionForceKernel(name, platform),
+        data(data) {
+    }
+    /**
+     * Execute the kernel to calculate the forces and/or energy.
+     *
+     * @param context        the context in which to execute this kernel
+     * @param includeForces  true if forces should be calculated
+     * @param includeEnergy  true if the energy should be calculated
+     * @return the potential energy due to the force
+     */
+    double execute(ContextImpl& context, bool includeForces, bool includeEnergy);
+private:
+    CpuPlatform::PlatformData& data;
+};
+
+/**
+ * This kernel is invoked by RBTorsionForce to calculate the forces acting on the system and the energy of the system.
+ */
+class CpuCalcRBTorsionForceKernel : public ReferenceCalcRBTorsionForceKernel {
+public:
+    CpuCalcRBTorsionForceKernel(std::string name, const Platform& platform, CpuPlatform::PlatformData& data) : ReferenceCalcRBTorsionForceKernel(name, platform),
+        data(data) {
+    }
+    /**
+     * Execute the kernel to calculate the forces and/or energy.
+     *
+     * @param context        the context in which to execute this kernel
+     * @param includeForces  true if forces should be calculated
+     * @param includeEnergy  true if the energy should be calculated
+     * @return the potential energy due to the force
+     */
+    double execute(ContextImpl& context, bool includeForces, bool includeEnergy);
+private:
+    CpuPlatform::PlatformData& data;
+};
+
+/**
+ * This kernel is invoked by NonbondedForce to calculate the forces acting on the system.  The direct space
+ * interactions are divided between threads, and are computed with SIMD instructions unless the CpuVectorizeNonbonded
+ * property is false.  Reciprocal space is computed on a single thread, as is everything when no cutoff is used.  If the
+ * CPU PME plugin is available, PME reciprocal space is instead computed by it in parallel with direct space.  The plugin
+ * only handles Coulomb interactions, so the dispersion reciprocal space sum for LJPME is always computed on one thread.
+ */
+class CpuCalcNonbondedForceKernel : public ReferenceCalcNonbondedForceKernel {
+public:
+    class NonbondedTask;
+    CpuCalcNonbondedForceKernel(std::string name, const Platform& platform, CpuPlatform::PlatformData& data) : ReferenceCalcNonbondedForceKernel(name, platform),
+        data(data) {
+        pmePrecision = CalcPmeReciprocalForceKernel::SinglePrecision;
+    }
+    /**
+     * Execute the kernel to calculate the forces and/or energy.
+     *
+     * @param context        the context in which to execute this kernel
+     * @param includeForces  true if forces should be calculated
+     * @param includeEnergy  true if the energy should be calculated
+     * @param includeDirect  true if direct space interactions should be included
+     * @param includeReciprocal  true if reciprocal space interactions should be included
+     * @return the potential energy due to the force
+     */
+    double execute(ContextImpl& context, bool includeForces, bool includeEnergy, bool includeDirect, bool includeReciprocal);
+private:
+    CpuPlatform::PlatformData& data;
+    std::vector<NeighborList> threadNeighborList;
+    std::vector<std::set<int> > noExclusions;
+    CpuNonbondedForceVec vecForce;
+    NeighborList emptyNeighborList;
+};
+
+/**
+ * This kernel is invoked by GBSAOBCForce to calculate the forces acting on the system.
+ */
+class CpuCalcGBSAOBCForceKernel : public ReferenceCalcGBSAOBCForceKernel {
+public:
+    CpuCalcGBSAOBCForceKernel(std::string name, const Platform& platform, CpuPlatform::PlatformData& data) : ReferenceCalcGBSAOBCForceKernel(name, platform),
+        data(data), cpuObc(NULL) {
+    }
+    ~CpuCalcGBSAOBCForceKernel();
+    /**
+     * Initialize the kernel.
+     *
+     * @param system     the System this kernel will be applied to
+     * @param force      the GBSAOBCForce this kernel will be used for
+     */
+    void initialize(const System& system, const GBSAOBCForce& force);
+    /**
+     * Execute the kernel to calculate the forces and/or energy.
+     *
+     * @param context        the context in which to execute this kernel
+     * @param includeForces  true if forces should be calculated
+     * @param includeEnergy  true if the energy should be calculated
+     * @return the potential energy due to the force
+     */
+    double execute(ContextImpl& context, bool includeForces, bool includeEnergy);
+private:
+    CpuPlatform::PlatformData& data;
+    CpuGBSAOBCForce* cpuObc;
+};
+
+/**
+ * This kernel is invoked by VerletIntegrator to take one time step.
+ */
+class CpuIntegrateVerletStepKernel : public ReferenceIntegrateVerletStepKernel {
+public:
+    CpuIntegrateVerletStepKernel(std::string name, const Platform& platform, ReferencePlatform::PlatformData& data, CpuPlatform::PlatformData& cpuData) :
+        ReferenceIntegrateVerletStepKernel(name, platform, data), cpuData(cpuData) {
+    }
+    /**
+     * Execute the kernel.
+     *
+     * @param context    the context in which to execute this kernel
+     * @param integrator the VerletIntegrator this kernel is being used for
+     */
+    void execute(ContextImpl& context, const VerletIntegrator& integrator);
+private:
+    CpuPlatform::PlatformData& cpuData;
+};
+
+/**
+ * This kernel is invoked by CustomIntegrator to take one time step.
+ */
+class CpuIntegrateCustomStepKernel : public ReferenceIntegrateCustomStepKernel {
+public:
+    CpuIntegrateCustomStepKernel(std::string name, const Platform& platform, ReferencePlatform::PlatformData& data, CpuPlatform::PlatformData& cpuData) :
+        ReferenceIntegrateCustomStepKernel(name, platform, data), cpuData(cpuData) {
+    }
+    /**
+     * Initialize the kernel.
+     *
+     * @param system     the System this kernel will be applied to
+     * @param integrator the CustomIntegrator this kernel will be used for
+     */
+    void initialize(const System& system, const CustomIntegrator& integrator);
+private:
+    CpuPlatform::PlatformData& cpuData;
+};
+
+} // namespace OpenMM
+
+#endif /*OPENMM_CPUKERNELS_H_*/
@@ -0,0 +1,369 @@
+/* -------------------------------------------------------------------------- *
+ *                                   OpenMM                                   *
+ * -------------------------------------------------------------------------- *
+ * This is part of the OpenMM molecular simulation toolkit originating from   *
+ * Simbios, the NIH National Center for Physics-Based Simulation of           *
+ * Biological Structures at Stanford, funded under the NIH Roadmap for        *
+ * Medical Research, grant U54 GM072970. See https://simtk.org.               *
+ *                                                                            *
+ * Portions copyright (c) 2013 Stanford University and the Authors.           *
+ * Authors: Peter Eastman                                                     *
+ * Contributors:                                                              *
+ *                                                                            *
+ * Permission is hereby granted, free of charge, to any person obtaining a    *
+ * copy of this software and associated documentation files (the "Software"), *
+ * to deal in the Software without restriction, including without limitation  *
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,   *
+ * and/or sell copies of the Software, and to permit persons to whom the      *
+ * Software is furnished to do so, subject to the following conditions:       *
+ *                                                                            *
+ * The above copyright notice and this permission notice shall be included in *
+ * all copies or substantial portions of the Software.                        *
+ *                                                                            *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR *
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,   *
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL    *
+ * THE AUTHORS, CONTRIBUTORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,    *
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR      *
+ * OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE  *
+ * USE OR OTHER DEALINGS IN THE SOFTWARE.                                     *
+ * -------------------------------------------------------------------------- */
+
+
+#include "CpuNonbondedForceVec.h"
+#include "SimTKOpenMMRealType.h"
+#include "openmm/internal/MSVC_erfc.h"
+#include <algorithm>
+#include <cmath>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+using namespace OpenMM;
+using namespace std;
+
+static const int NUM_TABLE_POINTS = 2048;
+
+CpuNonbondedForceVec::CpuNonbondedForceVec() : cutoff(false), periodic(false), ewald(false), ljpme(false), useSwitch(false),
+        tabulatedAlpha(0), tabulatedCutoff(0), tabulatedDispersionAlpha(0), tabulatedDispersionCutoff(0) {
+}
+
+bool CpuNonbondedForceVec::isSupported() {
+#ifdef __SSE2__
+    return true;
+#else
+    return false;
+#endif
+}
+
+void CpuNonbondedForceVec::setUseCutoff(RealOpenMM distance, RealOpenMM solventDielectric) {
+    cutoff = true;
+    periodic = false;
+    ewald = false;
+    ljpme = false;
+    useSwitch = false;
+    cutoffDistance = (float) distance;
+    krf = (float) (pow(distance, -3.0)*(solventDielectric-1.0)/(2.0*solventDielectric+1.0));
+    crf = (float) ((1.0/distance)*(3.0*solventDielectric)/(2.0*solventDielectric+1.0));
+}
+
+void CpuNonbondedForceVec::setUseSwitchingFunction(RealOpenMM distance) {
+    useSwitch = true;
+    switchingDistance = (float) distance;
+}
+
+void CpuNonbondedForceVec::setPeriodic(const RealVec& boxSize) {
+    periodic = true;
+    periodicBoxSize[0] = (float) boxSize[0];
+    periodicBoxSize[1] = (float) boxSize[1];
+    periodicBoxSize[2] = (float) boxSize[2];
+}
+
+void CpuNonbondedForceVec::setUseEwald(RealOpenMM alpha) {
+    ewald = true;
+    alphaEwald = (float) alpha;
+    if (alphaEwald != tabulatedAlpha || cutoffDistance != tabulatedCutoff)
+        tabulateErfc();
+}
+
+void CpuNonbondedForceVec::setUseLJPME(RealOpenMM alpha) {
+    ljpme = true;
+    alphaDispersionEwald = (float) alpha;
+    if (alphaDispersionEwald != tabulatedDispersionAlpha || cutoffDistance != tabulatedDispersionCutoff)
+        tabulateDispersion();
+}
+
+void CpuNonbondedForceVec::tabulateErfc() {
+    // Each interval of the table holds the coefficients of a cubic polynomial in the fractional position
+    // within the interval.  They are chosen to match the value and derivative of erfc(alpha*r) at both ends
+    // (a cubic Hermite spline).  One extra interval is included so r == cutoff can be looked up safely.
+
+    tabulatedAlpha = alphaEwald;
+    tabulatedCutoff = cutoffDistance;
+    double alpha = alphaEwald;
+    double sqrtPi = sqrt(PI_M);
+    double spacing = cutoffDistance/(double) NUM_TABLE_POINTS;
+    erfcTableScale = (float) (1.0/spacing);
+    erfcTable.resize(4*(NUM_TABLE_POINTS+1));
+    for (int i = 0; i <= NUM_TABLE_POINTS; i++) {
+        double r1 = i*spacing;
+        double r2 = (i+1)*spacing;
+        double g1 = erfc(alpha*r1);
+        double g2 = erfc(alpha*r2);
+        double d1 = -spacing*2*alpha*exp(-alpha*alpha*r1*r1)/sqrtPi;
+        double d2 = -spacing*2*alpha*exp(-alpha*alpha*r2*r2)/sqrtPi;
+        erfcTable[4*i] = (float) g1;
+        erfcTable[4*i+1] = (float) d1;
+        erfcTable[4*i+2] = (float) (3*(g2-g1)-2*d1-d2);
+        erfcTable[4*i+3] = (float) (2*(g1-g2)+d1+d2);
+    }
+}
+
+void CpuNonbondedForceVec::tabulateDispersion() {
+    // This uses the same cubic Hermite spline as tabulateErfc().  The tabulated function is the fraction of the
+    // r^-6 interaction included in reciprocal space, g(r) = 1-exp(-x)*(1+x+x^2/2) with x = (alpha*r)^2.
+
+    tabulatedDispersionAlpha = alphaDispersionEwald;
+    tabulatedDispersionCutoff = cutoffDistance;
+    double alpha2 = alphaDispersionEwald*alphaDispersionEwald;
+    double alpha6 = alpha2*alpha2*alpha2;
+    double spacing = cutoffDistance/(double) NUM_TABLE_POINTS;
+    dispersionTableScale = (float) (1.0/spacing);
+    dispersionTable.resize(4*(NUM_TABLE_POINTS+1));
+    for (int i = 0; i <= NUM_TABLE_POINTS; i++) {
+        double r1 = i*spacing;
+        double r2 = (i+1)*spacing;
+        double x1 = alpha2*r1*r1;
+        double x2 = alpha2*r2*r2;
+        double g1 = 1-exp(-x1)*(1+x1+0.5*x1*x1);
+        double g2 = 1-exp(-x2)*(1+x2+0.5*x2*x2);
+        double d1 = spacing*alpha6*pow(r1, 5.0)*exp(-x1);
+        double d2 = spacing*alpha6*pow(r2, 5.0)*exp(-x2);
+        dispersionTable[4*i] = (float) g1;
+        dispersionTable[4*i+1] = (float) d1;
+        dispersionTable[4*i+2] = (float) (3*(g2-g1)-2*d1-d2);
+        dispersionTable[4*i+3] = (float) (2*(g1-g2)+d1+d2);
+    }
+}
+
+void CpuNonbondedForceVec::setNeighborList(int numberOfAtoms, const NeighborList& neighbors, int numThreads) {
+    // Store the neighbors of each atom in compressed row format.
+
+    neighborStart.assign(numberOfAtoms+1, 0);
+    for (int i = 0; i < (int) neighbors.size(); i++)
+        neighborStart[neighbors[i].first+1]++;
+    for (int i = 0; i < numberOfAtoms; i++)
+        neighborStart[i+1] += neighborStart[i];
+    this->neighbors.resize(neighbors.size());
+    vector<int> offset(neighborStart.begin(), neighborStart.end()-1);
+    for (int i = 0; i < (int) neighbors.size(); i++)
+        this->neighbors[offset[neighbors[i].first]++] = neighbors[i].second;
+
+    // Give each thread a contiguous block of atoms with roughly the same number of neighbors.
+
+    threadAtomStart.resize(numThreads+1);
+    threadAtomStart[0] = 0;
+    int atom = 0;
+    for (int i = 1; i < numThreads; i++) {
+        int target = (int) ((i*(long long) neighbors.size())/numThreads);
+        while (atom < numberOfAtoms && neighborStart[atom] < target)
+            atom++;
+        threadAtomStart[i] = atom;
+    }
+    threadAtomStart[numThreads] = numberOfAtoms;
+}
+
+void CpuNonbondedForceVec::setAtomData(const vector<RealVec>& atomCoordinates, RealOpenMM** atomParameters) {
+    int numAtoms = atomCoordinates.size();
+    posX.resize(numAtoms);
+    posY.resize(numAtoms);
+    posZ.resize(numAtoms);
+    charge.resize(numAtoms);
+    sigma.resize(numAtoms);
+    epsilon.resize(numAtoms);
+    c6.resize(numAtoms);
+    for (int i = 0; i < numAtoms; i++) {
+        RealVec pos = atomCoordinates[i];
+        if (periodic) {
+            // Translate into the first periodic box so single precision does not lose accuracy.
+
+            for (int j = 0; j < 3; j++)
+                pos[j] -= floor(pos[j]/periodicBoxSize[j])*periodicBoxSize[j];
+        }
+        posX[i] = (float) pos[0];
+        posY[i] = (float) pos[1];
+        posZ[i] = (float) pos[2];
+        sigma[i] = (float) atomParameters[i][0];
+        epsilon[i] = (float) atomParameters[i][1];
+        charge[i] = (float) atomParameters[i][2];
+
+        // The LJPME reciprocal space sum uses geometric combining rules, so each atom has its own dispersion
+        // coefficient and the coefficient for a pair is their product.
+
+        double halfSigma = atomParameters[i][0];
+        c6[i] = (float) (8*atomParameters[i][1]*halfSigma*halfSigma*halfSigma);
+    }
+}
+
+#ifdef __SSE2__
+/**
+ * Evaluate a table built by tabulateErfc() or tabulateDispersion() for four distances, returning the value
+ * of the tabulated function and its derivative with respect to r.
+ */
+static inline void evaluateTable(const float* table, __m128 r, __m128 maxR, __m128 scale, __m128& value, __m128& deriv) {
+    __m128 x = _mm_mul_ps(_mm_min_ps(r, maxR), scale);
+    __m128i index = _mm_cvttps_epi32(x);
+    __m128 frac = _mm_sub_ps(x, _mm_cvtepi32_ps(index));
+    int indices[4];
+    _mm_storeu_si128((__m128i*) indices, index);
+    __m128 c0 = _mm_loadu_ps(&table[4*indices[0]]);
+    __m128 c1 = _mm_loadu_ps(&table[4*indices[1]]);
+    __m128 c2 = _mm_loadu_ps(&table[4*indices[2]]);
+    __m128 c3 = _mm_loadu_ps(&table[4*indices[3]]);
+    _MM_TRANSPOSE4_PS(c0, c1, c2, c3);
+    value = _mm_add_ps(c0, _mm_mul_ps(frac, _mm_add_ps(c1, _mm_mul_ps(frac, _mm_add_ps(c2, _mm_mul_ps(frac, c3))))));
+    deriv = _mm_mul_ps(scale, _mm_add_ps(c1, _mm_mul_ps(frac,
+            _mm_add_ps(_mm_mul_ps(_mm_set1_ps(2.0f), c2), _mm_mul_ps(_mm_set1_ps(3.0f), _mm_mul_ps(frac, c3))))));
+}
+#endif
+
+RealOpenMM CpuNonbondedForceVec::calculateDirectIxn(int threadIndex, vector<RealVec>& forces, bool includeForces, bool includeEnergy) const {
+    double totalEnergy = 0;
+#ifdef __SSE2__
+    const __m128 zero = _mm_setzero_ps();
+    const __m128 one = _mm_set1_ps(1.0f);
+    const __m128 cutoff2 = _mm_set1_ps(cutoffDistance*cutoffDistance);
+    const __m128 coulombScale = _mm_set1_ps((float) ONE_4PI_EPS0);
+    const __m128 boxSize[3] = {_mm_set1_ps(periodicBoxSize[0]), _mm_set1_ps(periodicBoxSize[1]), _mm_set1_ps(periodicBoxSize[2])};
+    const __m128 invBoxSize[3] = {_mm_set1_ps(1.0f/periodicBoxSize[0]), _mm_set1_ps(1.0f/periodicBoxSize[1]), _mm_set1_ps(1.0f/periodicBoxSize[2])};
+    const __m128 switchStart = _mm_set1_ps(useSwitch ? switchingDistance : 0.0f);
+    const __m128 invSwitchWidth = _mm_set1_ps(useSwitch ? 1.0f/(cutoffDistance-switchingDistance) : 0.0f);
+    const __m128 krfVec = _mm_set1_ps(krf);
+    const __m128 crfVec = _mm_set1_ps(crf);
+    const __m128 tableScale = _mm_set1_ps(ewald ? erfcTableScale : 0.0f);
+    const __m128 dispersionScale = _mm_set1_ps(ljpme ? dispersionTableScale : 0.0f);
+    const __m128 maxTableR = _mm_set1_ps(cutoffDistance);
+    const __m128i validMask[5] = {_mm_set_epi32(0, 0, 0, 0), _mm_set_epi32(0, 0, 0, -1), _mm_set_epi32(0, 0, -1, -1),
+            _mm_set_epi32(0, -1, -1, -1), _mm_set_epi32(-1, -1, -1, -1)};
+    const float* table = (ewald ? &erfcTable[0] : NULL);
+    const float* dispersionTableData = (ljpme ? &dispersionTable[0] : NULL);
+    for (int i = threadAtomStart[threadIndex]; i < threadAtomStart[threadIndex+1]; i++) {
+        int numNeighbors = neighborStart[i+1]-neighborStart[i];
+        if (numNeighbors == 0)
+            continue;
+        const int* atomNeighbors = &neighbors[neighborStart[i]];
+        const __m128 xi = _mm_set1_ps(posX[i]);
+        const __m128 yi = _mm_set1_ps(posY[i]);
+        const __m128 zi = _mm_set1_ps(posZ[i]);
+        const __m128 sigmai = _mm_set1_ps(sigma[i]);
+        const __m128 epsiloni = _mm_set1_ps(epsilon[i]);
+        const __m128 c6i = _mm_set1_ps(c6[i]);
+        const __m128 chargei = _mm_mul_ps(_mm_set1_ps(charge[i]), coulombScale);
+        __m128 fxi = zero, fyi = zero, fzi = zero, energyi = zero;
+        for (int block = 0; block < numNeighbors; block += 4) {
+            // Load the next four neighbors.  Unused lanes at the end are filled with atom i and masked out.
+
+            int numValid = min(4, numNeighbors-block);
+            int j[4];
+            for (int k = 0; k < 4; k++)
+                j[k] = (k < numValid ? atomNeighbors[block+k] : i);
+            __m128 dx = _mm_sub_ps(xi, _mm_setr_ps(posX[j[0]], posX[j[1]], posX[j[2]], posX[j[3]]));
+            __m128 dy = _mm_sub_ps(yi, _mm_setr_ps(posY[j[0]], posY[j[1]], posY[j[2]], posY[j[3]]));
+            __m128 dz = _mm_sub_ps(zi, _mm_setr_ps(posZ[j[0]], posZ[j[1]], posZ[j[2]], posZ[j[3]]));
+            if (periodic) {
+                dx = _mm_sub_ps(dx, _mm_mul_ps(boxSize[0], _mm_cvtepi32_ps(_mm_cvtps_epi32(_mm_mul_ps(dx, invBoxSize[0])))));
+                dy = _mm_sub_ps(dy, _mm_mul_ps(boxSize[1], _mm_cvtepi32_ps(_mm_cvtps_epi32(_mm_mul_ps(dy, invBoxSize[1])))));
+                dz = _mm_sub_ps(dz, _mm_mul_ps(boxSize[2], _mm_cvtepi32_ps(_mm_cvtps_epi32(_mm_mul_ps(dz, invBoxSize[2])))));
+            }
+            __m128 r2 = _mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy)), _mm_mul_ps(dz, dz));
+            __m128 include = _mm_and_ps(_mm_cmplt_ps(r2, cutoff2), _mm_castsi128_ps(validMask[numValid]));
+            if (_mm_movemask_ps(include) == 0)
+                continue;
+            __m128 r = _mm_sqrt_ps(r2);
+            __m128 invR = _mm_div_ps(one, r);
+            __m128 invR2 = _mm_mul_ps(invR, invR);
+
+            // Lennard-Jones interaction.
+
+            __m128 sig = _mm_add_ps(sigmai, _mm_setr_ps(sigma[j[0]], sigma[j[1]], sigma[j[2]], sigma[j[3]]));
+            __m128 sig2 = _mm_mul_ps(sig, invR);
+            sig2 = _mm_mul_ps(sig2, sig2);
+            __m128 sig6 = _mm_mul_ps(_mm_mul_ps(sig2, sig2), sig2);
+            __m128 eps = _mm_mul_ps(epsiloni, _mm_setr_ps(epsilon[j[0]], epsilon[j[1]], epsilon[j[2]], epsilon[j[3]]));
+            __m128 energy = _mm_mul_ps(_mm_mul_ps(eps, _mm_sub_ps(sig6, one)), sig6);
+            __m128 dEdR = _mm_mul_ps(_mm_mul_ps(eps, _mm_sub_ps(_mm_mul_ps(_mm_set1_ps(12.0f), sig6), _mm_set1_ps(6.0f))), sig6);
+            if (useSwitch) {
+                __m128 t = _mm_mul_ps(_mm_max_ps(_mm_sub_ps(r, switchStart), zero), invSwitchWidth);
+                __m128 switchValue = _mm_add_ps(one, _mm_mul_ps(_mm_mul_ps(_mm_mul_ps(t, t), t),
+                        _mm_add_ps(_mm_set1_ps(-10.0f), _mm_mul_ps(t, _mm_sub_ps(_mm_set1_ps(15.0f), _mm_mul_ps(t, _mm_set1_ps(6.0f)))))));
+                __m128 switchDeriv = _mm_mul_ps(_mm_mul_ps(_mm_mul_ps(t, t), invSwitchWidth),
+                        _mm_add_ps(_mm_set1_ps(-30.0f), _mm_mul_ps(t, _mm_sub_ps(_mm_set1_ps(60.0f), _mm_mul_ps(t, _mm_set1_ps(30.0f))))));
+                dEdR = _mm_sub_ps(_mm_mul_ps(dEdR, switchValue), _mm_mul_ps(_mm_mul_ps(energy, switchDeriv), r));
+                energy = _mm_mul_ps(energy, switchValue);
+            }
+            if (ljpme) {
+                // Remove the part of the dispersion interaction that was included in reciprocal space.
+
+                __m128 g, gDeriv;
+                evaluateTable(dispersionTableData, r, maxTableR, dispersionScale, g, gDeriv);
+                __m128 dispersion = _mm_mul_ps(_mm_mul_ps(c6i, _mm_setr_ps(c6[j[0]], c6[j[1]], c6[j[2]], c6[j[3]])), _mm_mul_ps(_mm_mul_ps(invR2, invR2), invR2));
+                dEdR = _mm_add_ps(dEdR, _mm_mul_ps(dispersion, _mm_sub_ps(_mm_mul_ps(_mm_set1_ps(6.0f), g), _mm_mul_ps(r, gDeriv))));
+                energy = _mm_add_ps(energy, _mm_mul_ps(dispersion, g));
+            }
+
+            // Coulomb interaction.
+
+            __m128 qq = _mm_mul_ps(chargei, _mm_setr_ps(charge[j[0]], charge[j[1]], charge[j[2]], charge[j[3]]));
+            if (ewald) {
+                __m128 erfcValue, erfcDeriv;
+                evaluateTable(table, r, maxTableR, tableScale, erfcValue, erfcDeriv);
+                __m128 coulomb = _mm_mul_ps(qq, invR);
+                dEdR = _mm_add_ps(dEdR, _mm_mul_ps(coulomb, _mm_sub_ps(erfcValue, _mm_mul_ps(r, erfcDeriv))));
+                energy = _mm_add_ps(energy, _mm_mul_ps(coulomb, erfcValue));
+            }
+            else {
+                dEdR = _mm_add_ps(dEdR, _mm_mul_ps(qq, _mm_sub_ps(invR, _mm_mul_ps(_mm_mul_ps(_mm_set1_ps(2.0f), krfVec), r2))));
+                energy = _mm_add_ps(energy, _mm_mul_ps(qq, _mm_sub_ps(_mm_add_ps(invR, _mm_mul_ps(krfVec, r2)), crfVec)));
+            }
+            dEdR = _mm_and_ps(_mm_mul_ps(dEdR, invR2), include);
+            if (includeEnergy)
+                energyi = _mm_add_ps(energyi, _mm_and_ps(energy, include));
+            if (!includeForces)
+                continue;
+
+            // Accumulate the forces.
+
+            __m128 fx = _mm_mul_ps(dEdR, dx);
+            __m128 fy = _mm_mul_ps(dEdR, dy);
+            __m128 fz = _mm_mul_ps(dEdR, dz);
+            fxi = _mm_add_ps(fxi, fx);
+            fyi = _mm_add_ps(fyi, fy);
+            fzi = _mm_add_ps(fzi, fz);
+            float fjx[4], fjy[4], fjz[4];
+            _mm_storeu_ps(fjx, fx);
+            _mm_storeu_ps(fjy, fy);
+            _mm_storeu_ps(fjz, fz);
+            for (int k = 0; k < numValid; k++) {
+                RealVec& f = forces[j[k]];
+                f[0] -= fjx[k];
+                f[1] -= fjy[k];
+                f[2] -= fjz[k];
+            }
+        }
+        float sum[4];
+        if (includeForces) {
+            _mm_storeu_ps(sum, fxi);
+            forces[i][0] += sum[0]+sum[1]+sum[2]+sum[3];
+            _mm_storeu_ps(sum, fyi);
+            forces[i][1] += sum[0]+sum[1]+sum[2]+sum[3];
+            _mm_storeu_ps(sum, fzi);
+            forces[i][2] += sum[0]+sum[1]+sum[2]+sum[3];
+        }
+        if (includeEnergy) {
+            _mm_storeu_ps(sum, energyi);
+            totalEnergy += sum[0]+sum[1]+sum[2]+sum[3];
+        }
+    }
+#endif
+    return (RealOpenMM) totalEnergy;
+}
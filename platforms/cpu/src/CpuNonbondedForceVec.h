@@ -0,0 +1,123 @@
+#ifndef OPENMM_CPUNONBONDEDFORCEVEC_H_
+#define OPENMM_CPUNONBONDEDFORCEVEC_H_
+
+/* -------------------------------------------------------------------------- *
+ *                                   OpenMM                                   *
+ * -------------------------------------------------------------------------- *
+ * This is part of the OpenMM molecular simulation toolkit originating from   *
+ * Simbios, the NIH National Center for Physics-Based Simulation of           *
+ * Biological Structures at Stanford, funded under the NIH Roadmap for        *
+ * Medical Research, grant U54 GM072970. See https://simtk.org.               *
+ *                                                                            *
+ * Portions copyright (c) 2013 Stanford University and the Authors.           *
+ * Authors: Peter Eastman                                                     *
+ * Contributors:                                                              *
+ *                                                                            *
+ * Permission is hereby granted, free of charge, to any person obtaining a    *
+ * copy of this software and associated documentation files (the "Software"), *
+ * to deal in the Software without restriction, including without limitation  *
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,   *
+ * and/or sell copies of the Software, and to permit persons to whom the      *
+ * Software is furnished to do so, subject to the following conditions:       *
+ *                                                                            *
+ * The above copyright notice and this permission notice shall be included in *
+ * all copies or substantial portions of the Software.                        *
+ *                                                                            *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR *
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,   *
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL    *
+ * THE AUTHORS, CONTRIBUTORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,    *
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR      *
+ * OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE  *
+ * USE OR OTHER DEALINGS IN THE SOFTWARE.                                     *
+ * -------------------------------------------------------------------------- */
+
+#include "ReferenceNeighborList.h"
+#include "RealVec.h"
+#include <vector>
+
+namespace OpenMM {
+
+/**
+ * This class computes the direct space part of NonbondedForce with SIMD instructions.  Coordinates
+ * and parameters are converted to single precision arrays, and each atom is processed together
+ * with four of its neighbors at a time.  For Ewald and PME, erfc(alpha*r) is evaluated from a
+ * cubic spline table rather than by calling erfc() for every pair.  The same is done for the
+ * fraction of the dispersion interaction that LJPME includes in reciprocal space.
+ *
+ * Only interactions in the neighbor list are computed.  The exclusion corrections needed by Ewald,
+ * PME, and LJPME must be computed separately.
+ */
+
+class CpuNonbondedForceVec {
+public:
+    CpuNonbondedForceVec();
+    /**
+     * Get whether SIMD instructions are available in this build.  If not, this class cannot be used.
+     */
+    static bool isSupported();
+    /**
+     * Set the cutoff distance.  Unless Ewald summation is enabled, reaction field is used for Coulomb interactions.
+     *
+     * @param distance            the cutoff distance
+     * @param solventDielectric   the dielectric constant of the bulk solvent
+     */
+    void setUseCutoff(RealOpenMM distance, RealOpenMM solventDielectric);
+    /**
+     * Set the distance at which the switching function for Lennard-Jones interactions begins.
+     */
+    void setUseSwitchingFunction(RealOpenMM distance);
+    /**
+     * Set the periodic box size.  This must be called after setUseCutoff().
+     */
+    void setPeriodic(const RealVec& boxSize);
+    /**
+     * Use Ewald summation for Coulomb interactions.  This is also used for the direct space part of PME.
+     * This must be called after setUseCutoff().
+     *
+     * @param alpha   the Ewald separation parameter
+     */
+    void setUseEwald(RealOpenMM alpha);
+    /**
+     * Use Ewald summation for the dispersion part of the Lennard-Jones interaction (LJPME).  The part of it
+     * included in reciprocal space is subtracted, so the full Lennard-Jones interaction is computed within
+     * the cutoff.  This must be called after setUseEwald().
+     *
+     * @param alpha   the dispersion Ewald separation parameter
+     */
+    void setUseLJPME(RealOpenMM alpha);
+    /**
+     * Set the neighbor list, and divide its atoms between threads.  This only needs to be called when the
+     * neighbor list changes.
+     */
+    void setNeighborList(int numberOfAtoms, const NeighborList& neighbors, int numThreads);
+    /**
+     * Record the current coordinates and parameters of all atoms.  This must be called before calculateDirectIxn().
+     */
+    void setAtomData(const std::vector<RealVec>& atomCoordinates, RealOpenMM** atomParameters);
+    /**
+     * Compute the interactions assigned to one thread.
+     *
+     * @param threadIndex    the index of the thread
+     * @param forces         forces are added to this array
+     * @param includeForces  whether to compute the forces
+     * @param includeEnergy  whether to compute the energy
+     * @return the energy of the interactions computed by this thread
+     */
+    RealOpenMM calculateDirectIxn(int threadIndex, std::vector<RealVec>& forces, bool includeForces, bool includeEnergy) const;
+private:
+    void tabulateErfc();
+    void tabulateDispersion();
+    bool cutoff, periodic, ewald, ljpme, useSwitch;
+    float cutoffDistance, switchingDistance, krf, crf, alphaEwald, alphaDispersionEwald;
+    float periodicBoxSize[3];
+    float tabulatedAlpha, tabulatedCutoff, erfcTableScale;
+    float tabulatedDispersionAlpha, tabulatedDispersionCutoff, dispersionTableScale;
+    std::vector<float> erfcTable, dispersionTable;
+    std::vector<float> posX, posY, posZ, charge, sigma, epsilon, c6;
+    std::vector<int> threadAtomStart, neighborStart, neighbors;
+};
+
+} // namespace OpenMM
+
+#endif /*OPENMM_CPUNONBONDEDFORCEVEC_H_*/
@@ -0,0 +1,182 @@
+/* -------------------------------------------------------------------------- *
+ *                                   OpenMM                                   *
+ * -------------------------------------------------------------------------- *
+ * This is part of the OpenMM molecular simulation toolkit originating from   *
+ * Simbios, the NIH National Center for Physics-Based Simulation of           *
+ * Biological Structures at Stanford, funded under the NIH Roadmap for        *
+ * Medical Research, grant U54 GM072970. See https://simtk.org.               *
+ *                                                                            *
+ * Portions copyright (c) 2013 Stanford University and the Authors.           *
+ * Authors: Peter Eastman                                                     *
+ * Contributors:                                                              *
+ *                                                                            *
+ * Permission is hereby granted, free of charge, to any person obtaining a    *
+ * copy of this software and associated documentation files (the "Software"), *
+ * to deal in the Software without restriction, including without limitation  *
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,   *
+ * and/or sell copies of the Software, and to permit persons to whom the      *
+ * Software is furnished to do so, subject to the following conditions:       *
+ *                                                                            *
+ * The above copyright notice and this permission notice shall be included in *
+ * all copies or substantial portions of the Software.                        *
+ *                                                                            *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR *
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,   *
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL    *
+ * THE AUTHORS, CONTRIBUTORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,    *
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR      *
+ * OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE  *
+ * USE OR OTHER DEALINGS IN THE SOFTWARE.                                     *
+ * -------------------------------------------------------------------------- */
+
+#include "CpuPlatform.h"
+#include "CpuKernelFactory.h"
+#include "CpuKernels.h"
+#include "CpuNonbondedForceVec.h"
+#include "openmm/OpenMMException.h"
+#include "openmm/internal/ContextImpl.h"
+#include <pthread.h>
+#include <sstream>
+
+using namespace OpenMM;
+using namespace std;
+
+map<const ContextImpl*, CpuPlatform::PlatformData*> CpuPlatform::contextData;
+
+// Contexts may be created and destroyed on different threads, so every access to contextData must hold this lock.
+
+static pthread_mutex_t contextDataLock = PTHREAD_MUTEX_INITIALIZER;
+
+extern "C" OPENMM_EXPORT_CPU void registerPlatforms() {
+    Platform::registerPlatform(new CpuPlatform());
+}
+
+CpuPlatform::CpuPlatform() {
+    CpuKernelFactory* factory = new CpuKernelFactory();
+    registerKernelFactory(CalcForcesAndEnergyKernel::Name(), factory);
+    registerKernelFactory(CalcHarmonicBondForceKernel::Name(), factory);
+    registerKernelFactory(CalcHarmonicAngleForceKernel::Name(), factory);
+    registerKernelFactory(CalcPeriodicTorsionForceKernel::Name(), factory);
+    registerKernelFactory(CalcRBTorsionForceKernel::Name(), factory);
+    registerKernelFactory(CalcNonbondedForceKernel::Name(), factory);
+    registerKernelFactory(CalcGBSAOBCForceKernel::Name(), factory);
+    registerKernelFactory(IntegrateVerletStepKernel::Name(), factory);
+    registerKernelFactory(IntegrateCustomStepKernel::Name(), factory);
+    platformProperties.push_back(CpuThreads());
+    stringstream threads;
+    threads << ThreadPool::getNumProcessors();
+    setPropertyDefaultValue(CpuThreads(), threads.str());
+    platformProperties.push_back(CpuVectorizeNonbonded());
+    setPropertyDefaultValue(CpuVectorizeNonbonded(), CpuNonbondedForceVec::isSupported() ? "true" : "false");
+    setPropertyDefaultValue(ReferenceUseCpuPme(), "true");
+}
+
+static int parseThreads(const string& value) {
+    int threads = 0;
+    stringstream(value) >> threads;
+    if (threads < 1)
+        throw OpenMMException("Illegal value for CpuThreads: "+value);
+    return threads;
+}
+
+static bool parseVectorize(const string& value) {
+    if (value == "true")
+        return true;
+    if (value == "false")
+        return false;
+    throw OpenMMException("Illegal value for CpuVectorizeNonbonded: "+value);
+}
+
+double CpuPlatform::getSpeed() const {
+    return 10;
+}
+
+const string& CpuPlatform::getPropertyValue(const Context& context, const string& property) const {
+    const ContextImpl& impl = getContextImpl(context);
+    const PlatformData& data = getPlatformData(const_cast<ContextImpl&>(impl));
+    map<string, string>::const_iterator value = data.propertyValues.find(property);
+    if (value != data.propertyValues.end())
+        return value->second;
+    return ReferencePlatform::getPropertyValue(context, property);
+}
+
+void CpuPlatform::contextCreated(ContextImpl& context, const map<string, string>& properties) const {
+    ReferencePlatform::contextCreated(context, properties);
+    const string& threadsPropValue = (properties.find(CpuThreads()) == properties.end() ?
+            getPropertyDefaultValue(CpuThreads()) : properties.find(CpuThreads())->second);
+    const string& vectorizePropValue = (properties.find(CpuVectorizeNonbonded()) == properties.end() ?
+            getPropertyDefaultValue(CpuVectorizeNonbonded()) : properties.find(CpuVectorizeNonbonded())->second);
+    bool vectorize = parseVectorize(vectorizePropValue);
+    if (vectorize && !CpuNonbondedForceVec::isSupported())
+        throw OpenMMException("CpuVectorizeNonbonded is not supported by this build");
+    PlatformData* data = new PlatformData(context.getSystem().getNumParticles(), parseThreads(threadsPropValue), vectorize);
+    pthread_mutex_lock(&contextDataLock);
+    contextData[&context] = data;
+    pthread_mutex_unlock(&contextDataLock);
+}
+
+void CpuPlatform::contextDestroyed(ContextImpl& context) const {
+    pthread_mutex_lock(&contextDataLock);
+    PlatformData* data = contextData[&context];
+    contextData.erase(&context);
+    pthread_mutex_unlock(&contextDataLock);
+    delete data;
+    ReferencePlatform::contextDestroyed(context);
+}
+
+CpuPlatform::PlatformData& CpuPlatform::getPlatformData(ContextImpl& context) {
+    pthread_mutex_lock(&contextDataLock);
+    PlatformData* data = contextData[&context];
+    pthread_mutex_unlock(&contextDataLock);
+    return *data;
+}
+
+class CpuClearForcesTask : public ThreadPool::Task {
+public:
+    CpuClearForcesTask(vector<vector<RealVec> >& threadForce) : threadForce(threadForce) {
+    }
+    void execute(ThreadPool& threads, int threadIndex) {
+        vector<RealVec>& f = threadForce[threadIndex];
+        for (int i = 0; i < (int) f.size(); i++)
+            f[i] = RealVec();
+    }
+    vector<vector<RealVec> >& threadForce;
+};
+
+class CpuSumForcesTask : public ThreadPool::Task {
+public:
+    CpuSumForcesTask(vector<vector<RealVec> >& threadForce, vector<RealVec>& forces) : threadForce(threadForce), forces(forces) {
+    }
+    void execute(ThreadPool& threads, int threadIndex) {
+        // Each thread sums a contiguous block of atoms over all the buffers.
+
+        int numThreads = threads.getNumThreads();
+        int start = (threadIndex*forces.size())/numThreads;
+        int end = ((threadIndex+1)*forces.size())/numThreads;
+        for (int j = 0; j < numThreads; j++) {
+            vector<RealVec>& f = threadForce[j];
+            for (int i = start; i < end; i++)
+                forces[i] += f[i];
+        }
+    }
+    vector<vector<RealVec> >& threadForce;
+    vector<RealVec>& forces;
+};
+
+CpuPlatform::PlatformData::PlatformData(int numParticles, int numThreads, bool vectorizeNonbonded) : threads(numThreads),
+        threadForce(numThreads, vector<RealVec>(numParticles)), threadEnergy(numThreads), vectorizeNonbonded(vectorizeNonbonded) {
+    stringstream threadsString;
+    threadsString << numThreads;
+    propertyValues[CpuPlatform::CpuThreads()] = threadsString.str();
+    propertyValues[CpuPlatform::CpuVectorizeNonbonded()] = (vectorizeNonbonded ? "true" : "false");
+}
+
+void CpuPlatform::PlatformData::clearThreadForces() {
+    CpuClearForcesTask task(threadForce);
+    threads.execute(task);
+}
+
+void CpuPlatform::PlatformData::sumThreadForces(vector<RealVec>& forces) {
+    CpuSumForcesTask task(threadForce, forces);
+    threads.execute(task);
+}
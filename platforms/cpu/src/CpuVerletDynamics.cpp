@@ -0,0 +1,100 @@
+/* -------------------------------------------------------------------------- *
+ *                                   OpenMM                                   *
+ * -------------------------------------------------------------------------- *
+ * This is part of the OpenMM molecular simulation toolkit originating from   *
+ * Simbios, the NIH National Center for Physics-Based Simulation of           *
+ * Biological Structures at Stanford, funded under the NIH Roadmap for        *
+ * Medical Research, grant U54 GM072970. See https://simtk.org.               *
+ *                                                                            *
+ * Portions copyright (c) 2013 Stanford University and the Authors.           *
+ * Authors: Peter Eastman                                                     *
+ * Contributors:                                                              *
+ *                                                                            *
+ * Permission is hereby granted, free of charge, to any person obtaining a    *
+ * copy of this software and associated documentation files (the "Software"), *
+ * to deal in the Software without restriction, including without limitation  *
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,   *
+ * and/or sell copies of the Software, and to permit persons to whom the      *
+ * Software is furnished to do so, subject to the following conditions:       *
+ *                                                                            *
+ * The above copyright notice and this permission notice shall be included in *
+ * all copies or substantial portions of the Software.                        *
+ *                                                                            *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR *
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,   *
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL    *
+ * THE AUTHORS, CONTRIBUTORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,    *
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR      *
+ * OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE  *
+ * USE OR OTHER DEALINGS IN THE SOFTWARE.                                     *
+ * -------------------------------------------------------------------------- */
+
+#include "CpuVerletDynamics.h"
+#include "ReferenceConstraintAlgorithm.h"
+#include "ReferenceVirtualSites.h"
+
+using namespace OpenMM;
+using namespace std;
+
+class CpuVerletDynamics::UpdateTask : public ThreadPool::Task {
+public:
+    UpdateTask(vector<RealVec>& atomCoordinates, vector<RealVec>& velocities, vector<RealVec>& forces,
+            vector<RealVec>& xPrime, vector<RealOpenMM>& inverseMasses, RealOpenMM deltaT) : atomCoordinates(atomCoordinates),
+            velocities(velocities), forces(forces), xPrime(xPrime), inverseMasses(inverseMasses), deltaT(deltaT), stage(0) {
+    }
+    void execute(ThreadPool& threads, int threadIndex) {
+        int numAtoms = atomCoordinates.size();
+        int start = (threadIndex*numAtoms)/threads.getNumThreads();
+        int end = ((threadIndex+1)*numAtoms)/threads.getNumThreads();
+        if (stage == 0) {
+            // Compute the unconstrained positions.
+
+            for (int i = start; i < end; i++)
+                if (inverseMasses[i] != 0)
+                    for (int j = 0; j < 3; j++) {
+                        velocities[i][j] += inverseMasses[i]*forces[i][j]*deltaT;
+                        xPrime[i][j] = atomCoordinates[i][j]+velocities[i][j]*deltaT;
+                    }
+        }
+        else {
+            // Update the positions and velocities from the constrained positions.
+
+            RealOpenMM velocityScale = 1/deltaT;
+            for (int i = start; i < end; i++)
+                if (inverseMasses[i] != 0)
+                    for (int j = 0; j < 3; j++) {
+                        velocities[i][j] = velocityScale*(xPrime[i][j]-atomCoordinates[i][j]);
+                        atomCoordinates[i][j] = xPrime[i][j];
+                    }
+        }
+    }
+    vector<RealVec>& atomCoordinates;
+    vector<RealVec>& velocities;
+    vector<RealVec>& forces;
+    vector<RealVec>& xPrime;
+    vector<RealOpenMM>& inverseMasses;
+    RealOpenMM deltaT;
+    int stage;
+};
+
+CpuVerletDynamics::CpuVerletDynamics(int numberOfAtoms, RealOpenMM deltaT, CpuPlatform::PlatformData& data) :
+        ReferenceVerletDynamics(numberOfAtoms, deltaT), data(data) {
+}
+
+void CpuVerletDynamics::update(const System& system, vector<RealVec>& atomCoordinates,
+        vector<RealVec>& velocities, vector<RealVec>& forces, vector<RealOpenMM>& masses) {
+    int numberOfAtoms = system.getNumParticles();
+    if (getTimeStep() == 0) {
+        for (int i = 0; i < numberOfAtoms; i++)
+            inverseMasses[i] = (masses[i] == 0 ? 0 : 1/masses[i]);
+    }
+    UpdateTask task(atomCoordinates, velocities, forces, xPrime, inverseMasses, getDeltaT());
+    data.threads.execute(task);
+    ReferenceConstraintAlgorithm* constraints = getReferenceConstraintAlgorithm();
+    if (constraints)
+        constraints->apply(numberOfAtoms, atomCoordinates, xPrime, inverseMasses);
+    task.stage = 1;
+    data.threads.execute(task);
+    ReferenceVirtualSites::computePositions(system, atomCoordinates);
+    incrementTimeStep();
+}
@@ -0,0 +1,73 @@
+#ifndef OPENMM_CPUVERLETDYNAMICS_H_
+#define OPENMM_CPUVERLETDYNAMICS_H_
+
+/* -------------------------------------------------------------------------- *
+ *                                   OpenMM                                   *
+ * -------------------------------------------------------------------------- *
+ * This is part of the OpenMM molecular simulation toolkit originating from   *
+ * Simbios, the NIH National Center for Physics-Based Simulation of           *
+ * Biological Structures at Stanford, funded under the NIH Roadmap for        *
+ * Medical Research, grant U54 GM072970. See https://simtk.org.               *
+ *                                                                            *
+ * Portions copyright (c) 2013 Stanford University and the Authors.           *
+ * Authors: Peter Eastman                                                     *
+ * Contributors:                                                              *
+ *                                                                            *
+ * Permission is hereby granted, free of charge, to any person obtaining a    *
+ * copy of this software and associated documentation files (the "Software"), *
+ * to deal in the Software without restriction, including without limitation  *
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,   *
+ * and/or sell copies of the Software, and to permit persons to whom the      *
+ * Software is furnished to do so, subject to the following conditions:       *
+ *                                                                            *
+ * The above copyright notice and this permission notice shall be included in *
+ * all copies or substantial portions of the Software.                        *
+ *                                                                            *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR *
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,   *
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL    *
+ * THE AUTHORS, CONTRIBUTORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,    *
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR      *
+ * OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE  *
+ * USE OR OTHER DEALINGS IN THE SOFTWARE.                                     *
+ * -------------------------------------------------------------------------- */
+
+#include "CpuPlatform.h"
+#include "ReferenceVerletDynamics.h"
+
+namespace OpenMM {
+
+/**
+ * This class performs the same integration as ReferenceVerletDynamics, but divides the atoms
+ * between the threads of a CpuPlatform.  Constraints are still applied on a single thread.
+ */
+
+class CpuVerletDynamics : public ReferenceVerletDynamics {
+public:
+    class UpdateTask;
+    /**
+     * Create a CpuVerletDynamics.
+     *
+     * @param numberOfAtoms  number of atoms
+     * @param deltaT         delta t for dynamics
+     * @param data           the platform data for the context
+     */
+    CpuVerletDynamics(int numberOfAtoms, RealOpenMM deltaT, CpuPlatform::PlatformData& data);
+    /**
+     * Advance the positions and velocities by one time step.
+     *
+     * @param system              the System to be integrated
+     * @param atomCoordinates     atom coordinates
+     * @param velocities          velocities
+     * @param forces              forces
+     * @param masses              atom masses
+     */
+    void update(const System& system, std::vector<RealVec>& atomCoordinates,
+                std::vector<RealVec>& velocities, std::vector<RealVec>& forces, std::vector<RealOpenMM>& masses);
+private:
+    CpuPlatform::PlatformData& data;
+};
+
+} // namespace OpenMM
+
+#endif /*OPENMM_CPUVERLETDYNAMICS_H_*/
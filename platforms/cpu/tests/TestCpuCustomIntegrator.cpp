@@ -0,0 +1,146 @@
+/* -------------------------------------------------------------------------- *
+ *                                   OpenMM                                   *
+ * -------------------------------------------------------------------------- *
+ * This is part of the OpenMM molecular simulation toolkit originating from   *
+ * Simbios, the NIH National Center for Physics-Based Simulation of           *
+ * Biological Structures at Stanford, funded under the NIH Roadmap for        *
+ * Medical Research, grant U54 GM072970. See https://simtk.org.               *
+ *                                                                            *
+ * Portions copyright (c) 2013 Stanford University and the Authors.           *
+ * Authors: Peter Eastman                                                     *
+ * Contributors:                                                              *
+ *                                                                            *
+ * Permission is hereby granted, free of charge, to any person obtaining a    *
+ * copy of this software and associated documentation files (the "Software"), *
+ * to deal in the Software without restriction, including without limitation  *
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,   *
+ * and/or sell copies of the Software, and to permit persons to whom the      *
+ * Software is furnished to do so, subject to the following conditions:       *
+ *                                                                            *
+ * The above copyright notice and this permission notice shall be included in *
+ * all copies or substantial portions of the Software.                        *
+ *                                                                            *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR *
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,   *
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL    *
+ * THE AUTHORS, CONTRIBUTORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,    *
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR      *
+ * OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE  *
+ * USE OR OTHER DEALINGS IN THE SOFTWARE.                                     *
+ * -------------------------------------------------------------------------- */
+
+/**
+ * This tests the CPU implementation of CustomIntegrator by comparing trajectories to the reference platform.
+ */
+
+#include "openmm/internal/AssertionUtilities.h"
+#include "openmm/Context.h"
+#include "CpuPlatform.h"
+#include "ReferencePlatform.h"
+#include "openmm/CustomIntegrator.h"
+#include "openmm/HarmonicBondForce.h"
+#include "openmm/NonbondedForce.h"
+#include "openmm/System.h"
+#include <iostream>
+#include <map>
+#include <vector>
+
+using namespace OpenMM;
+using namespace std;
+
+CustomIntegrator* createIntegrator() {
+    CustomIntegrator* integrator = new CustomIntegrator(0.002);
+    integrator->addGlobalVariable("ke", 0.0);
+    integrator->addGlobalVariable("scale", 1.0);
+    integrator->addPerDofVariable("x1", 0.0);
+    integrator->addComputePerDof("v", "v+0.5*dt*f/m");
+    integrator->addComputePerDof("x", "x+dt*v*scale");
+    integrator->addComputePerDof("x1", "x");
+    integrator->addConstrainPositions();
+    integrator->addComputePerDof("v", "v+0.5*dt*f/m+(x-x1)/dt");
+    integrator->addConstrainVelocities();
+    integrator->addComputeSum("ke", "0.5*m*v*v");
+    integrator->addComputeGlobal("scale", "1/(1+1e-4*ke)");
+    return integrator;
+}
+
+void testConstrainedTrajectory() {
+    const int gridSize = 4;
+    const double spacing = 0.5;
+    System system;
+    system.setDefaultPeriodicBoxVectors(Vec3(gridSize*spacing, 0, 0), Vec3(0, gridSize*spacing, 0), Vec3(0, 0, gridSize*spacing));
+    NonbondedForce* nonbonded = new NonbondedForce();
+    nonbonded->setNonbondedMethod(NonbondedForce::CutoffPeriodic);
+    nonbonded->setCutoffDistance(0.9);
+    HarmonicBondForce* bonds = new HarmonicBondForce();
+    vector<Vec3> positions;
+    vector<Vec3> velocities;
+    for (int i = 0; i < gridSize; i++)
+        for (int j = 0; j < gridSize; j++)
+            for (int k = 0; k < gridSize; k++) {
+                int first = system.getNumParticles();
+                system.addParticle(10.0);
+                system.addParticle(10.0);
+                system.addParticle(i == 0 && j == 0 ? 0.0 : 1.0);
+                nonbonded->addParticle(0.2, 0.3, 0.5);
+                nonbonded->addParticle(-0.1, 0.3, 0.5);
+                nonbonded->addParticle(-0.1, 0.3, 0.5);
+                nonbonded->addException(first, first+1, 0, 1, 0);
+                nonbonded->addException(first, first+2, 0, 1, 0);
+                nonbonded->addException(first+1, first+2, 0, 1, 0);
+                system.addConstraint(first, first+1, 0.1);
+                bonds->addBond(first, first+2, 0.1, 1000.0);
+                Vec3 pos(i*spacing, j*spacing, k*spacing);
+                positions.push_back(pos);
+                positions.push_back(pos+Vec3(0.1, 0, 0));
+                positions.push_back(pos+Vec3(0, 0.1, 0));
+                velocities.push_back(Vec3(0.1*i, -0.1*j, 0.05*k));
+                velocities.push_back(Vec3(0.1*i, -0.1*j, 0.05*k));
+                velocities.push_back(Vec3(-0.2*k, 0.1, 0.1*j));
+            }
+    system.addForce(nonbonded);
+    system.addForce(bonds);
+    CustomIntegrator* integrator1 = createIntegrator();
+    CustomIntegrator* integrator2 = createIntegrator();
+    CpuPlatform cpu;
+    ReferencePlatform reference;
+    map<string, string> properties;
+    properties[CpuPlatform::CpuThreads()] = "3";
+    Context cpuContext(system, *integrator1, cpu, properties);
+    Context referenceContext(system, *integrator2, reference);
+    cpuContext.setPositions(positions);
+    cpuContext.setVelocities(velocities);
+    referenceContext.setPositions(positions);
+    referenceContext.setVelocities(velocities);
+    integrator1->step(20);
+    integrator2->step(20);
+    State cpuState = cpuContext.getState(State::Positions | State::Velocities | State::Energy);
+    State referenceState = referenceContext.getState(State::Positions | State::Velocities | State::Energy);
+    for (int i = 0; i < system.getNumParticles(); i++) {
+        ASSERT_EQUAL_VEC(referenceState.getPositions()[i], cpuState.getPositions()[i], 1e-4);
+        ASSERT_EQUAL_VEC(referenceState.getVelocities()[i], cpuState.getVelocities()[i], 1e-4);
+    }
+    ASSERT_EQUAL_VEC(positions[2], cpuState.getPositions()[2], 1e-10);
+    ASSERT_EQUAL_TOL(referenceState.getPotentialEnergy(), cpuState.getPotentialEnergy(), 1e-4);
+    ASSERT_EQUAL_TOL(referenceState.getKineticEnergy(), cpuState.getKineticEnergy(), 1e-4);
+    ASSERT_EQUAL_TOL(integrator2->getGlobalVariable(0), integrator1->getGlobalVariable(0), 1e-4);
+    vector<Vec3> cpuValues, referenceValues;
+    integrator1->getPerDofVariable(0, cpuValues);
+    integrator2->getPerDofVariable(0, referenceValues);
+    for (int i = 0; i < system.getNumParticles(); i++)
+        ASSERT_EQUAL_VEC(referenceValues[i], cpuValues[i], 1e-4);
+    delete integrator1;
+    delete integrator2;
+}
+
+int main() {
+    try {
+        testConstrainedTrajectory();
+    }
+    catch(const exception& e) {
+        cout << "exception: " << e.what() << endl;
+        return 1;
+    }
+    cout << "Done" << endl;
+    return 0;
+}
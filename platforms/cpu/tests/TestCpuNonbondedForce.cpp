@@ -0,0 +1,174 @@
+/* -------------------------------------------------------------------------- *
+ *                                   OpenMM                                   *
+ * -------------------------------------------------------------------------- *
+ * This is part of the OpenMM molecular simulation toolkit originating from   *
+ * Simbios, the NIH National Center for Physics-Based Simulation of           *
+ * Biological Structures at Stanford, funded under the NIH Roadmap for        *
+ * Medical Research, grant U54 GM072970. See https://simtk.org.               *
+ *                                                                            *
+ * Portions copyright (c) 2013 Stanford University and the Authors.           *
+ * Authors: Peter Eastman                                                     *
+ * Contributors:                                                              *
+ *                                                                            *
+ * Permission is hereby granted, free of charge, to any person obtaining a    *
+ * copy of this software and associated documentation files (the "Software"), *
+ * to deal in the Software without restriction, including without limitation  *
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,   *
+ * and/or sell copies of the Software, and to permit persons to whom the      *
+ * Software is furnished to do so, subject to the following conditions:       *
+ *                                                                            *
+ * The above copyright notice and this permission notice shall be included in *
+ * all copies or substantial portions of the Software.                        *
+ *                                                                            *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR *
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,   *
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL    *
+ * THE AUTHORS, CONTRIBUTORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,    *
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR      *
+ * OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE  *
+ * USE OR OTHER DEALINGS IN THE SOFTWARE.                                     *
+ * -------------------------------------------------------------------------- */
+
+/**
+ * This tests the CPU implementation of NonbondedForce by comparing it to the reference platform.
+ */
+
+#include "openmm/internal/AssertionUtilities.h"
+#include "openmm/Context.h"
+#include "CpuPlatform.h"
+#include "ReferencePlatform.h"
+#include "openmm/NonbondedForce.h"
+#include "openmm/System.h"
+#include "openmm/VerletIntegrator.h"
+#include "sfmt/SFMT.h"
+#include <iostream>
+#include <map>
+#include <vector>
+
+using namespace OpenMM;
+using namespace std;
+
+void compareToReference(NonbondedForce::NonbondedMethod method, const string& numThreads, const string& vectorize, bool useSwitch, double tol) {
+    const int numMolecules = 300;
+    const double boxSize = 4.0;
+    System system;
+    system.setDefaultPeriodicBoxVectors(Vec3(boxSize, 0, 0), Vec3(0, boxSize, 0), Vec3(0, 0, boxSize));
+    NonbondedForce* nonbonded = new NonbondedForce();
+    nonbonded->setNonbondedMethod(method);
+    nonbonded->setCutoffDistance(1.0);
+    nonbonded->setUseDispersionCorrection(true);
+    nonbonded->setUseSwitchingFunction(useSwitch);
+    nonbonded->setSwitchingDistance(0.8);
+    vector<Vec3> positions(2*numMolecules);
+    OpenMM_SFMT::SFMT sfmt;
+    init_gen_rand(0, sfmt);
+    for (int i = 0; i < numMolecules; i++) {
+        system.addParticle(1.0);
+        system.addParticle(1.0);
+        nonbonded->addParticle(-0.5, 0.2, 0.1);
+        nonbonded->addParticle(0.5, 0.3, 0.2);
+        positions[2*i] = Vec3(boxSize*genrand_real2(sfmt), boxSize*genrand_real2(sfmt), boxSize*genrand_real2(sfmt));
+        positions[2*i+1] = Vec3(positions[2*i][0]+0.1, positions[2*i][1], positions[2*i][2]);
+        nonbonded->addException(2*i, 2*i+1, 0.1, 0.25, 0.05);
+    }
+    system.addForce(nonbonded);
+    VerletIntegrator integrator1(0.001);
+    VerletIntegrator integrator2(0.001);
+    CpuPlatform cpu;
+    ReferencePlatform reference;
+    map<string, string> properties;
+    properties[CpuPlatform::CpuThreads()] = numThreads;
+    properties[CpuPlatform::CpuVectorizeNonbonded()] = vectorize;
+    Context cpuContext(system, integrator1, cpu, properties);
+    Context referenceContext(system, integrator2, reference);
+    ASSERT_EQUAL(properties[CpuPlatform::CpuThreads()], cpu.getPropertyValue(cpuContext, CpuPlatform::CpuThreads()));
+    ASSERT_EQUAL(vectorize, cpu.getPropertyValue(cpuContext, CpuPlatform::CpuVectorizeNonbonded()));
+    cpuContext.setPositions(positions);
+    referenceContext.setPositions(positions);
+    State cpuState = cpuContext.getState(State::Forces | State::Energy);
+    State referenceState = referenceContext.getState(State::Forces | State::Energy);
+    for (int i = 0; i < system.getNumParticles(); i++)
+        ASSERT_EQUAL_VEC(referenceState.getForces()[i], cpuState.getForces()[i], tol);
+    ASSERT_EQUAL_TOL(referenceState.getPotentialEnergy(), cpuState.getPotentialEnergy(), tol);
+
+    // Computing only the energy should give the same result, and leave the forces unchanged.
+
+    State energyState = cpuContext.getState(State::Energy);
+    ASSERT_EQUAL_TOL(cpuState.getPotentialEnergy(), energyState.getPotentialEnergy(), 1e-6);
+    State forceState = cpuContext.getState(State::Forces);
+    for (int i = 0; i < system.getNumParticles(); i++)
+        ASSERT_EQUAL_VEC(cpuState.getForces()[i], forceState.getForces()[i], 1e-6);
+}
+
+void compareLJPMEToReference(const string& numThreads, const string& vectorize, bool useSwitch, double tol) {
+    // Use uncharged particles so the dispersion terms are not hidden by much larger Coulomb interactions.
+
+    const int gridSize = 7;
+    const double spacing = 0.45;
+    const double boxSize = gridSize*spacing;
+    System system;
+    system.setDefaultPeriodicBoxVectors(Vec3(boxSize, 0, 0), Vec3(0, boxSize, 0), Vec3(0, 0, boxSize));
+    NonbondedForce* nonbonded = new NonbondedForce();
+    nonbonded->setNonbondedMethod(NonbondedForce::LJPME);
+    nonbonded->setCutoffDistance(1.0);
+    nonbonded->setUseSwitchingFunction(useSwitch);
+    nonbonded->setSwitchingDistance(0.8);
+    vector<Vec3> positions;
+    OpenMM_SFMT::SFMT sfmt;
+    init_gen_rand(0, sfmt);
+    for (int i = 0; i < gridSize; i++)
+        for (int j = 0; j < gridSize; j++)
+            for (int k = 0; k < gridSize; k++) {
+                system.addParticle(1.0);
+                nonbonded->addParticle(0.0, (positions.size()%2 == 0 ? 0.3 : 0.35), (positions.size()%3 == 0 ? 0.5 : 1.0));
+                positions.push_back(Vec3(i+0.2*genrand_real2(sfmt), j+0.2*genrand_real2(sfmt), k+0.2*genrand_real2(sfmt))*spacing);
+            }
+    for (int i = 0; i < (int) positions.size(); i += 10)
+        nonbonded->addException(i, i+1, 0.0, 0.3, 0.0);
+    system.addForce(nonbonded);
+    VerletIntegrator integrator1(0.001);
+    VerletIntegrator integrator2(0.001);
+    CpuPlatform cpu;
+    ReferencePlatform reference;
+    map<string, string> properties;
+    properties[CpuPlatform::CpuThreads()] = numThreads;
+    properties[CpuPlatform::CpuVectorizeNonbonded()] = vectorize;
+    Context cpuContext(system, integrator1, cpu, properties);
+    Context referenceContext(system, integrator2, reference);
+    cpuContext.setPositions(positions);
+    referenceContext.setPositions(positions);
+    State cpuState = cpuContext.getState(State::Forces | State::Energy);
+    State referenceState = referenceContext.getState(State::Forces | State::Energy);
+    for (int i = 0; i < system.getNumParticles(); i++)
+        ASSERT_EQUAL_VEC(referenceState.getForces()[i], cpuState.getForces()[i], tol);
+    ASSERT_EQUAL_TOL(referenceState.getPotentialEnergy(), cpuState.getPotentialEnergy(), tol);
+}
+
+int main() {
+    try {
+        compareToReference(NonbondedForce::NoCutoff, "2", "false", false, 1e-5);
+        compareToReference(NonbondedForce::CutoffNonPeriodic, "2", "false", false, 1e-5);
+        compareToReference(NonbondedForce::CutoffPeriodic, "5", "false", false, 1e-5);
+        compareToReference(NonbondedForce::Ewald, "2", "false", false, 1e-5);
+        compareToReference(NonbondedForce::PME, "5", "false", false, 1e-5);
+        compareToReference(NonbondedForce::PME, "2", "false", true, 1e-5);
+        compareLJPMEToReference("3", "false", false, 1e-5);
+
+        // The vectorized code works in single precision, so it needs a looser tolerance.
+
+        compareToReference(NonbondedForce::CutoffNonPeriodic, "2", "true", false, 1e-4);
+        compareToReference(NonbondedForce::CutoffPeriodic, "5", "true", false, 1e-4);
+        compareToReference(NonbondedForce::CutoffPeriodic, "3", "true", true, 1e-4);
+        compareToReference(NonbondedForce::Ewald, "2", "true", false, 1e-4);
+        compareToReference(NonbondedForce::PME, "5", "true", false, 1e-4);
+        compareToReference(NonbondedForce::PME, "1", "true", true, 1e-4);
+        compareLJPMEToReference("5", "true", false, 1e-4);
+        compareLJPMEToReference("2", "true", true, 1e-4);
+    }
+    catch(const exception& e) {
+        cout << "exception: " << e.what() << endl;
+        return 1;
+    }
+    cout << "Done" << endl;
+    return 0;
+}
@@ -1440,6 +1440,8 @@ static int findFFTDimension(int minimum) {
 }
 
 void CudaCalcNonbondedForceKernel::initialize(const System& system, const NonbondedForce& force) {
+    if (force.getNonbondedMethod() == NonbondedForce::LJPME)
+        throw OpenMMException("LJPME is not supported by the CUDA platform");
     cu.setAsCurrent();
 
     // Identify which exceptions are 1-4 interactions.
@@ -1412,6 +1412,8 @@ OpenCLCalcNonbondedForceKernel::~OpenCLCalcNonbondedForceKernel() {
 }
 
 void OpenCLCalcNonbondedForceKernel::initialize(const System& system, const NonbondedForce& force) {
+    if (force.getNonbondedMethod() == NonbondedForce::LJPME)
+        throw OpenMMException("LJPME is not supported by the OpenCL platform");
 
     // Identify which exceptions are 1-4 interactions.
 
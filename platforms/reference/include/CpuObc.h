@@ -46,6 +46,11 @@ class CpuObc {
 
       int _includeAceApproximation;
 
+      // flag to signal whether forces are to be computed,
+      // or only the energy
+
+      bool _includeForces;
+
 
    public:
 
@@ -109,6 +114,18 @@ class CpuObc {
 
       void setIncludeAceApproximation( int includeAceApproximation );
 
+      /**---------------------------------------------------------------------------------------
+      
+         Set whether forces are to be computed.  If this is false, computeBornEnergyForces()
+         only returns the energy: the force array is left unchanged and the Born radius
+         chain rule loop is skipped.
+      
+         @param includeForces true if forces are to be computed (the default)
+      
+         --------------------------------------------------------------------------------------- */
+
+      void setIncludeForces( bool includeForces );
+
       /**---------------------------------------------------------------------------------------
       
          Return OBC chain derivative: size = _implicitSolventParameters->getNumberOfAtoms()
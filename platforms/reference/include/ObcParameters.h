@@ -26,10 +26,11 @@
 #define __ObcParameters_H__
 
 #include "SimTKOpenMMCommon.h"
+#include "openmm/internal/windowsExport.h"
 
 // ---------------------------------------------------------------------------------------
 
-class ObcParameters {
+class OPENMM_EXPORT ObcParameters {
 
    public:
 
@@ -31,7 +31,9 @@
 
 class OPENMM_EXPORT ReferenceBondIxn {
 
-   private:
+   protected:
+
+      bool includeForces;
 
    public:
 
@@ -51,6 +53,19 @@ class OPENMM_EXPORT ReferenceBondIxn {
 
        ~ReferenceBondIxn( );
 
+      /**---------------------------------------------------------------------------------------
+      
+         Set whether forces should be computed.  If this is false, calculateBondIxn() only
+         adds to the energy and leaves the force array unchanged.
+      
+         @param include  true if forces should be computed (the default)
+      
+         --------------------------------------------------------------------------------------- */
+
+      void setIncludeForces( bool include ){
+         includeForces = include;
+      }
+
       /**---------------------------------------------------------------------------------------
       
          Calculate Bond Ixn -- virtual method
@@ -26,6 +26,7 @@
 #define __ReferenceCCMAAlgorithm_H__
 
 #include "ReferenceConstraintAlgorithm.h"
+#include "openmm/internal/ThreadPool.h"
 #include <utility>
 #include <vector>
 #include <set>
@@ -48,12 +49,34 @@ class OPENMM_EXPORT ReferenceCCMAAlgorithm : public ReferenceConstraintAlgorithm
       RealOpenMM* _distanceTolerance;
       RealOpenMM* _reducedMasses;
       bool _hasInitializedMasses;
-      std::vector<std::vector<std::pair<int, RealOpenMM> > > _matrix;
+
+      // The inverted coupling matrix in compressed sparse row format.  Constraints are
+      // ordered so that each cluster of coupled constraints occupies a contiguous range
+      // of rows, starting at _clusterStart[cluster].
+
+      std::vector<int> _matrixRowStart;
+      std::vector<int> _matrixColumn;
+      std::vector<RealOpenMM> _matrixValue;
+      std::vector<int> _clusterStart;
+      std::vector<RealOpenMM> _constraintDelta;
+      std::vector<RealOpenMM> _tempDelta;
+
+      OpenMM::ThreadPool* _threads;
+      std::vector<int> _threadClusterStart;
+      std::vector<int> _clusterIterations;
+      std::vector<char> _clusterConverged;
+      int _lastIterationCount;
+      std::vector<long long> _iterationHistory;
 
    private:
 
+      class ClusterTask;
+
       int applyConstraints(int numberOfAtoms, std::vector<OpenMM::RealVec>& atomCoordinates,
                        std::vector<OpenMM::RealVec>& atomCoordinatesP, std::vector<RealOpenMM>& inverseMasses, bool constrainingVelocities);
+
+      void applyToCluster(int cluster, std::vector<OpenMM::RealVec>& atomCoordinates,
+                       std::vector<OpenMM::RealVec>& atomCoordinatesP, std::vector<RealOpenMM>& inverseMasses, bool constrainingVelocities);
           
    public:
       class AngleInfo;
@@ -92,6 +115,58 @@ class OPENMM_EXPORT ReferenceCCMAAlgorithm : public ReferenceConstraintAlgorithm
 
       int getNumberOfConstraints( void ) const;
 
+      /**---------------------------------------------------------------------------------------
+
+         Get the number of clusters of coupled constraints.  Constraints in different
+         clusters share no atoms, so each cluster is solved independently.
+
+         @return number of clusters
+
+         --------------------------------------------------------------------------------------- */
+
+      int getNumberOfClusters( void ) const;
+
+      /**---------------------------------------------------------------------------------------
+
+         Set the thread pool used to process clusters in parallel
+
+         @param threads   the ThreadPool to use, or NULL to process clusters on the calling thread
+
+         --------------------------------------------------------------------------------------- */
+
+      void setThreadPool( OpenMM::ThreadPool* threads );
+
+      /**---------------------------------------------------------------------------------------
+
+         Get the number of iterations required by the most recent call to apply() or
+         applyToVelocities().  This is the maximum over all clusters.
+
+         @return number of iterations
+
+         --------------------------------------------------------------------------------------- */
+
+      int getLastIterationCount( void ) const;
+
+      /**---------------------------------------------------------------------------------------
+
+         Get the convergence history.  Element i is the number of calls to apply() or
+         applyToVelocities() that required i iterations.  A call that failed to converge is
+         counted under the maximum number of iterations.
+
+         @return the convergence history
+
+         --------------------------------------------------------------------------------------- */
+
+      const std::vector<long long>& getIterationHistory( void ) const;
+
+      /**---------------------------------------------------------------------------------------
+
+         Reset the convergence history
+
+         --------------------------------------------------------------------------------------- */
+
+      void resetIterationHistory( void );
+
       /**---------------------------------------------------------------------------------------
 
          Get maximum number of iterations
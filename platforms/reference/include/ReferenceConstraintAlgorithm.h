@@ -27,6 +27,8 @@
 
 #include "SimTKOpenMMCommon.h"
 #include "openmm/internal/windowsExport.h"
+#include <utility>
+#include <vector>
 
 /**
  * This abstract class defines the interface which constraint algorithms must implement.
@@ -85,6 +87,27 @@ public:
 
     virtual int applyToVelocities(int numberOfAtoms, std::vector<OpenMM::RealVec>& atomCoordinates,
                      std::vector<OpenMM::RealVec>& velocities, std::vector<RealOpenMM>& inverseMasses) = 0;
+
+protected:
+
+      /**---------------------------------------------------------------------------------------
+
+         Divide a set of constraints into clusters.  Two constraints are in the same cluster
+         if they are connected by a chain of constraints sharing atoms, so constraints in
+         different clusters can be solved independently of each other.
+
+         @param atomIndices        the atoms involved in each constraint
+         @param clusterConstraints on exit, the indices of the constraints ordered so that each
+                                   cluster is contiguous.  Within a cluster, constraints appear
+                                   in their original order.
+         @param clusterStart       on exit, the position in clusterConstraints where each cluster
+                                   begins, followed by one extra element equal to the number of
+                                   constraints
+
+         --------------------------------------------------------------------------------------- */
+
+    static void findClusters(const std::vector<std::pair<int, int> >& atomIndices, std::vector<int>& clusterConstraints,
+                     std::vector<int>& clusterStart);
 };
 
 // ---------------------------------------------------------------------------------------
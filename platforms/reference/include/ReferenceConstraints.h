@@ -0,0 +1,104 @@
+/* Portions copyright (c) 2013 Stanford University and Simbios.
+ * Contributors: Peter Eastman
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject
+ * to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS, CONTRIBUTORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef __ReferenceConstraints_H__
+#define __ReferenceConstraints_H__
+
+#include "ReferenceCCMAAlgorithm.h"
+#include "ReferenceSETTLEAlgorithm.h"
+#include "openmm/System.h"
+
+/**
+ * This class uses multiple algorithms to apply the constraints in a System.  Rigid three-site
+ * clusters such as water molecules are found automatically and constrained analytically with
+ * SETTLE.  All other constraints are handled by CCMA.
+ */
+class OPENMM_EXPORT ReferenceConstraints : public ReferenceConstraintAlgorithm {
+public:
+    /**
+     * Create a ReferenceConstraints for constraining a System.
+     *
+     * @param system     the System to constrain
+     * @param tolerance  the constraint tolerance for the iterative algorithm
+     */
+    ReferenceConstraints(const OpenMM::System& system, RealOpenMM tolerance);
+
+    ~ReferenceConstraints();
+
+    /**
+     * Get the algorithm used for clusters that are not handled by SETTLE.  This is NULL if there are none.
+     */
+    ReferenceCCMAAlgorithm* getCCMAAlgorithm() const;
+
+    /**
+     * Get the algorithm used for rigid three-site clusters.  This is NULL if there are none.
+     */
+    ReferenceSETTLEAlgorithm* getSETTLEAlgorithm() const;
+
+    /**
+     * Set the thread pool used to process independent clusters of constraints in parallel.
+     *
+     * @param threads   the ThreadPool to use, or NULL to do all work on the calling thread
+     */
+    void setThreadPool(OpenMM::ThreadPool* threads);
+
+    /**
+     * Get the constraint tolerance.
+     */
+    RealOpenMM getTolerance() const;
+
+    /**
+     * Set the constraint tolerance.
+     */
+    void setTolerance(RealOpenMM tolerance);
+
+    /**
+     * Apply the constraint algorithm.
+     *
+     * @param numberOfAtoms    number of atoms
+     * @param atomCoordinates  the original atom coordinates
+     * @param atomCoordinatesP the new atom coordinates
+     * @param inverseMasses    1/mass
+     * @return SimTKOpenMMCommon::DefaultReturn if converged; else SimTKOpenMMCommon::ErrorReturn
+     */
+    int apply(int numberOfAtoms, std::vector<OpenMM::RealVec>& atomCoordinates,
+              std::vector<OpenMM::RealVec>& atomCoordinatesP, std::vector<RealOpenMM>& inverseMasses);
+
+    /**
+     * Apply the constraint algorithm to velocities.
+     *
+     * @param numberOfAtoms    number of atoms
+     * @param atomCoordinates  the atom coordinates
+     * @param velocities       the velocities to modify
+     * @param inverseMasses    1/mass
+     * @return SimTKOpenMMCommon::DefaultReturn if converged; else SimTKOpenMMCommon::ErrorReturn
+     */
+    int applyToVelocities(int numberOfAtoms, std::vector<OpenMM::RealVec>& atomCoordinates,
+                          std::vector<OpenMM::RealVec>& velocities, std::vector<RealOpenMM>& inverseMasses);
+private:
+    ReferenceCCMAAlgorithm* ccma;
+    ReferenceSETTLEAlgorithm* settle;
+    RealOpenMM tolerance;
+};
+
+#endif // __ReferenceConstraints_H__
@@ -25,17 +25,16 @@
 #define __ReferenceCustomAngleIxn_H__
 
 #include "ReferenceBondIxn.h"
-#include "lepton/ExpressionProgram.h"
+#include "lepton/CompiledExpression.h"
 
 // ---------------------------------------------------------------------------------------
 
 class ReferenceCustomAngleIxn : public ReferenceBondIxn {
 
    private:
-      Lepton::ExpressionProgram energyExpression;
-      Lepton::ExpressionProgram forceExpression;
-      std::vector<std::string> paramNames;
-      std::map<std::string, double> globalParameters;
+      Lepton::CompiledExpression energyAndForceExpression;
+      std::vector<double*> params;
+      double* theta;
 
    public:
 
@@ -45,8 +44,7 @@ class ReferenceCustomAngleIxn : public ReferenceBondIxn {
 
          --------------------------------------------------------------------------------------- */
 
-       ReferenceCustomAngleIxn(const Lepton::ExpressionProgram& energyExpression, const Lepton::ExpressionProgram& forceExpression,
-                              const std::vector<std::string>& parameterNames, std::map<std::string, double> globalParameters);
+       ReferenceCustomAngleIxn(const Lepton::CompiledExpression& energyAndForceExpression, const std::vector<std::string>& parameterNames);
 
       /**---------------------------------------------------------------------------------------
 
@@ -56,6 +54,16 @@ class ReferenceCustomAngleIxn : public ReferenceBondIxn {
 
        ~ReferenceCustomAngleIxn( );
 
+      /**---------------------------------------------------------------------------------------
+
+         Set the values of global parameters
+
+         @param globalParameters the values of global parameters
+
+         --------------------------------------------------------------------------------------- */
+
+      void setGlobalParameters( const std::map<std::string, double>& globalParameters );
+
       /**---------------------------------------------------------------------------------------
 
          Calculate Custom Angle Ixn
@@ -26,17 +26,20 @@
 #define __ReferenceCustomBondIxn_H__
 
 #include "ReferenceBondIxn.h"
-#include "lepton/ExpressionProgram.h"
+#include "lepton/CompiledExpression.h"
 
 // ---------------------------------------------------------------------------------------
 
 class ReferenceCustomBondIxn : public ReferenceBondIxn {
 
    private:
-      Lepton::ExpressionProgram energyExpression;
-      Lepton::ExpressionProgram forceExpression;
+      Lepton::CompiledExpression energyExpression;
+      Lepton::CompiledExpression forceExpression;
       std::vector<std::string> paramNames;
-      std::map<std::string, double> globalParameters;
+      std::vector<double*> energyParams;
+      std::vector<double*> forceParams;
+      double* energyR;
+      double* forceR;
 
    public:
 
@@ -46,8 +49,8 @@ class ReferenceCustomBondIxn : public ReferenceBondIxn {
 
          --------------------------------------------------------------------------------------- */
 
-       ReferenceCustomBondIxn(const Lepton::ExpressionProgram& energyExpression, const Lepton::ExpressionProgram& forceExpression,
-                              const std::vector<std::string>& parameterNames, std::map<std::string, double> globalParameters);
+       ReferenceCustomBondIxn(const Lepton::CompiledExpression& energyExpression, const Lepton::CompiledExpression& forceExpression,
+                              const std::vector<std::string>& parameterNames);
 
       /**---------------------------------------------------------------------------------------
 
@@ -57,6 +60,16 @@ class ReferenceCustomBondIxn : public ReferenceBondIxn {
 
        ~ReferenceCustomBondIxn( );
 
+      /**---------------------------------------------------------------------------------------
+
+         Set the values of global parameters
+
+         @param globalParameters the values of global parameters
+
+         --------------------------------------------------------------------------------------- */
+
+      void setGlobalParameters( const std::map<std::string, double>& globalParameters );
+
       /**---------------------------------------------------------------------------------------
 
          Calculate Custom Bond Ixn
@@ -73,6 +86,24 @@ class ReferenceCustomBondIxn : public ReferenceBondIxn {
                             RealOpenMM* parameters, std::vector<OpenMM::RealVec>& forces,
                             RealOpenMM* totalEnergy ) const;
 
+      /**---------------------------------------------------------------------------------------
+
+         Calculate Custom Bond Ixn for a set of bonds, evaluating the energy and force
+         expressions for all of them in a single batch
+
+         @param numberOfBonds    number of bonds
+         @param atomIndices      two bond indices for each bond
+         @param atomCoordinates  atom coordinates
+         @param parameters       parameter values for each bond
+         @param forces           force array (forces added)
+         @param totalEnergy      if not null, the energy will be added to this
+
+         --------------------------------------------------------------------------------------- */
+
+      void calculateBondIxns( int numberOfBonds, int** atomIndices, std::vector<OpenMM::RealVec>& atomCoordinates,
+                              RealOpenMM** parameters, std::vector<OpenMM::RealVec>& forces,
+                              RealOpenMM* totalEnergy ) const;
+
 
 };
 
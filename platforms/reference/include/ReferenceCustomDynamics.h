@@ -28,7 +28,7 @@
 #include "ReferenceDynamics.h"
 #include "openmm/CustomIntegrator.h"
 #include "openmm/internal/ContextImpl.h"
-#include "lepton/ExpressionProgram.h"
+#include "lepton/CompiledExpression.h"
 
 #include <map>
 #include <string>
@@ -44,19 +44,42 @@ private:
     std::vector<OpenMM::RealVec> sumBuffer, oldPos;
     std::vector<OpenMM::CustomIntegrator::ComputationType> stepType;
     std::vector<std::string> stepVariable, forceName, energyName;
-    std::vector<Lepton::ExpressionProgram> stepExpression;
+    std::vector<Lepton::CompiledExpression> stepExpression;
     std::vector<bool> invalidatesForces, needsForces, needsEnergy;
     std::vector<int> forceGroup;
     RealOpenMM energy;
-    Lepton::ExpressionProgram kineticEnergyExpression;
+    Lepton::CompiledExpression kineticEnergyExpression;
     bool kineticEnergyNeedsForce;
+    std::vector<double> dofMasses, dofResults;
+    std::vector<std::vector<double> > dofValues;
     
+    void setGlobalVariables(Lepton::CompiledExpression& expression, const std::map<std::string, RealOpenMM>& globals);
+
     void computePerDof(int numberOfAtoms, std::vector<OpenMM::RealVec>& results, const std::vector<OpenMM::RealVec>& atomCoordinates,
                   const std::vector<OpenMM::RealVec>& velocities, const std::vector<OpenMM::RealVec>& forces, const std::vector<RealOpenMM>& masses,
                   const std::map<std::string, RealOpenMM>& globals, const std::vector<std::vector<OpenMM::RealVec> >& perDof,
-                  const Lepton::ExpressionProgram& expression, const std::string& forceName);
+                  Lepton::CompiledExpression& expression, const std::string& forceName);
     
     void recordChangedParameters(OpenMM::ContextImpl& context, std::map<std::string, RealOpenMM>& globals);
+
+protected:
+
+      /**---------------------------------------------------------------------------------------
+      
+         Evaluate a per-DOF expression for every degree of freedom.  Global variables have
+         already been stored in the expression's variable locations.  Subclasses may override
+         this to divide the work between threads.
+
+         @param expression   the expression to evaluate
+         @param numValues    the number of degrees of freedom
+         @param names        the names of the variables that differ between degrees of freedom
+         @param values       values[i][j] is the value of names[i] for degree of freedom j
+         @param results      on exit, the value of the expression for each degree of freedom
+      
+         --------------------------------------------------------------------------------------- */
+
+      virtual void evaluatePerDof(Lepton::CompiledExpression& expression, int numValues, const std::vector<std::string>& names,
+                                  const std::vector<const double*>& values, double* results);
       
 public:
 
@@ -77,7 +100,7 @@ public:
       
          --------------------------------------------------------------------------------------- */
 
-       ~ReferenceCustomDynamics();
+       virtual ~ReferenceCustomDynamics();
 
       /**---------------------------------------------------------------------------------------
       
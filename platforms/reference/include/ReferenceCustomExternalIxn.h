@@ -39,6 +39,7 @@ class ReferenceCustomExternalIxn {
       Lepton::ExpressionProgram forceExpressionZ;
       std::vector<std::string> paramNames;
       std::map<std::string, double> globalParameters;
+      bool includeForces;
 
    public:
 
@@ -60,6 +61,19 @@ class ReferenceCustomExternalIxn {
 
        ~ReferenceCustomExternalIxn( );
 
+      /**---------------------------------------------------------------------------------------
+
+         Set whether forces should be computed.  If this is false, only the energy is computed
+         and the force array is left unchanged.
+
+         @param include  true if forces should be computed (the default)
+
+         --------------------------------------------------------------------------------------- */
+
+      void setIncludeForces( bool include ){
+         includeForces = include;
+      }
+
       /**---------------------------------------------------------------------------------------
 
          Calculate Custom External Force
@@ -40,6 +40,7 @@ class ReferenceCustomGBIxn {
 
       bool cutoff;
       bool periodic;
+      bool includeForces;
       const OpenMM::NeighborList* neighborList;
       RealOpenMM periodicBoxSize[3];
       RealOpenMM cutoffDistance;
@@ -269,6 +270,19 @@ class ReferenceCustomGBIxn {
 
       void setPeriodic( OpenMM::RealVec& boxSize );
 
+      /**---------------------------------------------------------------------------------------
+
+         Set whether forces should be computed.  If this is false, only the energy is computed
+         and the force array is left unchanged.
+
+         @param include  true if forces should be computed (the default)
+
+         --------------------------------------------------------------------------------------- */
+
+      void setIncludeForces( bool include ){
+         includeForces = include;
+      }
+
       /**---------------------------------------------------------------------------------------
 
          Calculate custom GB ixn
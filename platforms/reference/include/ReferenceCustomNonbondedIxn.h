@@ -27,7 +27,7 @@
 
 #include "ReferencePairIxn.h"
 #include "ReferenceNeighborList.h"
-#include "lepton/ExpressionProgram.h"
+#include "lepton/CompiledExpression.h"
 #include <map>
 #include <set>
 #include <utility>
@@ -42,13 +42,14 @@ class ReferenceCustomNonbondedIxn {
       bool cutoff;
       bool useSwitch;
       bool periodic;
+      bool includeForces;
       const OpenMM::NeighborList* neighborList;
       RealOpenMM periodicBoxSize[3];
       RealOpenMM cutoffDistance, switchingDistance;
-      Lepton::ExpressionProgram energyExpression;
-      Lepton::ExpressionProgram forceExpression;
+      Lepton::CompiledExpression energyAndForceExpression;
       std::vector<std::string> paramNames;
-      std::vector<std::string> particleParamNames;
+      std::vector<double*> particleParams;
+      double* rValue;
       std::vector<std::pair<std::set<int>, std::set<int> > > interactionGroups;
 
       /**---------------------------------------------------------------------------------------
@@ -66,7 +67,7 @@ class ReferenceCustomNonbondedIxn {
          --------------------------------------------------------------------------------------- */
 
       void calculateOneIxn( int atom1, int atom2, std::vector<OpenMM::RealVec>& atomCoordinates,
-                            std::map<std::string, double>& variables, std::vector<OpenMM::RealVec>& forces,
+                            RealOpenMM** atomParameters, std::vector<OpenMM::RealVec>& forces,
                             RealOpenMM* energyByAtom, RealOpenMM* totalEnergy ) const;
 
 
@@ -78,8 +79,7 @@ class ReferenceCustomNonbondedIxn {
 
          --------------------------------------------------------------------------------------- */
 
-       ReferenceCustomNonbondedIxn(const Lepton::ExpressionProgram& energyExpression, const Lepton::ExpressionProgram& forceExpression,
-                                   const std::vector<std::string>& parameterNames);
+       ReferenceCustomNonbondedIxn(const Lepton::CompiledExpression& energyAndForceExpression, const std::vector<std::string>& parameterNames);
 
       /**---------------------------------------------------------------------------------------
 
@@ -133,6 +133,19 @@ class ReferenceCustomNonbondedIxn {
 
       void setPeriodic( OpenMM::RealVec& boxSize );
 
+      /**---------------------------------------------------------------------------------------
+
+         Set whether forces should be computed.  If this is false, only the energy is computed
+         and the force array is left unchanged.
+
+         @param include  true if forces should be computed (the default)
+
+         --------------------------------------------------------------------------------------- */
+
+      void setIncludeForces( bool include ){
+         includeForces = include;
+      }
+
       /**---------------------------------------------------------------------------------------
 
          Calculate custom pair ixn
@@ -153,7 +166,7 @@ class ReferenceCustomNonbondedIxn {
       void calculatePairIxn( int numberOfAtoms, std::vector<OpenMM::RealVec>& atomCoordinates,
                             RealOpenMM** atomParameters, std::vector<std::set<int> >& exclusions,
                             RealOpenMM* fixedParameters, const std::map<std::string, double>& globalParameters,
-                            std::vector<OpenMM::RealVec>& forces, RealOpenMM* energyByAtom, RealOpenMM* totalEnergy ) const;
+                            std::vector<OpenMM::RealVec>& forces, RealOpenMM* energyByAtom, RealOpenMM* totalEnergy );
 
 // ---------------------------------------------------------------------------------------
 
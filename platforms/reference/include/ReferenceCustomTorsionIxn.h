@@ -25,17 +25,19 @@
 #define __ReferenceCustomTorsionIxn_H__
 
 #include "ReferenceBondIxn.h"
-#include "lepton/ExpressionProgram.h"
+#include "lepton/CompiledExpression.h"
 
 // ---------------------------------------------------------------------------------------
 
 class ReferenceCustomTorsionIxn : public ReferenceBondIxn {
 
    private:
-      Lepton::ExpressionProgram energyExpression;
-      Lepton::ExpressionProgram forceExpression;
-      std::vector<std::string> paramNames;
-      std::map<std::string, double> globalParameters;
+      Lepton::CompiledExpression energyExpression;
+      Lepton::CompiledExpression forceExpression;
+      std::vector<double*> energyParams;
+      std::vector<double*> forceParams;
+      double* energyTheta;
+      double* forceTheta;
 
    public:
 
@@ -45,8 +47,8 @@ class ReferenceCustomTorsionIxn : public ReferenceBondIxn {
 
          --------------------------------------------------------------------------------------- */
 
-       ReferenceCustomTorsionIxn(const Lepton::ExpressionProgram& energyExpression, const Lepton::ExpressionProgram& forceExpression,
-                              const std::vector<std::string>& parameterNames, std::map<std::string, double> globalParameters);
+       ReferenceCustomTorsionIxn(const Lepton::CompiledExpression& energyExpression, const Lepton::CompiledExpression& forceExpression,
+                              const std::vector<std::string>& parameterNames);
 
       /**---------------------------------------------------------------------------------------
 
@@ -56,6 +58,16 @@ class ReferenceCustomTorsionIxn : public ReferenceBondIxn {
 
        ~ReferenceCustomTorsionIxn( );
 
+      /**---------------------------------------------------------------------------------------
+
+         Set the values of global parameters
+
+         @param globalParameters the values of global parameters
+
+         --------------------------------------------------------------------------------------- */
+
+      void setGlobalParameters( const std::map<std::string, double>& globalParameters );
+
       /**---------------------------------------------------------------------------------------
 
          Calculate Custom Torsion Ixn
@@ -0,0 +1,48 @@
+/* Portions copyright (c) 2013 Stanford University and Simbios.
+ * Contributors: Peter Eastman
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject
+ * to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS, CONTRIBUTORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include "ReferenceSETTLEAlgorithm.h"
+
+#ifndef __ReferenceFFTWPlannerLock_H__
+#define __ReferenceFFTWPlannerLock_H__
+
+#include "openmm/internal/windowsExport.h"
+
+/**
+ * FFTW's planner keeps global state and is not thread safe.  Every piece of code in the process that
+ * creates or destroys FFTW plans, or imports or exports wisdom, must hold this lock while doing so.  It
+ * lives in the main library so that the reference PME implementation and plugins share a single lock.
+ */
+class OPENMM_EXPORT ReferenceFFTWPlannerLock {
+public:
+    /**
+     * Acquire the lock, blocking until it is available.
+     */
+    static void lock();
+    /**
+     * Release the lock.
+     */
+    static void unlock();
+};
+
+#endif // __ReferenceFFTWPlannerLock_H__
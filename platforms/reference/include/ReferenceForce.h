@@ -25,7 +25,9 @@
 #ifndef __ReferenceForce_H__
 #define __ReferenceForce_H__
 
+#include "lepton/CompiledExpression.h"
 #include "openmm/internal/windowsExport.h"
+#include <string>
 
 // ---------------------------------------------------------------------------------------
 
@@ -109,6 +111,32 @@ class OPENMM_EXPORT  ReferenceForce {
       
       static void getDeltaROnly( const RealOpenMM* atomCoordinatesI, const RealOpenMM* atomCoordinatesJ,
                                 RealOpenMM* deltaR );
+
+      /**---------------------------------------------------------------------------------------
+      
+         Get a pointer to the memory location where a compiled expression stores the value of
+         a variable, or NULL if the expression does not use it (static method)
+      
+         @param expression          the compiled expression
+         @param name                the name of the variable
+      
+         @return pointer to the variable's value, or NULL
+      
+         --------------------------------------------------------------------------------------- */
+      
+      static double* getVariablePointer( Lepton::CompiledExpression& expression, const std::string& name );
+
+      /**---------------------------------------------------------------------------------------
+      
+         Set the value of a variable through a pointer returned by getVariablePointer(), doing
+         nothing if the pointer is NULL (static method)
+      
+         @param pointer             the location of the variable, or NULL
+         @param value               the value to store
+      
+         --------------------------------------------------------------------------------------- */
+      
+      static void setVariable( double* pointer, double value );
 };
 
 // ---------------------------------------------------------------------------------------
@@ -29,7 +29,7 @@
 
 // ---------------------------------------------------------------------------------------
 
-class ReferenceHarmonicBondIxn : public ReferenceBondIxn {
+class OPENMM_EXPORT ReferenceHarmonicBondIxn : public ReferenceBondIxn {
 
    private:
 
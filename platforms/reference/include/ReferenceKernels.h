@@ -36,13 +36,19 @@
 #include "openmm/kernels.h"
 #include "SimTKOpenMMRealType.h"
 #include "ReferenceNeighborList.h"
+#include "lepton/CompiledExpression.h"
 #include "lepton/ExpressionProgram.h"
 
+struct pme;
 class CpuObc;
 class CpuGBVI;
 class ReferenceAndersenThermostat;
+class ReferenceCustomAngleIxn;
+class ReferenceCustomBondIxn;
 class ReferenceCustomCompoundBondIxn;
 class ReferenceCustomHbondIxn;
+class ReferenceCustomNonbondedIxn;
+class ReferenceCustomTorsionIxn;
 class ReferenceBrownianDynamics;
 class ReferenceStochasticDynamics;
 class ReferenceConstraintAlgorithm;
@@ -51,6 +57,7 @@ class ReferenceVariableStochasticDynamics;
 class ReferenceVariableVerletDynamics;
 class ReferenceVerletDynamics;
 class ReferenceCustomDynamics;
+class ReferenceMTSDynamics;
 
 namespace OpenMM {
 
@@ -59,7 +66,7 @@ namespace OpenMM {
  * Platform a chance to clear buffers and do other initialization at the beginning, and to do any
  * necessary work at the end to determine the final results.
  */
-class ReferenceCalcForcesAndEnergyKernel : public CalcForcesAndEnergyKernel {
+class OPENMM_EXPORT ReferenceCalcForcesAndEnergyKernel : public CalcForcesAndEnergyKernel {
 public:
     ReferenceCalcForcesAndEnergyKernel(std::string name, const Platform& platform) : CalcForcesAndEnergyKernel(name, platform) {
     }
@@ -218,9 +225,6 @@ private:
     ReferenceConstraintAlgorithm* constraints;
     std::vector<RealOpenMM> masses;
     std::vector<RealOpenMM> inverseMasses;
-    std::vector<std::pair<int, int> > constraintIndices;
-    std::vector<RealOpenMM> constraintDistances;
-    int numConstraints;
 };
 
 /**
@@ -247,7 +251,7 @@ public:
 /**
  * This kernel is invoked by HarmonicBondForce to calculate the forces acting on the system and the energy of the system.
  */
-class ReferenceCalcHarmonicBondForceKernel : public CalcHarmonicBondForceKernel {
+class OPENMM_EXPORT ReferenceCalcHarmonicBondForceKernel : public CalcHarmonicBondForceKernel {
 public:
     ReferenceCalcHarmonicBondForceKernel(std::string name, const Platform& platform) : CalcHarmonicBondForceKernel(name, platform) {
     }
@@ -275,7 +279,7 @@ public:
      * @param force      the HarmonicBondForce to copy the parameters from
      */
     void copyParametersToContext(ContextImpl& context, const HarmonicBondForce& force);
-private:
+protected:
     int numBonds;
     int **bondIndexArray;
     RealOpenMM **bondParamArray;
@@ -286,7 +290,7 @@ private:
  */
 class ReferenceCalcCustomBondForceKernel : public CalcCustomBondForceKernel {
 public:
-    ReferenceCalcCustomBondForceKernel(std::string name, const Platform& platform) : CalcCustomBondForceKernel(name, platform) {
+    ReferenceCalcCustomBondForceKernel(std::string name, const Platform& platform) : CalcCustomBondForceKernel(name, platform), ixn(NULL) {
     }
     ~ReferenceCalcCustomBondForceKernel();
     /**
@@ -316,14 +320,14 @@ private:
     int numBonds;
     int **bondIndexArray;
     RealOpenMM **bondParamArray;
-    Lepton::ExpressionProgram energyExpression, forceExpression;
+    ReferenceCustomBondIxn* ixn;
     std::vector<std::string> parameterNames, globalParameterNames;
 };
 
 /**
  * This kernel is invoked by HarmonicAngleForce to calculate the forces acting on the system and the energy of the system.
  */
-class ReferenceCalcHarmonicAngleForceKernel : public CalcHarmonicAngleForceKernel {
+class OPENMM_EXPORT ReferenceCalcHarmonicAngleForceKernel : public CalcHarmonicAngleForceKernel {
 public:
     ReferenceCalcHarmonicAngleForceKernel(std::string name, const Platform& platform) : CalcHarmonicAngleForceKernel(name, platform) {
     }
@@ -351,7 +355,7 @@ public:
      * @param force      the HarmonicAngleForce to copy the parameters from
      */
     void copyParametersToContext(ContextImpl& context, const HarmonicAngleForce& force);
-private:
+protected:
     int numAngles;
     int **angleIndexArray;
     RealOpenMM **angleParamArray;
@@ -362,7 +366,7 @@ private:
  */
 class ReferenceCalcCustomAngleForceKernel : public CalcCustomAngleForceKernel {
 public:
-    ReferenceCalcCustomAngleForceKernel(std::string name, const Platform& platform) : CalcCustomAngleForceKernel(name, platform) {
+    ReferenceCalcCustomAngleForceKernel(std::string name, const Platform& platform) : CalcCustomAngleForceKernel(name, platform), ixn(NULL) {
     }
     ~ReferenceCalcCustomAngleForceKernel();
     /**
@@ -392,14 +396,14 @@ private:
     int numAngles;
     int **angleIndexArray;
     RealOpenMM **angleParamArray;
-    Lepton::ExpressionProgram energyExpression, forceExpression;
+    ReferenceCustomAngleIxn* ixn;
     std::vector<std::string> parameterNames, globalParameterNames;
 };
 
 /**
  * This kernel is invoked by PeriodicTorsionForce to calculate the forces acting on the system and the energy of the system.
  */
-class ReferenceCalcPeriodicTorsionForceKernel : public CalcPeriodicTorsionForceKernel {
+class OPENMM_EXPORT ReferenceCalcPeriodicTorsionForceKernel : public CalcPeriodicTorsionForceKernel {
 public:
     ReferenceCalcPeriodicTorsionForceKernel(std::string name, const Platform& platform) : CalcPeriodicTorsionForceKernel(name, platform) {
     }
@@ -427,7 +431,7 @@ public:
      * @param force      the PeriodicTorsionForce to copy the parameters from
      */
     void copyParametersToContext(ContextImpl& context, const PeriodicTorsionForce& force);
-private:
+protected:
     int numTorsions;
     int **torsionIndexArray;
     RealOpenMM **torsionParamArray;
@@ -436,7 +440,7 @@ private:
 /**
  * This kernel is invoked by RBTorsionForce to calculate the forces acting on the system and the energy of the system.
  */
-class ReferenceCalcRBTorsionForceKernel : public CalcRBTorsionForceKernel {
+class OPENMM_EXPORT ReferenceCalcRBTorsionForceKernel : public CalcRBTorsionForceKernel {
 public:
     ReferenceCalcRBTorsionForceKernel(std::string name, const Platform& platform) : CalcRBTorsionForceKernel(name, platform) {
     }
@@ -464,7 +468,7 @@ public:
      * @param force      the RBTorsionForce to copy the parameters from
      */
     void copyParametersToContext(ContextImpl& context, const RBTorsionForce& force);
-private:
+protected:
     int numTorsions;
     int **torsionIndexArray;
     RealOpenMM **torsionParamArray;
@@ -504,7 +508,7 @@ private:
  */
 class ReferenceCalcCustomTorsionForceKernel : public CalcCustomTorsionForceKernel {
 public:
-    ReferenceCalcCustomTorsionForceKernel(std::string name, const Platform& platform) : CalcCustomTorsionForceKernel(name, platform) {
+    ReferenceCalcCustomTorsionForceKernel(std::string name, const Platform& platform) : CalcCustomTorsionForceKernel(name, platform), ixn(NULL) {
     }
     ~ReferenceCalcCustomTorsionForceKernel();
     /**
@@ -534,16 +538,18 @@ private:
     int numTorsions;
     int **torsionIndexArray;
     RealOpenMM **torsionParamArray;
-    Lepton::ExpressionProgram energyExpression, forceExpression;
+    ReferenceCustomTorsionIxn* ixn;
     std::vector<std::string> parameterNames, globalParameterNames;
 };
 
 /**
  * This kernel is invoked by NonbondedForce to calculate the forces acting on the system.
  */
-class ReferenceCalcNonbondedForceKernel : public CalcNonbondedForceKernel {
+class OPENMM_EXPORT ReferenceCalcNonbondedForceKernel : public CalcNonbondedForceKernel {
 public:
-    ReferenceCalcNonbondedForceKernel(std::string name, const Platform& platform) : CalcNonbondedForceKernel(name, platform) {
+    class PmeIO;
+    ReferenceCalcNonbondedForceKernel(std::string name, const Platform& platform) : CalcNonbondedForceKernel(name, platform),
+            pmeio(NULL), dispersionPme(NULL), hasCheckedForOptimizedPme(false), hasStartedOptimizedPme(false), pmePrecision(CalcPmeReciprocalForceKernel::DoublePrecision) {
     }
     ~ReferenceCalcNonbondedForceKernel();
     /**
@@ -553,6 +559,16 @@ public:
      * @param force      the NonbondedForce this kernel will be used for
      */
     void initialize(const System& system, const NonbondedForce& force);
+    /**
+     * Start computing PME reciprocal space in the background, if an optimized kernel for it is available.
+     *
+     * @param context        the context in which to execute this kernel
+     * @param includeForces  true if forces should be calculated
+     * @param includeEnergy  true if the energy should be calculated
+     * @param includeDirect  true if direct space interactions should be included
+     * @param includeReciprocal  true if reciprocal space interactions should be included
+     */
+    void beginComputation(ContextImpl& context, bool includeForces, bool includeEnergy, bool includeDirect, bool includeReciprocal);
     /**
      * Execute the kernel to calculate the forces and/or energy.
      *
@@ -570,16 +586,44 @@ public:
      * @param force      the NonbondedForce to copy the parameters from
      */
     void copyParametersToContext(ContextImpl& context, const NonbondedForce& force);
-private:
+protected:
+    /**
+     * If an optimized implementation of CalcPmeReciprocalForceKernel is available (such as the one in the
+     * CPU PME plugin), start it computing reciprocal space in the background.  If it has already been started
+     * by beginComputation(), this does nothing.
+     *
+     * @param context        the context in which to execute this kernel
+     * @param includeForces  true if forces should be calculated
+     * @param includeEnergy  true if the energy should be calculated
+     * @return true if the computation was started, false if reciprocal space must be computed by this kernel
+     */
+    bool beginOptimizedPme(ContextImpl& context, bool includeForces, bool includeEnergy);
+    /**
+     * Wait for a computation started by beginOptimizedPme() to finish, and add the forces to the context.
+     *
+     * @param context        the context in which to execute this kernel
+     * @param includeEnergy  true if the energy should be calculated
+     * @return the reciprocal space energy, including the Ewald self energy
+     */
+    RealOpenMM finishOptimizedPme(ContextImpl& context, bool includeEnergy);
+    /**
+     * If a computation started by beginOptimizedPme() is still pending, wait for it to finish and discard its results.
+     */
+    void abortOptimizedPme();
     int numParticles, num14;
     int **bonded14IndexArray;
     RealOpenMM **particleParamArray, **bonded14ParamArray;
-    RealOpenMM nonbondedCutoff, switchingDistance, rfDielectric, ewaldAlpha, dispersionCoefficient;
-    int kmax[3], gridSize[3];
+    RealOpenMM nonbondedCutoff, switchingDistance, rfDielectric, ewaldAlpha, ewaldDispersionAlpha, dispersionCoefficient;
+    int kmax[3], gridSize[3], dispersionGridSize[3];
     bool useSwitchingFunction;
     std::vector<std::set<int> > exclusions;
     NonbondedMethod nonbondedMethod;
-    NeighborList* neighborList;
+    ReferenceNeighborList* neighborList;
+    Kernel optimizedPme;
+    PmeIO* pmeio;
+    struct pme* dispersionPme;
+    bool hasCheckedForOptimizedPme, hasStartedOptimizedPme;
+    CalcPmeReciprocalForceKernel::Precision pmePrecision;
 };
 
 /**
@@ -587,7 +631,7 @@ private:
  */
 class ReferenceCalcCustomNonbondedForceKernel : public CalcCustomNonbondedForceKernel {
 public:
-    ReferenceCalcCustomNonbondedForceKernel(std::string name, const Platform& platform) : CalcCustomNonbondedForceKernel(name, platform), forceCopy(NULL) {
+    ReferenceCalcCustomNonbondedForceKernel(std::string name, const Platform& platform) : CalcCustomNonbondedForceKernel(name, platform), forceCopy(NULL), ixn(NULL) {
     }
     ~ReferenceCalcCustomNonbondedForceKernel();
     /**
@@ -621,17 +665,16 @@ private:
     CustomNonbondedForce* forceCopy;
     std::map<std::string, double> globalParamValues;
     std::vector<std::set<int> > exclusions;
-    Lepton::ExpressionProgram energyExpression, forceExpression;
+    ReferenceCustomNonbondedIxn* ixn;
     std::vector<std::string> parameterNames, globalParameterNames;
-    std::vector<std::pair<std::set<int>, std::set<int> > > interactionGroups;
     NonbondedMethod nonbondedMethod;
-    NeighborList* neighborList;
+    ReferenceNeighborList* neighborList;
 };
 
 /**
  * This kernel is invoked by GBSAOBCForce to calculate the forces acting on the system.
  */
-class ReferenceCalcGBSAOBCForceKernel : public CalcGBSAOBCForceKernel {
+class OPENMM_EXPORT ReferenceCalcGBSAOBCForceKernel : public CalcGBSAOBCForceKernel {
 public:
     ReferenceCalcGBSAOBCForceKernel(std::string name, const Platform& platform) : CalcGBSAOBCForceKernel(name, platform) {
     }
@@ -659,7 +702,7 @@ public:
      * @param force      the GBSAOBCForce to copy the parameters from
      */
     void copyParametersToContext(ContextImpl& context, const GBSAOBCForce& force);
-private:
+protected:
     CpuObc* obc;
     std::vector<RealOpenMM> charges;
     bool isPeriodic;
@@ -743,7 +786,7 @@ private:
     std::vector<std::vector<Lepton::ExpressionProgram> > energyGradientExpressions;
     std::vector<OpenMM::CustomGBForce::ComputationType> energyTypes;
     NonbondedMethod nonbondedMethod;
-    NeighborList* neighborList;
+    ReferenceNeighborList* neighborList;
 };
 
 /**
@@ -867,7 +910,7 @@ private:
 /**
  * This kernel is invoked by VerletIntegrator to take one time step.
  */
-class ReferenceIntegrateVerletStepKernel : public IntegrateVerletStepKernel {
+class OPENMM_EXPORT ReferenceIntegrateVerletStepKernel : public IntegrateVerletStepKernel {
 public:
     ReferenceIntegrateVerletStepKernel(std::string name, const Platform& platform, ReferencePlatform::PlatformData& data) : IntegrateVerletStepKernel(name, platform),
         data(data), dynamics(0), constraints(0) {
@@ -894,7 +937,7 @@ public:
      * @param integrator the VerletIntegrator this kernel is being used for
      */
     double computeKineticEnergy(ContextImpl& context, const VerletIntegrator& integrator);
-private:
+protected:
     ReferencePlatform::PlatformData& data;
     ReferenceVerletDynamics* dynamics;
     ReferenceConstraintAlgorithm* constraints;
@@ -1063,6 +1106,49 @@ private:
     double prevErrorTol;
 };
 
+/**
+ * This kernel is invoked by MTSIntegrator to take one time step.
+ */
+class ReferenceIntegrateMTSStepKernel : public IntegrateMTSStepKernel {
+public:
+    ReferenceIntegrateMTSStepKernel(std::string name, const Platform& platform, ReferencePlatform::PlatformData& data) : IntegrateMTSStepKernel(name, platform),
+        data(data), dynamics(0), constraints(0) {
+    }
+    ~ReferenceIntegrateMTSStepKernel();
+    /**
+     * Initialize the kernel.
+     * 
+     * @param system     the System this kernel will be applied to
+     * @param integrator the MTSIntegrator this kernel will be used for
+     */
+    void initialize(const System& system, const MTSIntegrator& integrator);
+    /**
+     * Execute the kernel.
+     * 
+     * @param context        the context in which to execute this kernel
+     * @param integrator     the MTSIntegrator this kernel is being used for
+     * @param forcesAreValid if the context has been modified since the last time step, this will be
+     *                       false to show that cached forces are invalid and must be recalculated.
+     *                       On exit, this should specify whether the cached forces are valid at the
+     *                       end of the step.
+     */
+    void execute(ContextImpl& context, const MTSIntegrator& integrator, bool& forcesAreValid);
+    /**
+     * Compute the kinetic energy.
+     * 
+     * @param context    the context in which to execute this kernel
+     * @param integrator the MTSIntegrator this kernel is being used for
+     */
+    double computeKineticEnergy(ContextImpl& context, const MTSIntegrator& integrator);
+private:
+    ReferencePlatform::PlatformData& data;
+    ReferenceMTSDynamics* dynamics;
+    ReferenceConstraintAlgorithm* constraints;
+    std::vector<RealOpenMM> masses;
+    int numConstraints;
+    double prevStepSize;
+};
+
 /**
  * This kernel is invoked by CustomIntegrator to take one time step.
  */
@@ -1131,7 +1217,7 @@ public:
      * @param values    a vector containing the values
      */
     void setPerDofVariable(ContextImpl& context, int variable, const std::vector<Vec3>& values);
-private:
+protected:
     ReferencePlatform::PlatformData& data;
     ReferenceCustomDynamics* dynamics;
     ReferenceConstraintAlgorithm* constraints;
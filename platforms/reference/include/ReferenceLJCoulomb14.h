@@ -29,7 +29,7 @@
 
 // ---------------------------------------------------------------------------------------
 
-class ReferenceLJCoulomb14 : public ReferenceBondIxn {
+class OPENMM_EXPORT ReferenceLJCoulomb14 : public ReferenceBondIxn {
 
    public:
 
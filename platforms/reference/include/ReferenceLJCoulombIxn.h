@@ -28,9 +28,11 @@
 #include "ReferencePairIxn.h"
 #include "ReferenceNeighborList.h"
 
+struct pme;
+
 // ---------------------------------------------------------------------------------------
 
-class ReferenceLJCoulombIxn {
+class OPENMM_EXPORT ReferenceLJCoulombIxn {
 
    private:
        
@@ -39,13 +41,16 @@ class ReferenceLJCoulombIxn {
       bool periodic;
       bool ewald;
       bool pme;
+      bool ljpme;
+      bool includeForces;
       const OpenMM::NeighborList* neighborList;
       RealOpenMM periodicBoxSize[3];
       RealOpenMM cutoffDistance, switchingDistance;
       RealOpenMM krf, crf;
-      RealOpenMM alphaEwald;
+      RealOpenMM alphaEwald, alphaDispersionEwald;
       int numRx, numRy, numRz;
-      int meshDim[3];
+      int meshDim[3], dispersionMeshDim[3];
+      struct pme* dispersionPme;
 
       // parameter indices
 
@@ -149,6 +154,87 @@ class ReferenceLJCoulombIxn {
       
       void setUsePME(RealOpenMM alpha, int meshSize[3]);
       
+      /**---------------------------------------------------------------------------------------
+      
+         Set the force to also use Particle-Mesh Ewald summation for the dispersion part of the
+         Lennard-Jones interaction (LJPME).  This requires that PME has already been set.
+      
+         @param alpha    the dispersion Ewald separation parameter
+         @param gridSize the dimensions of the dispersion mesh
+      
+         --------------------------------------------------------------------------------------- */
+      
+      void setUseLJPME(RealOpenMM alpha, int meshSize[3]);
+      
+      /**---------------------------------------------------------------------------------------
+      
+         Set a PME object to use for the dispersion reciprocal space sum.  It must have been created
+         by createDispersionPme() with the same alpha and mesh as setUseLJPME() and the same number
+         of atoms.
+         This lets the caller create it once rather than on every evaluation.  If it is not set, a
+         temporary one is created each time.
+      
+         @param pmeData  the PME object to use, which remains owned by the caller
+      
+         --------------------------------------------------------------------------------------- */
+      
+      void setDispersionPme(struct pme* pmeData);
+      
+      /**---------------------------------------------------------------------------------------
+      
+         Create a PME object that can be passed to setDispersionPme().
+      
+         @param alpha          the dispersion Ewald separation parameter
+         @param meshSize       the dimensions of the dispersion mesh
+         @param numberOfAtoms  number of atoms
+      
+         @return the new PME object, which should be deleted with destroyDispersionPme()
+      
+         --------------------------------------------------------------------------------------- */
+      
+      static struct pme* createDispersionPme(RealOpenMM alpha, int meshSize[3], int numberOfAtoms);
+      
+      /**---------------------------------------------------------------------------------------
+      
+         Delete a PME object created by createDispersionPme().
+      
+         @param pmeData  the PME object to delete
+      
+         --------------------------------------------------------------------------------------- */
+      
+      static void destroyDispersionPme(struct pme* pmeData);
+
+      /**---------------------------------------------------------------------------------------
+
+         Set whether forces should be computed.  If this is false, only the energy is computed
+         and the force array is left unchanged.  For PME this also skips the inverse FFT.
+
+         @param include  true if forces should be computed (the default)
+
+         --------------------------------------------------------------------------------------- */
+
+      void setIncludeForces(bool include);
+      
+      /**---------------------------------------------------------------------------------------
+      
+         Calculate the reciprocal space part of the LJPME dispersion interaction, including the
+         self energy.  This is called by calculatePairIxn() when reciprocal space interactions are
+         included, but may also be called on its own when the Coulomb reciprocal space interaction
+         is computed elsewhere.
+      
+         @param numberOfAtoms    number of atoms
+         @param atomCoordinates  atom coordinates
+         @param atomParameters   atom parameters (charges, c6, c12, ...)     atomParameters[atomIndex][paramterIndex]
+         @param forces           force array (forces added)
+         @param energyByAtom     atom energy
+         @param totalEnergy      total energy
+      
+         --------------------------------------------------------------------------------------- */
+      
+      void calculateDispersionReciprocalIxn(int numberOfAtoms, std::vector<OpenMM::RealVec>& atomCoordinates,
+                            RealOpenMM** atomParameters, std::vector<OpenMM::RealVec>& forces,
+                            RealOpenMM* energyByAtom, RealOpenMM* totalEnergy) const;
+      
       /**---------------------------------------------------------------------------------------
       
          Calculate LJ Coulomb pair ixn
@@ -0,0 +1,95 @@
+
+/* Portions copyright (c) 2013 Stanford University and Simbios.
+ * Contributors: Peter Eastman
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject
+ * to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS, CONTRIBUTORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef __ReferenceMTSDynamics_H__
+#define __ReferenceMTSDynamics_H__
+
+#include "ReferenceDynamics.h"
+#include "openmm/internal/ContextImpl.h"
+
+#include <utility>
+#include <vector>
+
+// ---------------------------------------------------------------------------------------
+
+class OPENMM_EXPORT ReferenceMTSDynamics : public ReferenceDynamics {
+private:
+
+    std::vector<int> levelGroups, levelSubsteps;
+    std::vector<std::vector<OpenMM::RealVec> > levelForces;
+    std::vector<bool> levelForcesValid;
+    std::vector<OpenMM::RealVec> xPrime, forcePositions;
+    std::vector<RealOpenMM> inverseMasses;
+    OpenMM::Vec3 forceBox[3];
+
+    void integrateLevel(OpenMM::ContextImpl& context, int level, std::vector<OpenMM::RealVec>& atomCoordinates,
+                        std::vector<OpenMM::RealVec>& velocities, std::vector<OpenMM::RealVec>& forces, std::vector<RealOpenMM>& masses);
+
+    void applyForces(OpenMM::ContextImpl& context, int level, RealOpenMM deltaT, std::vector<OpenMM::RealVec>& velocities,
+                     std::vector<OpenMM::RealVec>& forces);
+
+public:
+
+      /**---------------------------------------------------------------------------------------
+      
+         Constructor
+
+         @param numberOfAtoms  number of atoms
+         @param deltaT         delta t for the slowest group
+         @param groups         a list of (force group, substeps) pairs
+      
+         --------------------------------------------------------------------------------------- */
+
+       ReferenceMTSDynamics(int numberOfAtoms, RealOpenMM deltaT, const std::vector<std::pair<int, int> >& groups);
+
+      /**---------------------------------------------------------------------------------------
+      
+         Destructor
+      
+         --------------------------------------------------------------------------------------- */
+
+       ~ReferenceMTSDynamics();
+
+      /**---------------------------------------------------------------------------------------
+      
+         Update
+      
+         @param context             the context this integrator is updating
+         @param atomCoordinates     atom coordinates
+         @param velocities          velocities
+         @param forces              the context's force buffer
+         @param masses              atom masses
+         @param forcesAreValid      whether the cached forces from the previous step can be reused.
+                                    On exit, this is true.
+      
+         --------------------------------------------------------------------------------------- */
+     
+      void update(OpenMM::ContextImpl& context, std::vector<OpenMM::RealVec>& atomCoordinates,
+                  std::vector<OpenMM::RealVec>& velocities, std::vector<OpenMM::RealVec>& forces, std::vector<RealOpenMM>& masses,
+                  bool& forcesAreValid);
+};
+
+// ---------------------------------------------------------------------------------------
+
+#endif // __ReferenceMTSDynamics_H__
@@ -44,6 +44,66 @@ void OPENMM_EXPORT computeNeighborListVoxelHash(
                               bool reportSymmetricPairs = false
                              );
 
+// O(n) neighbor list method using a cell list stored in flat arrays.
+// Each pair of neighboring cells is only visited once.  Each pair is reported
+// with the higher atom index first, as in computeNeighborListVoxelHash().
+// parameter neighborList is automatically clear()ed before 
+// neighbors are added
+void OPENMM_EXPORT computeNeighborListCellList(
+                              NeighborList& neighborList,
+                              int nAtoms,
+                              const AtomLocationList& atomLocations, 
+                              const std::vector<std::set<int> >& exclusions,
+                              const RealVec& periodicBoxSize,
+                              bool usePeriodic,
+                              double maxDistance,
+                              double minDistance = 0.0,
+                              bool reportSymmetricPairs = false
+                             );
+
+/**
+ * A neighbor list that is reused across steps.  It includes all pairs within the cutoff plus a
+ * skin distance, and is only rebuilt when some atom has moved more than half the skin since the
+ * last build, or when the cutoff or periodicity has changed.  If the periodic box has been scaled,
+ * atoms are compared to their scaled positions at the last build, and the allowed distance is
+ * reduced by however much the box has shrunk.  Pairs in the list may be farther apart than the
+ * cutoff, so the code that uses it must check the distance for each pair.
+ */
+class OPENMM_EXPORT ReferenceNeighborList {
+public:
+    ReferenceNeighborList();
+    /**
+     * Get the current list of neighbors.
+     */
+    const NeighborList& getNeighborList() const {
+        return neighborList;
+    }
+    /**
+     * Bring the list up to date with the current atom positions, rebuilding it if necessary.
+     *
+     * @return true if the list was rebuilt, false if the existing list was still valid
+     */
+    bool update(int nAtoms,
+                const AtomLocationList& atomLocations,
+                const std::vector<std::set<int> >& exclusions,
+                const RealVec& periodicBoxSize,
+                bool usePeriodic,
+                double cutoff,
+                double skin);
+    /**
+     * Force the list to be rebuilt the next time update() is called.
+     */
+    void invalidate() {
+        isValid = false;
+    }
+private:
+    NeighborList neighborList;
+    AtomLocationList lastPositions;
+    RealVec lastBoxSize;
+    double lastCutoff, lastSkin;
+    bool lastUsePeriodic, isValid;
+};
+
 } // namespace OpenMM
 
 #endif // OPENMM_REFERENCE_NEIGHBORLIST_H_
@@ -51,20 +51,50 @@ public:
     }
     double getSpeed() const;
     bool supportsDoublePrecision() const;
+    const std::string& getPropertyValue(const Context& context, const std::string& property) const;
+    void setPropertyValue(Context& context, const std::string& property, const std::string& value) const;
     void contextCreated(ContextImpl& context, const std::map<std::string, std::string>& properties) const;
     void contextDestroyed(ContextImpl& context) const;
+    /**
+     * This is the name of the parameter for selecting the skin distance (in nm) added to the cutoff
+     * when building neighbor lists.  A neighbor list is only rebuilt once some atom has moved more than
+     * half this distance.
+     */
+    static const std::string& ReferenceNeighborListSkin() {
+        static const std::string key = "ReferenceNeighborListSkin";
+        return key;
+    }
+    /**
+     * This is the name of the parameter that reports how many times neighbor lists have been rebuilt.
+     */
+    static const std::string& ReferenceNeighborListRebuilds() {
+        static const std::string key = "ReferenceNeighborListRebuilds";
+        return key;
+    }
+    /**
+     * This is the name of the parameter for selecting whether to compute PME reciprocal space with an optimized
+     * CalcPmeReciprocalForceKernel (such as the one provided by the CPU PME plugin) when one is available.  The
+     * default is "false", so the Reference platform computes everything itself unless this is explicitly enabled.
+     * If it is explicitly set to "true" and no optimized kernel can be used, computing the force throws an exception.
+     */
+    static const std::string& ReferenceUseCpuPme() {
+        static const std::string key = "ReferenceUseCpuPme";
+        return key;
+    }
 };
 
 class ReferencePlatform::PlatformData {
 public:
-    PlatformData(int numParticles);
+    PlatformData(int numParticles, double neighborListSkin, bool useCpuPme);
     ~PlatformData();
-    int numParticles, stepCount;
-    double time;
+    int numParticles, stepCount, neighborListRebuilds;
+    double time, neighborListSkin;
+    bool useCpuPme, requireCpuPme;
     void* positions;
     void* velocities;
     void* forces;
     void* periodicBoxSize;
+    std::map<std::string, std::string> propertyValues;
 };
 } // namespace OpenMM
 
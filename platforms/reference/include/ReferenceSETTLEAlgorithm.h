@@ -0,0 +1,100 @@
+/* Portions copyright (c) 2013 Stanford University and Simbios.
+ * Contributors: Peter Eastman
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject
+ * to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS, CONTRIBUTORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef __ReferenceSETTLEAlgorithm_H__
+#define __ReferenceSETTLEAlgorithm_H__
+
+#include "ReferenceConstraintAlgorithm.h"
+#include <vector>
+
+/**
+ * This class uses the SETTLE algorithm to apply constraints to rigid three-site clusters such as
+ * water molecules.  Each cluster consists of a central atom bonded to two other atoms of equal mass
+ * at equal distances, with a third constraint between the two outer atoms.  The constraints are
+ * solved analytically, so no iteration is required and the tolerance is ignored.
+ */
+class OPENMM_EXPORT ReferenceSETTLEAlgorithm : public ReferenceConstraintAlgorithm {
+public:
+    /**
+     * Create a ReferenceSETTLEAlgorithm.
+     *
+     * @param atom1      the index of the central atom of each cluster
+     * @param atom2      the index of the second atom of each cluster
+     * @param atom3      the index of the third atom of each cluster
+     * @param distance1  the distance from the central atom to each of the other two atoms
+     * @param distance2  the distance between the second and third atoms
+     * @param masses     the mass of every atom
+     */
+    ReferenceSETTLEAlgorithm(const std::vector<int>& atom1, const std::vector<int>& atom2, const std::vector<int>& atom3,
+            const std::vector<RealOpenMM>& distance1, const std::vector<RealOpenMM>& distance2, const std::vector<RealOpenMM>& masses);
+
+    /**
+     * Get the number of clusters this object constrains.
+     */
+    int getNumClusters() const;
+
+    /**
+     * Get the parameters describing one cluster.
+     */
+    void getClusterParameters(int index, int& atom1, int& atom2, int& atom3, RealOpenMM& distance1, RealOpenMM& distance2) const;
+
+    /**
+     * Get the constraint tolerance.  This has no effect on the result, since the constraints are solved exactly.
+     */
+    RealOpenMM getTolerance() const;
+
+    /**
+     * Set the constraint tolerance.  This has no effect on the result, since the constraints are solved exactly.
+     */
+    void setTolerance(RealOpenMM tolerance);
+
+    /**
+     * Apply the constraint algorithm.
+     *
+     * @param numberOfAtoms    number of atoms
+     * @param atomCoordinates  the original atom coordinates
+     * @param atomCoordinatesP the new atom coordinates
+     * @param inverseMasses    1/mass
+     * @return SimTKOpenMMCommon::DefaultReturn
+     */
+    int apply(int numberOfAtoms, std::vector<OpenMM::RealVec>& atomCoordinates,
+              std::vector<OpenMM::RealVec>& atomCoordinatesP, std::vector<RealOpenMM>& inverseMasses);
+
+    /**
+     * Apply the constraint algorithm to velocities.
+     *
+     * @param numberOfAtoms    number of atoms
+     * @param atomCoordinates  the atom coordinates
+     * @param velocities       the velocities to modify
+     * @param inverseMasses    1/mass
+     * @return SimTKOpenMMCommon::DefaultReturn
+     */
+    int applyToVelocities(int numberOfAtoms, std::vector<OpenMM::RealVec>& atomCoordinates,
+                          std::vector<OpenMM::RealVec>& velocities, std::vector<RealOpenMM>& inverseMasses);
+private:
+    std::vector<int> atom1, atom2, atom3;
+    std::vector<RealOpenMM> distance1, distance2, masses;
+    RealOpenMM tolerance;
+};
+
+#endif // __ReferenceSETTLEAlgorithm_H__
@@ -29,9 +29,9 @@
 
 // ---------------------------------------------------------------------------------------
 
-class ReferenceVerletDynamics : public ReferenceDynamics {
+class OPENMM_EXPORT ReferenceVerletDynamics : public ReferenceDynamics {
 
-   private:
+   protected:
 
       std::vector<OpenMM::RealVec> xPrime;
       std::vector<RealOpenMM> inverseMasses;
@@ -36,7 +36,7 @@
 #include "ReferenceAngleBondIxn.h"
 #include "ReferenceBondForce.h"
 #include "ReferenceBrownianDynamics.h"
-#include "ReferenceCCMAAlgorithm.h"
+#include "ReferenceConstraints.h"
 #include "ReferenceCMAPTorsionIxn.h"
 #include "ReferenceCustomAngleIxn.h"
 #include "ReferenceCustomBondIxn.h"
@@ -50,6 +50,7 @@
 #include "ReferenceHarmonicBondIxn.h"
 #include "ReferenceLJCoulomb14.h"
 #include "ReferenceLJCoulombIxn.h"
+#include "ReferenceMTSDynamics.h"
 #include "ReferenceMonteCarloBarostat.h"
 #include "ReferenceProperDihedralBond.h"
 #include "ReferenceRbDihedralBond.h"
@@ -132,18 +133,13 @@ static RealVec& extractBoxSize(ContextImpl& context) {
     return *(RealVec*) data->periodicBoxSize;
 }
 
-static void findAnglesForCCMA(const System& system, vector<ReferenceCCMAAlgorithm::AngleInfo>& angles) {
-    for (int i = 0; i < system.getNumForces(); i++) {
-        const HarmonicAngleForce* force = dynamic_cast<const HarmonicAngleForce*>(&system.getForce(i));
-        if (force != NULL) {
-            for (int j = 0; j < force->getNumAngles(); j++) {
-                int atom1, atom2, atom3;
-                double angle, k;
-                force->getAngleParameters(j, atom1, atom2, atom3, angle, k);
-                angles.push_back(ReferenceCCMAAlgorithm::AngleInfo(atom1, atom2, atom3, (RealOpenMM)angle));
-            }
-        }
-    }
+/**
+ * Bring a neighbor list up to date, using the skin distance selected for the context.
+ */
+static void updateNeighborList(ContextImpl& context, ReferenceNeighborList& neighborList, int numParticles, const vector<set<int> >& exclusions, bool periodic, double cutoff) {
+    ReferencePlatform::PlatformData* data = reinterpret_cast<ReferencePlatform::PlatformData*>(context.getPlatformData());
+    if (neighborList.update(numParticles, *((vector<RealVec>*) data->positions), exclusions, *((RealVec*) data->periodicBoxSize), periodic, cutoff, data->neighborListSkin))
+        data->neighborListRebuilds++;
 }
 
 /**
@@ -198,13 +194,18 @@ void ReferenceCalcForcesAndEnergyKernel::beginComputation(ContextImpl& context,
             forceData[i][2] = (RealOpenMM) 0.0;
         }
     }
-    else
-        savedForces = forceData;
+    else {
+        // Move the forces aside so that computing only the energy cannot disturb them.  Every kernel
+        // on this platform honors includeForces, but any that does not will only write to scratch space.
+
+        savedForces.resize(forceData.size());
+        savedForces.swap(forceData);
+    }
 }
 
 double ReferenceCalcForcesAndEnergyKernel::finishComputation(ContextImpl& context, bool includeForces, bool includeEnergy, int groups) {
     if (!includeForces)
-        extractForces(context) = savedForces; // Restore the forces so computing the energy doesn't overwrite the forces with incorrect values.
+        savedForces.swap(extractForces(context));
     else
         ReferenceVirtualSites::distributeForces(context.getSystem(), extractPositions(context), extractForces(context));
     return 0.0;
@@ -315,17 +316,6 @@ void ReferenceApplyConstraintsKernel::initialize(const System& system) {
         masses[i] = static_cast<RealOpenMM>(system.getParticleMass(i));
         inverseMasses[i] = 1.0/masses[i];
     }
-    numConstraints = system.getNumConstraints();
-    constraintIndices.resize(numConstraints);
-    constraintDistances.resize(numConstraints);
-    for (int i = 0; i < numConstraints; ++i) {
-        int particle1, particle2;
-        double distance;
-        system.getConstraintParameters(i, particle1, particle2, distance);
-        constraintIndices[i].first = particle1;
-        constraintIndices[i].second = particle2;
-        constraintDistances[i] = static_cast<RealOpenMM>(distance);
-    }
 }
 
 ReferenceApplyConstraintsKernel::~ReferenceApplyConstraintsKernel() {
@@ -335,9 +325,7 @@ ReferenceApplyConstraintsKernel::~ReferenceApplyConstraintsKernel() {
 
 void ReferenceApplyConstraintsKernel::apply(ContextImpl& context, double tol) {
     if (constraints == NULL) {
-        vector<ReferenceCCMAAlgorithm::AngleInfo> angles;
-        findAnglesForCCMA(context.getSystem(), angles);
-        constraints = new ReferenceCCMAAlgorithm(context.getSystem().getNumParticles(), numConstraints, constraintIndices, constraintDistances, masses, angles, tol);
+        constraints = new ReferenceConstraints(context.getSystem(), tol);
     }
     vector<RealVec>& positions = extractPositions(context);
     constraints->setTolerance(tol);
@@ -347,9 +335,7 @@ void ReferenceApplyConstraintsKernel::apply(ContextImpl& context, double tol) {
 
 void ReferenceApplyConstraintsKernel::applyToVelocities(ContextImpl& context, double tol) {
     if (constraints == NULL) {
-        vector<ReferenceCCMAAlgorithm::AngleInfo> angles;
-        findAnglesForCCMA(context.getSystem(), angles);
-        constraints = new ReferenceCCMAAlgorithm(context.getSystem().getNumParticles(), numConstraints, constraintIndices, constraintDistances, masses, angles, tol);
+        constraints = new ReferenceConstraints(context.getSystem(), tol);
     }
     vector<RealVec>& positions = extractPositions(context);
     vector<RealVec>& velocities = extractVelocities(context);
@@ -391,6 +377,7 @@ double ReferenceCalcHarmonicBondForceKernel::execute(ContextImpl& context, bool
     RealOpenMM energy = 0;
     ReferenceBondForce refBondForce;
     ReferenceHarmonicBondIxn harmonicBond;
+    harmonicBond.setIncludeForces(includeForces);
     refBondForce.calculateForce(numBonds, bondIndexArray, posData, bondParamArray, forceData, includeEnergy ? &energy : NULL, harmonicBond);
     return energy;
 }
@@ -417,6 +404,8 @@ void ReferenceCalcHarmonicBondForceKernel::copyParametersToContext(ContextImpl&
 ReferenceCalcCustomBondForceKernel::~ReferenceCalcCustomBondForceKernel() {
     disposeIntArray(bondIndexArray, numBonds);
     disposeRealArray(bondParamArray, numBonds);
+    if (ixn != NULL)
+        delete ixn;
 }
 
 void ReferenceCalcCustomBondForceKernel::initialize(const System& system, const CustomBondForce& force) {
@@ -440,12 +429,13 @@ void ReferenceCalcCustomBondForceKernel::initialize(const System& system, const
     // Parse the expression used to calculate the force.
 
     Lepton::ParsedExpression expression = Lepton::Parser::parse(force.getEnergyFunction()).optimize();
-    energyExpression = expression.createProgram();
-    forceExpression = expression.differentiate("r").optimize().createProgram();
+    Lepton::CompiledExpression energyExpression = expression.createCompiledExpression();
+    Lepton::CompiledExpression forceExpression = expression.differentiate("r").optimize().createCompiledExpression();
     for (int i = 0; i < numParameters; i++)
         parameterNames.push_back(force.getPerBondParameterName(i));
     for (int i = 0; i < force.getNumGlobalParameters(); i++)
         globalParameterNames.push_back(force.getGlobalParameterName(i));
+    ixn = new ReferenceCustomBondIxn(energyExpression, forceExpression, parameterNames);
 }
 
 double ReferenceCalcCustomBondForceKernel::execute(ContextImpl& context, bool includeForces, bool includeEnergy) {
@@ -455,9 +445,9 @@ double ReferenceCalcCustomBondForceKernel::execute(ContextImpl& context, bool in
     map<string, double> globalParameters;
     for (int i = 0; i < (int) globalParameterNames.size(); i++)
         globalParameters[globalParameterNames[i]] = context.getParameter(globalParameterNames[i]);
-    ReferenceBondForce refBondForce;
-    ReferenceCustomBondIxn harmonicBond(energyExpression, forceExpression, parameterNames, globalParameters);
-    refBondForce.calculateForce(numBonds, bondIndexArray, posData, bondParamArray, forceData, includeEnergy ? &energy : NULL, harmonicBond);
+    ixn->setGlobalParameters(globalParameters);
+    ixn->setIncludeForces(includeForces);
+    ixn->calculateBondIxns(numBonds, bondIndexArray, posData, bondParamArray, forceData, includeEnergy ? &energy : NULL);
     return energy;
 }
 
@@ -506,6 +496,7 @@ double ReferenceCalcHarmonicAngleForceKernel::execute(ContextImpl& context, bool
     RealOpenMM energy = 0;
     ReferenceBondForce refBondForce;
     ReferenceAngleBondIxn angleBond;
+    angleBond.setIncludeForces(includeForces);
     refBondForce.calculateForce(numAngles, angleIndexArray, posData, angleParamArray, forceData, includeEnergy ? &energy : NULL, angleBond);
     return energy;
 }
@@ -530,6 +521,8 @@ void ReferenceCalcHarmonicAngleForceKernel::copyParametersToContext(ContextImpl&
 ReferenceCalcCustomAngleForceKernel::~ReferenceCalcCustomAngleForceKernel() {
     disposeIntArray(angleIndexArray, numAngles);
     disposeRealArray(angleParamArray, numAngles);
+    if (ixn != NULL)
+        delete ixn;
 }
 
 void ReferenceCalcCustomAngleForceKernel::initialize(const System& system, const CustomAngleForce& force) {
@@ -554,12 +547,14 @@ void ReferenceCalcCustomAngleForceKernel::initialize(const System& system, const
     // Parse the expression used to calculate the force.
 
     Lepton::ParsedExpression expression = Lepton::Parser::parse(force.getEnergyFunction()).optimize();
-    energyExpression = expression.createProgram();
-    forceExpression = expression.differentiate("theta").optimize().createProgram();
+    vector<Lepton::ParsedExpression> expressions;
+    expressions.push_back(expression);
+    expressions.push_back(expression.differentiate("theta").optimize());
     for (int i = 0; i < numParameters; i++)
         parameterNames.push_back(force.getPerAngleParameterName(i));
     for (int i = 0; i < force.getNumGlobalParameters(); i++)
         globalParameterNames.push_back(force.getGlobalParameterName(i));
+    ixn = new ReferenceCustomAngleIxn(Lepton::CompiledExpression(expressions), parameterNames);
 }
 
 double ReferenceCalcCustomAngleForceKernel::execute(ContextImpl& context, bool includeForces, bool includeEnergy) {
@@ -570,8 +565,9 @@ double ReferenceCalcCustomAngleForceKernel::execute(ContextImpl& context, bool i
     for (int i = 0; i < (int) globalParameterNames.size(); i++)
         globalParameters[globalParameterNames[i]] = context.getParameter(globalParameterNames[i]);
     ReferenceBondForce refBondForce;
-    ReferenceCustomAngleIxn customAngle(energyExpression, forceExpression, parameterNames, globalParameters);
-    refBondForce.calculateForce(numAngles, angleIndexArray, posData, angleParamArray, forceData, includeEnergy ? &energy : NULL, customAngle);
+    ixn->setGlobalParameters(globalParameters);
+    ixn->setIncludeForces(includeForces);
+    refBondForce.calculateForce(numAngles, angleIndexArray, posData, angleParamArray, forceData, includeEnergy ? &energy : NULL, *ixn);
     return energy;
 }
 
@@ -622,6 +618,7 @@ double ReferenceCalcPeriodicTorsionForceKernel::execute(ContextImpl& context, bo
     RealOpenMM energy = 0;
     ReferenceBondForce refBondForce;
     ReferenceProperDihedralBond periodicTorsionBond;
+    periodicTorsionBond.setIncludeForces(includeForces);
     refBondForce.calculateForce(numTorsions, torsionIndexArray, posData, torsionParamArray, forceData, includeEnergy ? &energy : NULL, periodicTorsionBond);
     return energy;
 }
@@ -676,6 +673,7 @@ double ReferenceCalcRBTorsionForceKernel::execute(ContextImpl& context, bool inc
     RealOpenMM energy = 0;
     ReferenceBondForce refBondForce;
     ReferenceRbDihedralBond rbTorsionBond;
+    rbTorsionBond.setIncludeForces(includeForces);
     refBondForce.calculateForce(numTorsions, torsionIndexArray, posData, torsionParamArray, forceData, includeEnergy ? &energy : NULL, rbTorsionBond);
     return energy;
 }
@@ -732,6 +730,7 @@ double ReferenceCalcCMAPTorsionForceKernel::execute(ContextImpl& context, bool i
     vector<RealVec>& forceData = extractForces(context);
     RealOpenMM totalEnergy = 0;
     ReferenceCMAPTorsionIxn torsion(coeff, torsionMaps, torsionIndices);
+    torsion.setIncludeForces(includeForces);
     torsion.calculateIxn(posData, forceData, &totalEnergy);
     return totalEnergy;
 }
@@ -739,6 +738,8 @@ double ReferenceCalcCMAPTorsionForceKernel::execute(ContextImpl& context, bool i
 ReferenceCalcCustomTorsionForceKernel::~ReferenceCalcCustomTorsionForceKernel() {
     disposeIntArray(torsionIndexArray, numTorsions);
     disposeRealArray(torsionParamArray, numTorsions);
+    if (ixn != NULL)
+        delete ixn;
 }
 
 void ReferenceCalcCustomTorsionForceKernel::initialize(const System& system, const CustomTorsionForce& force) {
@@ -764,12 +765,13 @@ void ReferenceCalcCustomTorsionForceKernel::initialize(const System& system, con
     // Parse the expression used to calculate the force.
 
     Lepton::ParsedExpression expression = Lepton::Parser::parse(force.getEnergyFunction()).optimize();
-    energyExpression = expression.createProgram();
-    forceExpression = expression.differentiate("theta").optimize().createProgram();
+    Lepton::CompiledExpression energyExpression = expression.createCompiledExpression();
+    Lepton::CompiledExpression forceExpression = expression.differentiate("theta").optimize().createCompiledExpression();
     for (int i = 0; i < numParameters; i++)
         parameterNames.push_back(force.getPerTorsionParameterName(i));
     for (int i = 0; i < force.getNumGlobalParameters(); i++)
         globalParameterNames.push_back(force.getGlobalParameterName(i));
+    ixn = new ReferenceCustomTorsionIxn(energyExpression, forceExpression, parameterNames);
 }
 
 double ReferenceCalcCustomTorsionForceKernel::execute(ContextImpl& context, bool includeForces, bool includeEnergy) {
@@ -780,8 +782,9 @@ double ReferenceCalcCustomTorsionForceKernel::execute(ContextImpl& context, bool
     for (int i = 0; i < (int) globalParameterNames.size(); i++)
         globalParameters[globalParameterNames[i]] = context.getParameter(globalParameterNames[i]);
     ReferenceBondForce refBondForce;
-    ReferenceCustomTorsionIxn customTorsion(energyExpression, forceExpression, parameterNames, globalParameters);
-    refBondForce.calculateForce(numTorsions, torsionIndexArray, posData, torsionParamArray, forceData, includeEnergy ? &energy : NULL, customTorsion);
+    ixn->setGlobalParameters(globalParameters);
+    ixn->setIncludeForces(includeForces);
+    refBondForce.calculateForce(numTorsions, torsionIndexArray, posData, torsionParamArray, forceData, includeEnergy ? &energy : NULL, *ixn);
     return energy;
 }
 
@@ -803,12 +806,51 @@ void ReferenceCalcCustomTorsionForceKernel::copyParametersToContext(ContextImpl&
     }
 }
 
+class ReferenceCalcNonbondedForceKernel::PmeIO : public CalcPmeReciprocalForceKernel::IO {
+public:
+    PmeIO(vector<RealVec>& forces) : includeForces(true), forces(forces) {
+    }
+    float* getPosq() {
+        return &posq[0];
+    }
+    double* getPosqDouble() {
+        return &posqDouble[0];
+    }
+    void setForce(float* force) {
+        if (!includeForces)
+            return;
+        for (int i = 0; i < (int) forces.size(); i++) {
+            forces[i][0] += force[4*i];
+            forces[i][1] += force[4*i+1];
+            forces[i][2] += force[4*i+2];
+        }
+    }
+    void setForceDouble(double* force) {
+        if (!includeForces)
+            return;
+        for (int i = 0; i < (int) forces.size(); i++) {
+            forces[i][0] += force[4*i];
+            forces[i][1] += force[4*i+1];
+            forces[i][2] += force[4*i+2];
+        }
+    }
+    vector<float> posq;
+    vector<double> posqDouble;
+    bool includeForces;
+private:
+    vector<RealVec>& forces;
+};
+
 ReferenceCalcNonbondedForceKernel::~ReferenceCalcNonbondedForceKernel() {
     disposeRealArray(particleParamArray, numParticles);
     disposeIntArray(bonded14IndexArray, num14);
     disposeRealArray(bonded14ParamArray, num14);
     if (neighborList != NULL)
         delete neighborList;
+    if (pmeio != NULL)
+        delete pmeio;
+    if (dispersionPme != NULL)
+        ReferenceLJCoulombIxn::destroyDispersionPme(dispersionPme);
 }
 
 void ReferenceCalcNonbondedForceKernel::initialize(const System& system, const NonbondedForce& force) {
@@ -859,7 +901,7 @@ void ReferenceCalcNonbondedForceKernel::initialize(const System& system, const N
         useSwitchingFunction = false;
     }
     else {
-        neighborList = new NeighborList();
+        neighborList = new ReferenceNeighborList();
         useSwitchingFunction = force.getUseSwitchingFunction();
         switchingDistance = force.getSwitchingDistance();
     }
@@ -868,10 +910,18 @@ void ReferenceCalcNonbondedForceKernel::initialize(const System& system, const N
         NonbondedForceImpl::calcEwaldParameters(system, force, alpha, kmax[0], kmax[1], kmax[2]);
         ewaldAlpha = (RealOpenMM) alpha;
     }
-    else if (nonbondedMethod == PME) {
+    else if (nonbondedMethod == PME || nonbondedMethod == LJPME) {
         double alpha;
         NonbondedForceImpl::calcPMEParameters(system, force, alpha, gridSize[0], gridSize[1], gridSize[2]);
         ewaldAlpha = (RealOpenMM) alpha;
+        if (nonbondedMethod == LJPME) {
+            NonbondedForceImpl::calcLJPMEParameters(system, force, alpha, dispersionGridSize[0], dispersionGridSize[1], dispersionGridSize[2]);
+            ewaldDispersionAlpha = (RealOpenMM) alpha;
+
+            // The dispersion grid and FFT plans are the same for every evaluation, so create them once.
+
+            dispersionPme = ReferenceLJCoulombIxn::createDispersionPme(ewaldDispersionAlpha, dispersionGridSize, numParticles);
+        }
     }
     rfDielectric = (RealOpenMM)force.getReactionFieldDielectric();
     if (force.getUseDispersionCorrection())
@@ -880,42 +930,158 @@ void ReferenceCalcNonbondedForceKernel::initialize(const System& system, const N
         dispersionCoefficient = 0.0;
 }
 
-double ReferenceCalcNonbondedForceKernel::execute(ContextImpl& context, bool includeForces, bool includeEnergy, bool includeDirect, bool includeReciprocal) {
-    vector<RealVec>& posData = extractPositions(context);
-    vector<RealVec>& forceData = extractForces(context);
-    RealOpenMM energy = 0;
-    ReferenceLJCoulombIxn clj;
-    bool periodic = (nonbondedMethod == CutoffPeriodic);
-    bool ewald  = (nonbondedMethod == Ewald);
-    bool pme  = (nonbondedMethod == PME);
-    if (nonbondedMethod != NoCutoff) {
-        computeNeighborListVoxelHash(*neighborList, numParticles, posData, exclusions, extractBoxSize(context), periodic || ewald || pme, nonbondedCutoff, 0.0);
-        clj.setUseCutoff(nonbondedCutoff, *neighborList, rfDielectric);
-    }
-    if (periodic || ewald || pme) {
+void ReferenceCalcNonbondedForceKernel::beginComputation(ContextImpl& context, bool includeForces, bool includeEnergy, bool includeDirect, bool includeReciprocal) {
+    // A computation may still be pending if a previous evaluation threw an exception before execute() was called.
+
+    abortOptimizedPme();
+    if ((nonbondedMethod == PME || nonbondedMethod == LJPME) && includeReciprocal) {
+        // Check the box before starting anything, so an invalid box cannot leave a computation running.
+
         RealVec& box = extractBoxSize(context);
         double minAllowedSize = 1.999999*nonbondedCutoff;
         if (box[0] < minAllowedSize || box[1] < minAllowedSize || box[2] < minAllowedSize)
             throw OpenMMException("The periodic box size has decreased to less than twice the nonbonded cutoff.");
-        clj.setPeriodic(box);
+        beginOptimizedPme(context, includeForces, includeEnergy);
     }
-    if (ewald)
-        clj.setUseEwald(ewaldAlpha, kmax[0], kmax[1], kmax[2]);
-    if (pme)
-        clj.setUsePME(ewaldAlpha, gridSize);
-    if (useSwitchingFunction)
-        clj.setUseSwitchingFunction(switchingDistance);
-    clj.calculatePairIxn(numParticles, posData, particleParamArray, exclusions, 0, forceData, 0, includeEnergy ? &energy : NULL, includeDirect, includeReciprocal);
-    if (includeDirect) {
-        ReferenceBondForce refBondForce;
-        ReferenceLJCoulomb14 nonbonded14;
-        refBondForce.calculateForce(num14, bonded14IndexArray, posData, bonded14ParamArray, forceData, includeEnergy ? &energy : NULL, nonbonded14);
+}
+
+double ReferenceCalcNonbondedForceKernel::execute(ContextImpl& context, bool includeForces, bool includeEnergy, bool includeDirect, bool includeReciprocal) {
+    // If this throws after reciprocal space was started in the background, wait for it and discard the results.
+    // Otherwise the next evaluation would pick them up even though they were computed from stale coordinates.
+
+    try {
+        vector<RealVec>& posData = extractPositions(context);
+        vector<RealVec>& forceData = extractForces(context);
+        RealOpenMM energy = 0;
+        ReferenceLJCoulombIxn clj;
+        bool periodic = (nonbondedMethod == CutoffPeriodic);
+        bool ewald  = (nonbondedMethod == Ewald);
+        bool pme  = (nonbondedMethod == PME || nonbondedMethod == LJPME);
+        bool ljpme = (nonbondedMethod == LJPME);
+        if (nonbondedMethod != NoCutoff) {
+            updateNeighborList(context, *neighborList, numParticles, exclusions, periodic || ewald || pme, nonbondedCutoff);
+            clj.setUseCutoff(nonbondedCutoff, neighborList->getNeighborList(), rfDielectric);
+        }
         if (periodic || ewald || pme) {
-            RealVec& boxSize = extractBoxSize(context);
-            energy += dispersionCoefficient/(boxSize[0]*boxSize[1]*boxSize[2]);
+            RealVec& box = extractBoxSize(context);
+            double minAllowedSize = 1.999999*nonbondedCutoff;
+            if (box[0] < minAllowedSize || box[1] < minAllowedSize || box[2] < minAllowedSize)
+                throw OpenMMException("The periodic box size has decreased to less than twice the nonbonded cutoff.");
+            clj.setPeriodic(box);
+        }
+        if (ewald)
+            clj.setUseEwald(ewaldAlpha, kmax[0], kmax[1], kmax[2]);
+        if (pme)
+            clj.setUsePME(ewaldAlpha, gridSize);
+        if (ljpme) {
+            clj.setUseLJPME(ewaldDispersionAlpha, dispersionGridSize);
+            clj.setDispersionPme(dispersionPme);
         }
+        if (useSwitchingFunction)
+            clj.setUseSwitchingFunction(switchingDistance);
+        bool useOptimizedPme = (pme && includeReciprocal && beginOptimizedPme(context, includeForces, includeEnergy));
+        clj.setIncludeForces(includeForces);
+        clj.calculatePairIxn(numParticles, posData, particleParamArray, exclusions, 0, forceData, 0, includeEnergy ? &energy : NULL, includeDirect, includeReciprocal && !useOptimizedPme);
+        if (useOptimizedPme) {
+            // The optimized kernel only handles the Coulomb interaction, so the dispersion part of LJPME is still computed here.
+
+            if (ljpme)
+                clj.calculateDispersionReciprocalIxn(numParticles, posData, particleParamArray, forceData, 0, includeEnergy ? &energy : NULL);
+            energy += finishOptimizedPme(context, includeEnergy);
+        }
+        if (includeDirect) {
+            ReferenceBondForce refBondForce;
+            ReferenceLJCoulomb14 nonbonded14;
+            nonbonded14.setIncludeForces(includeForces);
+            refBondForce.calculateForce(num14, bonded14IndexArray, posData, bonded14ParamArray, forceData, includeEnergy ? &energy : NULL, nonbonded14);
+            if (periodic || ewald || pme) {
+                RealVec& boxSize = extractBoxSize(context);
+                energy += dispersionCoefficient/(boxSize[0]*boxSize[1]*boxSize[2]);
+            }
+        }
+        return energy;
     }
-    return energy;
+    catch (...) {
+        abortOptimizedPme();
+        throw;
+    }
+}
+
+bool ReferenceCalcNonbondedForceKernel::beginOptimizedPme(ContextImpl& context, bool includeForces, bool includeEnergy) {
+    if (hasStartedOptimizedPme)
+        return true;
+    if (!hasCheckedForOptimizedPme) {
+        // The first time this is called, see whether an optimized PME kernel has been registered.
+
+        ReferencePlatform::PlatformData* data = reinterpret_cast<ReferencePlatform::PlatformData*>(context.getPlatformData());
+        if (data->useCpuPme) {
+            try {
+                optimizedPme = getPlatform().createKernel(CalcPmeReciprocalForceKernel::Name(), context);
+                CalcPmeReciprocalForceKernel& kernel = optimizedPme.getAs<CalcPmeReciprocalForceKernel>();
+
+                // Double precision needs an optional library, so fall back to mixed precision if it is missing.
+
+                if (pmePrecision == CalcPmeReciprocalForceKernel::DoublePrecision && !kernel.supportsPrecision(pmePrecision))
+                    pmePrecision = CalcPmeReciprocalForceKernel::MixedPrecision;
+                kernel.initialize(gridSize[0], gridSize[1], gridSize[2], numParticles, ewaldAlpha, pmePrecision);
+                pmeio = new PmeIO(extractForces(context));
+            }
+            catch (OpenMMException& ex) {
+                // The CPU PME plugin isn't available.  That is only an error if the user explicitly asked for it.
+
+                optimizedPme = Kernel();
+                if (data->requireCpuPme)
+                    throw OpenMMException(string("ReferenceUseCpuPme was set to true, but the CPU PME kernel could not be used: ")+ex.what());
+            }
+        }
+        hasCheckedForOptimizedPme = true;
+    }
+    if (pmeio == NULL)
+        return false;
+
+    // Translate the positions into the box before converting them to the kernel's precision.
+
+    vector<RealVec>& posData = extractPositions(context);
+    RealVec& box = extractBoxSize(context);
+    if (pmePrecision == CalcPmeReciprocalForceKernel::DoublePrecision) {
+        pmeio->posqDouble.resize(4*numParticles);
+        for (int i = 0; i < numParticles; i++) {
+            for (int j = 0; j < 3; j++)
+                pmeio->posqDouble[4*i+j] = posData[i][j]-floor(posData[i][j]/box[j])*box[j];
+            pmeio->posqDouble[4*i+3] = particleParamArray[i][2];
+        }
+    }
+    else {
+        pmeio->posq.resize(4*numParticles);
+        for (int i = 0; i < numParticles; i++) {
+            for (int j = 0; j < 3; j++)
+                pmeio->posq[4*i+j] = (float) (posData[i][j]-floor(posData[i][j]/box[j])*box[j]);
+            pmeio->posq[4*i+3] = (float) particleParamArray[i][2];
+        }
+    }
+    pmeio->includeForces = includeForces;
+    optimizedPme.getAs<CalcPmeReciprocalForceKernel>().beginComputation(*pmeio, Vec3(box[0], box[1], box[2]), includeEnergy);
+    hasStartedOptimizedPme = true;
+    return true;
+}
+
+void ReferenceCalcNonbondedForceKernel::abortOptimizedPme() {
+    if (!hasStartedOptimizedPme)
+        return;
+    pmeio->includeForces = false;
+    hasStartedOptimizedPme = false;
+    optimizedPme.getAs<CalcPmeReciprocalForceKernel>().finishComputation(*pmeio);
+}
+
+RealOpenMM ReferenceCalcNonbondedForceKernel::finishOptimizedPme(ContextImpl& context, bool includeEnergy) {
+    double energy = optimizedPme.getAs<CalcPmeReciprocalForceKernel>().finishComputation(*pmeio);
+    hasStartedOptimizedPme = false;
+    if (!includeEnergy)
+        return 0;
+    double sumSquaredCharges = 0;
+    for (int i = 0; i < numParticles; i++)
+        sumSquaredCharges += particleParamArray[i][2]*particleParamArray[i][2];
+    return (RealOpenMM) (energy-ONE_4PI_EPS0*ewaldAlpha*sumSquaredCharges/sqrt(PI_M));
 }
 
 void ReferenceCalcNonbondedForceKernel::copyParametersToContext(ContextImpl& context, const NonbondedForce& force) {
@@ -997,6 +1163,8 @@ ReferenceCalcCustomNonbondedForceKernel::~ReferenceCalcCustomNonbondedForceKerne
         delete neighborList;
     if (forceCopy != NULL)
         delete forceCopy;
+    if (ixn != NULL)
+        delete ixn;
 }
 
 void ReferenceCalcCustomNonbondedForceKernel::initialize(const System& system, const CustomNonbondedForce& force) {
@@ -1029,7 +1197,7 @@ void ReferenceCalcCustomNonbondedForceKernel::initialize(const System& system, c
         useSwitchingFunction = false;
     }
     else {
-        neighborList = new NeighborList();
+        neighborList = new ReferenceNeighborList();
         useSwitchingFunction = force.getUseSwitchingFunction();
         switchingDistance = force.getSwitchingDistance();
     }
@@ -1048,10 +1216,12 @@ void ReferenceCalcCustomNonbondedForceKernel::initialize(const System& system, c
     // Parse the various expressions used to calculate the force.
 
     Lepton::ParsedExpression expression = Lepton::Parser::parse(force.getEnergyFunction(), functions).optimize();
-    energyExpression = expression.createProgram();
-    forceExpression = expression.differentiate("r").optimize().createProgram();
+    vector<Lepton::ParsedExpression> expressions;
+    expressions.push_back(expression);
+    expressions.push_back(expression.differentiate("r").optimize());
     for (int i = 0; i < numParameters; i++)
         parameterNames.push_back(force.getPerParticleParameterName(i));
+    ixn = new ReferenceCustomNonbondedIxn(Lepton::CompiledExpression(expressions), parameterNames);
     for (int i = 0; i < force.getNumGlobalParameters(); i++) {
         globalParameterNames.push_back(force.getGlobalParameterName(i));
         globalParamValues[force.getGlobalParameterName(i)] = force.getGlobalParameterDefaultValue(i);
@@ -1075,11 +1245,14 @@ void ReferenceCalcCustomNonbondedForceKernel::initialize(const System& system, c
     
     // Record the interaction groups.
     
+    vector<pair<set<int>, set<int> > > interactionGroups;
     for (int i = 0; i < force.getNumInteractionGroups(); i++) {
         set<int> set1, set2;
         force.getInteractionGroupParameters(i, set1, set2);
         interactionGroups.push_back(make_pair(set1, set2));
     }
+    if (interactionGroups.size() > 0)
+        ixn->setInteractionGroups(interactionGroups);
 }
 
 double ReferenceCalcCustomNonbondedForceKernel::execute(ContextImpl& context, bool includeForces, bool includeEnergy) {
@@ -1087,20 +1260,17 @@ double ReferenceCalcCustomNonbondedForceKernel::execute(ContextImpl& context, bo
     vector<RealVec>& forceData = extractForces(context);
     RealVec& box = extractBoxSize(context);
     RealOpenMM energy = 0;
-    ReferenceCustomNonbondedIxn ixn(energyExpression, forceExpression, parameterNames);
     bool periodic = (nonbondedMethod == CutoffPeriodic);
     if (nonbondedMethod != NoCutoff) {
-        computeNeighborListVoxelHash(*neighborList, numParticles, posData, exclusions, extractBoxSize(context), periodic, nonbondedCutoff, 0.0);
-        ixn.setUseCutoff(nonbondedCutoff, *neighborList);
+        updateNeighborList(context, *neighborList, numParticles, exclusions, periodic, nonbondedCutoff);
+        ixn->setUseCutoff(nonbondedCutoff, neighborList->getNeighborList());
     }
     if (periodic) {
         double minAllowedSize = 2*nonbondedCutoff;
         if (box[0] < minAllowedSize || box[1] < minAllowedSize || box[2] < minAllowedSize)
             throw OpenMMException("The periodic box size has decreased to less than twice the nonbonded cutoff.");
-        ixn.setPeriodic(box);
+        ixn->setPeriodic(box);
     }
-    if (interactionGroups.size() > 0)
-        ixn.setInteractionGroups(interactionGroups);
     bool globalParamsChanged = false;
     for (int i = 0; i < (int) globalParameterNames.size(); i++) {
         double value = context.getParameter(globalParameterNames[i]);
@@ -1109,8 +1279,9 @@ double ReferenceCalcCustomNonbondedForceKernel::execute(ContextImpl& context, bo
         globalParamValues[globalParameterNames[i]] = value;
     }
     if (useSwitchingFunction)
-        ixn.setUseSwitchingFunction(switchingDistance);
-    ixn.calculatePairIxn(numParticles, posData, particleParamArray, exclusions, 0, globalParamValues, forceData, 0, includeEnergy ? &energy : NULL);
+        ixn->setUseSwitchingFunction(switchingDistance);
+    ixn->setIncludeForces(includeForces);
+    ixn->calculatePairIxn(numParticles, posData, particleParamArray, exclusions, 0, globalParamValues, forceData, 0, includeEnergy ? &energy : NULL);
     
     // Add in the long range correction.
     
@@ -1182,6 +1353,7 @@ double ReferenceCalcGBSAOBCForceKernel::execute(ContextImpl& context, bool inclu
     vector<RealVec>& forceData = extractForces(context);
     if (isPeriodic)
         obc->getObcParameters()->setPeriodic(extractBoxSize(context));
+    obc->setIncludeForces(includeForces);
     return obc->computeBornEnergyForces(posData, charges, forceData);
 }
 
@@ -1319,7 +1491,7 @@ void ReferenceCalcCustomGBForceKernel::initialize(const System& system, const Cu
     if (nonbondedMethod == NoCutoff)
         neighborList = NULL;
     else
-        neighborList = new NeighborList();
+        neighborList = new ReferenceNeighborList();
 
     // Create custom functions for the tabulated functions.
 
@@ -1398,12 +1570,13 @@ double ReferenceCalcCustomGBForceKernel::execute(ContextImpl& context, bool incl
     if (periodic)
         ixn.setPeriodic(extractBoxSize(context));
     if (nonbondedMethod != NoCutoff) {
-        computeNeighborListVoxelHash(*neighborList, numParticles, posData, exclusions, extractBoxSize(context), periodic, nonbondedCutoff, 0.0);
-        ixn.setUseCutoff(nonbondedCutoff, *neighborList);
+        updateNeighborList(context, *neighborList, numParticles, exclusions, periodic, nonbondedCutoff);
+        ixn.setUseCutoff(nonbondedCutoff, neighborList->getNeighborList());
     }
     map<string, double> globalParameters;
     for (int i = 0; i < (int) globalParameterNames.size(); i++)
         globalParameters[globalParameterNames[i]] = context.getParameter(globalParameterNames[i]);
+    ixn.setIncludeForces(includeForces);
     ixn.calculateIxn(numParticles, posData, particleParamArray, exclusions, globalParameters, forceData, includeEnergy ? &energy : NULL);
     return energy;
 }
@@ -1464,6 +1637,7 @@ double ReferenceCalcCustomExternalForceKernel::execute(ContextImpl& context, boo
     for (int i = 0; i < (int) globalParameterNames.size(); i++)
         globalParameters[globalParameterNames[i]] = context.getParameter(globalParameterNames[i]);
     ReferenceCustomExternalIxn force(energyExpression, forceExpressionX, forceExpressionY, forceExpressionZ, parameterNames, globalParameters);
+    force.setIncludeForces(includeForces);
     for (int i = 0; i < numParticles; ++i)
         force.calculateForce(particles[i], posData, particleParamArray[i], forceData, includeEnergy ? &energy : NULL);
     return energy;
@@ -1585,6 +1759,7 @@ double ReferenceCalcCustomHbondForceKernel::execute(ContextImpl& context, bool i
     map<string, double> globalParameters;
     for (int i = 0; i < (int) globalParameterNames.size(); i++)
         globalParameters[globalParameterNames[i]] = context.getParameter(globalParameterNames[i]);
+    ixn->setIncludeForces(includeForces);
     ixn->calculatePairIxn(posData, donorParamArray, acceptorParamArray, exclusions, globalParameters, forceData, includeEnergy ? &energy : NULL);
     return energy;
 }
@@ -1679,6 +1854,7 @@ double ReferenceCalcCustomCompoundBondForceKernel::execute(ContextImpl& context,
     map<string, double> globalParameters;
     for (int i = 0; i < (int) globalParameterNames.size(); i++)
         globalParameters[globalParameterNames[i]] = context.getParameter(globalParameterNames[i]);
+    ixn->setIncludeForces(includeForces);
     ixn->calculatePairIxn(posData, bondParamArray, globalParameters, forceData, includeEnergy ? &energy : NULL);
     return energy;
 }
@@ -1716,19 +1892,7 @@ void ReferenceIntegrateVerletStepKernel::initialize(const System& system, const
     for (int i = 0; i < numParticles; ++i)
         masses[i] = static_cast<RealOpenMM>(system.getParticleMass(i));
     numConstraints = system.getNumConstraints();
-    vector<pair<int, int> > constraintIndices(numConstraints);
-    vector<RealOpenMM> constraintDistances(numConstraints);
-    for (int i = 0; i < numConstraints; ++i) {
-        int particle1, particle2;
-        double distance;
-        system.getConstraintParameters(i, particle1, particle2, distance);
-        constraintIndices[i].first = particle1;
-        constraintIndices[i].second = particle2;
-        constraintDistances[i] = static_cast<RealOpenMM>(distance);
-    }
-    vector<ReferenceCCMAAlgorithm::AngleInfo> angles;
-    findAnglesForCCMA(system, angles);
-    constraints = new ReferenceCCMAAlgorithm(system.getNumParticles(), numConstraints, constraintIndices, constraintDistances, masses, angles, (RealOpenMM)integrator.getConstraintTolerance());
+    constraints = new ReferenceConstraints(system, (RealOpenMM)integrator.getConstraintTolerance());
 }
 
 void ReferenceIntegrateVerletStepKernel::execute(ContextImpl& context, const VerletIntegrator& integrator) {
@@ -1768,20 +1932,8 @@ void ReferenceIntegrateLangevinStepKernel::initialize(const System& system, cons
     for (int i = 0; i < numParticles; ++i)
         masses[i] = static_cast<RealOpenMM>(system.getParticleMass(i));
     numConstraints = system.getNumConstraints();
-    vector<pair<int, int> > constraintIndices(numConstraints);
-    vector<RealOpenMM> constraintDistances(numConstraints);
-    for (int i = 0; i < numConstraints; ++i) {
-        int particle1, particle2;
-        double distance;
-        system.getConstraintParameters(i, particle1, particle2, distance);
-        constraintIndices[i].first = particle1;
-        constraintIndices[i].second = particle2;
-        constraintDistances[i] = static_cast<RealOpenMM>(distance);
-    }
     SimTKOpenMMUtilities::setRandomNumberSeed((unsigned int) integrator.getRandomNumberSeed());
-    vector<ReferenceCCMAAlgorithm::AngleInfo> angles;
-    findAnglesForCCMA(system, angles);
-    constraints = new ReferenceCCMAAlgorithm(system.getNumParticles(), numConstraints, constraintIndices, constraintDistances, masses, angles, (RealOpenMM)integrator.getConstraintTolerance());
+    constraints = new ReferenceConstraints(system, (RealOpenMM)integrator.getConstraintTolerance());
 }
 
 void ReferenceIntegrateLangevinStepKernel::execute(ContextImpl& context, const LangevinIntegrator& integrator) {
@@ -1830,20 +1982,8 @@ void ReferenceIntegrateBrownianStepKernel::initialize(const System& system, cons
     for (int i = 0; i < numParticles; ++i)
         masses[i] = static_cast<RealOpenMM>(system.getParticleMass(i));
     numConstraints = system.getNumConstraints();
-    vector<pair<int, int> > constraintIndices(numConstraints);
-    vector<RealOpenMM> constraintDistances(numConstraints);
-    for (int i = 0; i < numConstraints; ++i) {
-        int particle1, particle2;
-        double distance;
-        system.getConstraintParameters(i, particle1, particle2, distance);
-        constraintIndices[i].first = particle1;
-        constraintIndices[i].second = particle2;
-        constraintDistances[i] = static_cast<RealOpenMM>(distance);
-    }
     SimTKOpenMMUtilities::setRandomNumberSeed((unsigned int) integrator.getRandomNumberSeed());
-    vector<ReferenceCCMAAlgorithm::AngleInfo> angles;
-    findAnglesForCCMA(system, angles);
-    constraints = new ReferenceCCMAAlgorithm(system.getNumParticles(), numConstraints, constraintIndices, constraintDistances, masses, angles, (RealOpenMM)integrator.getConstraintTolerance());
+    constraints = new ReferenceConstraints(system, (RealOpenMM)integrator.getConstraintTolerance());
 }
 
 void ReferenceIntegrateBrownianStepKernel::execute(ContextImpl& context, const BrownianIntegrator& integrator) {
@@ -1891,20 +2031,8 @@ void ReferenceIntegrateVariableLangevinStepKernel::initialize(const System& syst
     for (int i = 0; i < numParticles; ++i)
         masses[i] = static_cast<RealOpenMM>(system.getParticleMass(i));
     numConstraints = system.getNumConstraints();
-    vector<pair<int, int> > constraintIndices(numConstraints);
-    vector<RealOpenMM> constraintDistances(numConstraints);
-    for (int i = 0; i < numConstraints; ++i) {
-        int particle1, particle2;
-        double distance;
-        system.getConstraintParameters(i, particle1, particle2, distance);
-        constraintIndices[i].first = particle1;
-        constraintIndices[i].second = particle2;
-        constraintDistances[i] = static_cast<RealOpenMM>(distance);
-    }
     SimTKOpenMMUtilities::setRandomNumberSeed((unsigned int) integrator.getRandomNumberSeed());
-    vector<ReferenceCCMAAlgorithm::AngleInfo> angles;
-    findAnglesForCCMA(system, angles);
-    constraints = new ReferenceCCMAAlgorithm(system.getNumParticles(), numConstraints, constraintIndices, constraintDistances, masses, angles, (RealOpenMM)integrator.getConstraintTolerance());
+    constraints = new ReferenceConstraints(system, (RealOpenMM)integrator.getConstraintTolerance());
 }
 
 double ReferenceIntegrateVariableLangevinStepKernel::execute(ContextImpl& context, const VariableLangevinIntegrator& integrator, double maxTime) {
@@ -1953,19 +2081,7 @@ void ReferenceIntegrateVariableVerletStepKernel::initialize(const System& system
     for (int i = 0; i < numParticles; ++i)
         masses[i] = static_cast<RealOpenMM>(system.getParticleMass(i));
     numConstraints = system.getNumConstraints();
-    vector<pair<int, int> > constraintIndices(numConstraints);
-    vector<RealOpenMM> constraintDistances(numConstraints);
-    for (int i = 0; i < numConstraints; ++i) {
-        int particle1, particle2;
-        double distance;
-        system.getConstraintParameters(i, particle1, particle2, distance);
-        constraintIndices[i].first = particle1;
-        constraintIndices[i].second = particle2;
-        constraintDistances[i] = static_cast<RealOpenMM>(distance);
-    }
-    vector<ReferenceCCMAAlgorithm::AngleInfo> angles;
-    findAnglesForCCMA(system, angles);
-    constraints = new ReferenceCCMAAlgorithm(system.getNumParticles(), numConstraints, constraintIndices, constraintDistances, masses, angles, (RealOpenMM)integrator.getConstraintTolerance());
+    constraints = new ReferenceConstraints(system, (RealOpenMM)integrator.getConstraintTolerance());
 }
 
 double ReferenceIntegrateVariableVerletStepKernel::execute(ContextImpl& context, const VariableVerletIntegrator& integrator, double maxTime) {
@@ -1996,6 +2112,47 @@ double ReferenceIntegrateVariableVerletStepKernel::computeKineticEnergy(ContextI
     return computeShiftedKineticEnergy(context, masses, 0.5*integrator.getStepSize(), constraints);
 }
 
+ReferenceIntegrateMTSStepKernel::~ReferenceIntegrateMTSStepKernel() {
+    if (dynamics)
+        delete dynamics;
+    if (constraints)
+        delete constraints;
+}
+
+void ReferenceIntegrateMTSStepKernel::initialize(const System& system, const MTSIntegrator& integrator) {
+    int numParticles = system.getNumParticles();
+    masses.resize(numParticles);
+    for (int i = 0; i < numParticles; ++i)
+        masses[i] = static_cast<RealOpenMM>(system.getParticleMass(i));
+    numConstraints = system.getNumConstraints();
+    constraints = new ReferenceConstraints(system, (RealOpenMM)integrator.getConstraintTolerance());
+}
+
+void ReferenceIntegrateMTSStepKernel::execute(ContextImpl& context, const MTSIntegrator& integrator, bool& forcesAreValid) {
+    double stepSize = integrator.getStepSize();
+    vector<RealVec>& posData = extractPositions(context);
+    vector<RealVec>& velData = extractVelocities(context);
+    vector<RealVec>& forceData = extractForces(context);
+    if (dynamics == 0 || stepSize != prevStepSize) {
+        // Recreate the computation objects with the new parameters.
+        
+        if (dynamics)
+            delete dynamics;
+        dynamics = new ReferenceMTSDynamics(context.getSystem().getNumParticles(), static_cast<RealOpenMM>(stepSize), integrator.getGroups());
+        dynamics->setReferenceConstraintAlgorithm(constraints);
+        prevStepSize = stepSize;
+        forcesAreValid = false;
+    }
+    constraints->setTolerance(integrator.getConstraintTolerance());
+    dynamics->update(context, posData, velData, forceData, masses, forcesAreValid);
+    data.time += stepSize;
+    data.stepCount++;
+}
+
+double ReferenceIntegrateMTSStepKernel::computeKineticEnergy(ContextImpl& context, const MTSIntegrator& integrator) {
+    return computeShiftedKineticEnergy(context, masses, 0.0, constraints);
+}
+
 ReferenceIntegrateCustomStepKernel::~ReferenceIntegrateCustomStepKernel() {
     if (dynamics)
         delete dynamics;
@@ -2009,16 +2166,6 @@ void ReferenceIntegrateCustomStepKernel::initialize(const System& system, const
     for (int i = 0; i < numParticles; ++i)
         masses[i] = static_cast<RealOpenMM>(system.getParticleMass(i));
     numConstraints = system.getNumConstraints();
-    vector<pair<int, int> > constraintIndices(numConstraints);
-    vector<RealOpenMM> constraintDistances(numConstraints);
-    for (int i = 0; i < numConstraints; ++i) {
-        int particle1, particle2;
-        double distance;
-        system.getConstraintParameters(i, particle1, particle2, distance);
-        constraintIndices[i].first = particle1;
-        constraintIndices[i].second = particle2;
-        constraintDistances[i] = static_cast<RealOpenMM>(distance);
-    }
     perDofValues.resize(integrator.getNumPerDofVariables());
     for (int i = 0; i < (int) perDofValues.size(); i++)
         perDofValues[i].resize(numParticles);
@@ -2026,9 +2173,7 @@ void ReferenceIntegrateCustomStepKernel::initialize(const System& system, const
     // Create the computation objects.
 
     dynamics = new ReferenceCustomDynamics(system.getNumParticles(), integrator);
-    vector<ReferenceCCMAAlgorithm::AngleInfo> angles;
-    findAnglesForCCMA(system, angles);
-    constraints = new ReferenceCCMAAlgorithm(system.getNumParticles(), numConstraints, constraintIndices, constraintDistances, masses, angles, (RealOpenMM)integrator.getConstraintTolerance());
+    constraints = new ReferenceConstraints(system, (RealOpenMM)integrator.getConstraintTolerance());
     dynamics->setReferenceConstraintAlgorithm(constraints);
 }
 
@@ -32,9 +32,11 @@
 #include "ReferencePlatform.h"
 #include "ReferenceKernelFactory.h"
 #include "ReferenceKernels.h"
+#include "openmm/OpenMMException.h"
 #include "openmm/internal/ContextImpl.h"
 #include "SimTKOpenMMRealType.h"
 #include "RealVec.h"
+#include <sstream>
 #include <vector>
 
 using namespace OpenMM;
@@ -67,10 +69,33 @@ ReferencePlatform::ReferencePlatform() {
     registerKernelFactory(IntegrateBrownianStepKernel::Name(), factory);
     registerKernelFactory(IntegrateVariableLangevinStepKernel::Name(), factory);
     registerKernelFactory(IntegrateVariableVerletStepKernel::Name(), factory);
+    registerKernelFactory(IntegrateMTSStepKernel::Name(), factory);
     registerKernelFactory(IntegrateCustomStepKernel::Name(), factory);
     registerKernelFactory(ApplyAndersenThermostatKernel::Name(), factory);
     registerKernelFactory(ApplyMonteCarloBarostatKernel::Name(), factory);
     registerKernelFactory(RemoveCMMotionKernel::Name(), factory);
+    platformProperties.push_back(ReferenceNeighborListSkin());
+    platformProperties.push_back(ReferenceNeighborListRebuilds());
+    platformProperties.push_back(ReferenceUseCpuPme());
+    setPropertyDefaultValue(ReferenceNeighborListSkin(), "0.1");
+    setPropertyDefaultValue(ReferenceNeighborListRebuilds(), "0");
+    setPropertyDefaultValue(ReferenceUseCpuPme(), "false");
+}
+
+static double parseSkin(const string& value) {
+    double skin = -1.0;
+    stringstream(value) >> skin;
+    if (skin < 0)
+        throw OpenMMException("Illegal value for ReferenceNeighborListSkin: "+value);
+    return skin;
+}
+
+static bool parseUseCpuPme(const string& value) {
+    if (value == "true")
+        return true;
+    if (value == "false")
+        return false;
+    throw OpenMMException("Illegal value for ReferenceUseCpuPme: "+value);
 }
 
 double ReferencePlatform::getSpeed() const {
@@ -81,8 +106,39 @@ bool ReferencePlatform::supportsDoublePrecision() const {
     return (sizeof(RealOpenMM) >= sizeof(double));
 }
 
+const string& ReferencePlatform::getPropertyValue(const Context& context, const string& property) const {
+    const ContextImpl& impl = getContextImpl(context);
+    PlatformData* data = reinterpret_cast<PlatformData*>(const_cast<void*>(impl.getPlatformData()));
+    if (property == ReferenceNeighborListRebuilds()) {
+        stringstream rebuilds;
+        rebuilds << data->neighborListRebuilds;
+        data->propertyValues[property] = rebuilds.str();
+    }
+    map<string, string>::const_iterator value = data->propertyValues.find(property);
+    if (value != data->propertyValues.end())
+        return value->second;
+    return Platform::getPropertyValue(context, property);
+}
+
+void ReferencePlatform::setPropertyValue(Context& context, const string& property, const string& value) const {
+    if (property != ReferenceNeighborListSkin())
+        throw OpenMMException("setPropertyValue: Illegal property name");
+    ContextImpl& impl = getContextImpl(context);
+    PlatformData* data = reinterpret_cast<PlatformData*>(impl.getPlatformData());
+    data->neighborListSkin = parseSkin(value);
+    data->propertyValues[property] = value;
+}
+
 void ReferencePlatform::contextCreated(ContextImpl& context, const map<string, string>& properties) const {
-    context.setPlatformData(new PlatformData(context.getSystem().getNumParticles()));
+    const string& skinPropValue = (properties.find(ReferenceNeighborListSkin()) == properties.end() ?
+            getPropertyDefaultValue(ReferenceNeighborListSkin()) : properties.find(ReferenceNeighborListSkin())->second);
+    const string& cpuPmePropValue = (properties.find(ReferenceUseCpuPme()) == properties.end() ?
+            getPropertyDefaultValue(ReferenceUseCpuPme()) : properties.find(ReferenceUseCpuPme())->second);
+    PlatformData* data = new PlatformData(context.getSystem().getNumParticles(), parseSkin(skinPropValue), parseUseCpuPme(cpuPmePropValue));
+    data->propertyValues[ReferenceNeighborListSkin()] = skinPropValue;
+    data->propertyValues[ReferenceUseCpuPme()] = cpuPmePropValue;
+    data->requireCpuPme = (data->useCpuPme && properties.find(ReferenceUseCpuPme()) != properties.end());
+    context.setPlatformData(data);
 }
 
 void ReferencePlatform::contextDestroyed(ContextImpl& context) const {
@@ -90,7 +146,8 @@ void ReferencePlatform::contextDestroyed(ContextImpl& context) const {
     delete data;
 }
 
-ReferencePlatform::PlatformData::PlatformData(int numParticles) : time(0.0), stepCount(0), numParticles(numParticles) {
+ReferencePlatform::PlatformData::PlatformData(int numParticles, double neighborListSkin, bool useCpuPme) : time(0.0), stepCount(0), numParticles(numParticles),
+        neighborListSkin(neighborListSkin), neighborListRebuilds(0), useCpuPme(useCpuPme), requireCpuPme(false) {
     positions = new vector<RealVec>(numParticles);
     velocities = new vector<RealVec>(numParticles);
     forces = new vector<RealVec>(numParticles);
@@ -36,11 +36,52 @@
 #include "PME.h"
 #include "fftpack.h"
 
+#ifdef OPENMM_REFERENCE_USE_FFTW
+#include "ReferenceFFTWPlannerLock.h"
+#include <fftw3.h>
+#include <vector>
+#endif
+
+// In case we're using some primitive version of Visual Studio this will
+// make sure that erf() and erfc() are defined.
+#include "openmm/internal/MSVC_erfc.h"
+
 using std::vector;
 using OpenMM::RealVec;
 
 typedef int    ivec[3];
 
+/* Atoms are processed in blocks of this size when calculating bsplines, so the recursion
+ * over the interpolation order can run over contiguous arrays of atoms.
+ */
+static const int PME_ATOM_BLOCK = 16;
+
+#ifdef OPENMM_REFERENCE_USE_FFTW
+#if RealOpenMMType == 2
+typedef fftw_plan     pme_fftw_plan;
+typedef fftw_complex  pme_fftw_complex;
+#define PME_FFTW(name) fftw_##name
+#else
+typedef fftwf_plan    pme_fftw_plan;
+typedef fftwf_complex pme_fftw_complex;
+#define PME_FFTW(name) fftwf_##name
+#endif
+
+/* Plans are created once for each grid size and then shared by every pme structure with that size,
+ * since they are applied with the new-array execute interface.  The grids are allocated with FFTW's
+ * allocator, so they all have the alignment the plans were created with.  Access to the cache is
+ * serialized by the same lock that guards the FFTW planner.
+ */
+struct pme_fftw_plans
+{
+    int           ngrid[3];
+    pme_fftw_plan forwardplan;
+    pme_fftw_plan backwardplan;
+};
+
+static vector<pme_fftw_plans> fftwPlanCache;
+#endif
+
 
 struct pme
 {
@@ -52,7 +93,12 @@ struct pme
                                         * grid[i*ngrid[1]*ngrid[2] + j*ngrid[2] + k]
                                         */
     int          ngrid[3];             /* Total grid dimensions (all data is complex!) */
+#ifdef OPENMM_REFERENCE_USE_FFTW
+    pme_fftw_plan forwardplan;         /* In-place FFTW plans for the grid, owned by fftwPlanCache */
+    pme_fftw_plan backwardplan;
+#else
     fftpack_t    fftplan;              /* Handle to fourier transform setup  */
+#endif
 
     int          order;                /* PME interpolation order. Almost always 4 */
 
@@ -68,6 +114,10 @@ struct pme
     rvec *       particlefraction;     /* Array of length natoms. Fractional offset in the grid for
                                         * each atom in all three dimensions.
                                         */
+    int *        gridoffset[3];        /* each of x/y/z has length order*natoms. The offsets into the grid of the
+                                        * order points each atom is spread to, with PBC already applied and
+                                        * premultiplied by the grid stride in that dimension.
+                                        */
 
     /* Further explanation of index/fraction:
      *
@@ -252,65 +302,120 @@ pme_update_grid_index_and_fraction(pme_t    pme,
             pme->particleindex[i][d]    = ti % pme->ngrid[d];
         }
     }
+
+    /* Precalculate the grid offsets each atom touches, so the spreading and interpolation loops
+     * need neither modulo operations nor index arithmetic.
+     */
+    int order     = pme->order;
+    int stride[3] = {pme->ngrid[1]*pme->ngrid[2], pme->ngrid[2], 1};
+    for(d=0;d<3;d++)
+    {
+        for(i=0;i<pme->natoms;i++)
+        {
+            int* offset = &(pme->gridoffset[d][i*order]);
+            int  index  = pme->particleindex[i][d];
+            for(int k=0;k<order;k++)
+            {
+                offset[k] = index*stride[d];
+                if(++index == pme->ngrid[d])
+                    index = 0;
+            }
+        }
+    }
 }
 
 
 /* Ugly bspline calculation taken from Tom Dardens reference equations.
- * This probably very sub-optimal in Cuda? Separate kernel?
  *
- * In practice, it might help to require order=4 for the cuda port.
+ * Atoms are processed in blocks of PME_ATOM_BLOCK. Within a block the coefficients are stored
+ * as data[k*PME_ATOM_BLOCK+atom], so every step of the recursion is a simple loop over atoms
+ * the compiler can vectorize. The results are then copied into the per-atom arrays, where
+ * the order coefficients for each atom are contiguous.
  */
 static void
 pme_update_bsplines(pme_t    pme)
 {
-    int       i,j,k,l;
+    int       j,k,l,a;
     int       order;
-    RealOpenMM    dr,div;
+    int       start,blocksize;
+    RealOpenMM    div;
+    RealOpenMM    dr[PME_ATOM_BLOCK];
     RealOpenMM *  data;
     RealOpenMM *  ddata;
 
     order = pme->order;
+    vector<RealOpenMM> blockdata(order*PME_ATOM_BLOCK);
+    vector<RealOpenMM> blockddata(order*PME_ATOM_BLOCK);
+    data  = &blockdata[0];
+    ddata = &blockddata[0];
 
-    for(i=0; (i<pme->natoms); i++)
+    for(start=0; start<pme->natoms; start+=PME_ATOM_BLOCK)
     {
+        blocksize = (pme->natoms-start < PME_ATOM_BLOCK) ? pme->natoms-start : PME_ATOM_BLOCK;
         for(j=0; j<3; j++)
         {
             /* dr is relative offset from lower cell limit */
-            dr = pme->particlefraction[i][j];
+            for(a=0; a<blocksize; a++)
+                dr[a] = pme->particlefraction[start+a][j];
 
-            data  = &(pme->bsplines_theta[j][i*order]);
-            ddata = &(pme->bsplines_dtheta[j][i*order]);
-            data[order-1] = 0;
-            data[1]       = dr;
-            data[0]       = 1-dr;
+            for(a=0; a<blocksize; a++)
+            {
+                data[(order-1)*PME_ATOM_BLOCK+a] = 0;
+                data[PME_ATOM_BLOCK+a]           = dr[a];
+                data[a]                          = 1-dr[a];
+            }
 
             for(k=3; k<order; k++)
             {
                 div = (RealOpenMM) (1.0/(k-1.0));
-                data[k-1] = div*dr*data[k-2];
+                for(a=0; a<blocksize; a++)
+                    data[(k-1)*PME_ATOM_BLOCK+a] = div*dr[a]*data[(k-2)*PME_ATOM_BLOCK+a];
                 for(l=1; l<(k-1); l++)
                 {
-                    data[k-l-1] = div*((dr+l)*data[k-l-2]+(k-l-dr)*data[k-l-1]);
+                    RealOpenMM* lower = &data[(k-l-2)*PME_ATOM_BLOCK];
+                    RealOpenMM* upper = &data[(k-l-1)*PME_ATOM_BLOCK];
+                    for(a=0; a<blocksize; a++)
+                        upper[a] = div*((dr[a]+l)*lower[a]+(k-l-dr[a])*upper[a]);
                 }
-                data[0] = div*(1-dr)*data[0];
+                for(a=0; a<blocksize; a++)
+                    data[a] = div*(1-dr[a])*data[a];
             }
 
             /* differentiate */
-            ddata[0] = -data[0];
+            for(a=0; a<blocksize; a++)
+                ddata[a] = -data[a];
 
             for(k=1; k<order; k++)
             {
-                ddata[k] = data[k-1]-data[k];
+                for(a=0; a<blocksize; a++)
+                    ddata[k*PME_ATOM_BLOCK+a] = data[(k-1)*PME_ATOM_BLOCK+a]-data[k*PME_ATOM_BLOCK+a];
             }
 
-            div           = (RealOpenMM) (1.0/(order-1));
-            data[order-1] = div*dr*data[order-2];
+            div = (RealOpenMM) (1.0/(order-1));
+            for(a=0; a<blocksize; a++)
+                data[(order-1)*PME_ATOM_BLOCK+a] = div*dr[a]*data[(order-2)*PME_ATOM_BLOCK+a];
 
             for(l=1; l<(order-1); l++)
             {
-                data[order-l-1] = div*((dr+l)*data[order-l-2]+(order-l-dr)*data[order-l-1]);
+                RealOpenMM* lower = &data[(order-l-2)*PME_ATOM_BLOCK];
+                RealOpenMM* upper = &data[(order-l-1)*PME_ATOM_BLOCK];
+                for(a=0; a<blocksize; a++)
+                    upper[a] = div*((dr[a]+l)*lower[a]+(order-l-dr[a])*upper[a]);
+            }
+            for(a=0; a<blocksize; a++)
+                data[a] = div*(1-dr[a])*data[a];
+
+            /* Store the coefficients contiguously for each atom */
+            for(a=0; a<blocksize; a++)
+            {
+                RealOpenMM* theta  = &(pme->bsplines_theta[j][(start+a)*order]);
+                RealOpenMM* dtheta = &(pme->bsplines_dtheta[j][(start+a)*order]);
+                for(k=0; k<order; k++)
+                {
+                    theta[k]  = data[k*PME_ATOM_BLOCK+a];
+                    dtheta[k] = ddata[k*PME_ATOM_BLOCK+a];
+                }
             }
-            data[0] = div*(1-dr)*data[0];
         }
     }
 }
@@ -318,19 +423,19 @@ pme_update_bsplines(pme_t    pme)
 
 static void
 pme_grid_spread_charge(pme_t      pme,
-                       RealOpenMM **   atomParameters)
+                       const vector<RealOpenMM>& charges)
 {
-        static const int   QIndex = 2; // atom charges are stored in atomParameters[atomID][2]
     int       order;
     int       i;
     int       ix,iy,iz;
-    int       x0index,y0index,z0index;
-    int       xindex,yindex,zindex;
-    int       index;
-    RealOpenMM    q;
+    RealOpenMM    q,qx,qxy;
     RealOpenMM *  thetax;
     RealOpenMM *  thetay;
     RealOpenMM *  thetaz;
+    int *     xoffset;
+    int *     yoffset;
+    int *     zoffset;
+    t_complex *   row;
 
     order = pme->order;
 
@@ -342,18 +447,20 @@ pme_grid_spread_charge(pme_t      pme,
 
     for(i=0;i<pme->natoms;i++)
     {
-        q = atomParameters[i][QIndex];
-
-        /* Grid index for the actual atom position */
-        x0index = pme->particleindex[i][0];
-        y0index = pme->particleindex[i][1];
-        z0index = pme->particleindex[i][2];
+        q = charges[i];
+        if(q == 0)
+            continue;
 
         /* Bspline factors for this atom in each dimension , calculated from fractional coordinates */
         thetax  = &(pme->bsplines_theta[0][i*order]);
         thetay  = &(pme->bsplines_theta[1][i*order]);
         thetaz  = &(pme->bsplines_theta[2][i*order]);
 
+        /* Grid offsets for the points this atom is spread to, with PBC already applied */
+        xoffset = &(pme->gridoffset[0][i*order]);
+        yoffset = &(pme->gridoffset[1][i*order]);
+        zoffset = &(pme->gridoffset[2][i*order]);
+
         /* Loop over norder*norder*norder (typically 4*4*4) neighbor cells.
          *
          * As a neat optimization, we only spread in the forward direction, but apply PBC!
@@ -370,25 +477,24 @@ pme_grid_spread_charge(pme_t      pme,
          * 1) The loops get much simpler
          * 2) Just looking forward will hopefully get us more cache hits
          * 3) When we parallelize things, we only need to communicate in one direction instead of two!
+         *
+         * The products of the charge with the x and y factors are hoisted out of the inner loop, which
+         * leaves a single multiply-add per grid point.
          */
 
         for(ix=0;ix<order;ix++)
         {
-            /* Calculate index, apply PBC so we spread to index 0/1/2 when a particle is close to the upper limit of the grid */
-            xindex = (x0index + ix) % pme->ngrid[0];
+            qx = q*thetax[ix];
 
             for(iy=0;iy<order;iy++)
             {
-                yindex = (y0index + iy) % pme->ngrid[1];
+                qxy = qx*thetay[iy];
+                row = pme->grid + xoffset[ix] + yoffset[iy];
 
                 for(iz=0;iz<order;iz++)
                 {
-                    /* Can be optimized, but we keep it simple here */
-                    zindex               = (z0index + iz) % pme->ngrid[2];
-                    /* Calculate index in the charge grid */
-                    index                = xindex*pme->ngrid[1]*pme->ngrid[2] + yindex*pme->ngrid[2] + zindex;
                     /* Add the charge times the bspline spread/interpolation factors to this grid position */
-                    pme->grid[index].re += q*thetax[ix]*thetay[iy]*thetaz[iz];
+                    row[zoffset[iz]].re += qxy*thetaz[iz];
                 }
             }
         }
@@ -520,18 +626,90 @@ pme_reciprocal_convolution(pme_t     pme,
 }
 
 
+/* Solve in k-space for the dispersion (r^-6) interaction.  Unlike the Coulomb case, the zero frequency
+ * term is included: the sum of all c6 coefficients does not vanish.  See Essmann et al., J. Chem. Phys. 103, 8577 (1995).
+ */
+static void
+pme_reciprocal_convolution_dispersion(pme_t     pme,
+                                      const RealOpenMM    periodicBoxSize[3],
+                                      RealOpenMM *  energy)
+{
+    int kx,ky,kz;
+    int nx,ny,nz;
+    RealOpenMM mx,my,mz;
+    RealOpenMM mhx,mhy,mhz,m2;
+    RealOpenMM bx,by,bz;
+    RealOpenMM d1,d2;
+    RealOpenMM b,b2,fb,eterm,struct2;
+    RealOpenMM esum;
+    RealOpenMM prefactor;
+    RealOpenMM maxkx,maxky,maxkz;
+    RealOpenMM sqrtpi;
+
+    t_complex *ptr;
+
+    nx = pme->ngrid[0];
+    ny = pme->ngrid[1];
+    nz = pme->ngrid[2];
+
+    sqrtpi = (RealOpenMM) sqrt(M_PI);
+    prefactor = (RealOpenMM) (-M_PI*sqrtpi*pme->ewaldcoeff*pme->ewaldcoeff*pme->ewaldcoeff/(periodicBoxSize[0]*periodicBoxSize[1]*periodicBoxSize[2]));
+
+    esum = 0;
+
+    maxkx = (RealOpenMM) ((nx+1)/2);
+    maxky = (RealOpenMM) ((ny+1)/2);
+    maxkz = (RealOpenMM) ((nz+1)/2);
+
+    for(kx=0;kx<nx;kx++)
+    {
+        mx  = (RealOpenMM) ((kx<maxkx) ? kx : (kx-nx));
+        mhx = mx/periodicBoxSize[0];
+        bx  = pme->bsplines_moduli[0][kx];
+
+        for(ky=0;ky<ny;ky++)
+        {
+            my  = (RealOpenMM) ((ky<maxky) ? ky : (ky-ny));
+            mhy = my/periodicBoxSize[1];
+            by  = pme->bsplines_moduli[1][ky];
+
+            for(kz=0;kz<nz;kz++)
+            {
+                mz        = (RealOpenMM) ((kz<maxkz) ? kz : (kz-nz));
+                mhz       = mz/periodicBoxSize[2];
+                bz        = pme->bsplines_moduli[2][kz];
+
+                ptr       = pme->grid + kx*ny*nz + ky*nz + kz;
+                d1        = ptr->re;
+                d2        = ptr->im;
+
+                /* f(b) = ((1-2b^2)exp(-b^2) + 2b^3 sqrt(pi) erfc(b))/3, with b = pi*|m|/beta */
+                m2        = mhx*mhx+mhy*mhy+mhz*mhz;
+                b         = (RealOpenMM) (M_PI*sqrt(m2)/pme->ewaldcoeff);
+                b2        = b*b;
+                fb        = (RealOpenMM) (((1-2*b2)*exp(-b2) + 2*b2*b*sqrtpi*erfc(b))/3);
+                eterm     = prefactor*fb/(bx*by*bz);
+
+                ptr->re   = d1*eterm;
+                ptr->im   = d2*eterm;
+
+                struct2   = (d1*d1+d2*d2);
+                esum     += eterm*struct2;
+            }
+        }
+    }
+    *energy = (RealOpenMM) (0.5*esum);
+}
+
+
 static void
 pme_grid_interpolate_force(pme_t      pme,
                            const RealOpenMM     periodicBoxSize[3],
-                           RealOpenMM **   atomParameters,
+                           const vector<RealOpenMM>& charges,
                            vector<RealVec>&   forces)
 {
-        static const int   QIndex = 2; // atom charges are stored in atomParameters[atomID][2]
     int       i;
     int       ix,iy,iz;
-    int       x0index,y0index,z0index;
-    int       xindex,yindex,zindex;
-    int       index;
     int       order;
     RealOpenMM    q;
     RealOpenMM *  thetax;
@@ -540,8 +718,13 @@ pme_grid_interpolate_force(pme_t      pme,
     RealOpenMM *  dthetax;
     RealOpenMM *  dthetay;
     RealOpenMM *  dthetaz;
-    RealOpenMM    tx,ty,tz;
-    RealOpenMM    dtx,dty,dtz;
+    int *     xoffset;
+    int *     yoffset;
+    int *     zoffset;
+    t_complex *   row;
+    RealOpenMM    tx,ty;
+    RealOpenMM    dtx,dty;
+    RealOpenMM    sz,dsz;
     RealOpenMM    fx,fy,fz;
     RealOpenMM    gridvalue;
     int       nx,ny,nz;
@@ -556,14 +739,11 @@ pme_grid_interpolate_force(pme_t      pme,
 
     for(i=0;i<pme->natoms;i++)
     {
-        fx = fy = fz = 0;
+        q = charges[i];
+        if(q == 0)
+            continue;
 
-        q = atomParameters[i][QIndex];
-
-        /* Grid index for the actual atom position */
-        x0index = pme->particleindex[i][0];
-        y0index = pme->particleindex[i][1];
-        z0index = pme->particleindex[i][2];
+        fx = fy = fz = 0;
 
         /* Bspline factors for this atom in each dimension , calculated from fractional coordinates */
         thetax  = &(pme->bsplines_theta[0][i*order]);
@@ -573,43 +753,40 @@ pme_grid_interpolate_force(pme_t      pme,
         dthetay = &(pme->bsplines_dtheta[1][i*order]);
         dthetaz = &(pme->bsplines_dtheta[2][i*order]);
 
+        xoffset = &(pme->gridoffset[0][i*order]);
+        yoffset = &(pme->gridoffset[1][i*order]);
+        zoffset = &(pme->gridoffset[2][i*order]);
+
         /* See pme_grid_spread_charge() for comments about the order here, and only interpolation in one direction */
 
-        /* Since we will add order^3 (typically 4*4*4=64) terms to the force on each particle, we use temporary fx/fy/fz
-         * variables, and only add it to memory forces[] at the end.
+        /* The z direction is reduced first: for each (x,y) row we only need the grid values weighted by
+         * the z bsplines and by their derivatives. The d component of the force is then the derived
+         * bspline in dimension d times the normal bsplines in the other two.
          */
         for(ix=0;ix<order;ix++)
         {
-            xindex = (x0index + ix) % pme->ngrid[0];
             /* Get both the bspline factor and its derivative with respect to the x coordinate! */
             tx     = thetax[ix];
             dtx    = dthetax[ix];
 
             for(iy=0;iy<order;iy++)
             {
-                yindex = (y0index + iy) % pme->ngrid[1];
                 /* bspline + derivative wrt y */
                 ty     = thetay[iy];
                 dty    = dthetay[iy];
+                row    = pme->grid + xoffset[ix] + yoffset[iy];
 
+                sz = dsz = 0;
                 for(iz=0;iz<order;iz++)
                 {
-                    /* Can be optimized, but we keep it simple here */
-                    zindex               = (z0index + iz) % pme->ngrid[2];
-                    /* bspline + derivative wrt z */
-                    tz                   = thetaz[iz];
-                    dtz                  = dthetaz[iz];
-                    index                = xindex*pme->ngrid[1]*pme->ngrid[2] + yindex*pme->ngrid[2] + zindex;
-
                     /* Get the fft+convoluted+ifft:d data from the grid, which must be real by definition */
-                    /* Checking that the imaginary part is indeed zero might be a good check :-) */
-                    gridvalue            = pme->grid[index].re;
-
-                    /* The d component of the force is calculated by taking the derived bspline in dimension d, normal bsplines in the other two */
-                    fx                  += dtx*ty*tz*gridvalue;
-                    fy                  += tx*dty*tz*gridvalue;
-                    fz                  += tx*ty*dtz*gridvalue;
+                    gridvalue  = row[zoffset[iz]].re;
+                    sz        += thetaz[iz]*gridvalue;
+                    dsz       += dthetaz[iz]*gridvalue;
                 }
+                fx += dtx*ty*sz;
+                fy += tx*dty*sz;
+                fz += tx*ty*dsz;
             }
         }
         /* Update memory force, note that we multiply by charge and some box stuff */
@@ -621,6 +798,62 @@ pme_grid_interpolate_force(pme_t      pme,
 
 
 
+/* Fourier transform setup and execution. FFTW is used when it is available, and the
+ * built in FFTPACK otherwise. Both compute unnormalized transforms with the same sign
+ * convention, so a forward-backward pair scales the data by the number of grid points.
+ */
+static void
+pme_fft_init(pme_t pme)
+{
+#ifdef OPENMM_REFERENCE_USE_FFTW
+    pme_fftw_complex* grid = (pme_fftw_complex*) pme->grid;
+    ReferenceFFTWPlannerLock::lock();
+    int i;
+    for (i = 0; i < (int) fftwPlanCache.size(); i++)
+        if (fftwPlanCache[i].ngrid[0] == pme->ngrid[0] && fftwPlanCache[i].ngrid[1] == pme->ngrid[1] && fftwPlanCache[i].ngrid[2] == pme->ngrid[2])
+            break;
+    if (i == (int) fftwPlanCache.size())
+    {
+        pme_fftw_plans plans;
+        for (int d = 0; d < 3; d++)
+            plans.ngrid[d] = pme->ngrid[d];
+        plans.forwardplan  = PME_FFTW(plan_dft_3d)(pme->ngrid[0], pme->ngrid[1], pme->ngrid[2], grid, grid, FFTW_FORWARD, FFTW_ESTIMATE);
+        plans.backwardplan = PME_FFTW(plan_dft_3d)(pme->ngrid[0], pme->ngrid[1], pme->ngrid[2], grid, grid, FFTW_BACKWARD, FFTW_ESTIMATE);
+        fftwPlanCache.push_back(plans);
+    }
+    pme->forwardplan  = fftwPlanCache[i].forwardplan;
+    pme->backwardplan = fftwPlanCache[i].backwardplan;
+    ReferenceFFTWPlannerLock::unlock();
+#else
+    fftpack_init_3d(&pme->fftplan,pme->ngrid[0],pme->ngrid[1],pme->ngrid[2]);
+#endif
+}
+
+
+static void
+pme_fft_exec(pme_t pme, bool forward)
+{
+#ifdef OPENMM_REFERENCE_USE_FFTW
+    pme_fftw_complex* grid = (pme_fftw_complex*) pme->grid;
+    PME_FFTW(execute_dft)(forward ? pme->forwardplan : pme->backwardplan, grid, grid);
+#else
+    fftpack_exec_3d(pme->fftplan,forward ? FFTPACK_FORWARD : FFTPACK_BACKWARD,pme->grid,pme->grid);
+#endif
+}
+
+
+static void
+pme_fft_destroy(pme_t pme)
+{
+#ifdef OPENMM_REFERENCE_USE_FFTW
+    /* The plans belong to the cache and are kept for reuse. */
+#else
+    fftpack_destroy(pme->fftplan);
+#endif
+}
+
+
+
 /* EXPORTED ROUTINES */
 
 int
@@ -646,15 +879,20 @@ pme_init(pme_t *       ppme,
         pme->ngrid[d]            = ngrid[d];
         pme->bsplines_theta[d]   = (RealOpenMM *)malloc(sizeof(RealOpenMM)*pme_order*natoms);
         pme->bsplines_dtheta[d]  = (RealOpenMM *)malloc(sizeof(RealOpenMM)*pme_order*natoms);
+        pme->gridoffset[d]       = (int *)malloc(sizeof(int)*pme_order*natoms);
     }
 
     pme->particlefraction = (rvec *)malloc(sizeof(rvec)*natoms);
     pme->particleindex    = (ivec *)malloc(sizeof(ivec)*natoms);
 
     /* Allocate charge grid storage */
+#ifdef OPENMM_REFERENCE_USE_FFTW
+    pme->grid        = (t_complex *)PME_FFTW(malloc)(sizeof(t_complex)*ngrid[0]*ngrid[1]*ngrid[2]);
+#else
     pme->grid        = (t_complex *)malloc(sizeof(t_complex)*ngrid[0]*ngrid[1]*ngrid[2]);
+#endif
 
-    fftpack_init_3d(&pme->fftplan,ngrid[0],ngrid[1],ngrid[2]);
+    pme_fft_init(pme);
 
     /* Setup bspline moduli (see Essman paper) */
     pme_calculate_bsplines_moduli(pme);
@@ -670,7 +908,7 @@ pme_init(pme_t *       ppme,
 
 int pme_exec(pme_t       pme,
              vector<RealVec>&   atomCoordinates,
-             vector<RealVec>&   forces,
+             vector<RealVec>*   forces,
              RealOpenMM **   atomParameters,
              const RealOpenMM      periodicBoxSize[3],
              RealOpenMM *    energy,
@@ -692,19 +930,52 @@ int pme_exec(pme_t       pme,
     pme_update_bsplines(pme);
 
     /* Spread the charges on grid (using newly calculated bsplines in the pme structure) */
-    pme_grid_spread_charge(pme,atomParameters);
+    static const int QIndex = 2; // atom charges are stored in atomParameters[atomID][2]
+    vector<RealOpenMM> charges(pme->natoms);
+    for (int i = 0; i < pme->natoms; i++)
+        charges[i] = atomParameters[i][QIndex];
+    pme_grid_spread_charge(pme,charges);
 
     /* do 3d-fft */
-    fftpack_exec_3d(pme->fftplan,FFTPACK_FORWARD,pme->grid,pme->grid);
+    pme_fft_exec(pme,true);
 
     /* solve in k-space */
     pme_reciprocal_convolution(pme,periodicBoxSize,energy,pme_virial);
 
+    /* The energy is known at this point, so nothing more is needed if forces were not requested */
+    if (forces == NULL)
+        return 0;
+
     /* do 3d-invfft */
-    fftpack_exec_3d(pme->fftplan,FFTPACK_BACKWARD,pme->grid,pme->grid);
+    pme_fft_exec(pme,false);
 
     /* Get the particle forces from the grid and bsplines in the pme structure */
-    pme_grid_interpolate_force(pme,periodicBoxSize,atomParameters,forces);
+    pme_grid_interpolate_force(pme,periodicBoxSize,charges,*forces);
+
+    return 0;
+}
+
+
+
+int pme_exec_dpme(pme_t       pme,
+                  vector<RealVec>&   atomCoordinates,
+                  vector<RealVec>*   forces,
+                  const vector<RealOpenMM>& c6s,
+                  const RealOpenMM      periodicBoxSize[3],
+                  RealOpenMM *    energy)
+{
+    /* This is identical to pme_exec(), except that the dispersion coefficients are spread instead of the charges,
+     * and a different function is used in k-space.
+     */
+    pme_update_grid_index_and_fraction(pme,atomCoordinates,periodicBoxSize);
+    pme_update_bsplines(pme);
+    pme_grid_spread_charge(pme,c6s);
+    pme_fft_exec(pme,true);
+    pme_reciprocal_convolution_dispersion(pme,periodicBoxSize,energy);
+    if (forces == NULL)
+        return 0;
+    pme_fft_exec(pme,false);
+    pme_grid_interpolate_force(pme,periodicBoxSize,c6s,*forces);
 
     return 0;
 }
@@ -716,19 +987,24 @@ pme_destroy(pme_t    pme)
 {
     int d;
 
+#ifdef OPENMM_REFERENCE_USE_FFTW
+    PME_FFTW(free)(pme->grid);
+#else
     free(pme->grid);
+#endif
 
     for(d=0;d<3;d++)
     {
         free(pme->bsplines_moduli[d]);
         free(pme->bsplines_theta[d]);
         free(pme->bsplines_dtheta[d]);
+        free(pme->gridoffset[d]);
     }
 
     free(pme->particlefraction);
     free(pme->particleindex);
 
-    fftpack_destroy(pme->fftplan);
+    pme_fft_destroy(pme);
 
     /* destroy structure itself */
     free(pme);
@@ -67,7 +67,8 @@ pme_init(pme_t *       ppme,
  *
  * pme         Opaque pme_t object, must have been initialized with pme_init()
  * x           Pointer to coordinate data array (nm)
- * f           Pointer to force data array (will be written as kJ/mol/nm)
+ * f           Pointer to force data array (will be written as kJ/mol/nm).  If this is NULL,
+ *             only the energy is computed and the inverse FFT is skipped.
  * charge      Array of charges (units of e)
  * box         Simulation cell dimensions (nm)
  * energy      Total energy (will be written in units of kJ/mol)
@@ -76,12 +77,35 @@ pme_init(pme_t *       ppme,
 int
 pme_exec(pme_t       pme,
          std::vector<OpenMM::RealVec>&  atomCoordinates,
-         std::vector<OpenMM::RealVec>&  forces,
+         std::vector<OpenMM::RealVec>*  forces,
          RealOpenMM **  atomParameters,
          const RealOpenMM  periodicBoxSize[3],
          RealOpenMM *    energy,
          RealOpenMM      pme_virial[3][3]);
 
+/*
+ * Evaluate reciprocal space energy and forces for the dispersion (r^-6) interaction.
+ * The pme_t object must have been initialized with the dispersion Ewald coefficient.
+ *
+ * Args:
+ *
+ * pme         Opaque pme_t object, must have been initialized with pme_init()
+ * x           Pointer to coordinate data array (nm)
+ * f           Pointer to force data array (will be written as kJ/mol/nm), or NULL to
+ *             compute only the energy
+ * c6s         Array of per-atom dispersion coefficients.  The coefficient for a pair
+ *             is the product of the two atoms' coefficients.
+ * box         Simulation cell dimensions (nm)
+ * energy      Total energy (will be written in units of kJ/mol)
+ */
+int
+pme_exec_dpme(pme_t       pme,
+              std::vector<OpenMM::RealVec>&  atomCoordinates,
+              std::vector<OpenMM::RealVec>*  forces,
+              const std::vector<RealOpenMM>& c6s,
+              const RealOpenMM  periodicBoxSize[3],
+              RealOpenMM *    energy);
+
 
 
 /* Release all memory in pme structure */
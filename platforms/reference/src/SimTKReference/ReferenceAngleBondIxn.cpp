@@ -164,6 +164,14 @@ void ReferenceAngleBondIxn::calculateBondIxn( int* atomIndices,
    RealOpenMM energy;
    getPrefactorsGivenAngleCosine( cosine, parameters, &dEdR, &energy );
 
+   // If only the energy is needed, there is no need to go further.
+
+   if (!includeForces) {
+      if (totalEnergy != NULL)
+          *totalEnergy += energy;
+      return;
+   }
+
    RealOpenMM termA           =  dEdR/(deltaR[0][ReferenceForce::R2Index]*rp);
    RealOpenMM termC           = -dEdR/(deltaR[1][ReferenceForce::R2Index]*rp);
 
@@ -40,7 +40,7 @@ using OpenMM::RealVec;
 
    --------------------------------------------------------------------------------------- */
 
-ReferenceBondIxn::ReferenceBondIxn( ){
+ReferenceBondIxn::ReferenceBondIxn( ) : includeForces(true) {
 
    // ---------------------------------------------------------------------------------------
 
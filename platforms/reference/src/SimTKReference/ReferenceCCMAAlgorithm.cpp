@@ -31,7 +31,9 @@
 #include "ReferenceCCMAAlgorithm.h"
 #include "ReferenceDynamics.h"
 #include "quern.h"
+#include "openmm/internal/ThreadPool.h"
 #include "openmm/Vec3.h"
+#include <algorithm>
 #include <map>
 
 using std::map;
@@ -93,119 +95,161 @@ ReferenceCCMAAlgorithm::ReferenceCCMAAlgorithm( int numberOfAtoms,
        _distanceTolerance          = SimTKOpenMMUtilities::allocateOneDRealOpenMMArray( numberOfConstraints, NULL, 1, zero, "distanceTolerance" );
        _reducedMasses              = SimTKOpenMMUtilities::allocateOneDRealOpenMMArray( numberOfConstraints, NULL, 1, zero, "reducedMasses" );
    }
+   _lastIterationCount         = 0;
+   _threads                    = NULL;
+   _iterationHistory.resize(_maximumNumberOfIterations+1, 0);
+   _clusterStart.push_back(0);
+   _matrixRowStart.push_back(0);
    if (numberOfConstraints > 0)
    {
-       // Compute the constraint coupling matrix
+       // Divide the constraints into clusters that share no atoms, and reorder them so the
+       // constraints in each cluster are contiguous.
+
+       vector<int> order;
+       findClusters(atomIndices, order, _clusterStart);
+       for (int i = 0; i < numberOfConstraints; i++) {
+           _atomIndices[i] = atomIndices[order[i]];
+           _distance[i] = distance[order[i]];
+       }
+
+       // Record which constraints involve each atom.
+
+       vector<vector<int> > atomConstraints(numberOfAtoms);
+       for (int i = 0; i < numberOfConstraints; i++) {
+           atomConstraints[_atomIndices[i].first].push_back(i);
+           atomConstraints[_atomIndices[i].second].push_back(i);
+       }
+
+       // Compute the constraint coupling matrix.  Only constraints that share an atom are coupled.
 
        vector<vector<int> > atomAngles(numberOfAtoms);
        for (int i = 0; i < (int) angles.size(); i++)
            atomAngles[angles[i].atom2].push_back(i);
-       vector<vector<pair<int, double> > > matrix(numberOfConstraints);
+       vector<map<int, double> > matrix(numberOfConstraints);
        for (int j = 0; j < numberOfConstraints; j++) {
-           for (int k = 0; k < numberOfConstraints; k++) {
-               if (j == k) {
-                   matrix[j].push_back(pair<int, double>(j, 1.0));
-                   continue;
-               }
-               double scale;
-               int atomj0 = _atomIndices[j].first;
-               int atomj1 = _atomIndices[j].second;
-               int atomk0 = _atomIndices[k].first;
-               int atomk1 = _atomIndices[k].second;
-               RealOpenMM invMass0 = one/masses[atomj0];
-               RealOpenMM invMass1 = one/masses[atomj1];
-               int atoma, atomb, atomc;
-               if (atomj0 == atomk0) {
-                   atoma = atomj1;
-                   atomb = atomj0;
-                   atomc = atomk1;
-                   scale = invMass0/(invMass0+invMass1);
-               }
-               else if (atomj1 == atomk1) {
-                   atoma = atomj0;
-                   atomb = atomj1;
-                   atomc = atomk0;
-                   scale = invMass1/(invMass0+invMass1);
-               }
-               else if (atomj0 == atomk1) {
-                   atoma = atomj1;
-                   atomb = atomj0;
-                   atomc = atomk0;
-                   scale = invMass0/(invMass0+invMass1);
-               }
-               else if (atomj1 == atomk0) {
-                   atoma = atomj0;
-                   atomb = atomj1;
-                   atomc = atomk1;
-                   scale = invMass1/(invMass0+invMass1);
-               }
-               else
-                   continue; // These constraints are not connected.
-
-               // Look for a third constraint forming a triangle with these two.
-
-               bool foundConstraint = false;
-               for (int other = 0; other < numberOfConstraints; other++) {
-                   if ((_atomIndices[other].first == atoma && _atomIndices[other].second == atomc) || (_atomIndices[other].first == atomc && _atomIndices[other].second == atoma)) {
-                       double d1 = _distance[j];
-                       double d2 = _distance[k];
-                       double d3 = _distance[other];
-                       matrix[j].push_back(pair<int, double>(k, scale*(d1*d1+d2*d2-d3*d3)/(2.0*d1*d2)));
-                       foundConstraint = true;
-                       break;
+           matrix[j][j] = 1.0;
+           int atomj0 = _atomIndices[j].first;
+           int atomj1 = _atomIndices[j].second;
+           int atoms[] = {atomj0, atomj1};
+           for (int m = 0; m < 2; m++) {
+               for (int n = 0; n < (int) atomConstraints[atoms[m]].size(); n++) {
+                   int k = atomConstraints[atoms[m]][n];
+                   if (k == j)
+                       continue;
+                   double scale;
+                   int atomk0 = _atomIndices[k].first;
+                   int atomk1 = _atomIndices[k].second;
+                   RealOpenMM invMass0 = one/masses[atomj0];
+                   RealOpenMM invMass1 = one/masses[atomj1];
+                   int atoma, atomb, atomc;
+                   if (atomj0 == atomk0) {
+                       atoma = atomj1;
+                       atomb = atomj0;
+                       atomc = atomk1;
+                       scale = invMass0/(invMass0+invMass1);
                    }
-               }
-               if (!foundConstraint) {
-                   // We didn't find one, so look for an angle force field term.
-
-                   const vector<int>& angleCandidates = atomAngles[atomb];
-                   for (vector<int>::const_iterator iter = angleCandidates.begin(); iter != angleCandidates.end(); iter++) {
-                       const AngleInfo& angle = angles[*iter];
-                       if ((angle.atom1 == atoma && angle.atom3 == atomc) || (angle.atom3 == atoma && angle.atom1 == atomc)) {
-                           matrix[j].push_back(pair<int, double>(k, scale*cos(angle.angle)));
+                   else if (atomj1 == atomk1) {
+                       atoma = atomj0;
+                       atomb = atomj1;
+                       atomc = atomk0;
+                       scale = invMass1/(invMass0+invMass1);
+                   }
+                   else if (atomj0 == atomk1) {
+                       atoma = atomj1;
+                       atomb = atomj0;
+                       atomc = atomk0;
+                       scale = invMass0/(invMass0+invMass1);
+                   }
+                   else {
+                       atoma = atomj0;
+                       atomb = atomj1;
+                       atomc = atomk1;
+                       scale = invMass1/(invMass0+invMass1);
+                   }
+
+                   // Look for a third constraint forming a triangle with these two.
+
+                   bool foundConstraint = false;
+                   for (int p = 0; p < (int) atomConstraints[atoma].size(); p++) {
+                       int other = atomConstraints[atoma][p];
+                       if ((_atomIndices[other].first == atoma && _atomIndices[other].second == atomc) || (_atomIndices[other].first == atomc && _atomIndices[other].second == atoma)) {
+                           double d1 = _distance[j];
+                           double d2 = _distance[k];
+                           double d3 = _distance[other];
+                           matrix[j][k] = scale*(d1*d1+d2*d2-d3*d3)/(2.0*d1*d2);
+                           foundConstraint = true;
                            break;
                        }
                    }
+                   if (!foundConstraint) {
+                       // We didn't find one, so look for an angle force field term.
+
+                       const vector<int>& angleCandidates = atomAngles[atomb];
+                       for (vector<int>::const_iterator iter = angleCandidates.begin(); iter != angleCandidates.end(); iter++) {
+                           const AngleInfo& angle = angles[*iter];
+                           if ((angle.atom1 == atoma && angle.atom3 == atomc) || (angle.atom3 == atoma && angle.atom1 == atomc)) {
+                               matrix[j][k] = scale*cos(angle.angle);
+                               break;
+                           }
+                       }
+                   }
                }
            }
        }
 
-       // Invert it using QR.
-
-       vector<int> matrixRowStart;
-       vector<int> matrixColIndex;
-       vector<double> matrixValue;
-       for (int i = 0; i < numberOfConstraints; i++) {
+       // The matrix is block diagonal with one block per cluster, so invert each block separately
+       // using QR, and store the inverse in compressed sparse row format.
+
+       vector<vector<pair<int, RealOpenMM> > > inverse(numberOfConstraints);
+       for (int cluster = 0; cluster < (int) _clusterStart.size()-1; cluster++) {
+           int start = _clusterStart[cluster];
+           int size = _clusterStart[cluster+1]-start;
+           vector<int> matrixRowStart;
+           vector<int> matrixColIndex;
+           vector<double> matrixValue;
+           for (int i = start; i < start+size; i++) {
+               matrixRowStart.push_back(matrixValue.size());
+               for (map<int, double>::const_iterator element = matrix[i].begin(); element != matrix[i].end(); ++element) {
+                   matrixColIndex.push_back(element->first-start);
+                   matrixValue.push_back(element->second);
+               }
+           }
            matrixRowStart.push_back(matrixValue.size());
-           for (int j = 0; j < (int) matrix[i].size(); j++) {
-               pair<int, double> element = matrix[i][j];
-               matrixColIndex.push_back(element.first);
-               matrixValue.push_back(element.second);
+           int *qRowStart, *qColIndex, *rRowStart, *rColIndex;
+           double *qValue, *rValue;
+           QUERN_compute_qr(size, size, &matrixRowStart[0], &matrixColIndex[0], &matrixValue[0], NULL,
+                   &qRowStart, &qColIndex, &qValue, &rRowStart, &rColIndex, &rValue);
+           vector<double> rhs(size);
+           for (int i = 0; i < size; i++) {
+               // Extract column i of the inverse matrix.
+
+               for (int j = 0; j < size; j++)
+                   rhs[j] = (i == j ? 1.0 : 0.0);
+               QUERN_multiply_with_q_transpose(size, qRowStart, qColIndex, qValue, &rhs[0]);
+               QUERN_solve_with_r(size, rRowStart, rColIndex, rValue, &rhs[0], &rhs[0]);
+               for (int j = 0; j < size; j++) {
+                   double value = rhs[j]*_distance[start+i]/_distance[start+j];
+                   if (FABS((RealOpenMM)value) > 0.02)
+                       inverse[start+j].push_back(pair<int, RealOpenMM>(start+i, (RealOpenMM) value));
+               }
            }
+           QUERN_free_result(qRowStart, qColIndex, qValue);
+           QUERN_free_result(rRowStart, rColIndex, rValue);
        }
-       matrixRowStart.push_back(matrixValue.size());
-       int *qRowStart, *qColIndex, *rRowStart, *rColIndex;
-       double *qValue, *rValue;
-       QUERN_compute_qr(numberOfConstraints, numberOfConstraints, &matrixRowStart[0], &matrixColIndex[0], &matrixValue[0], NULL,
-               &qRowStart, &qColIndex, &qValue, &rRowStart, &rColIndex, &rValue);
-       vector<double> rhs(numberOfConstraints);
-       _matrix.resize(numberOfConstraints);
        for (int i = 0; i < numberOfConstraints; i++) {
-           // Extract column i of the inverse matrix.
-
-           for (int j = 0; j < numberOfConstraints; j++)
-               rhs[j] = (i == j ? 1.0 : 0.0);
-           QUERN_multiply_with_q_transpose(numberOfConstraints, qRowStart, qColIndex, qValue, &rhs[0]);
-           QUERN_solve_with_r(numberOfConstraints, rRowStart, rColIndex, rValue, &rhs[0], &rhs[0]);
-           for (int j = 0; j < numberOfConstraints; j++) {
-               double value = rhs[j]*_distance[i]/_distance[j];
-               if (FABS((RealOpenMM)value) > 0.02)
-                   _matrix[j].push_back(pair<int, RealOpenMM>(i, (RealOpenMM) value));
+           for (int j = 0; j < (int) inverse[i].size(); j++) {
+               _matrixColumn.push_back(inverse[i][j].first);
+               _matrixValue.push_back(inverse[i][j].second);
            }
+           _matrixRowStart.push_back(_matrixValue.size());
        }
-       QUERN_free_result(qRowStart, qColIndex, qValue);
-       QUERN_free_result(rRowStart, rColIndex, rValue);
+       _constraintDelta.resize(numberOfConstraints);
+       _tempDelta.resize(numberOfConstraints);
    }
+   _clusterIterations.resize(_clusterStart.size()-1);
+   _clusterConverged.resize(_clusterStart.size()-1);
+   _threadClusterStart.push_back(0);
+   _threadClusterStart.push_back(_clusterStart.size()-1);
 }
 
 /**---------------------------------------------------------------------------------------
@@ -364,28 +408,34 @@ int ReferenceCCMAAlgorithm::applyToVelocities(int numberOfAtoms, std::vector<Ope
     return applyConstraints(numberOfAtoms, atomCoordinates, velocities, inverseMasses, true);
 }
 
+class ReferenceCCMAAlgorithm::ClusterTask : public OpenMM::ThreadPool::Task {
+public:
+    ClusterTask(ReferenceCCMAAlgorithm& owner, vector<RealVec>& atomCoordinates, vector<RealVec>& atomCoordinatesP,
+            vector<RealOpenMM>& inverseMasses, bool constrainingVelocities) : owner(owner), atomCoordinates(atomCoordinates),
+            atomCoordinatesP(atomCoordinatesP), inverseMasses(inverseMasses), constrainingVelocities(constrainingVelocities) {
+    }
+    void execute(OpenMM::ThreadPool& threads, int threadIndex) {
+        int start = owner._threadClusterStart[threadIndex];
+        int end = owner._threadClusterStart[threadIndex+1];
+        for (int cluster = start; cluster < end; cluster++)
+            owner.applyToCluster(cluster, atomCoordinates, atomCoordinatesP, inverseMasses, constrainingVelocities);
+    }
+    ReferenceCCMAAlgorithm& owner;
+    vector<RealVec>& atomCoordinates;
+    vector<RealVec>& atomCoordinatesP;
+    vector<RealOpenMM>& inverseMasses;
+    bool constrainingVelocities;
+};
+
 int ReferenceCCMAAlgorithm::applyConstraints(int numberOfAtoms, vector<RealVec>& atomCoordinates,
                                          vector<RealVec>& atomCoordinatesP,
                                          vector<RealOpenMM>& inverseMasses, bool constrainingVelocities){
    // ---------------------------------------------------------------------------------------
 
-   static const char* methodName = "\nReferenceCCMAAlgorithm::apply";
-
-   static const RealOpenMM zero        =  0.0;
-   static const RealOpenMM one         =  1.0;
-   static const RealOpenMM two         =  2.0;
    static const RealOpenMM half        =  0.5;
 
-   static const RealOpenMM epsilon6    = (RealOpenMM) 1.0e-06;
-
    // ---------------------------------------------------------------------------------------
 
-   // temp arrays
-
-   vector<RealVec>& r_ij               = _r_ij;
-   RealOpenMM* d_ij2                   = _d_ij2;
-   RealOpenMM* reducedMasses           = _reducedMasses;
-
    // calculate reduced masses on 1st pass
 
    if( !_hasInitializedMasses ){
@@ -393,15 +443,61 @@ int ReferenceCCMAAlgorithm::applyConstraints(int numberOfAtoms, vector<RealVec>&
       for( int ii = 0; ii < _numberOfConstraints; ii++ ){
          int atomI          = _atomIndices[ii].first;
          int atomJ          = _atomIndices[ii].second;
-         reducedMasses[ii]  = half/( inverseMasses[atomI] + inverseMasses[atomJ] );
+         _reducedMasses[ii] = half/( inverseMasses[atomI] + inverseMasses[atomJ] );
       }
    }
 
+   // Clusters share no atoms, so each one can be iterated to convergence independently.
+
+   int numberOfClusters = _clusterStart.size()-1;
+   if (_threads != NULL && _threadClusterStart.size() > 2) {
+      ClusterTask task(*this, atomCoordinates, atomCoordinatesP, inverseMasses, constrainingVelocities);
+      _threads->execute(task);
+   }
+   else {
+      for (int cluster = 0; cluster < numberOfClusters; cluster++)
+         applyToCluster(cluster, atomCoordinates, atomCoordinatesP, inverseMasses, constrainingVelocities);
+   }
+
+   // Record how many iterations were needed.
+
+   bool converged = true;
+   _lastIterationCount = 0;
+   for (int cluster = 0; cluster < numberOfClusters; cluster++) {
+      if (!_clusterConverged[cluster])
+         converged = false;
+      _lastIterationCount = std::max(_lastIterationCount, _clusterIterations[cluster]);
+   }
+   if (_lastIterationCount >= (int) _iterationHistory.size())
+      _iterationHistory.resize(_lastIterationCount+1, 0);
+   _iterationHistory[_lastIterationCount]++;
+   return (converged ? SimTKOpenMMCommon::DefaultReturn : SimTKOpenMMCommon::ErrorReturn);
+}
+
+void ReferenceCCMAAlgorithm::applyToCluster(int cluster, vector<RealVec>& atomCoordinates,
+                                            vector<RealVec>& atomCoordinatesP,
+                                            vector<RealOpenMM>& inverseMasses, bool constrainingVelocities){
+   // ---------------------------------------------------------------------------------------
+
+   static const RealOpenMM zero        =  0.0;
+   static const RealOpenMM one         =  1.0;
+   static const RealOpenMM two         =  2.0;
+
+   static const RealOpenMM epsilon6    = (RealOpenMM) 1.0e-06;
+
+   // ---------------------------------------------------------------------------------------
+
+   int start = _clusterStart[cluster];
+   int end = _clusterStart[cluster+1];
+   RealOpenMM* d_ij2                   = _d_ij2;
+   RealOpenMM* reducedMasses           = _reducedMasses;
+   vector<RealVec>& r_ij               = _r_ij;
+   vector<RealOpenMM>& constraintDelta = _constraintDelta;
+   vector<RealOpenMM>& tempDelta       = _tempDelta;
+
    // setup: r_ij for each (i,j) constraint
 
-   RealOpenMM tolerance     = getTolerance();
-              tolerance    *= two;
-   for( int ii = 0; ii < _numberOfConstraints; ii++ ){
+   for( int ii = start; ii < end; ii++ ){
       int atomI   = _atomIndices[ii].first;
       int atomJ   = _atomIndices[ii].second;
       r_ij[ii] = atomCoordinates[atomI] - atomCoordinates[atomJ];
@@ -414,11 +510,9 @@ int ReferenceCCMAAlgorithm::applyConstraints(int numberOfAtoms, vector<RealVec>&
 
    int iterations           = 0;
    int numberConverged      = 0;
-   vector<RealOpenMM> constraintDelta(_numberOfConstraints);
-   vector<RealOpenMM> tempDelta(_numberOfConstraints);
    while (iterations < getMaximumNumberOfIterations()) {
       numberConverged  = 0;
-      for( int ii = 0; ii < _numberOfConstraints; ii++ ){
+      for( int ii = start; ii < end; ii++ ){
 
          int atomI   = _atomIndices[ii].first;
          int atomJ   = _atomIndices[ii].second;
@@ -447,33 +541,105 @@ int ReferenceCCMAAlgorithm::applyConstraints(int numberOfAtoms, vector<RealVec>&
                 numberConverged++;
          }
       }
-      if( numberConverged == _numberOfConstraints )
+      if( numberConverged == end-start )
          break;
       iterations++;
 
-      if (_matrix.size() > 0) {
-          for (int i = 0; i < _numberOfConstraints; i++) {
-              RealOpenMM sum = 0.0;
-              for (int j = 0; j < (int) _matrix[i].size(); j++) {
-                  pair<int, RealOpenMM> element = _matrix[i][j];
-                  sum += element.second*constraintDelta[element.first];
-              }
-              tempDelta[i] = sum;
-          }
-          constraintDelta = tempDelta;
+      // Multiply by the inverted coupling matrix.  Every row in this cluster only refers to
+      // constraints in the same cluster.
+
+      for (int i = start; i < end; i++) {
+          RealOpenMM sum = 0.0;
+          for (int j = _matrixRowStart[i]; j < _matrixRowStart[i+1]; j++)
+              sum += _matrixValue[j]*constraintDelta[_matrixColumn[j]];
+          tempDelta[i] = sum;
       }
-      for( int ii = 0; ii < _numberOfConstraints; ii++ ){
+      for( int ii = start; ii < end; ii++ ){
 
          int atomI   = _atomIndices[ii].first;
          int atomJ   = _atomIndices[ii].second;
-         RealVec dr = r_ij[ii]*constraintDelta[ii];
+         RealVec dr = r_ij[ii]*tempDelta[ii];
          atomCoordinatesP[atomI] += dr*inverseMasses[atomI];
          atomCoordinatesP[atomJ] -= dr*inverseMasses[atomJ];
       }
    }
+   _clusterIterations[cluster] = iterations;
+   _clusterConverged[cluster] = (numberConverged == end-start);
+}
+
+/**---------------------------------------------------------------------------------------
+
+   Get the number of clusters of coupled constraints
 
-   return (numberConverged == _numberOfConstraints ? SimTKOpenMMCommon::DefaultReturn : SimTKOpenMMCommon::ErrorReturn);
+   --------------------------------------------------------------------------------------- */
+
+int ReferenceCCMAAlgorithm::getNumberOfClusters( void ) const {
+   return _clusterStart.size()-1;
+}
+
+/**---------------------------------------------------------------------------------------
+
+   Set the thread pool used to process clusters in parallel
+
+   @param threads   the ThreadPool to use, or NULL to process clusters on the calling thread
+
+   --------------------------------------------------------------------------------------- */
+
+void ReferenceCCMAAlgorithm::setThreadPool( OpenMM::ThreadPool* threads ){
+   _threads = threads;
+   _threadClusterStart.clear();
+   _threadClusterStart.push_back(0);
+   int numberOfClusters = _clusterStart.size()-1;
+   if (threads == NULL || numberOfClusters < 2) {
+      _threadClusterStart.push_back(numberOfClusters);
+      return;
+   }
+
+   // Give each thread a contiguous range of clusters with about the same number of matrix elements.
+
+   int numThreads = threads->getNumThreads();
+   long long totalWork = _matrixRowStart[_numberOfConstraints];
+   int cluster = 0;
+   for (int i = 1; i < numThreads; i++) {
+      long long target = (totalWork*i)/numThreads;
+      while (cluster < numberOfClusters && _matrixRowStart[_clusterStart[cluster]] < target)
+         cluster++;
+      _threadClusterStart.push_back(cluster);
+   }
+   _threadClusterStart.push_back(numberOfClusters);
+}
+
+/**---------------------------------------------------------------------------------------
+
+   Get the number of iterations required by the most recent call to apply() or
+   applyToVelocities().  This is the maximum over all clusters.
+
+   --------------------------------------------------------------------------------------- */
+
+int ReferenceCCMAAlgorithm::getLastIterationCount( void ) const {
+   return _lastIterationCount;
+}
+
+/**---------------------------------------------------------------------------------------
+
+   Get the convergence history.  Element i is the number of calls to apply() or
+   applyToVelocities() that required i iterations.  A call that failed to converge is
+   counted under the maximum number of iterations.
+
+   --------------------------------------------------------------------------------------- */
+
+const vector<long long>& ReferenceCCMAAlgorithm::getIterationHistory( void ) const {
+   return _iterationHistory;
+}
+
+/**---------------------------------------------------------------------------------------
+
+   Reset the convergence history
+
+   --------------------------------------------------------------------------------------- */
 
+void ReferenceCCMAAlgorithm::resetIterationHistory( void ){
+   _iterationHistory.assign(_iterationHistory.size(), 0);
 }
 
 /**---------------------------------------------------------------------------------------
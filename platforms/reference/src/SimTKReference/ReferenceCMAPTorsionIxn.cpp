@@ -136,6 +136,8 @@ void ReferenceCMAPTorsionIxn::calculateOneIxn(int index, vector<RealVec>& atomCo
     dEdB /= delta;
     if (totalEnergy != NULL)
         *totalEnergy += energy;
+    if (!includeForces)
+        return;
 
     // Apply the force to the first torsion.
 
@@ -0,0 +1,72 @@
+
+/* Portions copyright (c) 2013 Stanford University and Simbios.
+ * Contributors: Peter Eastman
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject
+ * to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS, CONTRIBUTORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include "ReferenceConstraintAlgorithm.h"
+#include <algorithm>
+
+using std::pair;
+using std::vector;
+
+void ReferenceConstraintAlgorithm::findClusters(const vector<pair<int, int> >& atomIndices, vector<int>& clusterConstraints,
+            vector<int>& clusterStart) {
+    int numConstraints = atomIndices.size();
+    int numAtoms = 0;
+    for (int i = 0; i < numConstraints; i++)
+        numAtoms = std::max(numAtoms, std::max(atomIndices[i].first, atomIndices[i].second)+1);
+
+    // Record which constraints involve each atom.
+
+    vector<vector<int> > atomConstraints(numAtoms);
+    for (int i = 0; i < numConstraints; i++) {
+        atomConstraints[atomIndices[i].first].push_back(i);
+        atomConstraints[atomIndices[i].second].push_back(i);
+    }
+
+    // Do a breadth first search from each constraint not yet assigned to a cluster.
+
+    clusterConstraints.clear();
+    clusterStart.clear();
+    clusterStart.push_back(0);
+    vector<bool> visited(numConstraints, false);
+    for (int i = 0; i < numConstraints; i++) {
+        if (visited[i])
+            continue;
+        visited[i] = true;
+        int first = clusterConstraints.size();
+        clusterConstraints.push_back(i);
+        for (int next = first; next < (int) clusterConstraints.size(); next++) {
+            int atoms[] = {atomIndices[clusterConstraints[next]].first, atomIndices[clusterConstraints[next]].second};
+            for (int j = 0; j < 2; j++)
+                for (int k = 0; k < (int) atomConstraints[atoms[j]].size(); k++) {
+                    int other = atomConstraints[atoms[j]][k];
+                    if (!visited[other]) {
+                        visited[other] = true;
+                        clusterConstraints.push_back(other);
+                    }
+                }
+        }
+        std::sort(clusterConstraints.begin()+first, clusterConstraints.end());
+        clusterStart.push_back(clusterConstraints.size());
+    }
+}
@@ -0,0 +1,184 @@
+/* Portions copyright (c) 2013 Stanford University and Simbios.
+ * Contributors: Peter Eastman
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject
+ * to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS, CONTRIBUTORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include "ReferenceConstraints.h"
+#include "SimTKOpenMMCommon.h"
+#include "openmm/HarmonicAngleForce.h"
+#include <map>
+
+using namespace std;
+using namespace OpenMM;
+
+ReferenceConstraints::ReferenceConstraints(const System& system, RealOpenMM tolerance) : ccma(NULL), settle(NULL), tolerance(tolerance) {
+    int numParticles = system.getNumParticles();
+    int numConstraints = system.getNumConstraints();
+    vector<RealOpenMM> masses(numParticles);
+    for (int i = 0; i < numParticles; i++)
+        masses[i] = (RealOpenMM) system.getParticleMass(i);
+
+    // Record the constraints involving every atom that belongs to exactly two of them.
+
+    vector<int> constraintCount(numParticles, 0);
+    for (int i = 0; i < numConstraints; i++) {
+        int particle1, particle2;
+        double distance;
+        system.getConstraintParameters(i, particle1, particle2, distance);
+        constraintCount[particle1]++;
+        constraintCount[particle2]++;
+    }
+    vector<map<int, int> > settleConstraints(numParticles);
+    for (int i = 0; i < numConstraints; i++) {
+        int particle1, particle2;
+        double distance;
+        system.getConstraintParameters(i, particle1, particle2, distance);
+        if (constraintCount[particle1] == 2 && constraintCount[particle2] == 2) {
+            settleConstraints[particle1][particle2] = i;
+            settleConstraints[particle2][particle1] = i;
+        }
+    }
+
+    // A cluster can be handled by SETTLE if its three atoms are all constrained to each other, two of
+    // the distances are equal, and the two atoms at the ends of the equal distances have equal masses.
+
+    vector<bool> isSettleConstraint(numConstraints, false);
+    vector<int> settleAtom1, settleAtom2, settleAtom3;
+    vector<RealOpenMM> settleDistance1, settleDistance2;
+    for (int i = 0; i < numParticles; i++) {
+        if (settleConstraints[i].size() != 2)
+            continue;
+        int j = settleConstraints[i].begin()->first;
+        int k = (++settleConstraints[i].begin())->first;
+        if (j < i || k < i || settleConstraints[j].count(k) == 0)
+            continue;
+        int particle1, particle2;
+        double distij, distik, distjk;
+        system.getConstraintParameters(settleConstraints[i][j], particle1, particle2, distij);
+        system.getConstraintParameters(settleConstraints[i][k], particle1, particle2, distik);
+        system.getConstraintParameters(settleConstraints[j][k], particle1, particle2, distjk);
+        int center, outer1, outer2;
+        double centerDist, outerDist;
+        if (distij == distik) {
+            center = i; outer1 = j; outer2 = k;
+            centerDist = distij; outerDist = distjk;
+        }
+        else if (distij == distjk) {
+            center = j; outer1 = i; outer2 = k;
+            centerDist = distij; outerDist = distik;
+        }
+        else if (distik == distjk) {
+            center = k; outer1 = i; outer2 = j;
+            centerDist = distik; outerDist = distij;
+        }
+        else
+            continue;
+        if (masses[center] == 0 || masses[outer1] == 0 || masses[outer1] != masses[outer2] || outerDist >= 2*centerDist)
+            continue;
+        settleAtom1.push_back(center);
+        settleAtom2.push_back(outer1);
+        settleAtom3.push_back(outer2);
+        settleDistance1.push_back((RealOpenMM) centerDist);
+        settleDistance2.push_back((RealOpenMM) outerDist);
+        isSettleConstraint[settleConstraints[i][j]] = true;
+        isSettleConstraint[settleConstraints[i][k]] = true;
+        isSettleConstraint[settleConstraints[j][k]] = true;
+    }
+    if (settleAtom1.size() > 0)
+        settle = new ReferenceSETTLEAlgorithm(settleAtom1, settleAtom2, settleAtom3, settleDistance1, settleDistance2, masses);
+
+    // All other constraints are handled with CCMA.
+
+    vector<pair<int, int> > ccmaIndices;
+    vector<RealOpenMM> ccmaDistances;
+    for (int i = 0; i < numConstraints; i++) {
+        if (isSettleConstraint[i])
+            continue;
+        int particle1, particle2;
+        double distance;
+        system.getConstraintParameters(i, particle1, particle2, distance);
+        ccmaIndices.push_back(make_pair(particle1, particle2));
+        ccmaDistances.push_back((RealOpenMM) distance);
+    }
+    if (ccmaIndices.size() > 0) {
+        vector<ReferenceCCMAAlgorithm::AngleInfo> angles;
+        for (int i = 0; i < system.getNumForces(); i++) {
+            const HarmonicAngleForce* force = dynamic_cast<const HarmonicAngleForce*>(&system.getForce(i));
+            if (force != NULL) {
+                for (int j = 0; j < force->getNumAngles(); j++) {
+                    int atom1, atom2, atom3;
+                    double angle, k;
+                    force->getAngleParameters(j, atom1, atom2, atom3, angle, k);
+                    angles.push_back(ReferenceCCMAAlgorithm::AngleInfo(atom1, atom2, atom3, (RealOpenMM) angle));
+                }
+            }
+        }
+        ccma = new ReferenceCCMAAlgorithm(numParticles, ccmaIndices.size(), ccmaIndices, ccmaDistances, masses, angles, tolerance);
+    }
+}
+
+ReferenceConstraints::~ReferenceConstraints() {
+    if (ccma != NULL)
+        delete ccma;
+    if (settle != NULL)
+        delete settle;
+}
+
+ReferenceCCMAAlgorithm* ReferenceConstraints::getCCMAAlgorithm() const {
+    return ccma;
+}
+
+ReferenceSETTLEAlgorithm* ReferenceConstraints::getSETTLEAlgorithm() const {
+    return settle;
+}
+
+void ReferenceConstraints::setThreadPool(ThreadPool* threads) {
+    if (ccma != NULL)
+        ccma->setThreadPool(threads);
+}
+
+RealOpenMM ReferenceConstraints::getTolerance() const {
+    return tolerance;
+}
+
+void ReferenceConstraints::setTolerance(RealOpenMM tolerance) {
+    this->tolerance = tolerance;
+    if (ccma != NULL)
+        ccma->setTolerance(tolerance);
+}
+
+int ReferenceConstraints::apply(int numberOfAtoms, vector<RealVec>& atomCoordinates, vector<RealVec>& atomCoordinatesP, vector<RealOpenMM>& inverseMasses) {
+    int result = SimTKOpenMMCommon::DefaultReturn;
+    if (ccma != NULL)
+        result = ccma->apply(numberOfAtoms, atomCoordinates, atomCoordinatesP, inverseMasses);
+    if (settle != NULL)
+        settle->apply(numberOfAtoms, atomCoordinates, atomCoordinatesP, inverseMasses);
+    return result;
+}
+
+int ReferenceConstraints::applyToVelocities(int numberOfAtoms, vector<RealVec>& atomCoordinates, vector<RealVec>& velocities, vector<RealOpenMM>& inverseMasses) {
+    int result = SimTKOpenMMCommon::DefaultReturn;
+    if (ccma != NULL)
+        result = ccma->applyToVelocities(numberOfAtoms, atomCoordinates, velocities, inverseMasses);
+    if (settle != NULL)
+        settle->applyToVelocities(numberOfAtoms, atomCoordinates, velocities, inverseMasses);
+    return result;
+}
@@ -39,9 +39,9 @@ using namespace std;
 
    --------------------------------------------------------------------------------------- */
 
-ReferenceCustomAngleIxn::ReferenceCustomAngleIxn(const Lepton::ExpressionProgram& energyExpression,
-        const Lepton::ExpressionProgram& forceExpression, const vector<string>& parameterNames, map<string, double> globalParameters) :
-        energyExpression(energyExpression), forceExpression(forceExpression), paramNames(parameterNames), globalParameters(globalParameters) {
+ReferenceCustomAngleIxn::ReferenceCustomAngleIxn(const Lepton::CompiledExpression& energyAndForceExpression,
+        const vector<string>& parameterNames) :
+        energyAndForceExpression(energyAndForceExpression) {
 
    // ---------------------------------------------------------------------------------------
 
@@ -49,6 +49,11 @@ ReferenceCustomAngleIxn::ReferenceCustomAngleIxn(const Lepton::ExpressionProgram
 
    // ---------------------------------------------------------------------------------------
 
+   // Look up the variables once, so evaluating an interaction only needs to store values.
+
+   theta = ReferenceForce::getVariablePointer(this->energyAndForceExpression, "theta");
+   for (int i = 0; i < (int) parameterNames.size(); ++i)
+       params.push_back(ReferenceForce::getVariablePointer(this->energyAndForceExpression, parameterNames[i]));
 }
 
 /**---------------------------------------------------------------------------------------
@@ -67,6 +72,19 @@ ReferenceCustomAngleIxn::~ReferenceCustomAngleIxn( ){
 
 }
 
+/**---------------------------------------------------------------------------------------
+
+   Set the values of global parameters
+
+   @param globalParameters the values of global parameters
+
+   --------------------------------------------------------------------------------------- */
+
+void ReferenceCustomAngleIxn::setGlobalParameters( const map<string, double>& globalParameters ){
+   for (map<string, double>::const_iterator iter = globalParameters.begin(); iter != globalParameters.end(); ++iter)
+       ReferenceForce::setVariable(ReferenceForce::getVariablePointer(energyAndForceExpression, iter->first), iter->second);
+}
+
 /**---------------------------------------------------------------------------------------
 
    Calculate Custom Angle Ixn
@@ -91,9 +109,8 @@ void ReferenceCustomAngleIxn::calculateBondIxn( int* atomIndices,
    static const RealOpenMM one         = 1.0;
 
    RealOpenMM deltaR[2][ReferenceForce::LastDeltaRIndex];
-   map<string, double> variables = globalParameters;
-   for (int i = 0; i < (int) paramNames.size(); ++i)
-       variables[paramNames[i]] = parameters[i];
+   for (int i = 0; i < (int) params.size(); ++i)
+       ReferenceForce::setVariable(params[i], parameters[i]);
 
    // ---------------------------------------------------------------------------------------
 
@@ -118,12 +135,17 @@ void ReferenceCustomAngleIxn::calculateBondIxn( int* atomIndices,
       angle = PI_M;
    else
       angle = ACOS(cosine);
-   variables["theta"] = angle;
+   ReferenceForce::setVariable(theta, angle);
 
    // Compute the force and energy, and apply them to the atoms.
    
-   RealOpenMM energy = (RealOpenMM) energyExpression.evaluate(variables);
-   RealOpenMM dEdR = (RealOpenMM) forceExpression.evaluate(variables);
+   RealOpenMM energy = (RealOpenMM) energyAndForceExpression.evaluate();
+   if (!includeForces) {
+      if (totalEnergy != NULL)
+          *totalEnergy += energy;
+      return;
+   }
+   RealOpenMM dEdR = (RealOpenMM) energyAndForceExpression.getResult(1);
    RealOpenMM termA =  dEdR/(deltaR[0][ReferenceForce::R2Index]*rp);
    RealOpenMM termC = -dEdR/(deltaR[1][ReferenceForce::R2Index]*rp);
 
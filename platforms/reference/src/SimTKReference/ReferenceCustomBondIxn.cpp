@@ -40,9 +40,9 @@ using namespace OpenMM;
 
    --------------------------------------------------------------------------------------- */
 
-ReferenceCustomBondIxn::ReferenceCustomBondIxn(const Lepton::ExpressionProgram& energyExpression,
-        const Lepton::ExpressionProgram& forceExpression, const vector<string>& parameterNames, map<string, double> globalParameters) :
-        energyExpression(energyExpression), forceExpression(forceExpression), paramNames(parameterNames), globalParameters(globalParameters) {
+ReferenceCustomBondIxn::ReferenceCustomBondIxn(const Lepton::CompiledExpression& energyExpression,
+        const Lepton::CompiledExpression& forceExpression, const vector<string>& parameterNames) :
+        energyExpression(energyExpression), forceExpression(forceExpression), paramNames(parameterNames) {
 
    // ---------------------------------------------------------------------------------------
 
@@ -50,6 +50,14 @@ ReferenceCustomBondIxn::ReferenceCustomBondIxn(const Lepton::ExpressionProgram&
 
    // ---------------------------------------------------------------------------------------
 
+   // Look up the variables once, so evaluating an interaction only needs to store values.
+
+   energyR = ReferenceForce::getVariablePointer(this->energyExpression, "r");
+   forceR = ReferenceForce::getVariablePointer(this->forceExpression, "r");
+   for (int i = 0; i < (int) parameterNames.size(); ++i) {
+       energyParams.push_back(ReferenceForce::getVariablePointer(this->energyExpression, parameterNames[i]));
+       forceParams.push_back(ReferenceForce::getVariablePointer(this->forceExpression, parameterNames[i]));
+   }
 }
 
 /**---------------------------------------------------------------------------------------
@@ -68,6 +76,21 @@ ReferenceCustomBondIxn::~ReferenceCustomBondIxn( ){
 
 }
 
+/**---------------------------------------------------------------------------------------
+
+   Set the values of global parameters
+
+   @param globalParameters the values of global parameters
+
+   --------------------------------------------------------------------------------------- */
+
+void ReferenceCustomBondIxn::setGlobalParameters( const map<string, double>& globalParameters ){
+   for (map<string, double>::const_iterator iter = globalParameters.begin(); iter != globalParameters.end(); ++iter) {
+       ReferenceForce::setVariable(ReferenceForce::getVariablePointer(energyExpression, iter->first), iter->second);
+       ReferenceForce::setVariable(ReferenceForce::getVariablePointer(forceExpression, iter->first), iter->second);
+   }
+}
+
 /**---------------------------------------------------------------------------------------
 
    Calculate Custom Bond Ixn
@@ -95,9 +118,10 @@ void ReferenceCustomBondIxn::calculateBondIxn( int* atomIndices,
    static const RealOpenMM half        = 0.5;
 
    RealOpenMM deltaR[ReferenceForce::LastDeltaRIndex];
-   map<string, double> variables = globalParameters;
-   for (int i = 0; i < (int) paramNames.size(); ++i)
-       variables[paramNames[i]] = parameters[i];
+   for (int i = 0; i < (int) energyParams.size(); ++i) {
+       ReferenceForce::setVariable(energyParams[i], parameters[i]);
+       ReferenceForce::setVariable(forceParams[i], parameters[i]);
+   }
 
    // ---------------------------------------------------------------------------------------
 
@@ -106,18 +130,85 @@ void ReferenceCustomBondIxn::calculateBondIxn( int* atomIndices,
    int atomAIndex = atomIndices[0];
    int atomBIndex = atomIndices[1];
    ReferenceForce::getDeltaR( atomCoordinates[atomAIndex], atomCoordinates[atomBIndex], deltaR );
-   variables["r"]             = deltaR[ReferenceForce::RIndex];
-   RealOpenMM dEdR            = (RealOpenMM) forceExpression.evaluate(variables);
-   dEdR                       = deltaR[ReferenceForce::RIndex] > zero ? (dEdR/deltaR[ReferenceForce::RIndex]) : zero;
+   ReferenceForce::setVariable(energyR, deltaR[ReferenceForce::RIndex]);
+   ReferenceForce::setVariable(forceR, deltaR[ReferenceForce::RIndex]);
+   if (includeForces) {
+      RealOpenMM dEdR            = (RealOpenMM) forceExpression.evaluate();
+      dEdR                       = deltaR[ReferenceForce::RIndex] > zero ? (dEdR/deltaR[ReferenceForce::RIndex]) : zero;
 
-   forces[atomAIndex][0]     += dEdR*deltaR[ReferenceForce::XIndex];
-   forces[atomAIndex][1]     += dEdR*deltaR[ReferenceForce::YIndex];
-   forces[atomAIndex][2]     += dEdR*deltaR[ReferenceForce::ZIndex];
+      forces[atomAIndex][0]     += dEdR*deltaR[ReferenceForce::XIndex];
+      forces[atomAIndex][1]     += dEdR*deltaR[ReferenceForce::YIndex];
+      forces[atomAIndex][2]     += dEdR*deltaR[ReferenceForce::ZIndex];
 
-   forces[atomBIndex][0]     -= dEdR*deltaR[ReferenceForce::XIndex];
-   forces[atomBIndex][1]     -= dEdR*deltaR[ReferenceForce::YIndex];
-   forces[atomBIndex][2]     -= dEdR*deltaR[ReferenceForce::ZIndex];
+      forces[atomBIndex][0]     -= dEdR*deltaR[ReferenceForce::XIndex];
+      forces[atomBIndex][1]     -= dEdR*deltaR[ReferenceForce::YIndex];
+      forces[atomBIndex][2]     -= dEdR*deltaR[ReferenceForce::ZIndex];
+   }
 
    if (totalEnergy != NULL)
-       *totalEnergy += (RealOpenMM) energyExpression.evaluate(variables);
+       *totalEnergy += (RealOpenMM) energyExpression.evaluate();
+}
+
+/**---------------------------------------------------------------------------------------
+
+   Calculate Custom Bond Ixn for a set of bonds, evaluating the energy and force
+   expressions for all of them in a single batch
+
+   @param numberOfBonds    number of bonds
+   @param atomIndices      two bond indices for each bond
+   @param atomCoordinates  atom coordinates
+   @param parameters       parameter values for each bond
+   @param forces           force array (forces added to input values)
+   @param totalEnergy      if not null, the energy will be added to this
+
+   --------------------------------------------------------------------------------------- */
+
+void ReferenceCustomBondIxn::calculateBondIxns( int numberOfBonds, int** atomIndices,
+                                                vector<RealVec>& atomCoordinates,
+                                                RealOpenMM** parameters,
+                                                vector<RealVec>& forces,
+                                                RealOpenMM* totalEnergy ) const {
+
+   static const RealOpenMM zero        = 0.0;
+
+   // Gather the distance and parameters of every bond into columns.
+
+   int numParameters = paramNames.size();
+   vector<RealOpenMM> deltaR(numberOfBonds*ReferenceForce::LastDeltaRIndex);
+   vector<vector<double> > columns(numParameters+1, vector<double>(numberOfBonds));
+   for (int ii = 0; ii < numberOfBonds; ii++) {
+       RealOpenMM* bondDeltaR = &deltaR[ii*ReferenceForce::LastDeltaRIndex];
+       ReferenceForce::getDeltaR( atomCoordinates[atomIndices[ii][0]], atomCoordinates[atomIndices[ii][1]], bondDeltaR );
+       columns[0][ii] = bondDeltaR[ReferenceForce::RIndex];
+       for (int i = 0; i < numParameters; i++)
+           columns[i+1][ii] = parameters[ii][i];
+   }
+   vector<string> names(1, "r");
+   names.insert(names.end(), paramNames.begin(), paramNames.end());
+   vector<const double*> values(numParameters+1);
+   for (int i = 0; i <= numParameters; i++)
+       values[i] = (numberOfBonds > 0 ? &columns[i][0] : NULL);
+
+   // Evaluate the expressions and apply the forces.
+
+   vector<double> results(numberOfBonds);
+   if (includeForces && numberOfBonds > 0) {
+       forceExpression.evaluateBatch(numberOfBonds, names, values, vector<double*>(1, &results[0]));
+       for (int ii = 0; ii < numberOfBonds; ii++) {
+           RealOpenMM* bondDeltaR = &deltaR[ii*ReferenceForce::LastDeltaRIndex];
+           RealOpenMM r = bondDeltaR[ReferenceForce::RIndex];
+           RealOpenMM dEdR = r > zero ? (RealOpenMM) (results[ii]/r) : zero;
+           int atomAIndex = atomIndices[ii][0];
+           int atomBIndex = atomIndices[ii][1];
+           for (int j = 0; j < 3; j++) {
+               forces[atomAIndex][j] += dEdR*bondDeltaR[ReferenceForce::XIndex+j];
+               forces[atomBIndex][j] -= dEdR*bondDeltaR[ReferenceForce::XIndex+j];
+           }
+       }
+   }
+   if (totalEnergy != NULL && numberOfBonds > 0) {
+       energyExpression.evaluateBatch(numberOfBonds, names, values, vector<double*>(1, &results[0]));
+       for (int ii = 0; ii < numberOfBonds; ii++)
+           *totalEnergy += (RealOpenMM) results[ii];
+   }
 }
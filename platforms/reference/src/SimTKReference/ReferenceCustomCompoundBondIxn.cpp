@@ -150,6 +150,13 @@ void ReferenceCustomCompoundBondIxn::calculateOneIxn(int bond, vector<RealVec>&
         variables[term.name] = getDihedralAngleBetweenThreeVectors(term.delta1, term.delta2, term.delta3, crossProduct, &dotDihedral, term.delta1, &signOfDihedral, 1);
     }
     
+    // Add the energy
+
+    if (totalEnergy)
+        *totalEnergy += (RealOpenMM) energyExpression.evaluate(variables);
+    if (!includeForces)
+        return;
+
     // Apply forces based on individual particle coordinates.
     
     for (int i = 0; i < (int) particleTerms.size(); i++) {
@@ -226,11 +233,6 @@ void ReferenceCustomCompoundBondIxn::calculateOneIxn(int bond, vector<RealVec>&
             forces[atoms[term.p4]][i] += internalF[3][i];
         }
     }
-
-    // Add the energy
-
-    if (totalEnergy)
-        *totalEnergy += (RealOpenMM) energyExpression.evaluate(variables);
 }
 
 void ReferenceCustomCompoundBondIxn::computeDelta(int atom1, int atom2, RealOpenMM* delta, vector<RealVec>& atomCoordinates) const {
@@ -25,12 +25,12 @@
 #include "SimTKOpenMMCommon.h"
 #include "SimTKOpenMMLog.h"
 #include "SimTKOpenMMUtilities.h"
+#include "ReferenceForce.h"
 #include "ReferenceVirtualSites.h"
 #include "ReferenceCustomDynamics.h"
 #include "openmm/OpenMMException.h"
 #include "openmm/internal/ContextImpl.h"
 #include "openmm/internal/ForceImpl.h"
-#include "lepton/Operation.h"
 #include "lepton/ParsedExpression.h"
 #include "lepton/Parser.h"
 #include <set>
@@ -59,15 +59,10 @@ ReferenceCustomDynamics::ReferenceCustomDynamics(int numberOfAtoms, const Custom
         string expression;
         integrator.getComputationStep(i, stepType[i], stepVariable[i], expression);
         if (expression.length() > 0)
-            stepExpression[i] = Lepton::Parser::parse(expression).optimize().createProgram();
-    }
-    kineticEnergyExpression = Lepton::Parser::parse(integrator.getKineticEnergyExpression()).optimize().createProgram();
-    kineticEnergyNeedsForce = false;
-    for (int i = 0; i < kineticEnergyExpression.getNumOperations(); i++) {
-        const Lepton::Operation& op = kineticEnergyExpression.getOperation(i);
-        if (op.getId() == Lepton::Operation::VARIABLE && op.getName() == "f")
-            kineticEnergyNeedsForce = true;
+            stepExpression[i] = Lepton::Parser::parse(expression).optimize().createCompiledExpression();
     }
+    kineticEnergyExpression = Lepton::Parser::parse(integrator.getKineticEnergyExpression()).optimize().createCompiledExpression();
+    kineticEnergyNeedsForce = (kineticEnergyExpression.getVariables().count("f") > 0);
 }
 
 /**---------------------------------------------------------------------------------------
@@ -135,43 +130,41 @@ void ReferenceCustomDynamics::update(ContextImpl& context, int numberOfAtoms, ve
         }
         for (int i = 0; i < numSteps; i++) {
             if (stepType[i] == CustomIntegrator::ComputeGlobal || stepType[i] == CustomIntegrator::ComputePerDof || stepType[i] == CustomIntegrator::ComputeSum) {
-                for (int j = 0; j < stepExpression[i].getNumOperations(); j++) {
-                    const Lepton::Operation& op = stepExpression[i].getOperation(j);
-                    if (op.getId() == Lepton::Operation::VARIABLE) {
-                        if (op.getName() == "energy") {
-                            if (forceGroup[i] != -2)
-                                throw OpenMMException("A single computation step cannot depend on multiple force groups");
-                            needsEnergy[i] = true;
-                            forceGroup[i] = -1;
-                        }
-                        else if (op.getName().substr(0, 6) == "energy") {
-                            for (int k = 0; k < (int) energyGroupName.size(); k++)
-                                if (op.getName() == energyGroupName[k]) {
-                                    if (forceGroup[i] != -2)
-                                        throw OpenMMException("A single computation step cannot depend on multiple force groups");
-                                    needsForces[i] = true;
-                                    forceGroup[i] = 1<<k;
-                                    energyName[i] = energyGroupName[k];
-                                    break;
-                                }
-                        }
-                        else if (op.getName() == "f") {
-                            if (forceGroup[i] != -2)
-                                throw OpenMMException("A single computation step cannot depend on multiple force groups");
-                            needsForces[i] = true;
-                            forceGroup[i] = -1;
-                        }
-                        else if (op.getName()[0] == 'f') {
-                            for (int k = 0; k < (int) forceGroupName.size(); k++)
-                                if (op.getName() == forceGroupName[k]) {
-                                    if (forceGroup[i] != -2)
-                                        throw OpenMMException("A single computation step cannot depend on multiple force groups");
-                                    needsForces[i] = true;
-                                    forceGroup[i] = 1<<k;
-                                    forceName[i] = forceGroupName[k];
-                                    break;
-                                }
-                        }
+                const set<string>& variables = stepExpression[i].getVariables();
+                for (set<string>::const_iterator name = variables.begin(); name != variables.end(); ++name) {
+                    if (*name == "energy") {
+                        if (forceGroup[i] != -2)
+                            throw OpenMMException("A single computation step cannot depend on multiple force groups");
+                        needsEnergy[i] = true;
+                        forceGroup[i] = -1;
+                    }
+                    else if (name->substr(0, 6) == "energy") {
+                        for (int k = 0; k < (int) energyGroupName.size(); k++)
+                            if (*name == energyGroupName[k]) {
+                                if (forceGroup[i] != -2)
+                                    throw OpenMMException("A single computation step cannot depend on multiple force groups");
+                                needsForces[i] = true;
+                                forceGroup[i] = 1<<k;
+                                energyName[i] = energyGroupName[k];
+                                break;
+                            }
+                    }
+                    else if (*name == "f") {
+                        if (forceGroup[i] != -2)
+                            throw OpenMMException("A single computation step cannot depend on multiple force groups");
+                        needsForces[i] = true;
+                        forceGroup[i] = -1;
+                    }
+                    else if ((*name)[0] == 'f') {
+                        for (int k = 0; k < (int) forceGroupName.size(); k++)
+                            if (*name == forceGroupName[k]) {
+                                if (forceGroup[i] != -2)
+                                    throw OpenMMException("A single computation step cannot depend on multiple force groups");
+                                needsForces[i] = true;
+                                forceGroup[i] = 1<<k;
+                                forceName[i] = forceGroupName[k];
+                                break;
+                            }
                     }
                 }
             }
@@ -220,10 +213,10 @@ void ReferenceCustomDynamics::update(ContextImpl& context, int numberOfAtoms, ve
         
         switch (stepType[i]) {
             case CustomIntegrator::ComputeGlobal: {
-                map<string, RealOpenMM> variables = globals;
-                variables["uniform"] = SimTKOpenMMUtilities::getUniformlyDistributedRandomNumber();
-                variables["gaussian"] = SimTKOpenMMUtilities::getNormallyDistributedRandomNumber();
-                globals[stepVariable[i]] = stepExpression[i].evaluate(variables);
+                setGlobalVariables(stepExpression[i], globals);
+                ReferenceForce::setVariable(ReferenceForce::getVariablePointer(stepExpression[i], "uniform"), SimTKOpenMMUtilities::getUniformlyDistributedRandomNumber());
+                ReferenceForce::setVariable(ReferenceForce::getVariablePointer(stepExpression[i], "gaussian"), SimTKOpenMMUtilities::getNormallyDistributedRandomNumber());
+                globals[stepVariable[i]] = stepExpression[i].evaluate();
                 break;
             }
             case CustomIntegrator::ComputePerDof: {
@@ -274,30 +267,117 @@ void ReferenceCustomDynamics::update(ContextImpl& context, int numberOfAtoms, ve
     recordChangedParameters(context, globals);
 }
 
+/**
+ * Copy the values of global variables into the locations where an expression reads them.
+ */
+void ReferenceCustomDynamics::setGlobalVariables(Lepton::CompiledExpression& expression, const map<string, RealOpenMM>& globals) {
+    const set<string>& variables = expression.getVariables();
+    for (set<string>::const_iterator name = variables.begin(); name != variables.end(); ++name) {
+        map<string, RealOpenMM>::const_iterator value = globals.find(*name);
+        if (value != globals.end())
+            expression.getVariableReference(*name) = value->second;
+    }
+}
+
 void ReferenceCustomDynamics::computePerDof(int numberOfAtoms, vector<RealVec>& results, const vector<RealVec>& atomCoordinates,
               const vector<RealVec>& velocities, const vector<RealVec>& forces, const vector<RealOpenMM>& masses,
               const map<string, RealOpenMM>& globals, const vector<vector<RealVec> >& perDof,
-              const Lepton::ExpressionProgram& expression, const std::string& forceName) {
-    // Loop over all degrees of freedom.
-    
-    map<string, RealOpenMM> variables = globals;
-    for (int i = 0; i < numberOfAtoms; i++) {
-        if (masses[i] != 0.0) {
-            variables["m"] = masses[i];
-            for (int j = 0; j < 3; j++) {
-                // Compute the expression.
+              Lepton::CompiledExpression& expression, const std::string& forceName) {
+    int numDofs = 3*numberOfAtoms;
+    if ((int) dofMasses.size() != numDofs) {
+        dofMasses.resize(numDofs);
+        for (int i = 0; i < numberOfAtoms; i++)
+            for (int j = 0; j < 3; j++)
+                dofMasses[3*i+j] = masses[i];
+    }
+    dofResults.resize(numDofs);
+    setGlobalVariables(expression, globals);
 
-                variables["x"] = atomCoordinates[i][j];
-                variables["v"] = velocities[i][j];
-                variables[forceName] = forces[i][j];
-                variables["uniform"] = SimTKOpenMMUtilities::getUniformlyDistributedRandomNumber();
-                variables["gaussian"] = SimTKOpenMMUtilities::getNormallyDistributedRandomNumber();
-                for (int k = 0; k < (int) perDof.size(); k++)
-                    variables[integrator.getPerDofVariableName(k)] = perDof[k][i][j];
-                results[i][j] = expression.evaluate(variables);
-            }
+    // Gather the per-DOF inputs the expression actually uses into flat arrays.
+
+    const set<string>& variables = expression.getVariables();
+    vector<string> names;
+    vector<const vector<RealVec>*> sources;
+    if (variables.count("x") > 0) {
+        names.push_back("x");
+        sources.push_back(&atomCoordinates);
+    }
+    if (variables.count("v") > 0) {
+        names.push_back("v");
+        sources.push_back(&velocities);
+    }
+    if (variables.count(forceName) > 0) {
+        names.push_back(forceName);
+        sources.push_back(&forces);
+    }
+    for (int k = 0; k < (int) perDof.size(); k++)
+        if (variables.count(integrator.getPerDofVariableName(k)) > 0) {
+            names.push_back(integrator.getPerDofVariableName(k));
+            sources.push_back(&perDof[k]);
         }
+    bool needsUniform = (variables.count("uniform") > 0);
+    bool needsGaussian = (variables.count("gaussian") > 0);
+    int numBuffers = sources.size()+(needsUniform ? 1 : 0)+(needsGaussian ? 1 : 0);
+    if ((int) dofValues.size() < numBuffers)
+        dofValues.resize(numBuffers);
+    vector<const double*> values;
+    for (int k = 0; k < (int) sources.size(); k++) {
+        vector<double>& buffer = dofValues[k];
+        buffer.resize(numDofs);
+        const vector<RealVec>& source = *sources[k];
+        for (int i = 0; i < numberOfAtoms; i++)
+            for (int j = 0; j < 3; j++)
+                buffer[3*i+j] = source[i][j];
+        values.push_back(&buffer[0]);
     }
+    if (variables.count("m") > 0) {
+        names.push_back("m");
+        values.push_back(&dofMasses[0]);
+    }
+
+    // Random numbers are generated in a fixed order, so results do not depend on how the
+    // evaluation is divided up.
+
+    if (needsUniform || needsGaussian) {
+        double* uniform = NULL;
+        double* gaussian = NULL;
+        int buffer = sources.size();
+        if (needsUniform) {
+            dofValues[buffer].resize(numDofs);
+            uniform = &dofValues[buffer][0];
+            names.push_back("uniform");
+            values.push_back(uniform);
+            buffer++;
+        }
+        if (needsGaussian) {
+            dofValues[buffer].resize(numDofs);
+            gaussian = &dofValues[buffer][0];
+            names.push_back("gaussian");
+            values.push_back(gaussian);
+        }
+        for (int i = 0; i < numDofs; i++) {
+            if (dofMasses[i] == 0.0)
+                continue;
+            if (uniform != NULL)
+                uniform[i] = SimTKOpenMMUtilities::getUniformlyDistributedRandomNumber();
+            if (gaussian != NULL)
+                gaussian[i] = SimTKOpenMMUtilities::getNormallyDistributedRandomNumber();
+        }
+    }
+    
+    // Evaluate the expression and store the results for every particle with nonzero mass.
+
+    if (numDofs > 0)
+        evaluatePerDof(expression, numDofs, names, values, &dofResults[0]);
+    for (int i = 0; i < numberOfAtoms; i++)
+        if (masses[i] != 0.0)
+            for (int j = 0; j < 3; j++)
+                results[i][j] = dofResults[3*i+j];
+}
+
+void ReferenceCustomDynamics::evaluatePerDof(Lepton::CompiledExpression& expression, int numValues, const vector<string>& names,
+              const vector<const double*>& values, double* results) {
+    expression.evaluateBatch(numValues, names, values, vector<double*>(1, results));
 }
 
 /**
@@ -44,7 +44,7 @@ ReferenceCustomExternalIxn::ReferenceCustomExternalIxn(const Lepton::ExpressionP
         const Lepton::ExpressionProgram& forceExpressionX, const Lepton::ExpressionProgram& forceExpressionY,
         const Lepton::ExpressionProgram& forceExpressionZ, const vector<string>& parameterNames, map<string, double> globalParameters) :
         energyExpression(energyExpression), forceExpressionX(forceExpressionX), forceExpressionY(forceExpressionY),
-        forceExpressionZ(forceExpressionZ), paramNames(parameterNames), globalParameters(globalParameters) {
+        forceExpressionZ(forceExpressionZ), paramNames(parameterNames), globalParameters(globalParameters), includeForces(true) {
 
    // ---------------------------------------------------------------------------------------
 
@@ -99,9 +99,11 @@ void ReferenceCustomExternalIxn::calculateForce( int atomIndex,
 
    // ---------------------------------------------------------------------------------------
 
-   forces[atomIndex][0] -= (RealOpenMM) forceExpressionX.evaluate(variables);
-   forces[atomIndex][1] -= (RealOpenMM) forceExpressionY.evaluate(variables);
-   forces[atomIndex][2] -= (RealOpenMM) forceExpressionZ.evaluate(variables);
+   if (includeForces) {
+      forces[atomIndex][0] -= (RealOpenMM) forceExpressionX.evaluate(variables);
+      forces[atomIndex][1] -= (RealOpenMM) forceExpressionY.evaluate(variables);
+      forces[atomIndex][2] -= (RealOpenMM) forceExpressionZ.evaluate(variables);
+   }
    if (energy != NULL)
        *energy += (RealOpenMM) energyExpression.evaluate(variables);
 }
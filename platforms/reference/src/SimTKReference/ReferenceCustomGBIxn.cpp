@@ -54,7 +54,7 @@ ReferenceCustomGBIxn::ReferenceCustomGBIxn(const vector<Lepton::ExpressionProgra
                      const vector<vector<Lepton::ExpressionProgram> > energyGradientExpressions,
                      const vector<OpenMM::CustomGBForce::ComputationType>& energyTypes,
                      const vector<string>& parameterNames) :
-            cutoff(false), periodic(false), valueExpressions(valueExpressions), valueDerivExpressions(valueDerivExpressions), valueGradientExpressions(valueGradientExpressions),
+            cutoff(false), periodic(false), includeForces(true), valueExpressions(valueExpressions), valueDerivExpressions(valueDerivExpressions), valueGradientExpressions(valueGradientExpressions),
             valueNames(valueNames), valueTypes(valueTypes), energyExpressions(energyExpressions), energyDerivExpressions(energyDerivExpressions), energyGradientExpressions(energyGradientExpressions),
             energyTypes(energyTypes), paramNames(parameterNames) {
 
@@ -165,7 +165,8 @@ void ReferenceCustomGBIxn::calculateIxn(int numberOfAtoms, vector<RealVec>& atom
 
     // Apply the chain rule to evaluate forces.
 
-    calculateChainRuleForces(numberOfAtoms, atomCoordinates, atomParameters, values, globalParameters, exclusions, forces, dEdV);
+    if (includeForces)
+        calculateChainRuleForces(numberOfAtoms, atomCoordinates, atomParameters, values, globalParameters, exclusions, forces, dEdV);
 }
 
 void ReferenceCustomGBIxn::calculateSingleParticleValue(int index, int numAtoms, vector<RealVec>& atomCoordinates, vector<vector<RealOpenMM> >& values,
@@ -251,6 +252,8 @@ void ReferenceCustomGBIxn::calculateSingleParticleEnergyTerm(int index, int numA
             variables[valueNames[j]] = values[j][i];
         if (totalEnergy != NULL)
             *totalEnergy += (RealOpenMM) energyExpressions[index].evaluate(variables);
+        if (!includeForces)
+            continue;
         for (int j = 0; j < (int) valueNames.size(); j++)
             dEdV[j][i] += (RealOpenMM) energyDerivExpressions[index][j].evaluate(variables);
         forces[i][0] -= (RealOpenMM) energyGradientExpressions[index][0].evaluate(variables);
@@ -316,6 +319,8 @@ void ReferenceCustomGBIxn::calculateOnePairEnergyTerm(int index, int atom1, int
 
     if (totalEnergy != NULL)
         *totalEnergy += (RealOpenMM) energyExpressions[index].evaluate(variables);
+    if (!includeForces)
+        return;
     RealOpenMM dEdR = (RealOpenMM) energyDerivExpressions[index][0].evaluate(variables);
     dEdR *= 1/r;
     for (int i = 0; i < 3; i++) {
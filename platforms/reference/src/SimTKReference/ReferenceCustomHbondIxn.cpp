@@ -210,6 +210,13 @@ void ReferenceCustomHbondIxn::calculateOneIxn(int donor, int acceptor, vector<Re
         variables[term.name] = getDihedralAngleBetweenThreeVectors(term.delta1, term.delta2, term.delta3, crossProduct, &dotDihedral, term.delta1, &signOfDihedral, 1);
     }
 
+    // Add the energy
+
+    if (totalEnergy)
+        *totalEnergy += (RealOpenMM) energyExpression.evaluate(variables);
+    if (!includeForces)
+        return;
+
     // Apply forces based on distances.
 
     for (int i = 0; i < (int) distanceTerms.size(); i++) {
@@ -279,11 +286,6 @@ void ReferenceCustomHbondIxn::calculateOneIxn(int donor, int acceptor, vector<Re
             forces[atoms[term.p4]][i] += internalF[3][i];
         }
     }
-
-    // Add the energy
-
-    if (totalEnergy)
-        *totalEnergy += (RealOpenMM) energyExpression.evaluate(variables);
 }
 
 void ReferenceCustomHbondIxn::computeDelta(int atom1, int atom2, RealOpenMM* delta, vector<RealVec>& atomCoordinates) const {
@@ -45,9 +45,9 @@ using OpenMM::RealVec;
 
    --------------------------------------------------------------------------------------- */
 
-ReferenceCustomNonbondedIxn::ReferenceCustomNonbondedIxn(const Lepton::ExpressionProgram& energyExpression,
-        const Lepton::ExpressionProgram& forceExpression, const vector<string>& parameterNames) :
-            cutoff(false), useSwitch(false), periodic(false), energyExpression(energyExpression), forceExpression(forceExpression), paramNames(parameterNames) {
+ReferenceCustomNonbondedIxn::ReferenceCustomNonbondedIxn(const Lepton::CompiledExpression& energyAndForceExpression,
+        const vector<string>& parameterNames) :
+            cutoff(false), useSwitch(false), periodic(false), includeForces(true), energyAndForceExpression(energyAndForceExpression), paramNames(parameterNames) {
 
    // ---------------------------------------------------------------------------------------
 
@@ -55,11 +55,12 @@ ReferenceCustomNonbondedIxn::ReferenceCustomNonbondedIxn(const Lepton::Expressio
 
    // ---------------------------------------------------------------------------------------
 
+    rValue = ReferenceForce::getVariablePointer(this->energyAndForceExpression, "r");
     for (int i = 0; i < (int) paramNames.size(); i++) {
         for (int j = 1; j < 3; j++) {
             stringstream name;
             name << paramNames[i] << j;
-            particleParamNames.push_back(name.str());
+            particleParams.push_back(ReferenceForce::getVariablePointer(this->energyAndForceExpression, name.str()));
         }
     }
 }
@@ -166,9 +167,10 @@ void ReferenceCustomNonbondedIxn::setUseSwitchingFunction( RealOpenMM distance )
 void ReferenceCustomNonbondedIxn::calculatePairIxn( int numberOfAtoms, vector<RealVec>& atomCoordinates,
                                              RealOpenMM** atomParameters, vector<set<int> >& exclusions,
                                              RealOpenMM* fixedParameters, const map<string, double>& globalParameters, vector<RealVec>& forces,
-                                             RealOpenMM* energyByAtom, RealOpenMM* totalEnergy ) const {
+                                             RealOpenMM* energyByAtom, RealOpenMM* totalEnergy ) {
 
-    map<string, double> variables = globalParameters;
+    for (map<string, double>::const_iterator iter = globalParameters.begin(); iter != globalParameters.end(); ++iter)
+        ReferenceForce::setVariable(ReferenceForce::getVariablePointer(energyAndForceExpression, iter->first), iter->second);
     if (interactionGroups.size() > 0) {
         // The user has specified interaction groups, so compute only the requested interactions.
         
@@ -181,11 +183,7 @@ void ReferenceCustomNonbondedIxn::calculatePairIxn( int numberOfAtoms, vector<Re
                         continue; // This is an excluded interaction.
                     if (*atom1 > *atom2 && set1.find(*atom2) != set1.end() && set2.find(*atom1) != set2.end())
                         continue; // Both atoms are in both sets, so skip duplicate interactions.
-                    for (int j = 0; j < (int) paramNames.size(); j++) {
-                        variables[particleParamNames[j*2]] = atomParameters[*atom1][j];
-                        variables[particleParamNames[j*2+1]] = atomParameters[*atom2][j];
-                    }
-                    calculateOneIxn(*atom1, *atom2, atomCoordinates, variables, forces, energyByAtom, totalEnergy);
+                    calculateOneIxn(*atom1, *atom2, atomCoordinates, atomParameters, forces, energyByAtom, totalEnergy);
                 }
             }
         }
@@ -195,11 +193,7 @@ void ReferenceCustomNonbondedIxn::calculatePairIxn( int numberOfAtoms, vector<Re
         
         for (int i = 0; i < (int) neighborList->size(); i++) {
             OpenMM::AtomPair pair = (*neighborList)[i];
-            for (int j = 0; j < (int) paramNames.size(); j++) {
-                variables[particleParamNames[j*2]] = atomParameters[pair.first][j];
-                variables[particleParamNames[j*2+1]] = atomParameters[pair.second][j];
-            }
-            calculateOneIxn(pair.first, pair.second, atomCoordinates, variables, forces, energyByAtom, totalEnergy);
+            calculateOneIxn(pair.first, pair.second, atomCoordinates, atomParameters, forces, energyByAtom, totalEnergy);
         }
     }
     else {
@@ -208,11 +202,7 @@ void ReferenceCustomNonbondedIxn::calculatePairIxn( int numberOfAtoms, vector<Re
         for (int ii = 0; ii < numberOfAtoms; ii++) {
             for (int jj = ii+1; jj < numberOfAtoms; jj++) {
                 if (exclusions[jj].find(ii) == exclusions[jj].end()) {
-                    for (int j = 0; j < (int) paramNames.size(); j++) {
-                        variables[particleParamNames[j*2]] = atomParameters[ii][j];
-                        variables[particleParamNames[j*2+1]] = atomParameters[jj][j];
-                    }
-                    calculateOneIxn(ii, jj, atomCoordinates, variables, forces, energyByAtom, totalEnergy);
+                    calculateOneIxn(ii, jj, atomCoordinates, atomParameters, forces, energyByAtom, totalEnergy);
                 }
             }
         }
@@ -234,7 +224,7 @@ void ReferenceCustomNonbondedIxn::calculatePairIxn( int numberOfAtoms, vector<Re
      --------------------------------------------------------------------------------------- */
 
 void ReferenceCustomNonbondedIxn::calculateOneIxn( int ii, int jj, vector<RealVec>& atomCoordinates,
-                        map<string, double>& variables, vector<RealVec>& forces,
+                        RealOpenMM** atomParameters, vector<RealVec>& forces,
                         RealOpenMM* energyByAtom, RealOpenMM* totalEnergy ) const {
 
     // ---------------------------------------------------------------------------------------
@@ -266,9 +256,13 @@ void ReferenceCustomNonbondedIxn::calculateOneIxn( int ii, int jj, vector<RealVe
 
     // accumulate forces
 
-    variables["r"] = r;
-    RealOpenMM dEdR = (RealOpenMM) (forceExpression.evaluate(variables)/(deltaR[ReferenceForce::RIndex]));
-    RealOpenMM energy = (RealOpenMM) energyExpression.evaluate(variables);
+    for (int i = 0; i < (int) paramNames.size(); i++) {
+        ReferenceForce::setVariable(particleParams[i*2], atomParameters[ii][i]);
+        ReferenceForce::setVariable(particleParams[i*2+1], atomParameters[jj][i]);
+    }
+    ReferenceForce::setVariable(rValue, r);
+    RealOpenMM energy = (RealOpenMM) energyAndForceExpression.evaluate();
+    RealOpenMM dEdR = (RealOpenMM) (energyAndForceExpression.getResult(1)/(deltaR[ReferenceForce::RIndex]));
     if (useSwitch) {
         if (r > switchingDistance) {
             RealOpenMM t = (r-switchingDistance)/(cutoffDistance-switchingDistance);
@@ -278,10 +272,12 @@ void ReferenceCustomNonbondedIxn::calculateOneIxn( int ii, int jj, vector<RealVe
             energy *= switchValue;
         }
     }
-    for( int kk = 0; kk < 3; kk++ ){
-       RealOpenMM force  = -dEdR*deltaR[kk];
-       forces[ii][kk]   += force;
-       forces[jj][kk]   -= force;
+    if (includeForces) {
+       for( int kk = 0; kk < 3; kk++ ){
+          RealOpenMM force  = -dEdR*deltaR[kk];
+          forces[ii][kk]   += force;
+          forces[jj][kk]   -= force;
+       }
     }
 
     // accumulate energies
@@ -39,9 +39,9 @@ using namespace OpenMM;
 
    --------------------------------------------------------------------------------------- */
 
-ReferenceCustomTorsionIxn::ReferenceCustomTorsionIxn(const Lepton::ExpressionProgram& energyExpression,
-        const Lepton::ExpressionProgram& forceExpression, const vector<string>& parameterNames, map<string, double> globalParameters) :
-        energyExpression(energyExpression), forceExpression(forceExpression), paramNames(parameterNames), globalParameters(globalParameters) {
+ReferenceCustomTorsionIxn::ReferenceCustomTorsionIxn(const Lepton::CompiledExpression& energyExpression,
+        const Lepton::CompiledExpression& forceExpression, const vector<string>& parameterNames) :
+        energyExpression(energyExpression), forceExpression(forceExpression) {
 
    // ---------------------------------------------------------------------------------------
 
@@ -49,6 +49,14 @@ ReferenceCustomTorsionIxn::ReferenceCustomTorsionIxn(const Lepton::ExpressionPro
 
    // ---------------------------------------------------------------------------------------
 
+   // Look up the variables once, so evaluating an interaction only needs to store values.
+
+   energyTheta = ReferenceForce::getVariablePointer(this->energyExpression, "theta");
+   forceTheta = ReferenceForce::getVariablePointer(this->forceExpression, "theta");
+   for (int i = 0; i < (int) parameterNames.size(); ++i) {
+       energyParams.push_back(ReferenceForce::getVariablePointer(this->energyExpression, parameterNames[i]));
+       forceParams.push_back(ReferenceForce::getVariablePointer(this->forceExpression, parameterNames[i]));
+   }
 }
 
 /**---------------------------------------------------------------------------------------
@@ -67,6 +75,21 @@ ReferenceCustomTorsionIxn::~ReferenceCustomTorsionIxn( ){
 
 }
 
+/**---------------------------------------------------------------------------------------
+
+   Set the values of global parameters
+
+   @param globalParameters the values of global parameters
+
+   --------------------------------------------------------------------------------------- */
+
+void ReferenceCustomTorsionIxn::setGlobalParameters( const map<string, double>& globalParameters ){
+   for (map<string, double>::const_iterator iter = globalParameters.begin(); iter != globalParameters.end(); ++iter) {
+       ReferenceForce::setVariable(ReferenceForce::getVariablePointer(energyExpression, iter->first), iter->second);
+       ReferenceForce::setVariable(ReferenceForce::getVariablePointer(forceExpression, iter->first), iter->second);
+   }
+}
+
 /**---------------------------------------------------------------------------------------
 
    Calculate Custom Torsion Ixn
@@ -91,9 +114,10 @@ void ReferenceCustomTorsionIxn::calculateBondIxn( int* atomIndices,
    static const RealOpenMM one         = 1.0;
 
    RealOpenMM deltaR[3][ReferenceForce::LastDeltaRIndex];
-   map<string, double> variables = globalParameters;
-   for (int i = 0; i < (int) paramNames.size(); ++i)
-       variables[paramNames[i]] = parameters[i];
+   for (int i = 0; i < (int) energyParams.size(); ++i) {
+       ReferenceForce::setVariable(energyParams[i], parameters[i]);
+       ReferenceForce::setVariable(forceParams[i], parameters[i]);
+   }
 
    // ---------------------------------------------------------------------------------------
 
@@ -118,13 +142,23 @@ void ReferenceCustomTorsionIxn::calculateBondIxn( int* atomIndices,
 
    RealOpenMM dotDihedral;
    RealOpenMM signOfAngle;
-   variables["theta"] =  getDihedralAngleBetweenThreeVectors(deltaR[0], deltaR[1], deltaR[2],
-                                                             crossProduct, &dotDihedral, deltaR[0],
-                                                             &signOfAngle, 1);
+   RealOpenMM theta = getDihedralAngleBetweenThreeVectors(deltaR[0], deltaR[1], deltaR[2],
+                                                          crossProduct, &dotDihedral, deltaR[0],
+                                                          &signOfAngle, 1);
+   ReferenceForce::setVariable(energyTheta, theta);
+   ReferenceForce::setVariable(forceTheta, theta);
+
+   // If only the energy is needed, the force expression does not need to be evaluated.
+
+   if (!includeForces) {
+      if (totalEnergy != NULL)
+          *totalEnergy += (RealOpenMM) energyExpression.evaluate();
+      return;
+   }
 
    // evaluate delta angle, dE/d(angle)
 
-   RealOpenMM dEdAngle = (RealOpenMM) forceExpression.evaluate(variables);
+   RealOpenMM dEdAngle = (RealOpenMM) forceExpression.evaluate();
 
    // compute force
 
@@ -166,6 +200,6 @@ void ReferenceCustomTorsionIxn::calculateBondIxn( int* atomIndices,
    // accumulate energies
 
    if (totalEnergy != NULL)
-       *totalEnergy += (RealOpenMM) energyExpression.evaluate(variables);
+       *totalEnergy += (RealOpenMM) energyExpression.evaluate();
 }
 
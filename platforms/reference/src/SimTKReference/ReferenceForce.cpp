@@ -161,3 +161,36 @@ void ReferenceForce::getDeltaROnly( const RealOpenMM* atomCoordinatesI,
    deltaR[YIndex]    = atomCoordinatesJ[1] - atomCoordinatesI[1];
    deltaR[ZIndex]    = atomCoordinatesJ[2] - atomCoordinatesI[2];
 }
+
+/**---------------------------------------------------------------------------------------
+
+   Get a pointer to the memory location where a compiled expression stores the value of
+   a variable, or NULL if the expression does not use it (static method)
+
+   @param expression          the compiled expression
+   @param name                the name of the variable
+
+   @return pointer to the variable's value, or NULL
+
+   --------------------------------------------------------------------------------------- */
+
+double* ReferenceForce::getVariablePointer( Lepton::CompiledExpression& expression, const std::string& name ){
+   if (expression.getVariables().find(name) == expression.getVariables().end())
+       return NULL;
+   return &expression.getVariableReference(name);
+}
+
+/**---------------------------------------------------------------------------------------
+
+   Set the value of a variable through a pointer returned by getVariablePointer(), doing
+   nothing if the pointer is NULL (static method)
+
+   @param pointer             the location of the variable, or NULL
+   @param value               the value to store
+
+   --------------------------------------------------------------------------------------- */
+
+void ReferenceForce::setVariable( double* pointer, double value ){
+   if (pointer != NULL)
+       *pointer = value;
+}
@@ -114,13 +114,15 @@ void ReferenceHarmonicBondIxn::calculateBondIxn( int* atomIndices,
 
    dEdR                       = deltaR[ReferenceForce::RIndex] > zero ? (dEdR/deltaR[ReferenceForce::RIndex]) : zero;
 
-   forces[atomAIndex][0]     += dEdR*deltaR[ReferenceForce::XIndex];
-   forces[atomAIndex][1]     += dEdR*deltaR[ReferenceForce::YIndex];
-   forces[atomAIndex][2]     += dEdR*deltaR[ReferenceForce::ZIndex];
-
-   forces[atomBIndex][0]     -= dEdR*deltaR[ReferenceForce::XIndex];
-   forces[atomBIndex][1]     -= dEdR*deltaR[ReferenceForce::YIndex];
-   forces[atomBIndex][2]     -= dEdR*deltaR[ReferenceForce::ZIndex];
+   if (includeForces) {
+      forces[atomAIndex][0]     += dEdR*deltaR[ReferenceForce::XIndex];
+      forces[atomAIndex][1]     += dEdR*deltaR[ReferenceForce::YIndex];
+      forces[atomAIndex][2]     += dEdR*deltaR[ReferenceForce::ZIndex];
+
+      forces[atomBIndex][0]     -= dEdR*deltaR[ReferenceForce::XIndex];
+      forces[atomBIndex][1]     -= dEdR*deltaR[ReferenceForce::YIndex];
+      forces[atomBIndex][2]     -= dEdR*deltaR[ReferenceForce::ZIndex];
+   }
 
    if (totalEnergy != NULL)
        *totalEnergy += half*parameters[1]*deltaIdeal2;
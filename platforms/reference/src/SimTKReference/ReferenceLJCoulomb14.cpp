@@ -127,10 +127,12 @@ void ReferenceLJCoulomb14::calculateBondIxn( int* atomIndices, vector<RealVec>&
 
    // accumulate forces
 
-   for( int ii = 0; ii < 3; ii++ ){
-      RealOpenMM force        = dEdR*deltaR[0][ii];
-      forces[atomAIndex][ii] += force;
-      forces[atomBIndex][ii] -= force;
+   if (includeForces) {
+      for( int ii = 0; ii < 3; ii++ ){
+         RealOpenMM force        = dEdR*deltaR[0][ii];
+         forces[atomAIndex][ii] += force;
+         forces[atomBIndex][ii] -= force;
+      }
    }
 
    // accumulate energies
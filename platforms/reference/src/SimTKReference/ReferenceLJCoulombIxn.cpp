@@ -47,7 +47,7 @@ using OpenMM::RealVec;
 
    --------------------------------------------------------------------------------------- */
 
-ReferenceLJCoulombIxn::ReferenceLJCoulombIxn( ) : cutoff(false), useSwitch(false), periodic(false), ewald(false), pme(false) {
+ReferenceLJCoulombIxn::ReferenceLJCoulombIxn( ) : cutoff(false), useSwitch(false), periodic(false), ewald(false), pme(false), ljpme(false), includeForces(true), dispersionPme(NULL) {
 
    // ---------------------------------------------------------------------------------------
 
@@ -163,6 +163,140 @@ void ReferenceLJCoulombIxn::setUseSwitchingFunction( RealOpenMM distance ) {
       pme = true;
   }
 
+  /**---------------------------------------------------------------------------------------
+
+     Set the force to also use Particle-Mesh Ewald summation for the dispersion part of the
+     Lennard-Jones interaction (LJPME).
+
+     @param alpha  the dispersion Ewald separation parameter
+     @param gridSize the dimensions of the dispersion mesh
+
+     --------------------------------------------------------------------------------------- */
+
+  void ReferenceLJCoulombIxn::setUseLJPME(RealOpenMM alpha, int meshSize[3]) {
+      assert(pme);
+      alphaDispersionEwald = alpha;
+      dispersionMeshDim[0] = meshSize[0];
+      dispersionMeshDim[1] = meshSize[1];
+      dispersionMeshDim[2] = meshSize[2];
+      ljpme = true;
+  }
+
+  /**---------------------------------------------------------------------------------------
+
+     Set a PME object to use for the dispersion reciprocal space sum, so it does not need to be
+     created on every evaluation.
+
+     @param pmeData  the PME object to use, which remains owned by the caller
+
+     --------------------------------------------------------------------------------------- */
+
+  void ReferenceLJCoulombIxn::setDispersionPme(pme_t pmeData) {
+      dispersionPme = pmeData;
+  }
+
+  /**---------------------------------------------------------------------------------------
+
+     Create a PME object that can be passed to setDispersionPme().
+
+     @param alpha          the dispersion Ewald separation parameter
+     @param meshSize       the dimensions of the dispersion mesh
+     @param numberOfAtoms  number of atoms
+
+     @return the new PME object, which should be deleted with destroyDispersionPme()
+
+     --------------------------------------------------------------------------------------- */
+
+  pme_t ReferenceLJCoulombIxn::createDispersionPme(RealOpenMM alpha, int meshSize[3], int numberOfAtoms) {
+      pme_t pmeData;
+      pme_init(&pmeData, alpha, numberOfAtoms, meshSize, 5, 1);
+      return pmeData;
+  }
+
+  /**---------------------------------------------------------------------------------------
+
+     Delete a PME object created by createDispersionPme().
+
+     @param pmeData  the PME object to delete
+
+     --------------------------------------------------------------------------------------- */
+
+  void ReferenceLJCoulombIxn::destroyDispersionPme(pme_t pmeData) {
+      pme_destroy(pmeData);
+  }
+
+/**---------------------------------------------------------------------------------------
+
+     Set whether forces should be computed.  If this is false, only the energy is computed
+     and the force array passed to calculatePairIxn() is left unchanged.
+
+     @param include  true if forces should be computed
+
+     --------------------------------------------------------------------------------------- */
+
+  void ReferenceLJCoulombIxn::setIncludeForces(bool include) {
+      includeForces = include;
+  }
+
+/**---------------------------------------------------------------------------------------
+
+   Get the coefficient of an atom for the dispersion term in LJPME.  The reciprocal space sum
+   uses geometric combining rules, so the coefficient for a pair is the product of the two
+   atoms' coefficients: 4*sqrt(eps1*eps2)*(sigma1*sigma2)^3.
+
+   --------------------------------------------------------------------------------------- */
+
+static RealOpenMM getDispersionCoefficient(RealOpenMM** atomParameters, int atom) {
+    // SigIndex holds sigma/2 and EpsIndex holds 2*sqrt(epsilon).
+
+    RealOpenMM halfSigma = atomParameters[atom][0];
+    return 8*atomParameters[atom][1]*halfSigma*halfSigma*halfSigma;
+}
+
+/**---------------------------------------------------------------------------------------
+
+   Calculate the reciprocal space part of the LJPME dispersion interaction
+
+   @param numberOfAtoms    number of atoms
+   @param atomCoordinates  atom coordinates
+   @param atomParameters   atom parameters                             atomParameters[atomIndex][paramterIndex]
+   @param forces           force array (forces added)
+   @param energyByAtom     atom energy
+   @param totalEnergy      total energy
+
+   --------------------------------------------------------------------------------------- */
+
+void ReferenceLJCoulombIxn::calculateDispersionReciprocalIxn(int numberOfAtoms, vector<RealVec>& atomCoordinates,
+                                             RealOpenMM** atomParameters, vector<RealVec>& forces,
+                                             RealOpenMM* energyByAtom, RealOpenMM* totalEnergy) const {
+    vector<RealOpenMM> c6s(numberOfAtoms);
+    for (int i = 0; i < numberOfAtoms; i++)
+        c6s[i] = getDispersionCoefficient(atomParameters, i);
+
+    // The reciprocal space sum includes the interaction of each atom with itself, which must be removed.
+
+    RealOpenMM alpha6 = (RealOpenMM) pow(alphaDispersionEwald, 6.0);
+    RealOpenMM totalSelfEnergy = 0;
+    for (int i = 0; i < numberOfAtoms; i++) {
+        RealOpenMM selfEnergy = c6s[i]*c6s[i]*alpha6/12;
+        totalSelfEnergy += selfEnergy;
+        if (energyByAtom)
+            energyByAtom[i] += selfEnergy;
+    }
+    pme_t pmedata = dispersionPme;
+    RealOpenMM recipEnergy = 0;
+    if (pmedata == NULL)
+        pme_init(&pmedata, alphaDispersionEwald, numberOfAtoms, dispersionMeshDim, 5, 1);
+    pme_exec_dpme(pmedata, atomCoordinates, includeForces ? &forces : NULL, c6s, periodicBoxSize, &recipEnergy);
+    if (dispersionPme == NULL)
+        pme_destroy(pmedata);
+    if (totalEnergy)
+        *totalEnergy += totalSelfEnergy+recipEnergy;
+    if (energyByAtom)
+        for (int i = 0; i < numberOfAtoms; i++)
+            energyByAtom[i] += recipEnergy;
+}
+
 /**---------------------------------------------------------------------------------------
 
    Calculate Ewald ixn
@@ -233,7 +367,7 @@ void ReferenceLJCoulombIxn::calculateEwaldIxn(int numberOfAtoms, vector<RealVec>
 
     pme_init(&pmedata,alphaEwald,numberOfAtoms,meshDim,5,1);
 
-    pme_exec(pmedata,atomCoordinates,forces,atomParameters,periodicBoxSize,&recipEnergy,virial);
+    pme_exec(pmedata,atomCoordinates,includeForces ? &forces : NULL,atomParameters,periodicBoxSize,&recipEnergy,virial);
 
     if( totalEnergy )
        *totalEnergy += recipEnergy;
@@ -243,6 +377,9 @@ void ReferenceLJCoulombIxn::calculateEwaldIxn(int numberOfAtoms, vector<RealVec>
             energyByAtom[n] += recipEnergy;
 
         pme_destroy(pmedata);
+
+    if (ljpme)
+        calculateDispersionReciprocalIxn(numberOfAtoms, atomCoordinates, atomParameters, forces, energyByAtom, totalEnergy);
   }
 
     // Ewald method
@@ -327,11 +464,13 @@ void ReferenceLJCoulombIxn::calculateEwaldIxn(int numberOfAtoms, vector<RealVec>
           RealOpenMM k2 = kx * kx + ky * ky + kz * kz;
           RealOpenMM ak = exp(k2*factorEwald) / k2;
 
-          for(int n = 0; n < numberOfAtoms; n++) {
-            RealOpenMM force = ak * (cs * tab_qxyz[n].imag() - ss * tab_qxyz[n].real());
-            forces[n][0] += 2 * recipCoeff * force * kx ;
-            forces[n][1] += 2 * recipCoeff * force * ky ;
-            forces[n][2] += 2 * recipCoeff * force * kz ;
+          if (includeForces) {
+            for(int n = 0; n < numberOfAtoms; n++) {
+              RealOpenMM force = ak * (cs * tab_qxyz[n].imag() - ss * tab_qxyz[n].real());
+              forces[n][0] += 2 * recipCoeff * force * kx ;
+              forces[n][1] += 2 * recipCoeff * force * ky ;
+              forces[n][2] += 2 * recipCoeff * force * kz ;
+            }
           }
 
           recipEnergy       = recipCoeff * ak * ( cs * cs + ss * ss);
@@ -368,6 +507,8 @@ void ReferenceLJCoulombIxn::calculateEwaldIxn(int numberOfAtoms, vector<RealVec>
        RealOpenMM deltaR[2][ReferenceForce::LastDeltaRIndex];
        ReferenceForce::getDeltaRPeriodic( atomCoordinates[jj], atomCoordinates[ii], periodicBoxSize, deltaR[0] );
        RealOpenMM r         = deltaR[0][ReferenceForce::RIndex];
+       if (r >= cutoffDistance)
+           continue;
        RealOpenMM inverseR  = one/(deltaR[0][ReferenceForce::RIndex]);
        RealOpenMM switchValue = 1, switchDeriv = 0;
        if (useSwitch && r > switchingDistance) {
@@ -392,13 +533,28 @@ void ReferenceLJCoulombIxn::calculateEwaldIxn(int numberOfAtoms, vector<RealVec>
            dEdR -= vdwEnergy*switchDeriv*inverseR;
            vdwEnergy *= switchValue;
        }
+       if (ljpme) {
+           // Remove the part of the dispersion interaction that was included in reciprocal space, so the exact
+           // Lennard-Jones interaction is used within the cutoff.
+
+           RealOpenMM c6 = getDispersionCoefficient(atomParameters, ii)*getDispersionCoefficient(atomParameters, jj);
+           RealOpenMM inverseR2 = inverseR*inverseR;
+           RealOpenMM inverseR6 = inverseR2*inverseR2*inverseR2;
+           RealOpenMM dar2 = alphaDispersionEwald*alphaDispersionEwald*r*r;
+           RealOpenMM expTerm = EXP(-dar2);
+           RealOpenMM recipFraction = one-expTerm*(one+dar2+0.5*dar2*dar2);
+           vdwEnergy += c6*inverseR6*recipFraction;
+           dEdR += c6*inverseR6*inverseR2*(six*recipFraction-dar2*dar2*dar2*expTerm);
+       }
 
        // accumulate forces
 
-       for( int kk = 0; kk < 3; kk++ ){
-          RealOpenMM force  = dEdR*deltaR[0][kk];
-          forces[ii][kk]   += force;
-          forces[jj][kk]   -= force;
+       if (includeForces) {
+          for( int kk = 0; kk < 3; kk++ ){
+             RealOpenMM force  = dEdR*deltaR[0][kk];
+             forces[ii][kk]   += force;
+             forces[jj][kk]   -= force;
+          }
        }
 
        // accumulate energies
@@ -432,16 +588,42 @@ void ReferenceLJCoulombIxn::calculateEwaldIxn(int numberOfAtoms, vector<RealVec>
                RealOpenMM r         = deltaR[0][ReferenceForce::RIndex];
                RealOpenMM inverseR  = one/(deltaR[0][ReferenceForce::RIndex]);
                RealOpenMM alphaR    = alphaEwald * r;
+               RealOpenMM c6 = (ljpme ? getDispersionCoefficient(atomParameters, ii)*getDispersionCoefficient(atomParameters, jj) : 0);
+               if (c6 != 0) {
+                   // Remove the dispersion interaction that was included in reciprocal space.
+
+                   RealOpenMM inverseR2 = inverseR*inverseR;
+                   RealOpenMM inverseR6 = inverseR2*inverseR2*inverseR2;
+                   RealOpenMM dar2 = alphaDispersionEwald*alphaDispersionEwald*r*r;
+                   RealOpenMM expTerm = EXP(-dar2);
+                   RealOpenMM recipFraction = one-expTerm*(one+dar2+0.5*dar2*dar2);
+                   RealOpenMM dispersionEnergy = c6*inverseR6*recipFraction;
+                   RealOpenMM dEdR = c6*inverseR6*inverseR2*(six*recipFraction-dar2*dar2*dar2*expTerm);
+                   if (includeForces) {
+                      for( int kk = 0; kk < 3; kk++ ){
+                         RealOpenMM force  = dEdR*deltaR[0][kk];
+                         forces[ii][kk]   += force;
+                         forces[jj][kk]   -= force;
+                      }
+                   }
+                   totalExclusionEnergy -= dispersionEnergy;
+                   if( energyByAtom ){
+                       energyByAtom[ii] += dispersionEnergy;
+                       energyByAtom[jj] += dispersionEnergy;
+                   }
+               }
                if (erf(alphaR) > 1e-6) {
                    RealOpenMM dEdR      = (RealOpenMM) (ONE_4PI_EPS0 * atomParameters[ii][QIndex] * atomParameters[jj][QIndex] * inverseR * inverseR * inverseR);
                               dEdR      = (RealOpenMM) (dEdR * (erf(alphaR) - 2 * alphaR * exp ( - alphaR * alphaR) / SQRT_PI ));
 
                    // accumulate forces
 
-                   for( int kk = 0; kk < 3; kk++ ){
-                      RealOpenMM force  = dEdR*deltaR[0][kk];
-                      forces[ii][kk]   -= force;
-                      forces[jj][kk]   += force;
+                   if (includeForces) {
+                      for( int kk = 0; kk < 3; kk++ ){
+                         RealOpenMM force  = dEdR*deltaR[0][kk];
+                         forces[ii][kk]   -= force;
+                         forces[jj][kk]   += force;
+                      }
                    }
 
                    // accumulate energies
@@ -557,6 +739,8 @@ void ReferenceLJCoulombIxn::calculateOneIxn( int ii, int jj, vector<RealVec>& at
         ReferenceForce::getDeltaR( atomCoordinates[jj], atomCoordinates[ii], deltaR[0] );
 
     RealOpenMM r2        = deltaR[0][ReferenceForce::R2Index];
+    if (cutoff && deltaR[0][ReferenceForce::RIndex] >= cutoffDistance)
+        return;
     RealOpenMM inverseR  = one/(deltaR[0][ReferenceForce::RIndex]);
     RealOpenMM switchValue = 1, switchDeriv = 0;
     if (useSwitch) {
@@ -591,10 +775,12 @@ void ReferenceLJCoulombIxn::calculateOneIxn( int ii, int jj, vector<RealVec>& at
 
     // accumulate forces
 
-    for( int kk = 0; kk < 3; kk++ ){
-       RealOpenMM force  = dEdR*deltaR[0][kk];
-       forces[ii][kk]   += force;
-       forces[jj][kk]   -= force;
+    if (includeForces) {
+       for( int kk = 0; kk < 3; kk++ ){
+          RealOpenMM force  = dEdR*deltaR[0][kk];
+          forces[ii][kk]   += force;
+          forces[jj][kk]   -= force;
+       }
     }
 
     // accumulate energies
@@ -0,0 +1,191 @@
+
+/* Portions copyright (c) 2013 Stanford University and Simbios.
+ * Contributors: Peter Eastman
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject
+ * to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS, CONTRIBUTORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include "SimTKOpenMMCommon.h"
+#include "SimTKOpenMMUtilities.h"
+#include "ReferenceVirtualSites.h"
+#include "ReferenceMTSDynamics.h"
+#include <algorithm>
+
+using namespace std;
+using namespace OpenMM;
+
+/**---------------------------------------------------------------------------------------
+
+   ReferenceMTSDynamics constructor
+
+   @param numberOfAtoms  number of atoms
+   @param deltaT         delta t for the slowest group
+   @param groups         a list of (force group, substeps) pairs
+
+   --------------------------------------------------------------------------------------- */
+
+ReferenceMTSDynamics::ReferenceMTSDynamics(int numberOfAtoms, RealOpenMM deltaT, const vector<pair<int, int> >& groups) :
+           ReferenceDynamics(numberOfAtoms, deltaT, 0.0) {
+    // Groups that take the same number of substeps are evaluated together.  Sort the levels
+    // from slowest to fastest.
+
+    for (int i = 0; i < (int) groups.size(); i++)
+        levelSubsteps.push_back(groups[i].second);
+    sort(levelSubsteps.begin(), levelSubsteps.end());
+    levelSubsteps.erase(unique(levelSubsteps.begin(), levelSubsteps.end()), levelSubsteps.end());
+    levelGroups.resize(levelSubsteps.size(), 0);
+    for (int i = 0; i < (int) groups.size(); i++) {
+        int level = find(levelSubsteps.begin(), levelSubsteps.end(), groups[i].second)-levelSubsteps.begin();
+        levelGroups[level] |= 1<<groups[i].first;
+    }
+    levelForces.resize(levelSubsteps.size(), vector<RealVec>(numberOfAtoms));
+    levelForcesValid.resize(levelSubsteps.size(), false);
+    xPrime.resize(numberOfAtoms);
+    inverseMasses.resize(numberOfAtoms);
+}
+
+/**---------------------------------------------------------------------------------------
+
+   ReferenceMTSDynamics destructor
+
+   --------------------------------------------------------------------------------------- */
+
+ReferenceMTSDynamics::~ReferenceMTSDynamics() {
+}
+
+/**---------------------------------------------------------------------------------------
+
+   Update -- driver routine for performing r-RESPA dynamics update of coordinates
+   and velocities
+
+   @param context             the context this integrator is updating
+   @param atomCoordinates     atom coordinates
+   @param velocities          velocities
+   @param forces              the context's force buffer
+   @param masses              atom masses
+   @param forcesAreValid      whether the cached forces from the previous step can be reused.
+                              On exit, this is true.
+
+   --------------------------------------------------------------------------------------- */
+
+void ReferenceMTSDynamics::update(ContextImpl& context, vector<RealVec>& atomCoordinates,
+                                  vector<RealVec>& velocities, vector<RealVec>& forces, vector<RealOpenMM>& masses,
+                                  bool& forcesAreValid) {
+    int numberOfAtoms = context.getSystem().getNumParticles();
+    if (getTimeStep() == 0) {
+        for (int i = 0; i < numberOfAtoms; i++)
+            inverseMasses[i] = (masses[i] == 0.0 ? 0.0 : 1.0/masses[i]);
+    }
+
+    // The forces computed at the end of the previous step can be reused for the first half kick,
+    // unless something has modified the positions or box since then.  A ForceImpl (such as a
+    // barostat) can do that in updateContextState() without notifying the integrator, so check
+    // directly.
+
+    Vec3 box[3];
+    context.getPeriodicBoxVectors(box[0], box[1], box[2]);
+    if ((int) forcePositions.size() != numberOfAtoms || box[0] != forceBox[0] || box[1] != forceBox[1] || box[2] != forceBox[2])
+        forcesAreValid = false;
+    for (int i = 0; i < numberOfAtoms && forcesAreValid; i++)
+        if (atomCoordinates[i][0] != forcePositions[i][0] || atomCoordinates[i][1] != forcePositions[i][1] || atomCoordinates[i][2] != forcePositions[i][2])
+            forcesAreValid = false;
+    if (!forcesAreValid)
+        for (int i = 0; i < (int) levelForcesValid.size(); i++)
+            levelForcesValid[i] = false;
+
+    // Perform the integration.
+
+    integrateLevel(context, 0, atomCoordinates, velocities, forces, masses);
+    ReferenceConstraintAlgorithm* referenceConstraintAlgorithm = getReferenceConstraintAlgorithm();
+    if (referenceConstraintAlgorithm)
+        referenceConstraintAlgorithm->applyToVelocities(numberOfAtoms, atomCoordinates, velocities, inverseMasses);
+
+    // Remember where the cached forces were computed.
+
+    forcePositions = atomCoordinates;
+    for (int i = 0; i < 3; i++)
+        forceBox[i] = box[i];
+    forcesAreValid = true;
+    incrementTimeStep();
+}
+
+/**---------------------------------------------------------------------------------------
+
+   Take all the substeps for one level of the hierarchy that make up a single substep of the
+   next slower level.
+
+   --------------------------------------------------------------------------------------- */
+
+void ReferenceMTSDynamics::integrateLevel(ContextImpl& context, int level, vector<RealVec>& atomCoordinates,
+                                          vector<RealVec>& velocities, vector<RealVec>& forces, vector<RealOpenMM>& masses) {
+    int numberOfAtoms = context.getSystem().getNumParticles();
+    int numLevels = levelSubsteps.size();
+    int stepsPerParentStep = (level == 0 ? levelSubsteps[0] : levelSubsteps[level]/levelSubsteps[level-1]);
+    RealOpenMM dt = getDeltaT()/levelSubsteps[level];
+    for (int step = 0; step < stepsPerParentStep; step++) {
+        applyForces(context, level, 0.5*dt, velocities, forces);
+        if (level < numLevels-1)
+            integrateLevel(context, level+1, atomCoordinates, velocities, forces, masses);
+        else {
+            // This is the fastest level, so update the positions.
+
+            for (int i = 0; i < numberOfAtoms; i++) {
+                if (masses[i] != 0.0)
+                    xPrime[i] = atomCoordinates[i]+velocities[i]*dt;
+                else
+                    xPrime[i] = atomCoordinates[i];
+            }
+            ReferenceConstraintAlgorithm* referenceConstraintAlgorithm = getReferenceConstraintAlgorithm();
+            if (referenceConstraintAlgorithm)
+                referenceConstraintAlgorithm->apply(numberOfAtoms, atomCoordinates, xPrime, inverseMasses);
+            RealOpenMM velocityScale = 1.0/dt;
+            for (int i = 0; i < numberOfAtoms; i++) {
+                if (masses[i] != 0.0) {
+                    velocities[i] = (xPrime[i]-atomCoordinates[i])*velocityScale;
+                    atomCoordinates[i] = xPrime[i];
+                }
+            }
+            ReferenceVirtualSites::computePositions(context.getSystem(), atomCoordinates);
+            for (int i = 0; i < numLevels; i++)
+                levelForcesValid[i] = false;
+        }
+        applyForces(context, level, 0.5*dt, velocities, forces);
+    }
+}
+
+/**---------------------------------------------------------------------------------------
+
+   Update the velocities based on the forces for one level, computing those forces first if
+   the cached values are out of date.
+
+   --------------------------------------------------------------------------------------- */
+
+void ReferenceMTSDynamics::applyForces(ContextImpl& context, int level, RealOpenMM deltaT, vector<RealVec>& velocities, vector<RealVec>& forces) {
+    vector<RealVec>& levelForce = levelForces[level];
+    if (!levelForcesValid[level]) {
+        context.calcForcesAndEnergy(true, false, levelGroups[level]);
+        levelForce = forces;
+        levelForcesValid[level] = true;
+    }
+    int numberOfAtoms = velocities.size();
+    for (int i = 0; i < numberOfAtoms; i++)
+        if (inverseMasses[i] != 0.0)
+            velocities[i] += levelForce[i]*(deltaT*inverseMasses[i]);
+}
@@ -1,6 +1,7 @@
 #include "ReferenceNeighborList.h"
 #include <set>
 #include <map>
+#include <algorithm>
 #include <cmath>
 #include <iostream>
 #include <cassert>
@@ -256,4 +257,277 @@ void OPENMM_EXPORT computeNeighborListVoxelHash(
     }
 }
 
+/**
+ * A cell list stored in flat arrays.  Atoms are counting-sorted into cells, so that the atoms in
+ * each cell are contiguous in memory, and cellStart[c]..cellStart[c+1] gives the range belonging
+ * to cell c.  Each pair of neighboring cells is visited only once.
+ */
+class CellList
+{
+public:
+    CellList(int nAtoms, const AtomLocationList& atomLocations, const RealVec& periodicBoxSize, bool usePeriodic, double maxDistance) :
+            periodicBoxSize(periodicBoxSize), usePeriodic(usePeriodic) {
+        assert(maxDistance > 0);
+        
+        // Select the cell dimensions.
+        
+        if (usePeriodic) {
+            for (int i = 0; i < 3; i++) {
+                numCells[i] = max(1, (int) floor(periodicBoxSize[i]/maxDistance));
+                cellSize[i] = periodicBoxSize[i]/numCells[i];
+                origin[i] = 0.0;
+            }
+        }
+        else {
+            double minPos[3], maxPos[3];
+            for (int i = 0; i < 3; i++)
+                minPos[i] = maxPos[i] = (nAtoms > 0 ? atomLocations[0][i] : 0.0);
+            for (int atom = 1; atom < nAtoms; atom++)
+                for (int i = 0; i < 3; i++) {
+                    minPos[i] = min(minPos[i], (double) atomLocations[atom][i]);
+                    maxPos[i] = max(maxPos[i], (double) atomLocations[atom][i]);
+                }
+            
+            // Make sure a few distant atoms cannot cause the grid to use an excessive amount of memory.
+            
+            double edge = maxDistance;
+            double maxTotalCells = max(1000.0, 8.0*nAtoms);
+            while (true) {
+                double totalCells = 1.0;
+                for (int i = 0; i < 3; i++)
+                    totalCells *= floor((maxPos[i]-minPos[i])/edge)+1;
+                if (totalCells <= maxTotalCells)
+                    break;
+                edge *= 1.5;
+            }
+            for (int i = 0; i < 3; i++) {
+                numCells[i] = (int) floor((maxPos[i]-minPos[i])/edge)+1;
+                cellSize[i] = edge;
+                origin[i] = minPos[i];
+            }
+        }
+        for (int i = 0; i < 3; i++)
+            searchRange[i] = (int) ceil(maxDistance/cellSize[i]);
+        
+        // Sort the atoms into cells.
+        
+        int totalCells = numCells[0]*numCells[1]*numCells[2];
+        vector<int> atomCell(nAtoms);
+        cellStart.resize(totalCells+1, 0);
+        for (int atom = 0; atom < nAtoms; atom++) {
+            int cell = getCellIndex(atomLocations[atom]);
+            atomCell[atom] = cell;
+            cellStart[cell+1]++;
+        }
+        for (int cell = 0; cell < totalCells; cell++)
+            cellStart[cell+1] += cellStart[cell];
+        vector<int> nextInCell(cellStart.begin(), cellStart.end()-1);
+        cellAtoms.resize(nAtoms);
+        cellLocations.resize(nAtoms);
+        for (int atom = 0; atom < nAtoms; atom++) {
+            int index = nextInCell[atomCell[atom]]++;
+            cellAtoms[index] = atom;
+            RealVec location = atomLocations[atom];
+            if (usePeriodic)
+                for (int i = 0; i < 3; i++)
+                    location[i] -= periodicBoxSize[i]*floor(location[i]/periodicBoxSize[i]);
+            cellLocations[index] = location;
+        }
+    }
+
+    void getNeighbors(
+            NeighborList& neighbors,
+            const vector<set<int> >& exclusions,
+            bool reportSymmetricPairs,
+            double maxDistance,
+            double minDistance) const
+    {
+        assert(minDistance >= 0);
+        double maxDistanceSquared = maxDistance * maxDistance;
+        double minDistanceSquared = minDistance * minDistance;
+        
+        // For each cell index along each axis, find the distinct cells within range of it, along
+        // with the periodic shift to apply to positions in that cell.  If the grid is too small for
+        // the shift to be unique, fall back to computing the minimum image for every pair.
+        
+        vector<vector<NeighborCell> > neighborCells[3];
+        bool useMinimumImage = false;
+        for (int axis = 0; axis < 3; axis++) {
+            int n = numCells[axis];
+            int range = searchRange[axis];
+            neighborCells[axis].resize(n);
+            if (usePeriodic && n <= 2*range)
+                useMinimumImage = true;
+            for (int i = 0; i < n; i++) {
+                vector<NeighborCell>& cells = neighborCells[axis][i];
+                if (usePeriodic && n <= 2*range) {
+                    for (int j = 0; j < n; j++)
+                        cells.push_back(NeighborCell(j, 0.0));
+                }
+                else {
+                    for (int j = i-range; j <= i+range; j++) {
+                        if (!usePeriodic) {
+                            if (j >= 0 && j < n)
+                                cells.push_back(NeighborCell(j, 0.0));
+                        }
+                        else if (j < 0)
+                            cells.push_back(NeighborCell(j+n, -periodicBoxSize[axis]));
+                        else if (j >= n)
+                            cells.push_back(NeighborCell(j-n, periodicBoxSize[axis]));
+                        else
+                            cells.push_back(NeighborCell(j, 0.0));
+                    }
+                }
+            }
+        }
+        
+        // Loop over pairs of cells.  A pair of distinct cells is processed only from the one with
+        // the lower index.
+        
+        for (int z = 0; z < numCells[2]; z++)
+            for (int y = 0; y < numCells[1]; y++)
+                for (int x = 0; x < numCells[0]; x++) {
+                    int cell1 = (z*numCells[1]+y)*numCells[0]+x;
+                    int start1 = cellStart[cell1];
+                    int end1 = cellStart[cell1+1];
+                    if (start1 == end1)
+                        continue;
+                    const vector<NeighborCell>& cellsZ = neighborCells[2][z];
+                    const vector<NeighborCell>& cellsY = neighborCells[1][y];
+                    const vector<NeighborCell>& cellsX = neighborCells[0][x];
+                    for (int k = 0; k < (int) cellsZ.size(); k++)
+                        for (int j = 0; j < (int) cellsY.size(); j++)
+                            for (int i = 0; i < (int) cellsX.size(); i++) {
+                                int cell2 = (cellsZ[k].index*numCells[1]+cellsY[j].index)*numCells[0]+cellsX[i].index;
+                                if (cell2 < cell1)
+                                    continue;
+                                int start2 = cellStart[cell2];
+                                int end2 = cellStart[cell2+1];
+                                double shiftX = cellsX[i].shift;
+                                double shiftY = cellsY[j].shift;
+                                double shiftZ = cellsZ[k].shift;
+                                for (int index1 = start1; index1 < end1; index1++) {
+                                    const RealVec& location1 = cellLocations[index1];
+                                    for (int index2 = (cell1 == cell2 ? index1+1 : start2); index2 < end2; index2++) {
+                                        const RealVec& location2 = cellLocations[index2];
+                                        double dSquared;
+                                        if (useMinimumImage)
+                                            dSquared = compPairDistanceSquared(location1, location2, periodicBoxSize, usePeriodic);
+                                        else {
+                                            double dx = location2[0]+shiftX-location1[0];
+                                            double dy = location2[1]+shiftY-location1[1];
+                                            double dz = location2[2]+shiftZ-location1[2];
+                                            dSquared = dx*dx + dy*dy + dz*dz;
+                                        }
+                                        if (dSquared > maxDistanceSquared || dSquared < minDistanceSquared)
+                                            continue;
+                                        AtomIndex atomI = max(cellAtoms[index1], cellAtoms[index2]);
+                                        AtomIndex atomJ = min(cellAtoms[index1], cellAtoms[index2]);
+                                        if (exclusions[atomI].find(atomJ) != exclusions[atomI].end())
+                                            continue;
+                                        neighbors.push_back(AtomPair(atomI, atomJ));
+                                        if (reportSymmetricPairs)
+                                            neighbors.push_back(AtomPair(atomJ, atomI));
+                                    }
+                                }
+                            }
+                }
+    }
+
+private:
+    struct NeighborCell {
+        NeighborCell(int index, double shift) : index(index), shift(shift) {}
+        int index;
+        double shift;
+    };
+
+    int getCellIndex(const RealVec& location) const {
+        int index[3];
+        for (int i = 0; i < 3; i++) {
+            double pos = location[i]-origin[i];
+            if (usePeriodic)
+                pos -= periodicBoxSize[i]*floor(pos/periodicBoxSize[i]);
+            index[i] = min(max((int) floor(pos/cellSize[i]), 0), numCells[i]-1);
+        }
+        return (index[2]*numCells[1]+index[1])*numCells[0]+index[0];
+    }
+
+    int numCells[3], searchRange[3];
+    double cellSize[3], origin[3];
+    const RealVec& periodicBoxSize;
+    const bool usePeriodic;
+    vector<int> cellStart;
+    vector<AtomIndex> cellAtoms;
+    AtomLocationList cellLocations;
+};
+
+
+// O(n) neighbor list method using a flat array cell list
+void OPENMM_EXPORT computeNeighborListCellList(
+                              NeighborList& neighborList,
+                              int nAtoms,
+                              const AtomLocationList& atomLocations, 
+                              const vector<set<int> >& exclusions,
+                              const RealVec& periodicBoxSize,
+                              bool usePeriodic,
+                              double maxDistance,
+                              double minDistance,
+                              bool reportSymmetricPairs
+                             )
+{
+    neighborList.clear();
+    CellList cellList(nAtoms, atomLocations, periodicBoxSize, usePeriodic, maxDistance);
+    cellList.getNeighbors(neighborList, exclusions, reportSymmetricPairs, maxDistance, minDistance);
+}
+
+ReferenceNeighborList::ReferenceNeighborList() : lastCutoff(0.0), lastSkin(0.0), lastUsePeriodic(false), isValid(false) {
+}
+
+bool ReferenceNeighborList::update(int nAtoms,
+                                   const AtomLocationList& atomLocations,
+                                   const vector<set<int> >& exclusions,
+                                   const RealVec& periodicBoxSize,
+                                   bool usePeriodic,
+                                   double cutoff,
+                                   double skin)
+{
+    bool rebuild = (!isValid || cutoff != lastCutoff || skin != lastSkin || usePeriodic != lastUsePeriodic || nAtoms != (int) lastPositions.size());
+    if (!rebuild) {
+        // If the box has been scaled (for example by a barostat), measure how far each atom is from where
+        // scaling alone would have put it.  Every pair missing from the list was more than cutoff+skin apart,
+        // which scaling shrinks to at least minScale*(cutoff+skin).  The two atoms of a pair may share whatever
+        // is left beyond the cutoff.  When the box is unchanged this is the usual half skin test.
+
+        RealVec scale(1.0, 1.0, 1.0);
+        if (usePeriodic)
+            for (int i = 0; i < 3; i++)
+                scale[i] = periodicBoxSize[i]/lastBoxSize[i];
+        double minScale = min(scale[0], min(scale[1], scale[2]));
+        double maxMove = 0.5*(minScale*(cutoff+skin)-cutoff);
+        if (maxMove <= 0.0)
+            rebuild = true;
+        double maxMoveSquared = maxMove*maxMove;
+        for (int i = 0; i < nAtoms && !rebuild; i++) {
+            RealVec delta;
+            for (int j = 0; j < 3; j++) {
+                delta[j] = atomLocations[i][j]-scale[j]*lastPositions[i][j];
+                if (usePeriodic)
+                    delta[j] -= periodicBoxSize[j]*floor(delta[j]/periodicBoxSize[j]+0.5);
+            }
+            if (delta.dot(delta) > maxMoveSquared)
+                rebuild = true;
+        }
+    }
+    if (!rebuild)
+        return false;
+    computeNeighborListCellList(neighborList, nAtoms, atomLocations, exclusions, periodicBoxSize, usePeriodic, cutoff+skin, 0.0);
+    lastPositions.assign(atomLocations.begin(), atomLocations.begin()+nAtoms);
+    lastBoxSize = periodicBoxSize;
+    lastCutoff = cutoff;
+    lastSkin = skin;
+    lastUsePeriodic = usePeriodic;
+    isValid = true;
+    return true;
+}
+
 } // namespace OpenMM
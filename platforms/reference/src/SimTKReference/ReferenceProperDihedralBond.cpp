@@ -138,6 +138,14 @@ void ReferenceProperDihedralBond::calculateBondIxn( int* atomIndices,
    RealOpenMM sinDeltaAngle  = SIN( deltaAngle );
    RealOpenMM dEdAngle       = -parameters[0]*parameters[2]*sinDeltaAngle;
    RealOpenMM energy         =  parameters[0]*(one + COS( deltaAngle ) );
+
+   // If only the energy is needed, there is no need to go further.
+
+   if (!includeForces) {
+      if (totalEnergy != NULL)
+          *totalEnergy += energy;
+      return;
+   }
    
    // compute force
 
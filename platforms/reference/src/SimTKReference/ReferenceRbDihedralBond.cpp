@@ -156,6 +156,14 @@ void ReferenceRbDihedralBond::calculateBondIxn( int* atomIndices,
 
    dEdAngle *= SIN( dihederalAngle );
 
+   // If only the energy is needed, there is no need to go further.
+
+   if (!includeForces) {
+      if (totalEnergy != NULL)
+          *totalEnergy += energy;
+      return;
+   }
+
    RealOpenMM internalF[4][3];
    RealOpenMM forceFactors[4];
    RealOpenMM normCross1         = DOT3( crossProduct[0], crossProduct[0] );
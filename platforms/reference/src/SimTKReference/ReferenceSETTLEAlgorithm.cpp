@@ -0,0 +1,238 @@
+/* Portions copyright (c) 2013 Stanford University and Simbios.
+ * Contributors: Peter Eastman
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject
+ * to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS, CONTRIBUTORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include "ReferenceSETTLEAlgorithm.h"
+#include "SimTKOpenMMCommon.h"
+#include <algorithm>
+
+using namespace std;
+using namespace OpenMM;
+
+ReferenceSETTLEAlgorithm::ReferenceSETTLEAlgorithm(const vector<int>& atom1, const vector<int>& atom2, const vector<int>& atom3,
+        const vector<RealOpenMM>& distance1, const vector<RealOpenMM>& distance2, const vector<RealOpenMM>& masses) :
+        atom1(atom1), atom2(atom2), atom3(atom3), distance1(distance1), distance2(distance2), masses(masses), tolerance(0) {
+}
+
+int ReferenceSETTLEAlgorithm::getNumClusters() const {
+    return atom1.size();
+}
+
+void ReferenceSETTLEAlgorithm::getClusterParameters(int index, int& atom1, int& atom2, int& atom3, RealOpenMM& distance1, RealOpenMM& distance2) const {
+    atom1 = this->atom1[index];
+    atom2 = this->atom2[index];
+    atom3 = this->atom3[index];
+    distance1 = this->distance1[index];
+    distance2 = this->distance2[index];
+}
+
+RealOpenMM ReferenceSETTLEAlgorithm::getTolerance() const {
+    return tolerance;
+}
+
+void ReferenceSETTLEAlgorithm::setTolerance(RealOpenMM tolerance) {
+    this->tolerance = tolerance;
+}
+
+int ReferenceSETTLEAlgorithm::apply(int numberOfAtoms, vector<RealVec>& atomCoordinates, vector<RealVec>& atomCoordinatesP, vector<RealOpenMM>& inverseMasses) {
+    for (int index = 0; index < (int) atom1.size(); ++index) {
+        // Work with the displacements of each atom, relative to the original position of the central atom.
+
+        RealVec apos0 = atomCoordinates[atom1[index]];
+        RealVec xp0 = atomCoordinatesP[atom1[index]]-apos0;
+        RealVec apos1 = atomCoordinates[atom2[index]];
+        RealVec xp1 = atomCoordinatesP[atom2[index]]-apos1;
+        RealVec apos2 = atomCoordinates[atom3[index]];
+        RealVec xp2 = atomCoordinatesP[atom3[index]]-apos2;
+        RealOpenMM m0 = masses[atom1[index]];
+        RealOpenMM m1 = masses[atom2[index]];
+        RealOpenMM m2 = masses[atom3[index]];
+
+        // Step 1: find the center of mass of the new positions, and build a coordinate frame whose z axis is
+        // normal to the plane of the original molecule.
+
+        RealOpenMM xb0 = apos1[0]-apos0[0];
+        RealOpenMM yb0 = apos1[1]-apos0[1];
+        RealOpenMM zb0 = apos1[2]-apos0[2];
+        RealOpenMM xc0 = apos2[0]-apos0[0];
+        RealOpenMM yc0 = apos2[1]-apos0[1];
+        RealOpenMM zc0 = apos2[2]-apos0[2];
+
+        RealOpenMM invTotalMass = 1/(m0+m1+m2);
+        RealOpenMM xcom = (xp0[0]*m0 + (xb0+xp1[0])*m1 + (xc0+xp2[0])*m2) * invTotalMass;
+        RealOpenMM ycom = (xp0[1]*m0 + (yb0+xp1[1])*m1 + (yc0+xp2[1])*m2) * invTotalMass;
+        RealOpenMM zcom = (xp0[2]*m0 + (zb0+xp1[2])*m1 + (zc0+xp2[2])*m2) * invTotalMass;
+
+        RealOpenMM xa1 = xp0[0] - xcom;
+        RealOpenMM ya1 = xp0[1] - ycom;
+        RealOpenMM za1 = xp0[2] - zcom;
+        RealOpenMM xb1 = xb0 + xp1[0] - xcom;
+        RealOpenMM yb1 = yb0 + xp1[1] - ycom;
+        RealOpenMM zb1 = zb0 + xp1[2] - zcom;
+        RealOpenMM xc1 = xc0 + xp2[0] - xcom;
+        RealOpenMM yc1 = yc0 + xp2[1] - ycom;
+        RealOpenMM zc1 = zc0 + xp2[2] - zcom;
+
+        RealOpenMM xaksZd = yb0*zc0 - zb0*yc0;
+        RealOpenMM yaksZd = zb0*xc0 - xb0*zc0;
+        RealOpenMM zaksZd = xb0*yc0 - yb0*xc0;
+        RealOpenMM xaksXd = ya1*zaksZd - za1*yaksZd;
+        RealOpenMM yaksXd = za1*xaksZd - xa1*zaksZd;
+        RealOpenMM zaksXd = xa1*yaksZd - ya1*xaksZd;
+        RealOpenMM xaksYd = yaksZd*zaksXd - zaksZd*yaksXd;
+        RealOpenMM yaksYd = zaksZd*xaksXd - xaksZd*zaksXd;
+        RealOpenMM zaksYd = xaksZd*yaksXd - yaksZd*xaksXd;
+
+        RealOpenMM axlng = SQRT(xaksXd*xaksXd + yaksXd*yaksXd + zaksXd*zaksXd);
+        RealOpenMM aylng = SQRT(xaksYd*xaksYd + yaksYd*yaksYd + zaksYd*zaksYd);
+        RealOpenMM azlng = SQRT(xaksZd*xaksZd + yaksZd*yaksZd + zaksZd*zaksZd);
+        RealOpenMM trns11 = xaksXd / axlng;
+        RealOpenMM trns21 = yaksXd / axlng;
+        RealOpenMM trns31 = zaksXd / axlng;
+        RealOpenMM trns12 = xaksYd / aylng;
+        RealOpenMM trns22 = yaksYd / aylng;
+        RealOpenMM trns32 = zaksYd / aylng;
+        RealOpenMM trns13 = xaksZd / azlng;
+        RealOpenMM trns23 = yaksZd / azlng;
+        RealOpenMM trns33 = zaksZd / azlng;
+
+        RealOpenMM xb0d = trns11*xb0 + trns21*yb0 + trns31*zb0;
+        RealOpenMM yb0d = trns12*xb0 + trns22*yb0 + trns32*zb0;
+        RealOpenMM xc0d = trns11*xc0 + trns21*yc0 + trns31*zc0;
+        RealOpenMM yc0d = trns12*xc0 + trns22*yc0 + trns32*zc0;
+        RealOpenMM za1d = trns13*xa1 + trns23*ya1 + trns33*za1;
+        RealOpenMM xb1d = trns11*xb1 + trns21*yb1 + trns31*zb1;
+        RealOpenMM yb1d = trns12*xb1 + trns22*yb1 + trns32*zb1;
+        RealOpenMM zb1d = trns13*xb1 + trns23*yb1 + trns33*zb1;
+        RealOpenMM xc1d = trns11*xc1 + trns21*yc1 + trns31*zc1;
+        RealOpenMM yc1d = trns12*xc1 + trns22*yc1 + trns32*zc1;
+        RealOpenMM zc1d = trns13*xc1 + trns23*yc1 + trns33*zc1;
+
+        // Step 2: place the canonical molecule in that frame, tilted to match the out of plane
+        // displacements of the new positions.
+
+        RealOpenMM rc = 0.5*distance2[index];
+        RealOpenMM rb = SQRT(distance1[index]*distance1[index]-rc*rc);
+        RealOpenMM ra = rb*(m1+m2)*invTotalMass;
+        rb -= ra;
+        RealOpenMM sinphi = za1d/ra;
+        RealOpenMM cosphi = SQRT(max((RealOpenMM) 0, 1-sinphi*sinphi));
+        RealOpenMM sinpsi = (zb1d-zc1d) / (2*rc*cosphi);
+        RealOpenMM cospsi = SQRT(max((RealOpenMM) 0, 1-sinpsi*sinpsi));
+
+        RealOpenMM ya2d =   ra*cosphi;
+        RealOpenMM xb2d = - rc*cospsi;
+        RealOpenMM yb2d = - rb*cosphi - rc*sinpsi*sinphi;
+        RealOpenMM yc2d = - rb*cosphi + rc*sinpsi*sinphi;
+        RealOpenMM xb2d2 = xb2d*xb2d;
+        RealOpenMM hh2 = 4*xb2d2 + (yb2d-yc2d)*(yb2d-yc2d) + (zb1d-zc1d)*(zb1d-zc1d);
+        RealOpenMM deltx = 2*xb2d + SQRT(4*xb2d2 - hh2 + distance2[index]*distance2[index]);
+        xb2d -= deltx*0.5;
+
+        // Step 3: find the rotation about the z axis that conserves angular momentum.
+
+        RealOpenMM alpha = (xb2d*(xb0d-xc0d) + yb0d*yb2d + yc0d*yc2d);
+        RealOpenMM beta = (xb2d*(yc0d-yb0d) + xb0d*yb2d + xc0d*yc2d);
+        RealOpenMM gamma = xb0d*yb1d - xb1d*yb0d + xc0d*yc1d - xc1d*yc0d;
+
+        RealOpenMM al2be2 = alpha*alpha + beta*beta;
+        RealOpenMM sintheta = (alpha*gamma - beta*SQRT(max((RealOpenMM) 0, al2be2 - gamma*gamma))) / al2be2;
+
+        // Step 4: rotate the canonical molecule.
+
+        RealOpenMM costheta = SQRT(max((RealOpenMM) 0, 1-sintheta*sintheta));
+        RealOpenMM xa3d = - ya2d*sintheta;
+        RealOpenMM ya3d =   ya2d*costheta;
+        RealOpenMM za3d = za1d;
+        RealOpenMM xb3d =   xb2d*costheta - yb2d*sintheta;
+        RealOpenMM yb3d =   xb2d*sintheta + yb2d*costheta;
+        RealOpenMM zb3d = zb1d;
+        RealOpenMM xc3d = - xb2d*costheta - yc2d*sintheta;
+        RealOpenMM yc3d = - xb2d*sintheta + yc2d*costheta;
+        RealOpenMM zc3d = zc1d;
+
+        // Step 5: transform back to the original coordinate frame.
+
+        RealOpenMM xa3 = trns11*xa3d + trns12*ya3d + trns13*za3d;
+        RealOpenMM ya3 = trns21*xa3d + trns22*ya3d + trns23*za3d;
+        RealOpenMM za3 = trns31*xa3d + trns32*ya3d + trns33*za3d;
+        RealOpenMM xb3 = trns11*xb3d + trns12*yb3d + trns13*zb3d;
+        RealOpenMM yb3 = trns21*xb3d + trns22*yb3d + trns23*zb3d;
+        RealOpenMM zb3 = trns31*xb3d + trns32*yb3d + trns33*zb3d;
+        RealOpenMM xc3 = trns11*xc3d + trns12*yc3d + trns13*zc3d;
+        RealOpenMM yc3 = trns21*xc3d + trns22*yc3d + trns23*zc3d;
+        RealOpenMM zc3 = trns31*xc3d + trns32*yc3d + trns33*zc3d;
+
+        atomCoordinatesP[atom1[index]] = apos0+RealVec(xcom+xa3, ycom+ya3, zcom+za3);
+        atomCoordinatesP[atom2[index]] = apos0+RealVec(xcom+xb3, ycom+yb3, zcom+zb3);
+        atomCoordinatesP[atom3[index]] = apos0+RealVec(xcom+xc3, ycom+yc3, zcom+zc3);
+    }
+    return SimTKOpenMMCommon::DefaultReturn;
+}
+
+int ReferenceSETTLEAlgorithm::applyToVelocities(int numberOfAtoms, vector<RealVec>& atomCoordinates, vector<RealVec>& velocities, vector<RealOpenMM>& inverseMasses) {
+    for (int index = 0; index < (int) atom1.size(); ++index) {
+        int a = atom1[index];
+        int b = atom2[index];
+        int c = atom3[index];
+
+        // Find the unit vector along each bond, and the relative velocity along it.
+
+        RealVec eAB = atomCoordinates[b]-atomCoordinates[a];
+        RealVec eBC = atomCoordinates[c]-atomCoordinates[b];
+        RealVec eCA = atomCoordinates[a]-atomCoordinates[c];
+        eAB *= 1/SQRT(eAB.dot(eAB));
+        eBC *= 1/SQRT(eBC.dot(eBC));
+        eCA *= 1/SQRT(eCA.dot(eCA));
+        RealOpenMM vAB = (velocities[b]-velocities[a]).dot(eAB);
+        RealOpenMM vBC = (velocities[c]-velocities[b]).dot(eBC);
+        RealOpenMM vCA = (velocities[a]-velocities[c]).dot(eCA);
+
+        // Impulses tAB, tBC, and tCA along the three bonds must remove the relative velocities.
+        // That gives a symmetric 3x3 linear system, which we solve directly.  Unlike the
+        // formulation in the SETTLE paper, this does not assume the outer atoms have equal mass.
+
+        RealOpenMM invA = inverseMasses[a];
+        RealOpenMM invB = inverseMasses[b];
+        RealOpenMM invC = inverseMasses[c];
+        RealOpenMM m11 = invA+invB;
+        RealOpenMM m22 = invB+invC;
+        RealOpenMM m33 = invC+invA;
+        RealOpenMM m12 = -eAB.dot(eBC)*invB;
+        RealOpenMM m13 = -eAB.dot(eCA)*invA;
+        RealOpenMM m23 = -eBC.dot(eCA)*invC;
+        RealOpenMM c11 = m22*m33-m23*m23;
+        RealOpenMM c12 = m13*m23-m12*m33;
+        RealOpenMM c13 = m12*m23-m13*m22;
+        RealOpenMM c22 = m11*m33-m13*m13;
+        RealOpenMM c23 = m12*m13-m11*m23;
+        RealOpenMM c33 = m11*m22-m12*m12;
+        RealOpenMM invDet = 1/(m11*c11+m12*c12+m13*c13);
+        RealOpenMM tAB = (c11*vAB + c12*vBC + c13*vCA)*invDet;
+        RealOpenMM tBC = (c12*vAB + c22*vBC + c23*vCA)*invDet;
+        RealOpenMM tCA = (c13*vAB + c23*vBC + c33*vCA)*invDet;
+        velocities[a] += (eAB*tAB - eCA*tCA)*invA;
+        velocities[b] += (eBC*tBC - eAB*tAB)*invB;
+        velocities[c] += (eCA*tCA - eBC*tBC)*invC;
+    }
+    return SimTKOpenMMCommon::DefaultReturn;
+}
@@ -43,7 +43,7 @@ using namespace std;
     
     --------------------------------------------------------------------------------------- */
 
-CpuObc::CpuObc( ObcParameters* obcParameters ) : _obcParameters(obcParameters), _includeAceApproximation(1) {
+CpuObc::CpuObc( ObcParameters* obcParameters ) : _obcParameters(obcParameters), _includeAceApproximation(1), _includeForces(true) {
     _obcChain.resize(_obcParameters->getNumberOfAtoms());
 }
 
@@ -104,6 +104,18 @@ void CpuObc::setIncludeAceApproximation( int includeAceApproximation ){
     _includeAceApproximation = includeAceApproximation;
 }
 
+/**---------------------------------------------------------------------------------------
+
+   Set whether forces are to be computed
+
+   @param includeForces true if forces are to be computed
+
+   --------------------------------------------------------------------------------------- */
+
+void CpuObc::setIncludeForces( bool includeForces ){
+    _includeForces = includeForces;
+}
+
 /**---------------------------------------------------------------------------------------
 
     Return OBC chain derivative: size = _obcParameters->getNumberOfAtoms()
@@ -384,17 +396,19 @@ RealOpenMM CpuObc::computeBornEnergyForces( const vector<RealVec>& atomCoordinat
               
               bornForces[atomJ]        += dGpol_dalpha2_ij*bornRadii[atomI];
 
-              deltaX                   *= dGpol_dr;
-              deltaY                   *= dGpol_dr;
-              deltaZ                   *= dGpol_dr;
+              if( _includeForces ){
+                  deltaX                   *= dGpol_dr;
+                  deltaY                   *= dGpol_dr;
+                  deltaZ                   *= dGpol_dr;
 
-              inputForces[atomI][0]    += deltaX;
-              inputForces[atomI][1]    += deltaY;
-              inputForces[atomI][2]    += deltaZ;
+                  inputForces[atomI][0]    += deltaX;
+                  inputForces[atomI][1]    += deltaY;
+                  inputForces[atomI][2]    += deltaZ;
 
-              inputForces[atomJ][0]    -= deltaX;
-              inputForces[atomJ][1]    -= deltaY;
-              inputForces[atomJ][2]    -= deltaZ;
+                  inputForces[atomJ][0]    -= deltaX;
+                  inputForces[atomJ][1]    -= deltaY;
+                  inputForces[atomJ][2]    -= deltaZ;
+              }
 
           } else {
              energy *= half;
@@ -406,6 +420,12 @@ RealOpenMM CpuObc::computeBornEnergyForces( const vector<RealVec>& atomCoordinat
        }
     }
 
+    // the second loop only applies the chain rule through the Born radii
+
+    if( !_includeForces ){
+       return obcEnergy;
+    }
+
     // ---------------------------------------------------------------------------------------
 
     // second main loop
@@ -0,0 +1,159 @@
+/* -------------------------------------------------------------------------- *
+ *                                   OpenMM                                   *
+ * -------------------------------------------------------------------------- *
+ * This is part of the OpenMM molecular simulation toolkit originating from   *
+ * Simbios, the NIH National Center for Physics-Based Simulation of           *
+ * Biological Structures at Stanford, funded under the NIH Roadmap for        *
+ * Medical Research, grant U54 GM072970. See https://simtk.org.               *
+ *                                                                            *
+ * Portions copyright (c) 2013 Stanford University and the Authors.           *
+ * Authors: Peter Eastman                                                     *
+ * Contributors:                                                              *
+ *                                                                            *
+ * Permission is hereby granted, free of charge, to any person obtaining a    *
+ * copy of this software and associated documentation files (the "Software"), *
+ * to deal in the Software without restriction, including without limitation  *
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,   *
+ * and/or sell copies of the Software, and to permit persons to whom the      *
+ * Software is furnished to do so, subject to the following conditions:       *
+ *                                                                            *
+ * The above copyright notice and this permission notice shall be included in *
+ * all copies or substantial portions of the Software.                        *
+ *                                                                            *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR *
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,   *
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL    *
+ * THE AUTHORS, CONTRIBUTORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,    *
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR      *
+ * OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE  *
+ * USE OR OTHER DEALINGS IN THE SOFTWARE.                                     *
+ * -------------------------------------------------------------------------- */
+
+
+/**
+ * This tests the Reference implementation of CCMA.
+ */
+
+#include "openmm/internal/AssertionUtilities.h"
+#include "openmm/internal/ThreadPool.h"
+#include "ReferenceCCMAAlgorithm.h"
+#include "SimTKOpenMMRealType.h"
+#include "sfmt/SFMT.h"
+#include <iostream>
+#include <vector>
+
+using namespace OpenMM;
+using namespace std;
+
+const int numChains = 15;
+const int chainLength = 8;
+const double bondLength = 0.15;
+
+/**
+ * Create a set of bent chains, each of which is a separate cluster of coupled constraints.
+ */
+void createChains(vector<RealVec>& positions, vector<RealOpenMM>& masses, vector<pair<int, int> >& indices,
+        vector<RealOpenMM>& distances, vector<ReferenceCCMAAlgorithm::AngleInfo>& angles) {
+    for (int i = 0; i < numChains; i++) {
+        for (int j = 0; j < chainLength; j++) {
+            int atom = positions.size();
+            positions.push_back(RealVec(i, 0.5*bondLength*(j%2), 0.9*bondLength*j));
+            masses.push_back(j%3 == 0 ? 1.0 : 12.0);
+            if (j > 0) {
+                indices.push_back(make_pair(atom-1, atom));
+                distances.push_back(bondLength);
+            }
+            if (j > 1)
+                angles.push_back(ReferenceCCMAAlgorithm::AngleInfo(atom-2, atom-1, atom, (RealOpenMM) (0.6*M_PI)));
+        }
+    }
+}
+
+void testConstraints() {
+    vector<RealVec> positions;
+    vector<RealOpenMM> masses, inverseMasses;
+    vector<pair<int, int> > indices;
+    vector<RealOpenMM> distances;
+    vector<ReferenceCCMAAlgorithm::AngleInfo> angles;
+    createChains(positions, masses, indices, distances, angles);
+    int numParticles = positions.size();
+    for (int i = 0; i < numParticles; i++)
+        inverseMasses.push_back(1/masses[i]);
+    ReferenceCCMAAlgorithm serial(numParticles, indices.size(), indices, distances, masses, angles, 1e-8);
+    ReferenceCCMAAlgorithm parallel(numParticles, indices.size(), indices, distances, masses, angles, 1e-8);
+    ASSERT_EQUAL(numChains, serial.getNumberOfClusters());
+    ThreadPool threads(4);
+    parallel.setThreadPool(&threads);
+
+    // Perturb the positions and constrain them.
+
+    OpenMM_SFMT::SFMT sfmt;
+    init_gen_rand(0, sfmt);
+    vector<RealVec> newPositions(numParticles), velocities(numParticles);
+    for (int i = 0; i < numParticles; i++)
+        for (int j = 0; j < 3; j++) {
+            newPositions[i][j] = positions[i][j]+0.02*(genrand_real2(sfmt)-0.5);
+            velocities[i][j] = genrand_real2(sfmt)-0.5;
+        }
+    vector<RealVec> serialPositions = newPositions;
+    vector<RealVec> parallelPositions = newPositions;
+    ASSERT_EQUAL(SimTKOpenMMCommon::DefaultReturn, serial.apply(numParticles, positions, serialPositions, inverseMasses));
+    ASSERT_EQUAL(SimTKOpenMMCommon::DefaultReturn, parallel.apply(numParticles, positions, parallelPositions, inverseMasses));
+    for (int i = 0; i < (int) indices.size(); i++) {
+        RealVec delta = serialPositions[indices[i].first]-serialPositions[indices[i].second];
+        ASSERT_EQUAL_TOL(bondLength, SQRT(delta.dot(delta)), 1e-7);
+    }
+    for (int i = 0; i < numParticles; i++)
+        ASSERT_EQUAL_VEC(serialPositions[i], parallelPositions[i], 1e-12);
+
+    // Now constrain the velocities.
+
+    vector<RealVec> serialVelocities = velocities;
+    vector<RealVec> parallelVelocities = velocities;
+    ASSERT_EQUAL(SimTKOpenMMCommon::DefaultReturn, serial.applyToVelocities(numParticles, serialPositions, serialVelocities, inverseMasses));
+    ASSERT_EQUAL(SimTKOpenMMCommon::DefaultReturn, parallel.applyToVelocities(numParticles, parallelPositions, parallelVelocities, inverseMasses));
+    for (int i = 0; i < (int) indices.size(); i++) {
+        RealVec delta = serialPositions[indices[i].first]-serialPositions[indices[i].second];
+        RealVec dv = serialVelocities[indices[i].first]-serialVelocities[indices[i].second];
+        ASSERT(fabs(dv.dot(delta)) < 1e-6);
+    }
+    for (int i = 0; i < numParticles; i++)
+        ASSERT_EQUAL_VEC(serialVelocities[i], parallelVelocities[i], 1e-12);
+
+    // Check the convergence history.
+
+    const vector<long long>& history = serial.getIterationHistory();
+    long long calls = 0;
+    for (int i = 0; i < (int) history.size(); i++)
+        calls += history[i];
+    ASSERT_EQUAL(2, calls);
+    ASSERT(serial.getLastIterationCount() > 0);
+    ASSERT_EQUAL(1, history[serial.getLastIterationCount()]);
+    ASSERT_EQUAL(serial.getLastIterationCount(), parallel.getLastIterationCount());
+    ASSERT_EQUAL(SimTKOpenMMCommon::DefaultReturn, serial.apply(numParticles, serialPositions, serialPositions, inverseMasses));
+    ASSERT_EQUAL(0, serial.getLastIterationCount());
+    ASSERT_EQUAL(1, serial.getIterationHistory()[0]);
+    serial.resetIterationHistory();
+    for (int i = 0; i < (int) history.size(); i++)
+        ASSERT_EQUAL(0, history[i]);
+
+    // A call that fails to converge is recorded under the maximum number of iterations.
+
+    serial.setMaximumNumberOfIterations(1);
+    serialPositions = newPositions;
+    ASSERT_EQUAL(SimTKOpenMMCommon::ErrorReturn, serial.apply(numParticles, positions, serialPositions, inverseMasses));
+    ASSERT_EQUAL(1, serial.getLastIterationCount());
+    ASSERT_EQUAL(1, serial.getIterationHistory()[1]);
+}
+
+int main() {
+    try {
+        testConstraints();
+    }
+    catch(const exception& e) {
+        cout << "exception: " << e.what() << endl;
+        return 1;
+    }
+    cout << "Done" << endl;
+    return 0;
+}
@@ -39,6 +39,7 @@
 #include "openmm/AndersenThermostat.h"
 #include "openmm/HarmonicBondForce.h"
 #include "openmm/NonbondedForce.h"
+#include "openmm/OpenMMException.h"
 #include "openmm/System.h"
 #include "openmm/CustomIntegrator.h"
 #include "SimTKOpenMMRealType.h"
@@ -588,6 +589,15 @@ void testForceGroups() {
     ASSERT_EQUAL_TOL(s.getPotentialEnergy(), integrator.getGlobalVariable(0), 1e-5);
     ASSERT_EQUAL_TOL(s1.getPotentialEnergy(), integrator.getGlobalVariable(1), 1e-5);
     ASSERT_EQUAL_TOL(s2.getPotentialEnergy(), integrator.getGlobalVariable(2), 1e-5);
+
+    // Querying only the energy does not compute forces, so the integrator must not reuse the
+    // forces left over from the last query as if they belonged to the groups just evaluated.
+
+    ASSERT_EQUAL_TOL(s.getPotentialEnergy(), context.getState(State::Energy).getPotentialEnergy(), 1e-10);
+    integrator.step(1);
+    integrator.getPerDofVariable(0, f);
+    ASSERT_EQUAL_VEC(f1[0]+f2[0], f[0], 1e-5);
+    ASSERT_EQUAL_VEC(f1[1]+f2[1], f[1], 1e-5);
 }
 
 /**
@@ -646,6 +656,49 @@ void testRespa() {
     }
 }
 
+/**
+ * Test that the integrator does not reuse forces when an energy evaluation throws an exception.
+ */
+void testExceptionDuringEnergy() {
+    ReferencePlatform platform;
+    System system;
+    system.setDefaultPeriodicBoxVectors(Vec3(3, 0, 0), Vec3(0, 3, 0), Vec3(0, 0, 3));
+    NonbondedForce* nonbonded = new NonbondedForce();
+    nonbonded->setNonbondedMethod(NonbondedForce::CutoffPeriodic);
+    nonbonded->setCutoffDistance(1.0);
+    system.addForce(nonbonded);
+    vector<Vec3> positions;
+    for (int i = 0; i < 3; i++) {
+        system.addParticle(1.0);
+        nonbonded->addParticle(i == 1 ? -1.0 : 1.0, 0.2, 1.0);
+        positions.push_back(Vec3(0.5*i, 0.1*i*i, 0));
+    }
+    CustomIntegrator integrator(0.001);
+    integrator.addComputePerDof("v", "f");
+    Context context(system, integrator, platform);
+    context.setPositions(positions);
+    integrator.step(1);
+    State state = context.getState(State::Forces);
+
+    // Shrinking the box makes the energy evaluation throw.  Restoring it leaves the positions unchanged, so the
+    // next step should see the same forces as before.
+
+    context.setPeriodicBoxVectors(Vec3(1.5, 0, 0), Vec3(0, 1.5, 0), Vec3(0, 0, 1.5));
+    bool threw = false;
+    try {
+        context.getState(State::Energy);
+    }
+    catch (const OpenMMException& ex) {
+        threw = true;
+    }
+    ASSERT(threw);
+    context.setPeriodicBoxVectors(Vec3(3, 0, 0), Vec3(0, 3, 0), Vec3(0, 0, 3));
+    integrator.step(1);
+    State state2 = context.getState(State::Velocities);
+    for (int i = 0; i < 3; i++)
+        ASSERT_EQUAL_VEC(state.getForces()[i], state2.getVelocities()[i], TOL);
+}
+
 int main() {
     try {
         testSingleBond();
@@ -659,6 +712,7 @@ int main() {
         testPerDofVariables();
         testForceGroups();
         testRespa();
+        testExceptionDuringEnergy();
     }
     catch(const exception& e) {
         cout << "exception: " << e.what() << endl;
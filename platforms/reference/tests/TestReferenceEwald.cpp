@@ -35,13 +35,19 @@
 
 #include "openmm/internal/AssertionUtilities.h"
 #include "openmm/Context.h"
+#include "openmm/OpenMMException.h"
+#include "openmm/kernels.h"
 #include "ReferencePlatform.h"
 #include "openmm/NonbondedForce.h"
 #include "openmm/System.h"
 #include "openmm/VerletIntegrator.h"
+#include "openmm/BrownianIntegrator.h"
 #include "SimTKOpenMMRealType.h"
 #include "sfmt/SFMT.h"
 #include "openmm/HarmonicBondForce.h"
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
 #include <iostream>
 #include <vector>
 
@@ -354,6 +360,337 @@ void testErrorTolerance(NonbondedForce::NonbondedMethod method) {
     }
 }
 
+void testPMEParameters() {
+    // Create a cloud of random point charges.
+
+    const int numParticles = 51;
+    const double boxWidth = 4.0;
+    const double cutoff = 1.0;
+    System system;
+    system.setDefaultPeriodicBoxVectors(Vec3(boxWidth, 0, 0), Vec3(0, boxWidth, 0), Vec3(0, 0, boxWidth));
+    NonbondedForce* force = new NonbondedForce();
+    system.addForce(force);
+    vector<Vec3> positions(numParticles);
+    OpenMM_SFMT::SFMT sfmt;
+    init_gen_rand(0, sfmt);
+    for (int i = 0; i < numParticles; i++) {
+        system.addParticle(1.0);
+        force->addParticle(-1.0+i*2.0/(numParticles-1), 1.0, 0.0);
+        positions[i] = Vec3(boxWidth*genrand_real2(sfmt), boxWidth*genrand_real2(sfmt), boxWidth*genrand_real2(sfmt));
+    }
+    force->setNonbondedMethod(NonbondedForce::PME);
+    force->setCutoffDistance(cutoff);
+    ReferencePlatform platform;
+    VerletIntegrator integrator1(0.01);
+    Context context1(system, integrator1, platform);
+    context1.setPositions(positions);
+    State state1 = context1.getState(State::Energy);
+
+    // Explicitly specifying the parameters that would be selected automatically should give identical results.
+
+    double tol = force->getEwaldErrorTolerance();
+    double alpha = (1.0/cutoff)*sqrt(-log(2.0*tol));
+    int gridSize = (int) ceil(2*alpha*boxWidth/(3*pow(tol, 0.2)));
+    force->setPMEParameters(alpha, gridSize, gridSize, gridSize);
+    VerletIntegrator integrator2(0.01);
+    Context context2(system, integrator2, platform);
+    context2.setPositions(positions);
+    State state2 = context2.getState(State::Energy);
+    ASSERT_EQUAL_TOL(state1.getPotentialEnergy(), state2.getPotentialEnergy(), 1e-10);
+
+    // Tuning the parameters should give a similar energy, and record the selection in the cache file.
+
+    const string cacheFile = "TestReferenceEwaldTuning.txt";
+    remove(cacheFile.c_str());
+    force->setPMEParameters(0.0, 0, 0, 0);
+    force->setUsePMETuning(true);
+    force->setPMETuningCacheFile(cacheFile);
+    VerletIntegrator integrator3(0.01);
+    Context context3(system, integrator3, platform);
+    context3.setPositions(positions);
+    State state3 = context3.getState(State::Energy);
+    ASSERT_EQUAL_TOL(state1.getPotentialEnergy(), state3.getPotentialEnergy(), 1e-3);
+    ifstream cache(cacheFile.c_str());
+    ASSERT(cache.good());
+    cache.close();
+
+    // Replace the cache contents with different parameters and make sure they get used.
+
+    vector<string> key(7);
+    {
+        ifstream in(cacheFile.c_str());
+        for (int i = 0; i < (int) key.size(); i++)
+            in >> key[i];
+    }
+    ASSERT_EQUAL(platform.getName(), key[0]);
+    ASSERT_EQUAL(numParticles, atoi(key[1].c_str()));
+    ASSERT_EQUAL_TOL(boxWidth, atof(key[2].c_str()), 1e-10);
+    {
+        ofstream out(cacheFile.c_str());
+        for (int i = 0; i < (int) key.size(); i++)
+            out << key[i] << " ";
+        out << "3.0 40 40 40" << endl;
+    }
+    VerletIntegrator integrator4(0.01);
+    Context context4(system, integrator4, platform);
+    context4.setPositions(positions);
+    State state4 = context4.getState(State::Energy);
+    force->setUsePMETuning(false);
+    force->setPMEParameters(3.0, 40, 40, 40);
+    VerletIntegrator integrator5(0.01);
+    Context context5(system, integrator5, platform);
+    context5.setPositions(positions);
+    State state5 = context5.getState(State::Energy);
+    ASSERT_EQUAL_TOL(state5.getPotentialEnergy(), state4.getPotentialEnergy(), 1e-10);
+    remove(cacheFile.c_str());
+    remove((cacheFile+".lock").c_str());
+}
+
+void testLJPME() {
+    // Create a randomly perturbed lattice of uncharged Lennard-Jones particles with the same sigma, so
+    // geometric and arithmetic combining rules agree.
+
+    const int gridSize = 3;
+    const int numParticles = gridSize*gridSize*gridSize;
+    const double boxWidth = 2.5;
+    const double spacing = boxWidth/gridSize;
+    const double cutoff = 1.0;
+    const double sigma = 0.3;
+    System system;
+    system.setDefaultPeriodicBoxVectors(Vec3(boxWidth, 0, 0), Vec3(0, boxWidth, 0), Vec3(0, 0, boxWidth));
+    NonbondedForce* force = new NonbondedForce();
+    system.addForce(force);
+    vector<Vec3> positions(numParticles);
+    vector<double> epsilon(numParticles);
+    OpenMM_SFMT::SFMT sfmt;
+    init_gen_rand(0, sfmt);
+    for (int i = 0; i < numParticles; i++) {
+        system.addParticle(1.0);
+        epsilon[i] = 0.5+genrand_real2(sfmt);
+        force->addParticle(0.0, sigma, epsilon[i]);
+        int x = i/(gridSize*gridSize), y = (i/gridSize)%gridSize, z = i%gridSize;
+        positions[i] = Vec3(spacing*(x+0.5*genrand_real2(sfmt)), spacing*(y+0.5*genrand_real2(sfmt)), spacing*(z+0.5*genrand_real2(sfmt)));
+    }
+    force->setNonbondedMethod(NonbondedForce::LJPME);
+    force->setCutoffDistance(cutoff);
+    force->setEwaldErrorTolerance(1e-5);
+    ReferencePlatform platform;
+    VerletIntegrator integrator(0.01);
+    Context context(system, integrator, platform);
+    context.setPositions(positions);
+    State state = context.getState(State::Energy);
+
+    // Compare the energy to a direct sum over periodic copies.  Beyond the cutoff, only the dispersion
+    // term is included.
+
+    const int numCopies = 10;
+    double expectedEnergy = 0.0;
+    for (int i = 0; i < numParticles; i++)
+        for (int j = i; j < numParticles; j++) {
+            double c6 = 4*sqrt(epsilon[i]*epsilon[j])*pow(sigma, 6.0);
+            double scale = (i == j ? 0.5 : 1.0);
+            for (int x = -numCopies; x <= numCopies; x++)
+                for (int y = -numCopies; y <= numCopies; y++)
+                    for (int z = -numCopies; z <= numCopies; z++) {
+                        if (i == j && x == 0 && y == 0 && z == 0)
+                            continue;
+                        Vec3 delta = positions[j]-positions[i]+Vec3(x*boxWidth, y*boxWidth, z*boxWidth);
+                        double r2 = delta.dot(delta);
+                        double r6 = r2*r2*r2;
+                        if (r2 < cutoff*cutoff)
+                            expectedEnergy += scale*(c6*pow(sigma, 6.0)/(r6*r6)-c6/r6);
+                        else
+                            expectedEnergy -= scale*c6/r6;
+                    }
+        }
+    ASSERT_EQUAL_TOL(expectedEnergy, state.getPotentialEnergy(), 1e-4);
+
+    // Add charges and exclusions, and check that the forces are consistent with the energy.
+
+    for (int i = 0; i < numParticles; i++)
+        force->setParticleParameters(i, (i%2 == 0 ? 0.5 : -0.5), sigma, epsilon[i]);
+    for (int i = 1; i < numParticles; i += 4)
+        force->addException(i-1, i, 0.0, sigma, 0.0);
+    int exception = force->addException(2, 3, 0.1, sigma, 0.5);
+    VerletIntegrator integrator2(0.01);
+    Context context2(system, integrator2, platform);
+    context2.setPositions(positions);
+    State state2 = context2.getState(State::Forces | State::Energy);
+    const vector<Vec3>& forces = state2.getForces();
+    double norm = 0.0;
+    for (int i = 0; i < numParticles; i++)
+        norm += forces[i].dot(forces[i]);
+    norm = std::sqrt(norm);
+    const double delta = 1e-3;
+    double step = delta/norm;
+    vector<Vec3> positions2(numParticles), positions3(numParticles);
+    for (int i = 0; i < numParticles; i++) {
+        Vec3 p = positions[i];
+        Vec3 f = forces[i];
+        positions2[i] = Vec3(p[0]-f[0]*step, p[1]-f[1]*step, p[2]-f[2]*step);
+        positions3[i] = Vec3(p[0]+f[0]*step, p[1]+f[1]*step, p[2]+f[2]*step);
+    }
+    context2.setPositions(positions2);
+    State state3 = context2.getState(State::Energy);
+    context2.setPositions(positions3);
+    State state4 = context2.getState(State::Energy);
+    ASSERT_EQUAL_TOL(norm, (state3.getPotentialEnergy()-state4.getPotentialEnergy())/(2*delta), 1e-3);
+
+    // With all epsilons set to zero, LJPME should give the same result as PME.
+
+    for (int i = 0; i < numParticles; i++)
+        force->setParticleParameters(i, (i%2 == 0 ? 0.5 : -0.5), sigma, 0.0);
+    force->setExceptionParameters(exception, 2, 3, 0.1, sigma, 0.0);
+    VerletIntegrator integrator3(0.01);
+    Context context3(system, integrator3, platform);
+    context3.setPositions(positions);
+    State state5 = context3.getState(State::Forces | State::Energy);
+    force->setNonbondedMethod(NonbondedForce::PME);
+    VerletIntegrator integrator4(0.01);
+    Context context4(system, integrator4, platform);
+    context4.setPositions(positions);
+    State state6 = context4.getState(State::Forces | State::Energy);
+    ASSERT_EQUAL_TOL(state6.getPotentialEnergy(), state5.getPotentialEnergy(), 1e-10);
+    for (int i = 0; i < numParticles; i++)
+        ASSERT_EQUAL_VEC(state6.getForces()[i], state5.getForces()[i], 1e-10);
+}
+
+void testEnergyWithoutForces(NonbondedForce::NonbondedMethod method) {
+    // Computing only the energy should give the same result as computing forces and energy together,
+    // and should leave the forces untouched.  BrownianIntegrator does not need forces to compute the
+    // kinetic energy, so getState() really does compute only the energy.
+
+    const int gridSize = 3;
+    const int numParticles = gridSize*gridSize*gridSize;
+    const double boxWidth = 2.5;
+    const double spacing = boxWidth/gridSize;
+    System system;
+    system.setDefaultPeriodicBoxVectors(Vec3(boxWidth, 0, 0), Vec3(0, boxWidth, 0), Vec3(0, 0, boxWidth));
+    NonbondedForce* force = new NonbondedForce();
+    system.addForce(force);
+    HarmonicBondForce* bonds = new HarmonicBondForce();
+    system.addForce(bonds);
+    vector<Vec3> positions(numParticles);
+    OpenMM_SFMT::SFMT sfmt;
+    init_gen_rand(0, sfmt);
+    for (int i = 0; i < numParticles; i++) {
+        system.addParticle(1.0);
+        force->addParticle((i%2 == 0 ? 0.5 : -0.5), 0.3, 0.5+genrand_real2(sfmt));
+        int x = i/(gridSize*gridSize), y = (i/gridSize)%gridSize, z = i%gridSize;
+        positions[i] = Vec3(spacing*(x+0.5*genrand_real2(sfmt)), spacing*(y+0.5*genrand_real2(sfmt)), spacing*(z+0.5*genrand_real2(sfmt)));
+    }
+    for (int i = 1; i < numParticles; i += 3) {
+        force->addException(i-1, i, 0.1, 0.3, 0.2);
+        bonds->addBond(i-1, i, 0.5, 100.0);
+    }
+    force->setNonbondedMethod(method);
+    force->setCutoffDistance(1.0);
+    ReferencePlatform platform;
+    BrownianIntegrator integrator(300.0, 1.0, 0.01);
+    Context context(system, integrator, platform);
+    context.setPositions(positions);
+    State state1 = context.getState(State::Forces | State::Energy);
+    State state2 = context.getState(State::Energy);
+    ASSERT_EQUAL_TOL(state1.getPotentialEnergy(), state2.getPotentialEnergy(), 1e-10);
+    State state3 = context.getState(State::Forces);
+    for (int i = 0; i < numParticles; i++)
+        ASSERT_EQUAL_VEC(state1.getForces()[i], state3.getForces()[i], 1e-10);
+}
+
+void testEnergyByGroup() {
+    // The per-group energies from a single evaluation should match evaluating each group separately.
+
+    const int gridSize = 3;
+    const int numParticles = gridSize*gridSize*gridSize;
+    const double boxWidth = 2.5;
+    const double spacing = boxWidth/gridSize;
+    System system;
+    system.setDefaultPeriodicBoxVectors(Vec3(boxWidth, 0, 0), Vec3(0, boxWidth, 0), Vec3(0, 0, boxWidth));
+    NonbondedForce* force = new NonbondedForce();
+    system.addForce(force);
+    HarmonicBondForce* bonds = new HarmonicBondForce();
+    system.addForce(bonds);
+    vector<Vec3> positions(numParticles);
+    OpenMM_SFMT::SFMT sfmt;
+    init_gen_rand(0, sfmt);
+    for (int i = 0; i < numParticles; i++) {
+        system.addParticle(1.0);
+        force->addParticle((i%2 == 0 ? 0.5 : -0.5), 0.3, 0.5+genrand_real2(sfmt));
+        int x = i/(gridSize*gridSize), y = (i/gridSize)%gridSize, z = i%gridSize;
+        positions[i] = Vec3(spacing*(x+0.5*genrand_real2(sfmt)), spacing*(y+0.5*genrand_real2(sfmt)), spacing*(z+0.5*genrand_real2(sfmt)));
+    }
+    for (int i = 1; i < numParticles; i += 3) {
+        force->addException(i-1, i, 0.1, 0.3, 0.2);
+        bonds->addBond(i-1, i, 0.5, 100.0);
+    }
+    force->setNonbondedMethod(NonbondedForce::PME);
+    force->setCutoffDistance(1.0);
+    force->setForceGroup(1);
+    force->setReciprocalSpaceForceGroup(2);
+    bonds->setForceGroup(3);
+    ReferencePlatform platform;
+    VerletIntegrator integrator(0.01);
+    Context context(system, integrator, platform);
+    context.setPositions(positions);
+    vector<double> energies = context.getEnergyByGroup();
+    ASSERT_EQUAL(32, energies.size());
+    double total = 0.0;
+    for (int i = 0; i < 32; i++) {
+        double expected = context.getState(State::Energy, false, 1<<i).getPotentialEnergy();
+        ASSERT_EQUAL_TOL(expected, energies[i], 1e-10);
+        total += energies[i];
+    }
+    ASSERT(energies[1] != 0.0);
+    ASSERT(energies[2] != 0.0);
+    ASSERT(energies[3] != 0.0);
+    ASSERT_EQUAL_TOL(context.getState(State::Energy).getPotentialEnergy(), total, 1e-10);
+
+    // Groups that are excluded from the mask should be reported as zero.
+
+    energies = context.getEnergyByGroup((1<<2)+(1<<3));
+    ASSERT_EQUAL(0.0, energies[1]);
+    ASSERT_EQUAL_TOL(context.getState(State::Energy, false, 1<<2).getPotentialEnergy(), energies[2], 1e-10);
+    ASSERT_EQUAL_TOL(context.getState(State::Energy, false, 1<<3).getPotentialEnergy(), energies[3], 1e-10);
+}
+
+void testRequireCpuPme() {
+    // Explicitly asking for the CPU PME kernel when it is not available should be reported, not silently ignored.
+
+    ReferencePlatform platform;
+    if (platform.supportsKernels(vector<string>(1, CalcPmeReciprocalForceKernel::Name())))
+        return;
+    System system;
+    system.addParticle(1.0);
+    system.addParticle(1.0);
+    NonbondedForce* nonbonded = new NonbondedForce();
+    nonbonded->addParticle(1.0, 1, 0);
+    nonbonded->addParticle(-1.0, 1, 0);
+    nonbonded->setNonbondedMethod(NonbondedForce::PME);
+    nonbonded->setCutoffDistance(1.0);
+    system.setDefaultPeriodicBoxVectors(Vec3(3, 0, 0), Vec3(0, 3, 0), Vec3(0, 0, 3));
+    system.addForce(nonbonded);
+    vector<Vec3> positions(2);
+    positions[0] = Vec3(0, 0, 0);
+    positions[1] = Vec3(0.5, 0, 0);
+    VerletIntegrator integrator1(0.01);
+    Context context1(system, integrator1, platform);
+    context1.setPositions(positions);
+    State state1 = context1.getState(State::Energy);
+    map<string, string> properties;
+    properties[ReferencePlatform::ReferenceUseCpuPme()] = "true";
+    VerletIntegrator integrator2(0.01);
+    Context context2(system, integrator2, platform, properties);
+    context2.setPositions(positions);
+    bool threwException = false;
+    try {
+        context2.getState(State::Energy);
+    }
+    catch (OpenMMException& ex) {
+        threwException = true;
+    }
+    ASSERT(threwException);
+}
+
 int main() {
     try {
      testEwaldExact();
@@ -362,6 +699,13 @@ int main() {
 //     testWaterSystem();
      testErrorTolerance(NonbondedForce::Ewald);
      testErrorTolerance(NonbondedForce::PME);
+     testPMEParameters();
+     testLJPME();
+     testEnergyWithoutForces(NonbondedForce::Ewald);
+     testEnergyWithoutForces(NonbondedForce::PME);
+     testEnergyWithoutForces(NonbondedForce::LJPME);
+     testEnergyByGroup();
+     testRequireCpuPme();
     }
     catch(const exception& e) {
         cout << "exception: " << e.what() << endl;
@@ -0,0 +1,227 @@
+
+/* -------------------------------------------------------------------------- *
+ *                                   OpenMM                                   *
+ * -------------------------------------------------------------------------- *
+ * This is part of the OpenMM molecular simulation toolkit originating from   *
+ * Simbios, the NIH National Center for Physics-Based Simulation of           *
+ * Biological Structures at Stanford, funded under the NIH Roadmap for        *
+ * Medical Research, grant U54 GM072970. See https://simtk.org.               *
+ *                                                                            *
+ * Portions copyright (c) 2013 Stanford University and the Authors.           *
+ * Authors: Peter Eastman                                                     *
+ * Contributors:                                                              *
+ *                                                                            *
+ * Permission is hereby granted, free of charge, to any person obtaining a    *
+ * copy of this software and associated documentation files (the "Software"), *
+ * to deal in the Software without restriction, including without limitation  *
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,   *
+ * and/or sell copies of the Software, and to permit persons to whom the      *
+ * Software is furnished to do so, subject to the following conditions:       *
+ *                                                                            *
+ * The above copyright notice and this permission notice shall be included in *
+ * all copies or substantial portions of the Software.                        *
+ *                                                                            *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR *
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,   *
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL    *
+ * THE AUTHORS, CONTRIBUTORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,    *
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR      *
+ * OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE  *
+ * USE OR OTHER DEALINGS IN THE SOFTWARE.                                     *
+ * -------------------------------------------------------------------------- */
+
+/**
+ * This tests the reference implementation of MTSIntegrator.
+ */
+
+#include "openmm/internal/AssertionUtilities.h"
+#include "openmm/Context.h"
+#include "ReferencePlatform.h"
+#include "openmm/CustomIntegrator.h"
+#include "openmm/HarmonicBondForce.h"
+#include "openmm/MTSIntegrator.h"
+#include "openmm/NonbondedForce.h"
+#include "openmm/OpenMMException.h"
+#include "openmm/System.h"
+#include "SimTKOpenMMRealType.h"
+#include "sfmt/SFMT.h"
+#include <iostream>
+#include <vector>
+
+using namespace OpenMM;
+using namespace std;
+
+/**
+ * Build a System of harmonically bonded particles with a NonbondedForce.  The bonds are in group 0,
+ * direct space nonbonded interactions in group 1, and reciprocal space in group 2.
+ */
+System* createSystem(int numParticles, bool constrain) {
+    System* system = new System();
+    const double boxSize = 2.5;
+    system->setDefaultPeriodicBoxVectors(Vec3(boxSize, 0, 0), Vec3(0, boxSize, 0), Vec3(0, 0, boxSize));
+    HarmonicBondForce* bonds = new HarmonicBondForce();
+    NonbondedForce* nonbonded = new NonbondedForce();
+    nonbonded->setNonbondedMethod(NonbondedForce::PME);
+    nonbonded->setCutoffDistance(1.0);
+    nonbonded->setForceGroup(1);
+    nonbonded->setReciprocalSpaceForceGroup(2);
+    for (int i = 0; i < numParticles; i++) {
+        system->addParticle(i%2 == 0 ? 16.0 : 2.0);
+        nonbonded->addParticle(i%2 == 0 ? -0.5 : 0.5, 0.3, 0.5);
+    }
+    for (int i = 0; i < numParticles; i += 2) {
+        if (constrain)
+            system->addConstraint(i, i+1, 0.1);
+        else
+            bonds->addBond(i, i+1, 0.1, 200000.0);
+        nonbonded->addException(i, i+1, 0.0, 1.0, 0.0);
+    }
+    system->addForce(bonds);
+    system->addForce(nonbonded);
+    return system;
+}
+
+vector<Vec3> createPositions(int numParticles) {
+    vector<Vec3> positions(numParticles);
+    OpenMM_SFMT::SFMT sfmt;
+    init_gen_rand(0, sfmt);
+    int gridSize = (int) ceil(pow(numParticles/2.0, 1.0/3.0));
+    for (int i = 0; i < numParticles; i += 2) {
+        int index = i/2;
+        positions[i] = Vec3(index%gridSize, (index/gridSize)%gridSize, index/(gridSize*gridSize))*(2.5/gridSize);
+        positions[i+1] = positions[i]+Vec3(0.1, 0, 0);
+        positions[i] += Vec3(genrand_real2(sfmt), genrand_real2(sfmt), genrand_real2(sfmt))*0.01;
+    }
+    return positions;
+}
+
+void testCompareToCustomIntegrator() {
+    // The same algorithm can be written as a CustomIntegrator.  Verify that they produce
+    // the same trajectory.
+
+    const int numParticles = 20;
+    const double dt = 0.002;
+    System* system = createSystem(numParticles, false);
+    vector<pair<int, int> > groups;
+    groups.push_back(make_pair(2, 1));
+    groups.push_back(make_pair(1, 2));
+    groups.push_back(make_pair(0, 4));
+    MTSIntegrator integrator(dt, groups);
+    CustomIntegrator custom(dt);
+    custom.addPerDofVariable("x1", 0);
+    custom.addUpdateContextState();
+    custom.addComputePerDof("v", "v+0.5*dt*f2/m");
+    for (int i = 0; i < 2; i++) {
+        custom.addComputePerDof("v", "v+0.5*(dt/2)*f1/m");
+        for (int j = 0; j < 2; j++) {
+            custom.addComputePerDof("v", "v+0.5*(dt/4)*f0/m");
+            custom.addComputePerDof("x1", "x");
+            custom.addComputePerDof("x", "x+(dt/4)*v");
+            custom.addConstrainPositions();
+            custom.addComputePerDof("v", "(x-x1)/(dt/4)");
+            custom.addComputePerDof("v", "v+0.5*(dt/4)*f0/m");
+        }
+        custom.addComputePerDof("v", "v+0.5*(dt/2)*f1/m");
+    }
+    custom.addComputePerDof("v", "v+0.5*dt*f2/m");
+    custom.addConstrainVelocities();
+    ReferencePlatform platform;
+    Context context1(*system, integrator, platform);
+    Context context2(*system, custom, platform);
+    vector<Vec3> positions = createPositions(numParticles);
+    context1.setPositions(positions);
+    context2.setPositions(positions);
+    context1.setVelocitiesToTemperature(300.0, 1);
+    context2.setVelocities(context1.getState(State::Velocities).getVelocities());
+    for (int i = 0; i < 10; i++) {
+        integrator.step(5);
+        custom.step(5);
+        State state1 = context1.getState(State::Positions | State::Velocities);
+        State state2 = context2.getState(State::Positions | State::Velocities);
+        ASSERT_EQUAL_TOL(state2.getTime(), state1.getTime(), 1e-10);
+        for (int j = 0; j < numParticles; j++) {
+            ASSERT_EQUAL_VEC(state2.getPositions()[j], state1.getPositions()[j], 1e-6);
+            ASSERT_EQUAL_VEC(state2.getVelocities()[j], state1.getVelocities()[j], 1e-6);
+        }
+    }
+    delete system;
+}
+
+void testEnergyConservation() {
+    // Evaluating reciprocal space once per outer step should still conserve energy.
+
+    const int numParticles = 40;
+    System* system = createSystem(numParticles, true);
+    vector<pair<int, int> > groups;
+    groups.push_back(make_pair(2, 1));
+    groups.push_back(make_pair(0, 2));
+    groups.push_back(make_pair(1, 2));
+    MTSIntegrator integrator(0.002, groups);
+    ReferencePlatform platform;
+    Context context(*system, integrator, platform);
+    context.setPositions(createPositions(numParticles));
+    context.setVelocitiesToTemperature(300.0, 1);
+    context.applyConstraints(1e-6);
+    State state = context.getState(State::Energy);
+    double initialEnergy = state.getKineticEnergy()+state.getPotentialEnergy();
+    for (int i = 0; i < 100; i++) {
+        integrator.step(5);
+        state = context.getState(State::Positions | State::Energy);
+        double energy = state.getKineticEnergy()+state.getPotentialEnergy();
+        ASSERT_EQUAL_TOL(initialEnergy, energy, 0.01);
+        for (int j = 0; j < system->getNumConstraints(); ++j) {
+            int particle1, particle2;
+            double distance;
+            system->getConstraintParameters(j, particle1, particle2, distance);
+            Vec3 delta = state.getPositions()[particle1]-state.getPositions()[particle2];
+            ASSERT_EQUAL_TOL(distance, sqrt(delta.dot(delta)), 2e-5);
+        }
+    }
+    delete system;
+}
+
+void testInvalidGroups() {
+    // A force group that does not appear in the list is an error.
+
+    System* system = createSystem(4, false);
+    vector<pair<int, int> > groups;
+    groups.push_back(make_pair(1, 1));
+    groups.push_back(make_pair(0, 2));
+    MTSIntegrator integrator(0.002, groups);
+    ReferencePlatform platform;
+    bool threwException = false;
+    try {
+        Context context(*system, integrator, platform);
+    }
+    catch (const OpenMMException& ex) {
+        threwException = true;
+    }
+    ASSERT(threwException);
+    delete system;
+
+    // Each group's number of substeps must be a multiple of the number for slower groups.
+
+    groups.push_back(make_pair(2, 3));
+    threwException = false;
+    try {
+        MTSIntegrator integrator2(0.002, groups);
+    }
+    catch (const OpenMMException& ex) {
+        threwException = true;
+    }
+    ASSERT(threwException);
+}
+
+int main() {
+    try {
+        testCompareToCustomIntegrator();
+        testEnergyConservation();
+        testInvalidGroups();
+    }
+    catch(const exception& e) {
+        cout << "exception: " << e.what() << endl;
+        return 1;
+    }
+    cout << "Done" << endl;
+    return 0;
+}
@@ -36,7 +36,10 @@
 #include "openmm/internal/AssertionUtilities.h"
 #include "openmm/MonteCarloBarostat.h"
 #include "openmm/Context.h"
+#include "openmm/CustomIntegrator.h"
 #include "ReferencePlatform.h"
+#include "openmm/HarmonicAngleForce.h"
+#include "openmm/HarmonicBondForce.h"
 #include "openmm/NonbondedForce.h"
 #include "openmm/System.h"
 #include "openmm/LangevinIntegrator.h"
@@ -205,11 +208,135 @@ void testRandomSeed() {
     }
 }
 
+/**
+ * Simulate two molecules connected by an angle, and return the final volume.  angleGroup is the force group
+ * for the angle, or -1 to omit it.
+ */
+double simulateIntermolecularAngle(int angleGroup) {
+    ReferencePlatform platform;
+    System system;
+    system.setDefaultPeriodicBoxVectors(Vec3(3, 0, 0), Vec3(0, 3, 0), Vec3(0, 0, 3));
+    for (int i = 0; i < 3; i++)
+        system.addParticle(1.0);
+    HarmonicBondForce* bonds = new HarmonicBondForce();
+    bonds->addBond(0, 1, 1.0, 1000.0);
+    bonds->setForceGroup(1);
+    system.addForce(bonds);
+    if (angleGroup >= 0) {
+        HarmonicAngleForce* angles = new HarmonicAngleForce();
+        angles->addAngle(0, 1, 2, M_PI/2, 1000.0);
+        angles->setForceGroup(angleGroup);
+        system.addForce(angles);
+    }
+    MonteCarloBarostat* barostat = new MonteCarloBarostat(1.0, 300.0, 1);
+    barostat->setRandomNumberSeed(1);
+    system.addForce(barostat);
+    VerletIntegrator integrator(1e-10);
+    Context context(system, integrator, platform);
+    vector<Vec3> positions;
+    positions.push_back(Vec3(2, 1, 1));
+    positions.push_back(Vec3(1, 1, 1));
+    positions.push_back(Vec3(1, 1.1, 1));
+    context.setPositions(positions);
+    integrator.step(100);
+    Vec3 x, y, z;
+    context.getState(State::Energy).getPeriodicBoxVectors(x, y, z);
+    return x[0]*y[1]*z[2];
+}
+
+/**
+ * The barostat skips forces that are unaffected by scaling molecule centers.  Make sure a bonded
+ * force whose interactions span two molecules is still included.
+ */
+void testIntermolecularBondedForce() {
+    // Group 0 also contains the barostat, so it is always evaluated.  With the same random seed, putting the
+    // angle in its own group must give exactly the same trajectory.
+
+    double expected = simulateIntermolecularAngle(0);
+    ASSERT_EQUAL_TOL(expected, simulateIntermolecularAngle(2), 1e-10);
+
+    // Make sure the angle really affects which steps are accepted.
+
+    ASSERT(fabs(expected-simulateIntermolecularAngle(-1)) > 0.1);
+}
+
+/**
+ * A CustomIntegrator that reads the forces of exactly the groups the barostat evaluates must not reuse
+ * forces computed before the box was scaled.
+ */
+void testCustomIntegrator() {
+    const int numParticles = 64;
+    const double boxSize = 4.0;
+    ReferencePlatform platform;
+    System system;
+    system.setDefaultPeriodicBoxVectors(Vec3(boxSize, 0, 0), Vec3(0, boxSize, 0), Vec3(0, 0, boxSize));
+    NonbondedForce* nonbonded = new NonbondedForce();
+    nonbonded->setNonbondedMethod(NonbondedForce::CutoffPeriodic);
+    nonbonded->setCutoffDistance(1.5);
+    system.addForce(nonbonded);
+    vector<Vec3> positions;
+    OpenMM_SFMT::SFMT sfmt;
+    init_gen_rand(0, sfmt);
+    for (int i = 0; i < 4; i++)
+        for (int j = 0; j < 4; j++)
+            for (int k = 0; k < 4; k++) {
+                system.addParticle(10.0);
+                nonbonded->addParticle((i+j+k)%2 == 0 ? 0.5 : -0.5, 0.3, 1.0);
+                Vec3 offset(genrand_real2(sfmt)-0.5, genrand_real2(sfmt)-0.5, genrand_real2(sfmt)-0.5);
+                positions.push_back(Vec3(i+0.5, j+0.5, k+0.5)*(boxSize/4)+offset*0.2);
+            }
+    MonteCarloBarostat* barostat = new MonteCarloBarostat(1000.0, 300.0, 1);
+    barostat->setRandomNumberSeed(1);
+    system.addForce(barostat);
+
+    // The integrator only records the forces it sees, so the particles move only when the barostat scales them.
+
+    CustomIntegrator integrator(0.001);
+    integrator.addPerDofVariable("f", 0.0);
+    integrator.addUpdateContextState();
+    integrator.addComputePerDof("f", "f0");
+    Context context(system, integrator, platform);
+    context.setPositions(positions);
+
+    // Compute the expected forces in a second Context, since asking the first one for forces would
+    // refresh the ones the integrator uses.
+
+    System refSystem;
+    refSystem.setDefaultPeriodicBoxVectors(Vec3(boxSize, 0, 0), Vec3(0, boxSize, 0), Vec3(0, 0, boxSize));
+    for (int i = 0; i < numParticles; i++)
+        refSystem.addParticle(10.0);
+    refSystem.addForce(new NonbondedForce(*nonbonded));
+    VerletIntegrator refIntegrator(0.001);
+    Context refContext(refSystem, refIntegrator, platform);
+    int numAccepted = 0;
+    double lastVolume = boxSize*boxSize*boxSize;
+    for (int i = 0; i < 20; i++) {
+        integrator.step(1);
+        vector<Vec3> recorded;
+        integrator.getPerDofVariable(0, recorded);
+        State state = context.getState(State::Positions);
+        Vec3 a, b, c;
+        state.getPeriodicBoxVectors(a, b, c);
+        double volume = a[0]*b[1]*c[2];
+        if (volume != lastVolume)
+            numAccepted++;
+        lastVolume = volume;
+        refContext.setPeriodicBoxVectors(a, b, c);
+        refContext.setPositions(state.getPositions());
+        State refState = refContext.getState(State::Forces);
+        for (int j = 0; j < numParticles; j++)
+            ASSERT_EQUAL_VEC(refState.getForces()[j], recorded[j], 1e-5);
+    }
+    ASSERT(numAccepted > 0);
+}
+
 int main() {
     try {
         testChangingBoxSize();
         testIdealGas();
         testRandomSeed();
+        testIntermolecularBondedForce();
+        testCustomIntegrator();
     }
     catch(const exception& e) {
         cout << "exception: " << e.what() << endl;
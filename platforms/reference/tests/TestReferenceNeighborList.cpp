@@ -32,6 +32,7 @@
 #include "openmm/internal/AssertionUtilities.h"
 #include "ReferenceNeighborList.h"
 #include "sfmt/SFMT.h"
+#include <algorithm>
 #include <cassert>
 #include <iostream>
 #include <vector>
@@ -60,6 +61,12 @@ void testNeighborList()
     
     computeNeighborListVoxelHash(neighborList, 2, particleList, exclusions, boxSize, false, 13.5, 0.01);
     assert(neighborList.size() == 0);
+    
+    computeNeighborListCellList(neighborList, 2, particleList, exclusions, boxSize, false, 13.7, 0.01);
+    ASSERT(neighborList.size() == 1);
+    
+    computeNeighborListCellList(neighborList, 2, particleList, exclusions, boxSize, false, 13.5, 0.01);
+    ASSERT(neighborList.size() == 0);
 }
 
 double periodicDifference(double val1, double val2, double period) {
@@ -108,6 +115,109 @@ void testPeriodic() {
     verifyNeighborList(neighborList, numParticles, particleList, periodicBoxSize, cutoff);
     computeNeighborListVoxelHash(neighborList, numParticles, particleList, exclusions, periodicBoxSize, true, cutoff);
     verifyNeighborList(neighborList, numParticles, particleList, periodicBoxSize, cutoff);
+    computeNeighborListCellList(neighborList, numParticles, particleList, exclusions, periodicBoxSize, true, cutoff);
+    verifyNeighborList(neighborList, numParticles, particleList, periodicBoxSize, cutoff);
+}
+
+void compareCellListToVoxelHash(int numParticles, const RealVec& boxSize, bool periodic, double cutoff) {
+    vector<RealVec> particleList(numParticles);
+    OpenMM_SFMT::SFMT sfmt;
+    init_gen_rand(1, sfmt);
+    for (int i = 0; i <numParticles; i++)
+        for (int j = 0; j < 3; j++)
+            particleList[i][j] = (RealOpenMM) (genrand_real2(sfmt)*boxSize[j]*3-boxSize[j]);
+    vector<set<int> > exclusions(numParticles);
+    for (int i = 1; i < numParticles; i += 3) {
+        exclusions[i].insert(i-1);
+        exclusions[i-1].insert(i);
+    }
+    NeighborList voxelList, cellList;
+    computeNeighborListVoxelHash(voxelList, numParticles, particleList, exclusions, boxSize, periodic, cutoff);
+    computeNeighborListCellList(cellList, numParticles, particleList, exclusions, boxSize, periodic, cutoff);
+    ASSERT_EQUAL(voxelList.size(), cellList.size());
+    sort(voxelList.begin(), voxelList.end());
+    sort(cellList.begin(), cellList.end());
+    for (int i = 0; i < (int) voxelList.size(); i++) {
+        ASSERT_EQUAL(voxelList[i].first, cellList[i].first);
+        ASSERT_EQUAL(voxelList[i].second, cellList[i].second);
+    }
+}
+
+void testCellList() {
+    compareCellListToVoxelHash(500, RealVec(20.0, 15.0, 22.0), true, 3.0);
+    compareCellListToVoxelHash(500, RealVec(20.0, 15.0, 22.0), false, 3.0);
+    compareCellListToVoxelHash(200, RealVec(6.0, 7.5, 11.0), true, 2.9);
+    compareCellListToVoxelHash(200, RealVec(6.0, 7.5, 11.0), false, 2.9);
+}
+
+/**
+ * Check that every pair within the cutoff is in a ReferenceNeighborList.
+ */
+void verifyContainsNeighbors(const ReferenceNeighborList& list, vector<RealVec>& positions, const RealVec& periodicBoxSize, double cutoff) {
+    set<pair<int, int> > pairs;
+    for (int i = 0; i < (int) list.getNeighborList().size(); i++) {
+        const AtomPair& p = list.getNeighborList()[i];
+        pairs.insert(make_pair(min(p.first, p.second), max(p.first, p.second)));
+    }
+    for (int i = 0; i < (int) positions.size(); i++)
+        for (int j = i+1; j < (int) positions.size(); j++)
+            if (distance2(positions[i], positions[j], periodicBoxSize) <= cutoff*cutoff)
+                ASSERT(pairs.find(make_pair(i, j)) != pairs.end());
+}
+
+/**
+ * Scaling the box together with the atoms, as a barostat does, should only rebuild the list when it
+ * could be missing a pair.
+ */
+void testScaledBox() {
+    const int numParticles = 300;
+    const double cutoff = 1.0;
+    const double skin = 0.2;
+    RealVec boxSize(5.0, 6.0, 5.5);
+    vector<RealVec> positions(numParticles);
+    OpenMM_SFMT::SFMT sfmt;
+    init_gen_rand(0, sfmt);
+    for (int i = 0; i < numParticles; i++)
+        for (int j = 0; j < 3; j++)
+            positions[i][j] = (RealOpenMM) (genrand_real2(sfmt)*boxSize[j]);
+    vector<set<int> > exclusions(numParticles);
+    ReferenceNeighborList list;
+    ASSERT(list.update(numParticles, positions, exclusions, boxSize, true, cutoff, skin));
+
+    // Shrink the box slightly and move every atom a little less than the allowed distance.
+
+    const double scale = 0.99;
+    double maxMove = 0.5*(scale*(cutoff+skin)-cutoff);
+    RealVec scaledBox = boxSize*scale;
+    vector<RealVec> scaledPositions(numParticles);
+    for (int i = 0; i < numParticles; i++) {
+        RealVec offset(genrand_real2(sfmt)-0.5, genrand_real2(sfmt)-0.5, genrand_real2(sfmt)-0.5);
+        scaledPositions[i] = positions[i]*scale + offset*(0.99*maxMove/sqrt(offset.dot(offset)));
+    }
+    ASSERT(!list.update(numParticles, scaledPositions, exclusions, scaledBox, true, cutoff, skin));
+    verifyContainsNeighbors(list, scaledPositions, scaledBox, cutoff);
+
+    // Moving an atom by a whole box vector does not change any distances.
+
+    scaledPositions[0][1] += scaledBox[1];
+    ASSERT(!list.update(numParticles, scaledPositions, exclusions, scaledBox, true, cutoff, skin));
+
+    // Restoring the original box and positions, as when a barostat step is rejected, should not rebuild it.
+
+    ASSERT(!list.update(numParticles, positions, exclusions, boxSize, true, cutoff, skin));
+
+    // Moving one atom farther than the allowed distance should rebuild it.
+
+    scaledPositions[1][0] += 2*maxMove;
+    ASSERT(list.update(numParticles, scaledPositions, exclusions, scaledBox, true, cutoff, skin));
+    verifyContainsNeighbors(list, scaledPositions, scaledBox, cutoff);
+
+    // Shrinking the box by more than the skin allows should rebuild it even if nothing else moves.
+
+    const double bigScale = 0.8;
+    for (int i = 0; i < numParticles; i++)
+        scaledPositions[i] = scaledPositions[i]*bigScale;
+    ASSERT(list.update(numParticles, scaledPositions, exclusions, scaledBox*bigScale, true, cutoff, skin));
 }
 
 int main() 
@@ -115,6 +225,8 @@ int main()
 try {
     testNeighborList();
     testPeriodic();
+    testCellList();
+    testScaledBox();
     
     cout << "Test Passed" << endl;
     return 0;
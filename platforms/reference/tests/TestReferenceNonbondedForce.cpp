@@ -41,7 +41,9 @@
 #include "openmm/VerletIntegrator.h"
 #include "SimTKOpenMMRealType.h"
 #include "openmm/HarmonicBondForce.h"
+#include "sfmt/SFMT.h"
 #include <iostream>
+#include <sstream>
 #include <vector>
 
 using namespace OpenMM;
@@ -475,6 +477,64 @@ void testSwitchingFunction(NonbondedForce::NonbondedMethod method) {
     }
 }
 
+void testNeighborListSkin() {
+    // Simulate a periodic gas with and without a skin on the neighbor list, and make sure the
+    // results agree while the buffered list is rebuilt less often.
+
+    const int gridSize = 6;
+    const int numParticles = gridSize*gridSize*gridSize;
+    const double boxSize = 4.0;
+    const double spacing = boxSize/gridSize;
+    const int numSteps = 100;
+    System system;
+    NonbondedForce* nonbonded = new NonbondedForce();
+    for (int i = 0; i < numParticles; i++) {
+        system.addParticle(10.0);
+        nonbonded->addParticle(i%2 == 0 ? 0.2 : -0.2, 0.3, 1.0);
+    }
+    nonbonded->setNonbondedMethod(NonbondedForce::CutoffPeriodic);
+    nonbonded->setCutoffDistance(1.0);
+    system.setDefaultPeriodicBoxVectors(Vec3(boxSize, 0, 0), Vec3(0, boxSize, 0), Vec3(0, 0, boxSize));
+    system.addForce(nonbonded);
+    OpenMM_SFMT::SFMT sfmt;
+    init_gen_rand(0, sfmt);
+    vector<Vec3> positions(numParticles);
+    for (int i = 0; i < gridSize; i++)
+        for (int j = 0; j < gridSize; j++)
+            for (int k = 0; k < gridSize; k++)
+                positions[(i*gridSize+j)*gridSize+k] = Vec3(spacing*(i+0.2*genrand_real2(sfmt)), spacing*(j+0.2*genrand_real2(sfmt)), spacing*(k+0.2*genrand_real2(sfmt)));
+    vector<Vec3> velocities(numParticles);
+    for (int i = 0; i < numParticles; i++)
+        velocities[i] = Vec3(genrand_real2(sfmt)-0.5, genrand_real2(sfmt)-0.5, genrand_real2(sfmt)-0.5)*5.0;
+    ReferencePlatform platform;
+    VerletIntegrator integrator1(0.001);
+    VerletIntegrator integrator2(0.001);
+    map<string, string> properties1, properties2;
+    properties1[ReferencePlatform::ReferenceNeighborListSkin()] = "0";
+    properties2[ReferencePlatform::ReferenceNeighborListSkin()] = "0.3";
+    Context context1(system, integrator1, platform, properties1);
+    Context context2(system, integrator2, platform, properties2);
+    context1.setPositions(positions);
+    context2.setPositions(positions);
+    context1.setVelocities(velocities);
+    context2.setVelocities(velocities);
+    for (int i = 0; i < numSteps; i++) {
+        State state1 = context1.getState(State::Energy | State::Forces);
+        State state2 = context2.getState(State::Energy | State::Forces);
+        ASSERT_EQUAL_TOL(state1.getPotentialEnergy(), state2.getPotentialEnergy(), 1e-5);
+        for (int j = 0; j < numParticles; j++)
+            ASSERT_EQUAL_VEC(state1.getForces()[j], state2.getForces()[j], 1e-5);
+        integrator1.step(1);
+        integrator2.step(1);
+    }
+    int rebuilds1, rebuilds2;
+    stringstream(platform.getPropertyValue(context1, ReferencePlatform::ReferenceNeighborListRebuilds())) >> rebuilds1;
+    stringstream(platform.getPropertyValue(context2, ReferencePlatform::ReferenceNeighborListRebuilds())) >> rebuilds2;
+    ASSERT(rebuilds1 >= numSteps);
+    ASSERT(rebuilds2 >= 1);
+    ASSERT(rebuilds2 < rebuilds1);
+}
+
 int main() {
     try {
         testCoulomb();
@@ -486,6 +546,7 @@ int main() {
         testDispersionCorrection();
         testSwitchingFunction(NonbondedForce::CutoffNonPeriodic);
         testSwitchingFunction(NonbondedForce::PME);
+        testNeighborListSkin();
     }
     catch(const exception& e) {
         cout << "exception: " << e.what() << endl;
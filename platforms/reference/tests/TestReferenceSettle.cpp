@@ -0,0 +1,225 @@
+/* -------------------------------------------------------------------------- *
+ *                                   OpenMM                                   *
+ * -------------------------------------------------------------------------- *
+ * This is part of the OpenMM molecular simulation toolkit originating from   *
+ * Simbios, the NIH National Center for Physics-Based Simulation of           *
+ * Biological Structures at Stanford, funded under the NIH Roadmap for        *
+ * Medical Research, grant U54 GM072970. See https://simtk.org.               *
+ *                                                                            *
+ * Portions copyright (c) 2013 Stanford University and the Authors.           *
+ * Authors: Peter Eastman                                                     *
+ * Contributors:                                                              *
+ *                                                                            *
+ * Permission is hereby granted, free of charge, to any person obtaining a    *
+ * copy of this software and associated documentation files (the "Software"), *
+ * to deal in the Software without restriction, including without limitation  *
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,   *
+ * and/or sell copies of the Software, and to permit persons to whom the      *
+ * Software is furnished to do so, subject to the following conditions:       *
+ *                                                                            *
+ * The above copyright notice and this permission notice shall be included in *
+ * all copies or substantial portions of the Software.                        *
+ *                                                                            *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR *
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,   *
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL    *
+ * THE AUTHORS, CONTRIBUTORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,    *
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR      *
+ * OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE  *
+ * USE OR OTHER DEALINGS IN THE SOFTWARE.                                     *
+ * -------------------------------------------------------------------------- */
+
+
+/**
+ * This tests the Reference implementation of SETTLE.
+ */
+
+#include "openmm/internal/AssertionUtilities.h"
+#include "ReferenceConstraints.h"
+#include "ReferencePlatform.h"
+#include "openmm/Context.h"
+#include "openmm/HarmonicBondForce.h"
+#include "openmm/System.h"
+#include "openmm/VerletIntegrator.h"
+#include "SimTKOpenMMRealType.h"
+#include "sfmt/SFMT.h"
+#include <iostream>
+#include <vector>
+
+using namespace OpenMM;
+using namespace std;
+
+const double dOH = 0.1;
+const double dHH = 0.1633;
+
+/**
+ * Build a System containing rigid water molecules, plus a chain of three constrained atoms
+ * that SETTLE cannot handle.
+ */
+System* createSystem(int numMolecules, vector<RealVec>& positions, OpenMM_SFMT::SFMT& sfmt) {
+    System* system = new System();
+    positions.clear();
+    for (int i = 0; i < numMolecules; i++) {
+        int first = system->getNumParticles();
+        system->addParticle(16.0);
+        system->addParticle(1.0);
+        system->addParticle(1.0);
+        system->addConstraint(first, first+1, dOH);
+        system->addConstraint(first, first+2, dOH);
+        system->addConstraint(first+1, first+2, dHH);
+        RealVec center(i%4, (i/4)%4, i/16);
+        RealVec axis1(genrand_real2(sfmt)-0.5, genrand_real2(sfmt)-0.5, genrand_real2(sfmt)-0.5);
+        axis1 *= 1/SQRT(axis1.dot(axis1));
+        RealVec axis2 = axis1.cross(RealVec(0, 0, 1));
+        axis2 *= 1/SQRT(axis2.dot(axis2));
+        double h = SQRT(dOH*dOH-0.25*dHH*dHH);
+        positions.push_back(center);
+        positions.push_back(center+axis1*h+axis2*(0.5*dHH));
+        positions.push_back(center+axis1*h-axis2*(0.5*dHH));
+    }
+    int first = system->getNumParticles();
+    for (int i = 0; i < 3; i++) {
+        system->addParticle(12.0);
+        positions.push_back(RealVec(-1.0, 0.15*i, 0));
+    }
+    system->addConstraint(first, first+1, 0.15);
+    system->addConstraint(first+1, first+2, 0.15);
+    return system;
+}
+
+void testClusterDetection() {
+    OpenMM_SFMT::SFMT sfmt;
+    init_gen_rand(0, sfmt);
+    vector<RealVec> positions;
+    System* system = createSystem(10, positions, sfmt);
+    ReferenceConstraints constraints(*system, 1e-5);
+    ASSERT(constraints.getSETTLEAlgorithm() != NULL);
+    ASSERT_EQUAL(10, constraints.getSETTLEAlgorithm()->getNumClusters());
+    ASSERT(constraints.getCCMAAlgorithm() != NULL);
+    ASSERT_EQUAL(2, constraints.getCCMAAlgorithm()->getNumberOfConstraints());
+    int atom1, atom2, atom3;
+    RealOpenMM distance1, distance2;
+    constraints.getSETTLEAlgorithm()->getClusterParameters(3, atom1, atom2, atom3, distance1, distance2);
+    ASSERT_EQUAL(9, atom1);
+    ASSERT_EQUAL(10, atom2);
+    ASSERT_EQUAL(11, atom3);
+    ASSERT_EQUAL_TOL(dOH, distance1, 1e-6);
+    ASSERT_EQUAL_TOL(dHH, distance2, 1e-6);
+
+    // A triangle whose outer atoms have different masses must not use SETTLE.
+
+    system->setParticleMass(2, 2.0);
+    ReferenceConstraints constraints2(*system, 1e-5);
+    ASSERT_EQUAL(9, constraints2.getSETTLEAlgorithm()->getNumClusters());
+    ASSERT_EQUAL(5, constraints2.getCCMAAlgorithm()->getNumberOfConstraints());
+    delete system;
+}
+
+void testConstraints() {
+    const int numMolecules = 20;
+    OpenMM_SFMT::SFMT sfmt;
+    init_gen_rand(1, sfmt);
+    vector<RealVec> positions;
+    System* system = createSystem(numMolecules, positions, sfmt);
+    int numParticles = system->getNumParticles();
+    vector<RealOpenMM> masses(numParticles), inverseMasses(numParticles);
+    for (int i = 0; i < numParticles; i++) {
+        masses[i] = system->getParticleMass(i);
+        inverseMasses[i] = 1/masses[i];
+    }
+
+    // Perturb the positions and velocities, then constrain them with SETTLE and with CCMA alone.
+
+    vector<RealVec> newPositions(numParticles), velocities(numParticles);
+    for (int i = 0; i < numParticles; i++) {
+        for (int j = 0; j < 3; j++) {
+            newPositions[i][j] = positions[i][j]+0.01*(genrand_real2(sfmt)-0.5);
+            velocities[i][j] = genrand_real2(sfmt)-0.5;
+        }
+    }
+    vector<pair<int, int> > indices(system->getNumConstraints());
+    vector<RealOpenMM> distances(system->getNumConstraints());
+    for (int i = 0; i < system->getNumConstraints(); i++) {
+        double distance;
+        system->getConstraintParameters(i, indices[i].first, indices[i].second, distance);
+        distances[i] = distance;
+    }
+    vector<ReferenceCCMAAlgorithm::AngleInfo> angles;
+    ReferenceCCMAAlgorithm ccma(numParticles, indices.size(), indices, distances, masses, angles, 1e-10);
+    ReferenceConstraints settle(*system, 1e-10);
+    vector<RealVec> ccmaPositions = newPositions;
+    vector<RealVec> settlePositions = newPositions;
+    ccma.apply(numParticles, positions, ccmaPositions, inverseMasses);
+    settle.apply(numParticles, positions, settlePositions, inverseMasses);
+    for (int i = 0; i < system->getNumConstraints(); i++) {
+        RealVec delta = settlePositions[indices[i].first]-settlePositions[indices[i].second];
+        ASSERT_EQUAL_TOL(distances[i], SQRT(delta.dot(delta)), 1e-8);
+    }
+    for (int i = 0; i < numParticles; i++)
+        ASSERT_EQUAL_VEC(ccmaPositions[i], settlePositions[i], 1e-6);
+    vector<RealVec> ccmaVelocities = velocities;
+    vector<RealVec> settleVelocities = velocities;
+    ccma.applyToVelocities(numParticles, settlePositions, ccmaVelocities, inverseMasses);
+    settle.applyToVelocities(numParticles, settlePositions, settleVelocities, inverseMasses);
+    for (int i = 0; i < system->getNumConstraints(); i++) {
+        RealVec delta = settlePositions[indices[i].first]-settlePositions[indices[i].second];
+        RealVec dv = settleVelocities[indices[i].first]-settleVelocities[indices[i].second];
+        ASSERT_EQUAL_TOL(0.0, dv.dot(delta), 1e-8);
+    }
+    for (int i = 0; i < numParticles; i++)
+        ASSERT_EQUAL_VEC(ccmaVelocities[i], settleVelocities[i], 1e-6);
+    delete system;
+}
+
+void testSimulation() {
+    const int numMolecules = 16;
+    OpenMM_SFMT::SFMT sfmt;
+    init_gen_rand(2, sfmt);
+    vector<RealVec> realPositions;
+    System* system = createSystem(numMolecules, realPositions, sfmt);
+    HarmonicBondForce* bonds = new HarmonicBondForce();
+    for (int i = 0; i < numMolecules-1; i++)
+        bonds->addBond(3*i, 3*i+3, 0.8, 10.0);
+    system->addForce(bonds);
+    VerletIntegrator integrator(0.002);
+    integrator.setConstraintTolerance(1e-6);
+    ReferencePlatform platform;
+    Context context(*system, integrator, platform);
+    vector<Vec3> positions(realPositions.size()), velocities(realPositions.size());
+    for (int i = 0; i < (int) positions.size(); i++) {
+        positions[i] = Vec3(realPositions[i][0], realPositions[i][1], realPositions[i][2]);
+        velocities[i] = Vec3(genrand_real2(sfmt)-0.5, genrand_real2(sfmt)-0.5, genrand_real2(sfmt)-0.5);
+    }
+    context.setPositions(positions);
+    context.setVelocities(velocities);
+    context.applyVelocityConstraints(1e-6);
+    State initial = context.getState(State::Energy);
+    double initialEnergy = initial.getKineticEnergy()+initial.getPotentialEnergy();
+    for (int step = 0; step < 200; step++) {
+        integrator.step(5);
+        State state = context.getState(State::Positions | State::Energy);
+        for (int i = 0; i < system->getNumConstraints(); i++) {
+            int particle1, particle2;
+            double distance;
+            system->getConstraintParameters(i, particle1, particle2, distance);
+            Vec3 delta = state.getPositions()[particle1]-state.getPositions()[particle2];
+            ASSERT_EQUAL_TOL(distance, sqrt(delta.dot(delta)), 1e-5);
+        }
+        ASSERT_EQUAL_TOL(initialEnergy, state.getKineticEnergy()+state.getPotentialEnergy(), 0.05);
+    }
+    delete system;
+}
+
+int main() {
+    try {
+        testClusterDetection();
+        testConstraints();
+        testSimulation();
+    }
+    catch(const exception& e) {
+        cout << "exception: " << e.what() << endl;
+        return 1;
+    }
+    cout << "Done" << endl;
+    return 0;
+}
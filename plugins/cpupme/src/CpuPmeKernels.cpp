@@ -33,10 +33,20 @@
   #define _USE_MATH_DEFINES // Needed to get M_PI
 #endif
 #include "CpuPmeKernels.h"
+#include "ReferenceFFTWPlannerLock.h"
 #include "SimTKOpenMMRealType.h"
+#include "openmm/OpenMMException.h"
+#include <cerrno>
 #include <cmath>
+#include <cstdio>
+#include <cstdlib>
 #include <cstring>
 #include <smmintrin.h>
+#include <sys/stat.h>
+#ifndef WIN32
+    #include <fcntl.h>
+    #include <sys/file.h>
+#endif
 
 using namespace OpenMM;
 using namespace std;
@@ -62,6 +72,83 @@ int CpuCalcPmeReciprocalForceKernel::numThreads = 0;
    #endif
 #endif
 
+/**
+ * This class holds an exclusive lock on a file for as long as it exists.  It is used to keep multiple
+ * processes from reading and writing the same wisdom file at once.  If the file cannot be opened,
+ * no lock is held.
+ */
+class WisdomFileLock {
+public:
+    WisdomFileLock(const string& filename) {
+#ifdef WIN32
+        handle = CreateFileA(filename.c_str(), GENERIC_READ|GENERIC_WRITE, FILE_SHARE_READ|FILE_SHARE_WRITE, NULL, OPEN_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+        if (handle != INVALID_HANDLE_VALUE) {
+            OVERLAPPED overlapped;
+            memset(&overlapped, 0, sizeof(overlapped));
+            LockFileEx(handle, LOCKFILE_EXCLUSIVE_LOCK, 0, 1, 0, &overlapped);
+        }
+#else
+        fd = open(filename.c_str(), O_RDWR|O_CREAT, 0666);
+        if (fd != -1)
+            while (flock(fd, LOCK_EX) == -1 && errno == EINTR)
+                ;
+#endif
+    }
+    ~WisdomFileLock() {
+        // Closing the file releases the lock.
+#ifdef WIN32
+        if (handle != INVALID_HANDLE_VALUE)
+            CloseHandle(handle);
+#else
+        if (fd != -1)
+            close(fd);
+#endif
+    }
+private:
+#ifdef WIN32
+    HANDLE handle;
+#else
+    int fd;
+#endif
+};
+
+static bool hasReadPlanningOptions = false;
+static string wisdomPath;
+static bool usePatientPlans = false;
+
+/**
+ * Set the default planning options from the environment, unless that has already been done.
+ */
+static void readPlanningOptions() {
+    if (hasReadPlanningOptions)
+        return;
+    char* path = getenv("OPENMM_FFTW_WISDOM");
+    if (path != NULL)
+        wisdomPath = path;
+    char* patient = getenv("OPENMM_FFTW_PATIENT");
+    usePatientPlans = (patient != NULL && string(patient) != "" && string(patient) != "0" && string(patient) != "false");
+    hasReadPlanningOptions = true;
+}
+
+/**
+ * Write FFTW wisdom to a file.  It is first written to a temporary file which then replaces the existing
+ * one, so the file is never left partially written.
+ */
+static void saveWisdom(const string& file, bool doublePrecision) {
+    string tempFile = file+".tmp";
+#ifdef OPENMM_PME_USE_DOUBLE_FFTW
+    int success = (doublePrecision ? fftw_export_wisdom_to_filename(tempFile.c_str()) : fftwf_export_wisdom_to_filename(tempFile.c_str()));
+#else
+    int success = fftwf_export_wisdom_to_filename(tempFile.c_str());
+#endif
+    if (success) {
+#ifdef WIN32
+        remove(file.c_str());
+#endif
+        rename(tempFile.c_str(), file.c_str());
+    }
+}
+
 static int getNumProcessors() {
 #ifdef __APPLE__
     int ncpu;
@@ -120,7 +207,126 @@ static void cpuid(int cpuInfo[4], int infoType){
 }
 #endif
 
-static void spreadCharge(int start, int end, float* posq, float* grid, int gridx, int gridy, int gridz, int numParticles, Vec3 periodicBoxSize) {
+static inline __m128i findGridIndex(__m128 pos, __m128 boxSize, __m128 invBoxSize, __m128 gridSize, __m128i gridSizeInt, __m128& dr) {
+    __m128 posFloor = _mm_floor_ps(_mm_mul_ps(pos, invBoxSize));
+    __m128 posInBox = _mm_sub_ps(pos, _mm_mul_ps(boxSize, posFloor));
+    __m128 t = _mm_mul_ps(_mm_mul_ps(posInBox, invBoxSize), gridSize);
+    __m128i ti = _mm_cvttps_epi32(t);
+    dr = _mm_sub_ps(t, _mm_cvtepi32_ps(ti));
+    return _mm_sub_epi32(ti, _mm_and_si128(gridSizeInt, _mm_cmpeq_epi32(ti, gridSizeInt)));
+}
+
+/**
+ * Find the grid point each atom's B-splines start at, and the atom's fractional position relative to it.
+ * This is the scalar equivalent of the SSE version above.
+ */
+template <class REAL>
+static inline void findGridIndex(const REAL* pos, const REAL* boxSize, const REAL* invBoxSize, const int* gridSize, int* gridIndex, REAL* dr) {
+    for (int i = 0; i < 3; i++) {
+        REAL posInBox = pos[i]-boxSize[i]*floor(pos[i]*invBoxSize[i]);
+        REAL t = posInBox*invBoxSize[i]*gridSize[i];
+        int ti = (int) t;
+        dr[i] = t-ti;
+        gridIndex[i] = (ti == gridSize[i] ? 0 : ti);
+    }
+}
+
+/**
+ * Compute the B-spline coefficients for one dimension, and optionally their derivatives.
+ */
+template <class REAL>
+static inline void computeBSplines(REAL dr, REAL* data, REAL* ddata) {
+    const REAL scale = (REAL) 1/(PME_ORDER-1);
+    data[PME_ORDER-1] = 0;
+    data[1] = dr;
+    data[0] = 1-dr;
+    for (int j = 3; j < PME_ORDER; j++) {
+        REAL div = (REAL) 1/(j-1);
+        data[j-1] = div*dr*data[j-2];
+        for (int k = 1; k < j-1; k++)
+            data[j-k-1] = div*((dr+k)*data[j-k-2]+(j-k-dr)*data[j-k-1]);
+        data[0] = div*(1-dr)*data[0];
+    }
+    if (ddata != NULL) {
+        ddata[0] = -data[0];
+        for (int j = 1; j < PME_ORDER; j++)
+            ddata[j] = data[j-1]-data[j];
+    }
+    data[PME_ORDER-1] = scale*dr*data[PME_ORDER-2];
+    for (int j = 1; j < (PME_ORDER-1); j++)
+        data[PME_ORDER-j-1] = scale*((dr+j)*data[PME_ORDER-j-2]+(PME_ORDER-j-dr)*data[PME_ORDER-j-1]);
+    data[0] = scale*(1-dr)*data[0];
+}
+
+template <class REAL>
+static void findAtomGridX(int start, int end, const REAL* posq, int* atomGridX, int gridx, int gridy, int gridz, Vec3 periodicBoxSize) {
+    REAL boxSize[3] = {(REAL) periodicBoxSize[0], (REAL) periodicBoxSize[1], (REAL) periodicBoxSize[2]};
+    REAL invBoxSize[3] = {(REAL) (1/periodicBoxSize[0]), (REAL) (1/periodicBoxSize[1]), (REAL) (1/periodicBoxSize[2])};
+    int gridSize[3] = {gridx, gridy, gridz};
+    int gridIndex[3];
+    REAL dr[3];
+    for (int i = start; i < end; i++) {
+        findGridIndex(&posq[4*i], boxSize, invBoxSize, gridSize, gridIndex, dr);
+        atomGridX[i] = gridIndex[0];
+    }
+}
+
+/**
+ * Spread the charges of a set of atoms onto a slab of the grid.  The slab begins at x index xstart, and must
+ * be large enough to hold every x index the atoms touch without wrapping.
+ */
+template <class REAL>
+static void spreadCharge(const int* atoms, int numAtoms, const REAL* posq, REAL* grid, int xstart, int numPlanes, int gridx, int gridy, int gridz, Vec3 periodicBoxSize) {
+    REAL boxSize[3] = {(REAL) periodicBoxSize[0], (REAL) periodicBoxSize[1], (REAL) periodicBoxSize[2]};
+    REAL invBoxSize[3] = {(REAL) (1/periodicBoxSize[0]), (REAL) (1/periodicBoxSize[1]), (REAL) (1/periodicBoxSize[2])};
+    int gridSize[3] = {gridx, gridy, gridz};
+    const REAL epsilonFactor = (REAL) sqrt(ONE_4PI_EPS0);
+    memset(grid, 0, sizeof(REAL)*numPlanes*gridy*gridz);
+    for (int atom = 0; atom < numAtoms; atom++) {
+        int i = atoms[atom];
+        int gridIndex[3];
+        REAL dr[3];
+        findGridIndex(&posq[4*i], boxSize, invBoxSize, gridSize, gridIndex, dr);
+        REAL data[3][PME_ORDER];
+        for (int j = 0; j < 3; j++)
+            computeBSplines<REAL>(dr[j], data[j], NULL);
+        int gridIndexX = gridIndex[0]-xstart;
+        if (gridIndexX < 0)
+            gridIndexX += gridx;
+        int zindex[PME_ORDER];
+        for (int j = 0; j < PME_ORDER; j++) {
+            zindex[j] = gridIndex[2]+j;
+            zindex[j] -= (zindex[j] >= gridz ? gridz : 0);
+        }
+        REAL charge = epsilonFactor*posq[4*i+3];
+        for (int ix = 0; ix < PME_ORDER; ix++) {
+            int xbase = (gridIndexX+ix)*gridy*gridz;
+            REAL xdata = charge*data[0][ix];
+            for (int iy = 0; iy < PME_ORDER; iy++) {
+                int ybase = gridIndex[1]+iy;
+                ybase -= (ybase >= gridy ? gridy : 0);
+                ybase = xbase + ybase*gridz;
+                REAL multiplier = xdata*data[1][iy];
+                for (int iz = 0; iz < PME_ORDER; iz++)
+                    grid[ybase+zindex[iz]] += multiplier*data[2][iz];
+            }
+        }
+    }
+}
+
+template <>
+void findAtomGridX<float>(int start, int end, const float* posq, int* atomGridX, int gridx, int gridy, int gridz, Vec3 periodicBoxSize) {
+    __m128 boxSize = _mm_set_ps(0, (float) periodicBoxSize[2], (float) periodicBoxSize[1], (float) periodicBoxSize[0]);
+    __m128 invBoxSize = _mm_set_ps(0, (float) (1/periodicBoxSize[2]), (float) (1/periodicBoxSize[1]), (float) (1/periodicBoxSize[0]));
+    __m128 gridSize = _mm_set_ps(0, gridz, gridy, gridx);
+    __m128i gridSizeInt = _mm_set_epi32(0, gridz, gridy, gridx);
+    __m128 dr;
+    for (int i = start; i < end; i++)
+        atomGridX[i] = _mm_extract_epi32(findGridIndex(_mm_loadu_ps(&posq[4*i]), boxSize, invBoxSize, gridSize, gridSizeInt, dr), 0);
+}
+
+template <>
+void spreadCharge<float>(const int* atoms, int numAtoms, const float* posq, float* grid, int xstart, int numPlanes, int gridx, int gridy, int gridz, Vec3 periodicBoxSize) {
     float temp[4];
     __m128 boxSize = _mm_set_ps(0, (float) periodicBoxSize[2], (float) periodicBoxSize[1], (float) periodicBoxSize[0]);
     __m128 invBoxSize = _mm_set_ps(0, (float) (1/periodicBoxSize[2]), (float) (1/periodicBoxSize[1]), (float) (1/periodicBoxSize[0]));
@@ -129,17 +335,14 @@ static void spreadCharge(int start, int end, float* posq, float* grid, int gridx
     __m128 one  = _mm_set1_ps(1);
     __m128 scale = _mm_set1_ps(1.0f/(PME_ORDER-1));
     const float epsilonFactor = sqrt(ONE_4PI_EPS0);
-    memset(grid, 0, sizeof(float)*gridx*gridy*gridz);
-    for (int i = start; i < end; i++) {
+    memset(grid, 0, sizeof(float)*numPlanes*gridy*gridz);
+    for (int atom = 0; atom < numAtoms; atom++) {
+        int i = atoms[atom];
+
         // Find the position relative to the nearest grid point.
         
-        __m128 pos = _mm_loadu_ps(&posq[4*i]);
-        __m128 posFloor = _mm_floor_ps(_mm_mul_ps(pos, invBoxSize));
-        __m128 posInBox = _mm_sub_ps(pos, _mm_mul_ps(boxSize, posFloor));
-        __m128 t = _mm_mul_ps(_mm_mul_ps(posInBox, invBoxSize), gridSize);
-        __m128i ti = _mm_cvttps_epi32(t);
-        __m128 dr = _mm_sub_ps(t, _mm_cvtepi32_ps(ti));
-        __m128i gridIndex = _mm_sub_epi32(ti, _mm_and_si128(gridSizeInt, _mm_cmpeq_epi32(ti, gridSizeInt)));
+        __m128 dr;
+        __m128i gridIndex = findGridIndex(_mm_loadu_ps(&posq[4*i]), boxSize, invBoxSize, gridSize, gridSizeInt, dr);
         
         // Compute the B-spline coefficients.
         
@@ -161,7 +364,9 @@ static void spreadCharge(int start, int end, float* posq, float* grid, int gridx
         
         // Spread the charges.
         
-        int gridIndexX = _mm_extract_epi32(gridIndex, 0);
+        int gridIndexX = _mm_extract_epi32(gridIndex, 0)-xstart;
+        if (gridIndexX < 0)
+            gridIndexX += gridx;
         int gridIndexY = _mm_extract_epi32(gridIndex, 1);
         int gridIndexZ = _mm_extract_epi32(gridIndex, 2);
         int zindex[PME_ORDER];
@@ -174,9 +379,7 @@ static void spreadCharge(int start, int end, float* posq, float* grid, int gridx
         float zdata4 = EXTRACT_FLOAT(data[4], 2);
         if (gridIndexZ+4 < gridz) {
             for (int ix = 0; ix < PME_ORDER; ix++) {
-                int xbase = gridIndexX+ix;
-                xbase -= (xbase >= gridx ? gridx : 0);
-                xbase = xbase*gridy*gridz;
+                int xbase = (gridIndexX+ix)*gridy*gridz;
                 float xdata = charge*EXTRACT_FLOAT(data[ix], 0);
                 for (int iy = 0; iy < PME_ORDER; iy++) {
                     int ybase = gridIndexY+iy;
@@ -191,9 +394,7 @@ static void spreadCharge(int start, int end, float* posq, float* grid, int gridx
         }
         else {
             for (int ix = 0; ix < PME_ORDER; ix++) {
-                int xbase = gridIndexX+ix;
-                xbase -= (xbase >= gridx ? gridx : 0);
-                xbase = xbase*gridy*gridz;
+                int xbase = (gridIndexX+ix)*gridy*gridz;
                 float xdata = charge*EXTRACT_FLOAT(data[ix], 0);
                 for (int iy = 0; iy < PME_ORDER; iy++) {
                     int ybase = gridIndexY+iy;
@@ -213,66 +414,118 @@ static void spreadCharge(int start, int end, float* posq, float* grid, int gridx
     }
 }
 
-static void computeReciprocalEterm(int start, int end, int gridx, int gridy, int gridz, vector<float>& recipEterm, double alpha, vector<float>* bsplineModuli, Vec3 periodicBoxSize) {
+template <class REAL>
+static inline void addToPlane(REAL* dest, const REAL* src, int planeSize) {
+    for (int i = 0; i < planeSize; i++)
+        dest[i] += src[i];
+}
+
+template <>
+inline void addToPlane<float>(float* dest, const float* src, int planeSize) {
+    int i = 0;
+    for (; i+3 < planeSize; i += 4)
+        _mm_storeu_ps(&dest[i], _mm_add_ps(_mm_loadu_ps(&dest[i]), _mm_loadu_ps(&src[i])));
+    for (; i < planeSize; i++)
+        dest[i] += src[i];
+}
+
+/**
+ * Sum the contributions of every thread's slab to a range of x planes in the full grid.
+ */
+template <class REAL>
+static void sumSlabs(int start, int end, REAL* realGrid, const vector<REAL*>& slabGrids, const vector<int>& slabStart, int gridx, int gridy, int gridz) {
+    const int planeSize = gridy*gridz;
+    const int numSlabs = slabGrids.size();
+    for (int x = start; x < end; x++) {
+        REAL* dest = &realGrid[x*planeSize];
+        bool isFirst = true;
+        for (int slab = 0; slab < numSlabs; slab++) {
+            int numPlanes = slabStart[slab+1]-slabStart[slab];
+            if (numPlanes == 0)
+                continue;
+            numPlanes += PME_ORDER-1;
+            int offset = x-slabStart[slab];
+            if (offset < 0)
+                offset += gridx;
+            for (; offset < numPlanes; offset += gridx) {
+                const REAL* src = &slabGrids[slab][offset*planeSize];
+                if (isFirst)
+                    memcpy(dest, src, sizeof(REAL)*planeSize);
+                else
+                    addToPlane(dest, src, planeSize);
+                isFirst = false;
+            }
+        }
+        if (isFirst)
+            memset(dest, 0, sizeof(REAL)*planeSize);
+    }
+}
+
+template <class REAL>
+static void computeReciprocalEterm(int start, int end, int gridx, int gridy, int gridz, vector<REAL>& recipEterm, double alpha, const vector<double>* bsplineModuli, Vec3 periodicBoxSize) {
     const unsigned int zsize = gridz/2+1;
     const unsigned int yzsize = gridy*zsize;
-    const float scaleFactor = (float) (M_PI*periodicBoxSize[0]*periodicBoxSize[1]*periodicBoxSize[2]);
-    const float recipExpFactor = (float) (M_PI*M_PI/(alpha*alpha));
-    const float invPeriodicBoxSizeX = (float) (1.0/periodicBoxSize[0]);
-    const float invPeriodicBoxSizeY = (float) (1.0/periodicBoxSize[1]);
-    const float invPeriodicBoxSizeZ = (float) (1.0/periodicBoxSize[2]);
+    const double scaleFactor = M_PI*periodicBoxSize[0]*periodicBoxSize[1]*periodicBoxSize[2];
+    const double recipExpFactor = M_PI*M_PI/(alpha*alpha);
+    const double invPeriodicBoxSizeX = 1.0/periodicBoxSize[0];
+    const double invPeriodicBoxSizeY = 1.0/periodicBoxSize[1];
+    const double invPeriodicBoxSizeZ = 1.0/periodicBoxSize[2];
 
     int firstz = (start == 0 ? 1 : 0);
     for (int kx = start; kx < end; kx++) {
         int mx = (kx < (gridx+1)/2) ? kx : kx-gridx;
-        float mhx = mx*invPeriodicBoxSizeX;
-        float bx = scaleFactor*bsplineModuli[0][kx];
+        double mhx = mx*invPeriodicBoxSizeX;
+        double bx = scaleFactor*bsplineModuli[0][kx];
         for (int ky = 0; ky < gridy; ky++) {
             int my = (ky < (gridy+1)/2) ? ky : ky-gridy;
-            float mhy = my*invPeriodicBoxSizeY;
-            float mhx2y2 = mhx*mhx + mhy*mhy;
-            float bxby = bx*bsplineModuli[1][ky];
+            double mhy = my*invPeriodicBoxSizeY;
+            double mhx2y2 = mhx*mhx + mhy*mhy;
+            double bxby = bx*bsplineModuli[1][ky];
             for (int kz = firstz; kz < zsize; kz++) {
                 int index = kx*yzsize + ky*zsize + kz;
                 int mz = (kz < (gridz+1)/2) ? kz : kz-gridz;
-                float mhz = mz*invPeriodicBoxSizeZ;
-                float bz = bsplineModuli[2][kz];
-                float m2 = mhx2y2 + mhz*mhz;
-                float denom = m2*bxby*bz;
-                recipEterm[index] = exp(-recipExpFactor*m2)/denom;
+                double mhz = mz*invPeriodicBoxSizeZ;
+                double bz = bsplineModuli[2][kz];
+                double m2 = mhx2y2 + mhz*mhz;
+                double denom = m2*bxby*bz;
+                recipEterm[index] = (REAL) (exp(-recipExpFactor*m2)/denom);
             }
             firstz = 0;
         }
     }
 }
 
-static float reciprocalEnergy(int start, int end, fftwf_complex* grid, int gridx, int gridy, int gridz, double alpha, vector<float>* bsplineModuli, Vec3 periodicBoxSize) {
+/**
+ * Compute the reciprocal space energy from a transformed charge grid.  This is always accumulated in double precision.
+ */
+template <class REAL>
+static double reciprocalEnergy(int start, int end, const REAL (*grid)[2], int gridx, int gridy, int gridz, double alpha, const vector<double>* bsplineModuli, Vec3 periodicBoxSize) {
     const unsigned int zsizeHalf = gridz/2+1;
     const unsigned int yzsizeHalf = gridy*zsizeHalf;
-    const float scaleFactor = (float) (M_PI*periodicBoxSize[0]*periodicBoxSize[1]*periodicBoxSize[2]);
-    const float recipExpFactor = (float) (M_PI*M_PI/(alpha*alpha));
-    const float invPeriodicBoxSizeX = (float) (1.0/periodicBoxSize[0]);
-    const float invPeriodicBoxSizeY = (float) (1.0/periodicBoxSize[1]);
-    const float invPeriodicBoxSizeZ = (float) (1.0/periodicBoxSize[2]);
-    float energy = 0.0f;
+    const double scaleFactor = M_PI*periodicBoxSize[0]*periodicBoxSize[1]*periodicBoxSize[2];
+    const double recipExpFactor = M_PI*M_PI/(alpha*alpha);
+    const double invPeriodicBoxSizeX = 1.0/periodicBoxSize[0];
+    const double invPeriodicBoxSizeY = 1.0/periodicBoxSize[1];
+    const double invPeriodicBoxSizeZ = 1.0/periodicBoxSize[2];
+    double energy = 0.0;
 
     int firstz = (start == 0 ? 1 : 0);
     for (int kx = start; kx < end; kx++) {
         int mx = (kx < (gridx+1)/2) ? kx : kx-gridx;
-        float mhx = mx*invPeriodicBoxSizeX;
-        float bx = scaleFactor*bsplineModuli[0][kx];
+        double mhx = mx*invPeriodicBoxSizeX;
+        double bx = scaleFactor*bsplineModuli[0][kx];
         for (int ky = 0; ky < gridy; ky++) {
             int my = (ky < (gridy+1)/2) ? ky : ky-gridy;
-            float mhy = my*invPeriodicBoxSizeY;
-            float mhx2y2 = mhx*mhx + mhy*mhy;
-            float bxby = bx*bsplineModuli[1][ky];
+            double mhy = my*invPeriodicBoxSizeY;
+            double mhx2y2 = mhx*mhx + mhy*mhy;
+            double bxby = bx*bsplineModuli[1][ky];
             for (int kz = firstz; kz < gridz; kz++) {
                 int mz = (kz < (gridz+1)/2) ? kz : kz-gridz;
-                float mhz = mz*invPeriodicBoxSizeZ;
-                float bz = bsplineModuli[2][kz];
-                float m2 = mhx2y2 + mhz*mhz;
-                float denom = m2*bxby*bz;
-                float eterm = exp(-recipExpFactor*m2)/denom;
+                double mhz = mz*invPeriodicBoxSizeZ;
+                double bz = bsplineModuli[2][kz];
+                double m2 = mhx2y2 + mhz*mhz;
+                double denom = m2*bxby*bz;
+                double eterm = exp(-recipExpFactor*m2)/denom;
                 int kx1, ky1, kz1;
                 if (kz >= gridz/2+1) {
                     kx1 = (kx == 0 ? kx : gridx-kx);
@@ -285,17 +538,18 @@ static float reciprocalEnergy(int start, int end, fftwf_complex* grid, int gridx
                     kz1 = kz;
                 }
                 int index = kx1*yzsizeHalf + ky1*zsizeHalf + kz1;
-                float gridReal = grid[index][0];
-                float gridImag = grid[index][1];
+                double gridReal = grid[index][0];
+                double gridImag = grid[index][1];
                 energy += eterm*(gridReal*gridReal+gridImag*gridImag);
             }
             firstz = 0;
         }
     }
-    return 0.5f*energy;
+    return 0.5*energy;
 }
 
-static void reciprocalConvolution(int start, int end, fftwf_complex* grid, int gridx, int gridy, int gridz, vector<float>& recipEterm) {
+template <class REAL>
+static void reciprocalConvolution(int start, int end, REAL (*grid)[2], int gridx, int gridy, int gridz, const vector<REAL>& recipEterm) {
     const unsigned int zsize = gridz/2+1;
     const unsigned int yzsize = gridy*zsize;
 
@@ -304,7 +558,7 @@ static void reciprocalConvolution(int start, int end, fftwf_complex* grid, int g
         for (int ky = 0; ky < gridy; ky++) {
             for (int kz = firstz; kz < zsize; kz++) {
                 int index = kx*yzsize + ky*zsize + kz;
-                float eterm = recipEterm[index];
+                REAL eterm = recipEterm[index];
                 grid[index][0] *= eterm;
                 grid[index][1] *= eterm;
             }
@@ -313,7 +567,57 @@ static void reciprocalConvolution(int start, int end, fftwf_complex* grid, int g
     }
 }
 
-static void interpolateForces(int start, int end, float* posq, float* force, float* grid, int gridx, int gridy, int gridz, int numParticles, Vec3 periodicBoxSize) {
+/**
+ * Interpolate the forces on a range of atoms from the potential grid.  The B-splines are evaluated and the
+ * forces are accumulated in the precision of the force array.
+ */
+template <class POS, class GRID, class FORCE>
+static void interpolateForces(int start, int end, const POS* posq, FORCE* force, const GRID* grid, int gridx, int gridy, int gridz, int numParticles, Vec3 periodicBoxSize) {
+    FORCE boxSize[3] = {(FORCE) periodicBoxSize[0], (FORCE) periodicBoxSize[1], (FORCE) periodicBoxSize[2]};
+    FORCE invBoxSize[3] = {(FORCE) (1/periodicBoxSize[0]), (FORCE) (1/periodicBoxSize[1]), (FORCE) (1/periodicBoxSize[2])};
+    int gridSize[3] = {gridx, gridy, gridz};
+    const FORCE epsilonFactor = (FORCE) sqrt(ONE_4PI_EPS0);
+    for (int i = start; i < end; i++) {
+        FORCE pos[3] = {(FORCE) posq[4*i], (FORCE) posq[4*i+1], (FORCE) posq[4*i+2]};
+        int gridIndex[3];
+        FORCE dr[3];
+        findGridIndex(pos, boxSize, invBoxSize, gridSize, gridIndex, dr);
+        FORCE data[3][PME_ORDER], ddata[3][PME_ORDER];
+        for (int j = 0; j < 3; j++)
+            computeBSplines(dr[j], data[j], ddata[j]);
+        int zindex[PME_ORDER];
+        for (int j = 0; j < PME_ORDER; j++) {
+            zindex[j] = gridIndex[2]+j;
+            zindex[j] -= (zindex[j] >= gridz ? gridz : 0);
+        }
+        FORCE f[3] = {0, 0, 0};
+        for (int ix = 0; ix < PME_ORDER; ix++) {
+            int xbase = gridIndex[0]+ix;
+            xbase -= (xbase >= gridx ? gridx : 0);
+            xbase = xbase*gridy*gridz;
+            for (int iy = 0; iy < PME_ORDER; iy++) {
+                int ybase = gridIndex[1]+iy;
+                ybase -= (ybase >= gridy ? gridy : 0);
+                ybase = xbase + ybase*gridz;
+                FORCE sum = 0, dsum = 0;
+                for (int iz = 0; iz < PME_ORDER; iz++) {
+                    FORCE gridValue = grid[ybase+zindex[iz]];
+                    sum += data[2][iz]*gridValue;
+                    dsum += ddata[2][iz]*gridValue;
+                }
+                f[0] += ddata[0][ix]*data[1][iy]*sum;
+                f[1] += data[0][ix]*ddata[1][iy]*sum;
+                f[2] += data[0][ix]*data[1][iy]*dsum;
+            }
+        }
+        FORCE scale = -epsilonFactor*(FORCE) posq[4*i+3];
+        for (int j = 0; j < 3; j++)
+            force[4*i+j] = scale*f[j]*gridSize[j]*invBoxSize[j];
+    }
+}
+
+template <>
+void interpolateForces<float, float, float>(int start, int end, const float* posq, float* force, const float* grid, int gridx, int gridy, int gridz, int numParticles, Vec3 periodicBoxSize) {
     __m128 boxSize = _mm_set_ps(0, (float) periodicBoxSize[2], (float) periodicBoxSize[1], (float) periodicBoxSize[0]);
     __m128 invBoxSize = _mm_set_ps(0, (float) (1/periodicBoxSize[2]), (float) (1/periodicBoxSize[1]), (float) (1/periodicBoxSize[0]));
     __m128 gridSize = _mm_set_ps(0, gridz, gridy, gridx);
@@ -400,7 +704,8 @@ public:
     CpuCalcPmeReciprocalForceKernel& owner;
     int index;
     float* tempGrid;
-    ThreadData(CpuCalcPmeReciprocalForceKernel& owner, int index) : owner(owner), index(index), tempGrid(NULL) {
+    double* tempGridDouble;
+    ThreadData(CpuCalcPmeReciprocalForceKernel& owner, int index) : owner(owner), index(index), tempGrid(NULL), tempGridDouble(NULL) {
     }
 };
 
@@ -409,47 +714,147 @@ static void* threadBody(void* args) {
     data.owner.runThread(data.index);
     if (data.tempGrid != NULL)
         fftwf_free(data.tempGrid);
+#ifdef OPENMM_PME_USE_DOUBLE_FFTW
+    if (data.tempGridDouble != NULL)
+        fftw_free(data.tempGridDouble);
+#endif
     delete &data;
     return 0;
 }
 
 void CpuCalcPmeReciprocalForceKernel::initialize(int xsize, int ysize, int zsize, int numParticles, double alpha) {
+    initialize(xsize, ysize, zsize, numParticles, alpha, SinglePrecision);
+}
+
+void CpuCalcPmeReciprocalForceKernel::initialize(int xsize, int ysize, int zsize, int numParticles, double alpha, Precision precision) {
+    if (!isPrecisionSupported(precision))
+        throw OpenMMException("CpuCalcPmeReciprocalForceKernel: double precision requires the double precision FFTW library");
     if (!hasInitializedThreads) {
         numThreads = getNumProcessors();
         fftwf_init_threads();
+#ifdef OPENMM_PME_USE_DOUBLE_FFTW
+        fftw_init_threads();
+#endif
         hasInitializedThreads = true;
     }
+    this->precision = precision;
     gridx = findFFTDimension(xsize);
     gridy = findFFTDimension(ysize);
     gridz = findFFTDimension(zsize);
     this->numParticles = numParticles;
     this->alpha = alpha;
-    force.resize(4*numParticles);
-    recipEterm.resize(gridx*gridy*gridz);
+    if (precision == SinglePrecision)
+        force.resize(4*numParticles);
+    else
+        forceDouble.resize(4*numParticles);
+    if (precision == DoublePrecision)
+        recipEtermDouble.resize(gridx*gridy*gridz);
+    else
+        recipEterm.resize(gridx*gridy*gridz);
     
     // Initialize threads.
     
-    pthread_cond_init(&startCondition, NULL);
-    pthread_cond_init(&endCondition, NULL);
     pthread_cond_init(&mainThreadStartCondition, NULL);
     pthread_cond_init(&mainThreadEndCondition, NULL);
     pthread_mutex_init(&lock, NULL);
     thread.resize(numThreads);
+    isFinished = true;
+
+    // The worker threads and the main thread all meet at the barrier between phases of the calculation.
+
+    barrier = new ThreadBarrier(numThreads+1);
+
+    // Each thread spreads charge onto its own slab of x planes, plus the PME_ORDER-1 planes after it that its
+    // atoms can also touch.  Only those overlapping planes need to be combined between threads.
+
+    slabStart.resize(numThreads+1);
+    for (int i = 0; i <= numThreads; i++)
+        slabStart[i] = (i*gridx)/numThreads;
+    planeSlab.resize(gridx);
+    for (int i = 0; i < numThreads; i++)
+        for (int j = slabStart[i]; j < slabStart[i+1]; j++)
+            planeSlab[j] = i;
+    atomGridX.resize(numParticles);
+    slabAtoms.resize(numParticles);
+    slabAtomStart.resize(numThreads+1);
+    slabGrids.resize(numThreads, NULL);
+    slabGridsDouble.resize(numThreads, NULL);
     for (int i = 0; i < numThreads; i++) {
         ThreadData* data = new ThreadData(*this, i);
         threadData.push_back(data);
+        int numPlanes = slabStart[i+1]-slabStart[i]+PME_ORDER-1;
+#ifdef OPENMM_PME_USE_DOUBLE_FFTW
+        if (precision == DoublePrecision) {
+            data->tempGridDouble = (double*) fftw_malloc(sizeof(double)*numPlanes*gridy*gridz);
+            slabGridsDouble[i] = data->tempGridDouble;
+        }
+        else
+#endif
+        {
+            data->tempGrid = (float*) fftwf_malloc(sizeof(float)*(numPlanes*gridy*gridz+3));
+            slabGrids[i] = data->tempGrid;
+        }
         pthread_create(&thread[i], NULL, threadBody, data);
-        data->tempGrid = (float*) fftwf_malloc(sizeof(float)*(gridx*gridy*gridz+3));
     }
     pthread_create(&mainThread, NULL, threadBody, new ThreadData(*this, -1));
+    hasStartedThreads = true;
     
-    // Initialize FFTW.
+    // Initialize FFTW.  If wisdom is being saved, first try to create the plans purely from the stored wisdom.
+    // Only if that fails are they measured, and the new wisdom saved.  The file lock keeps concurrent processes
+    // from measuring the same transforms at once.
     
-    realGrid = threadData[0]->tempGrid;
-    complexGrid = (fftwf_complex*) fftwf_malloc(sizeof(fftwf_complex)*gridx*gridy*(gridz/2+1));
-    fftwf_plan_with_nthreads(numThreads);
-    forwardFFT = fftwf_plan_dft_r2c_3d(gridx, gridy, gridz, realGrid, complexGrid, FFTW_MEASURE);
-    backwardFFT = fftwf_plan_dft_c2r_3d(gridx, gridy, gridz, complexGrid, realGrid, FFTW_MEASURE);
+    unsigned int flags = (getUsePatientPlans() ? FFTW_PATIENT : FFTW_MEASURE);
+    string wisdomFile = getWisdomFile(precision == DoublePrecision);
+    ReferenceFFTWPlannerLock::lock();
+    {
+        WisdomFileLock fileLock(wisdomFile == "" ? "" : wisdomFile+".lock");
+#ifdef OPENMM_PME_USE_DOUBLE_FFTW
+        if (precision == DoublePrecision) {
+            realGridDouble = (double*) fftw_malloc(sizeof(double)*gridx*gridy*gridz);
+            complexGridDouble = (fftw_complex*) fftw_malloc(sizeof(fftw_complex)*gridx*gridy*(gridz/2+1));
+            fftw_plan_with_nthreads(numThreads);
+            forwardFFTDouble = NULL;
+            backwardFFTDouble = NULL;
+            if (wisdomFile != "" && fftw_import_wisdom_from_filename(wisdomFile.c_str())) {
+                forwardFFTDouble = fftw_plan_dft_r2c_3d(gridx, gridy, gridz, realGridDouble, complexGridDouble, flags | FFTW_WISDOM_ONLY);
+                backwardFFTDouble = fftw_plan_dft_c2r_3d(gridx, gridy, gridz, complexGridDouble, realGridDouble, flags | FFTW_WISDOM_ONLY);
+            }
+            if (forwardFFTDouble == NULL || backwardFFTDouble == NULL) {
+                if (forwardFFTDouble != NULL)
+                    fftw_destroy_plan(forwardFFTDouble);
+                if (backwardFFTDouble != NULL)
+                    fftw_destroy_plan(backwardFFTDouble);
+                forwardFFTDouble = fftw_plan_dft_r2c_3d(gridx, gridy, gridz, realGridDouble, complexGridDouble, flags);
+                backwardFFTDouble = fftw_plan_dft_c2r_3d(gridx, gridy, gridz, complexGridDouble, realGridDouble, flags);
+                if (wisdomFile != "")
+                    saveWisdom(wisdomFile, true);
+            }
+        }
+        else
+#endif
+        {
+            realGrid = (float*) fftwf_malloc(sizeof(float)*(gridx*gridy*gridz+3));
+            complexGrid = (fftwf_complex*) fftwf_malloc(sizeof(fftwf_complex)*gridx*gridy*(gridz/2+1));
+            fftwf_plan_with_nthreads(numThreads);
+            forwardFFT = NULL;
+            backwardFFT = NULL;
+            if (wisdomFile != "" && fftwf_import_wisdom_from_filename(wisdomFile.c_str())) {
+                forwardFFT = fftwf_plan_dft_r2c_3d(gridx, gridy, gridz, realGrid, complexGrid, flags | FFTW_WISDOM_ONLY);
+                backwardFFT = fftwf_plan_dft_c2r_3d(gridx, gridy, gridz, complexGrid, realGrid, flags | FFTW_WISDOM_ONLY);
+            }
+            if (forwardFFT == NULL || backwardFFT == NULL) {
+                if (forwardFFT != NULL)
+                    fftwf_destroy_plan(forwardFFT);
+                if (backwardFFT != NULL)
+                    fftwf_destroy_plan(backwardFFT);
+                forwardFFT = fftwf_plan_dft_r2c_3d(gridx, gridy, gridz, realGrid, complexGrid, flags);
+                backwardFFT = fftwf_plan_dft_c2r_3d(gridx, gridy, gridz, complexGrid, realGrid, flags);
+                if (wisdomFile != "")
+                    saveWisdom(wisdomFile, false);
+            }
+        }
+    }
+    ReferenceFFTWPlannerLock::unlock();
     hasCreatedPlan = true;
     
     // Initialize the b-spline moduli.
@@ -491,7 +896,7 @@ void CpuCalcPmeReciprocalForceKernel::initialize(int xsize, int ysize, int zsize
     bsplineModuli[2].resize(gridz);
     for (int dim = 0; dim < 3; dim++) {
         int ndata = bsplineModuli[dim].size();
-        vector<float>& moduli = bsplineModuli[dim];
+        vector<double>& moduli = bsplineModuli[dim];
         for (int i = 0; i < ndata; i++) {
             double sc = 0.0;
             double ss = 0.0;
@@ -500,33 +905,55 @@ void CpuCalcPmeReciprocalForceKernel::initialize(int xsize, int ysize, int zsize
                 sc += bsplinesData[j]*cos(arg);
                 ss += bsplinesData[j]*sin(arg);
             }
-            moduli[i] = (float) (sc*sc+ss*ss);
+            moduli[i] = sc*sc+ss*ss;
         }
         for (int i = 0; i < ndata; i++)
-            if (moduli[i] < 1.0e-7f)
-                moduli[i] = (moduli[i-1]+moduli[i+1])*0.5f;
+            if (moduli[i] < 1.0e-7)
+                moduli[i] = (moduli[i-1]+moduli[i+1])*0.5;
     }
 }
 
 CpuCalcPmeReciprocalForceKernel::~CpuCalcPmeReciprocalForceKernel() {
-    isDeleted = true;
-    pthread_mutex_lock(&lock);
-    pthread_cond_broadcast(&startCondition);
-    pthread_cond_broadcast(&mainThreadStartCondition);
-    pthread_mutex_unlock(&lock);
-    for (int i = 0; i < (int) thread.size(); i++)
-        pthread_join(thread[i], NULL);
-    pthread_join(mainThread, NULL);
-    pthread_mutex_destroy(&lock);
-    pthread_cond_destroy(&startCondition);
-    pthread_cond_destroy(&endCondition);
-    pthread_cond_destroy(&mainThreadStartCondition);
-    pthread_cond_destroy(&mainThreadEndCondition);
+    if (hasStartedThreads) {
+        // The threads and synchronization objects only exist if initialize() got far enough to create them.
+
+        pthread_mutex_lock(&lock);
+        isDeleted = true;
+        pthread_cond_broadcast(&mainThreadStartCondition);
+        pthread_mutex_unlock(&lock);
+        for (int i = 0; i < (int) thread.size(); i++)
+            pthread_join(thread[i], NULL);
+        pthread_join(mainThread, NULL);
+        pthread_mutex_destroy(&lock);
+        pthread_cond_destroy(&mainThreadStartCondition);
+        pthread_cond_destroy(&mainThreadEndCondition);
+    }
+    if (barrier != NULL)
+        delete barrier;
+    if (realGrid != NULL)
+        fftwf_free(realGrid);
     if (complexGrid != NULL)
         fftwf_free(complexGrid);
+#ifdef OPENMM_PME_USE_DOUBLE_FFTW
+    if (realGridDouble != NULL)
+        fftw_free(realGridDouble);
+    if (complexGridDouble != NULL)
+        fftw_free(complexGridDouble);
+#endif
     if (hasCreatedPlan) {
-        fftwf_destroy_plan(forwardFFT);
-        fftwf_destroy_plan(backwardFFT);
+        ReferenceFFTWPlannerLock::lock();
+#ifdef OPENMM_PME_USE_DOUBLE_FFTW
+        if (precision == DoublePrecision) {
+            fftw_destroy_plan(forwardFFTDouble);
+            fftw_destroy_plan(backwardFFTDouble);
+        }
+        else
+#endif
+        {
+            fftwf_destroy_plan(forwardFFT);
+            fftwf_destroy_plan(backwardFFT);
+        }
+        ReferenceFFTWPlannerLock::unlock();
     }
 }
 
@@ -538,25 +965,48 @@ void CpuCalcPmeReciprocalForceKernel::runThread(int index) {
         while (true) {
             // Wait for the signal to start.
             
-            pthread_cond_wait(&mainThreadStartCondition, &lock);
-            if (isDeleted)
+            while (isFinished && !isDeleted)
+                pthread_cond_wait(&mainThreadStartCondition, &lock);
+            pthread_mutex_unlock(&lock);
+            if (isDeleted) {
+                barrier->wait(); // Release the worker threads so they can exit.
                 break;
-            posq = io->getPosq();
-            advanceThreads(); // Signal threads to perform charge spreading.
-            advanceThreads(); // Signal threads to sum the charge grids.
-            fftwf_execute_dft_r2c(forwardFFT, realGrid, complexGrid);
+            }
+            if (precision == DoublePrecision)
+                posqDouble = io->getPosqDouble();
+            else
+                posq = io->getPosq();
+            barrier->wait(); // Start threads finding the grid slab containing each atom.
+            barrier->wait(); // Wait for them to finish.
+            sortAtomsBySlab();
+            barrier->wait(); // Start threads performing charge spreading.
+            barrier->wait(); // Wait while they spread charge, then sum the charge grids.
+            barrier->wait();
+#ifdef OPENMM_PME_USE_DOUBLE_FFTW
+            if (precision == DoublePrecision)
+                fftw_execute_dft_r2c(forwardFFTDouble, realGridDouble, complexGridDouble);
+            else
+#endif
+                fftwf_execute_dft_r2c(forwardFFT, realGrid, complexGrid);
+            barrier->wait(); // Start threads computing the reciprocal scale factors, energy, and convolution.
             if (lastBoxSize != periodicBoxSize)
-                advanceThreads(); // Signal threads to compute the reciprocal scale factors.
+                barrier->wait();
             if (includeEnergy)
-                advanceThreads(); // Signal threads to compute energy.
-            advanceThreads(); // Signal threads to perform reciprocal convolution.
-            fftwf_execute_dft_c2r(backwardFFT, complexGrid, realGrid);
-            advanceThreads(); // Signal threads to interpolate forces.
-            isFinished = true;
+                barrier->wait();
+            barrier->wait();
+#ifdef OPENMM_PME_USE_DOUBLE_FFTW
+            if (precision == DoublePrecision)
+                fftw_execute_dft_c2r(backwardFFTDouble, complexGridDouble, realGridDouble);
+            else
+#endif
+                fftwf_execute_dft_c2r(backwardFFT, complexGrid, realGrid);
+            barrier->wait(); // Start threads interpolating forces.
+            barrier->wait(); // Wait for them to finish.
             lastBoxSize = periodicBoxSize;
+            pthread_mutex_lock(&lock);
+            isFinished = true;
             pthread_cond_signal(&mainThreadEndCondition);
         }
-        pthread_mutex_unlock(&lock);
     }
     else {
         // This is a worker thread.
@@ -565,55 +1015,80 @@ void CpuCalcPmeReciprocalForceKernel::runThread(int index) {
         int particleEnd = ((index+1)*numParticles)/numThreads;
         int gridxStart = (index*gridx)/numThreads;
         int gridxEnd = ((index+1)*gridx)/numThreads;
-        int gridSize = (gridx*gridy*gridz+3)/4;
-        int gridStart = 4*((index*gridSize)/numThreads);
-        int gridEnd = 4*(((index+1)*gridSize)/numThreads);
+        int slabPlanes = slabStart[index+1]-slabStart[index]+PME_ORDER-1;
         while (true) {
-            threadWait();
+            barrier->wait();
             if (isDeleted)
                 break;
-            spreadCharge(particleStart, particleEnd, posq, threadData[index]->tempGrid, gridx, gridy, gridz, numParticles, periodicBoxSize);
-            threadWait();
-            int numGrids = threadData.size();
-            for (int i = gridStart; i < gridEnd; i += 4) {
-                __m128 sum = _mm_load_ps(&realGrid[i]);
-                for (int j = 1; j < numGrids; j++)
-                    sum = _mm_add_ps(sum, _mm_load_ps(&threadData[j]->tempGrid[i]));
-                _mm_store_ps(&realGrid[i], sum);
+            bool isDouble = (precision == DoublePrecision);
+            if (isDouble)
+                findAtomGridX(particleStart, particleEnd, posqDouble, &atomGridX[0], gridx, gridy, gridz, periodicBoxSize);
+            else
+                findAtomGridX(particleStart, particleEnd, posq, &atomGridX[0], gridx, gridy, gridz, periodicBoxSize);
+            barrier->wait();
+            barrier->wait(); // The main thread sorts the atoms by slab.
+            int numSlabAtoms = slabAtomStart[index+1]-slabAtomStart[index];
+            if (slabStart[index+1] > slabStart[index]) {
+                if (isDouble)
+                    spreadCharge(&slabAtoms[slabAtomStart[index]], numSlabAtoms, posqDouble, threadData[index]->tempGridDouble, slabStart[index], slabPlanes, gridx, gridy, gridz, periodicBoxSize);
+                else
+                    spreadCharge(&slabAtoms[slabAtomStart[index]], numSlabAtoms, posq, threadData[index]->tempGrid, slabStart[index], slabPlanes, gridx, gridy, gridz, periodicBoxSize);
             }
-            threadWait();
+            barrier->wait();
+            if (isDouble)
+                sumSlabs(slabStart[index], slabStart[index+1], realGridDouble, slabGridsDouble, slabStart, gridx, gridy, gridz);
+            else
+                sumSlabs(slabStart[index], slabStart[index+1], realGrid, slabGrids, slabStart, gridx, gridy, gridz);
+            barrier->wait();
+            barrier->wait(); // The main thread performs the forward FFT.
             if (lastBoxSize != periodicBoxSize) {
-                computeReciprocalEterm(gridxStart, gridxEnd, gridx, gridy, gridz, recipEterm, alpha, bsplineModuli, periodicBoxSize);
-                threadWait();
+                if (isDouble)
+                    computeReciprocalEterm(gridxStart, gridxEnd, gridx, gridy, gridz, recipEtermDouble, alpha, bsplineModuli, periodicBoxSize);
+                else
+                    computeReciprocalEterm(gridxStart, gridxEnd, gridx, gridy, gridz, recipEterm, alpha, bsplineModuli, periodicBoxSize);
+                barrier->wait();
             }
             if (includeEnergy) {
-                double threadEnergy = reciprocalEnergy(gridxStart, gridxEnd, complexGrid, gridx, gridy, gridz, alpha, bsplineModuli, periodicBoxSize);
+                double threadEnergy;
+                if (isDouble)
+                    threadEnergy = reciprocalEnergy(gridxStart, gridxEnd, complexGridDouble, gridx, gridy, gridz, alpha, bsplineModuli, periodicBoxSize);
+                else
+                    threadEnergy = reciprocalEnergy(gridxStart, gridxEnd, complexGrid, gridx, gridy, gridz, alpha, bsplineModuli, periodicBoxSize);
                 pthread_mutex_lock(&lock);
                 energy += threadEnergy;
                 pthread_mutex_unlock(&lock);
-                threadWait();
+                barrier->wait();
             }
-            reciprocalConvolution(gridxStart, gridxEnd, complexGrid, gridx, gridy, gridz, recipEterm);
-            threadWait();
-            interpolateForces(particleStart, particleEnd, posq, &force[0], realGrid, gridx, gridy, gridz, numParticles, periodicBoxSize);
+            if (isDouble)
+                reciprocalConvolution(gridxStart, gridxEnd, complexGridDouble, gridx, gridy, gridz, recipEtermDouble);
+            else
+                reciprocalConvolution(gridxStart, gridxEnd, complexGrid, gridx, gridy, gridz, recipEterm);
+            barrier->wait();
+            barrier->wait(); // The main thread performs the backward FFT.
+            if (precision == SinglePrecision)
+                interpolateForces(particleStart, particleEnd, posq, &force[0], realGrid, gridx, gridy, gridz, numParticles, periodicBoxSize);
+            else if (precision == MixedPrecision)
+                interpolateForces(particleStart, particleEnd, posq, &forceDouble[0], realGrid, gridx, gridy, gridz, numParticles, periodicBoxSize);
+            else
+                interpolateForces(particleStart, particleEnd, posqDouble, &forceDouble[0], realGridDouble, gridx, gridy, gridz, numParticles, periodicBoxSize);
+            barrier->wait();
         }
     }
 }
 
-void CpuCalcPmeReciprocalForceKernel::threadWait() {
-    pthread_mutex_lock(&lock);
-    waitCount++;
-    pthread_cond_signal(&endCondition);
-    pthread_cond_wait(&startCondition, &lock);
-    pthread_mutex_unlock(&lock);
-}
+void CpuCalcPmeReciprocalForceKernel::sortAtomsBySlab() {
+    // Do a counting sort of the atoms based on which thread's slab they start in.
 
-void CpuCalcPmeReciprocalForceKernel::advanceThreads() {
-    waitCount = 0;
-    pthread_cond_broadcast(&startCondition);
-    while (waitCount < numThreads) {
-        pthread_cond_wait(&endCondition, &lock);
-    }
+    int numSlabs = slabStart.size()-1;
+    for (int i = 0; i <= numSlabs; i++)
+        slabAtomStart[i] = 0;
+    for (int i = 0; i < numParticles; i++)
+        slabAtomStart[planeSlab[atomGridX[i]]+1]++;
+    for (int i = 0; i < numSlabs; i++)
+        slabAtomStart[i+1] += slabAtomStart[i];
+    vector<int> offset(slabAtomStart.begin(), slabAtomStart.end()-1);
+    for (int i = 0; i < numParticles; i++)
+        slabAtoms[offset[planeSlab[atomGridX[i]]]++] = i;
 }
 
 void CpuCalcPmeReciprocalForceKernel::beginComputation(IO& io, Vec3 periodicBoxSize, bool includeEnergy) {
@@ -633,10 +1108,21 @@ double CpuCalcPmeReciprocalForceKernel::finishComputation(IO& io) {
         pthread_cond_wait(&mainThreadEndCondition, &lock);
     }
     pthread_mutex_unlock(&lock);
-    io.setForce(&force[0]);
+    if (precision == SinglePrecision)
+        io.setForce(&force[0]);
+    else
+        io.setForceDouble(&forceDouble[0]);
     return energy;
 }
 
+bool CpuCalcPmeReciprocalForceKernel::isPrecisionSupported(Precision precision) {
+#ifdef OPENMM_PME_USE_DOUBLE_FFTW
+    return true;
+#else
+    return (precision != DoublePrecision);
+#endif
+}
+
 bool CpuCalcPmeReciprocalForceKernel::isProcessorSupported() {
     int cpuInfo[4];
     cpuid(cpuInfo, 0);
@@ -647,6 +1133,42 @@ bool CpuCalcPmeReciprocalForceKernel::isProcessorSupported() {
     return false;
 }
 
+const string& CpuCalcPmeReciprocalForceKernel::getWisdomPath() {
+    readPlanningOptions();
+    return wisdomPath;
+}
+
+void CpuCalcPmeReciprocalForceKernel::setWisdomPath(const string& path) {
+    readPlanningOptions();
+    wisdomPath = path;
+}
+
+bool CpuCalcPmeReciprocalForceKernel::getUsePatientPlans() {
+    readPlanningOptions();
+    return usePatientPlans;
+}
+
+void CpuCalcPmeReciprocalForceKernel::setUsePatientPlans(bool patient) {
+    readPlanningOptions();
+    usePatientPlans = patient;
+}
+
+string CpuCalcPmeReciprocalForceKernel::getWisdomFile(bool doublePrecision) {
+    string path = getWisdomPath();
+    if (path == "")
+        return path;
+    struct stat info;
+    if (stat(path.c_str(), &info) == 0 && (info.st_mode & S_IFDIR) != 0) {
+#ifdef WIN32
+        string separator = "\\";
+#else
+        string separator = "/";
+#endif
+        return path+separator+(doublePrecision ? "fftw_wisdom" : "fftwf_wisdom");
+    }
+    return (doublePrecision ? path+".double" : path);
+}
+
 int CpuCalcPmeReciprocalForceKernel::findFFTDimension(int minimum) {
     if (minimum < 1)
         return 1;
@@ -35,6 +35,7 @@
 #include "internal/windowsExportPme.h"
 #include "openmm/kernels.h"
 #include "openmm/Vec3.h"
+#include "openmm/internal/ThreadBarrier.h"
 #include <fftw3.h>
 #include <pthread.h>
 #include <vector>
@@ -44,13 +45,16 @@ namespace OpenMM {
 /**
  * This is an optimized CPU implementation of CalcPmeReciprocalForceKernel.  It is both
  * vectorized (requiring SSE 4.1) and multithreaded.  It uses FFTW to perform the FFTs.
+ * It supports all three precision modes.  Only the single precision parts of the
+ * calculation are vectorized.
  */
 
 class OPENMM_EXPORT_PME CpuCalcPmeReciprocalForceKernel : public CalcPmeReciprocalForceKernel {
 public:
     class ThreadData;
     CpuCalcPmeReciprocalForceKernel(std::string name, const Platform& platform) : CalcPmeReciprocalForceKernel(name, platform),
-            hasCreatedPlan(false), isDeleted(false), realGrid(NULL), complexGrid(NULL) {
+            hasCreatedPlan(false), hasStartedThreads(false), isDeleted(false), precision(SinglePrecision), realGrid(NULL), complexGrid(NULL),
+            realGridDouble(NULL), complexGridDouble(NULL), barrier(NULL) {
     }
     /**
      * Initialize the kernel.
@@ -62,6 +66,17 @@ public:
      * @param alpha        the Ewald blending parameter
      */
     void initialize(int xsize, int ysize, int zsize, int numParticles, double alpha);
+    /**
+     * Initialize the kernel to use a particular precision.
+     * 
+     * @param gridx        the x size of the PME grid
+     * @param gridy        the y size of the PME grid
+     * @param gridz        the z size of the PME grid
+     * @param numParticles the number of particles in the system
+     * @param alpha        the Ewald blending parameter
+     * @param precision    the precision to perform the calculation in
+     */
+    void initialize(int xsize, int ysize, int zsize, int numParticles, double alpha, Precision precision);
     ~CpuCalcPmeReciprocalForceKernel();
     /**
      * Begin computing the force and energy.
@@ -82,37 +97,83 @@ public:
      * This routine contains the code executed by each thread.
      */
     void runThread(int index);
+    /**
+     * Get whether this kernel can be initialized with a particular precision.
+     */
+    bool supportsPrecision(Precision precision) const {
+        return isPrecisionSupported(precision);
+    }
     /**
      * Get whether the current CPU supports all features needed by this kernel.
      */
     static bool isProcessorSupported();
-private:
     /**
-     * This is called by the worker threads to wait until the master thread instructs them to advance.
+     * Get whether this build of the plugin supports a particular precision.  Double precision requires
+     * the double precision FFTW library, which is optional.  Single and mixed precision only need the
+     * single precision library.
      */
-    void threadWait();
+    static bool isPrecisionSupported(Precision precision);
     /**
-     * This is called by the master thread to instruct all the worker threads to advance.
+     * Get the location where FFTW wisdom is stored.  See setWisdomPath() for details.
      */
-    void advanceThreads();
+    static const std::string& getWisdomPath();
+    /**
+     * Set the location where FFTW wisdom is stored, so FFT plans measured by one process can be reused
+     * by later ones.  This may be either a directory or a file.  If it is a directory, single and double
+     * precision wisdom are stored in files called "fftwf_wisdom" and "fftw_wisdom" inside it.  If it is
+     * a file, single precision wisdom is stored in it and double precision wisdom is stored in a second
+     * file with ".double" appended to the name.  Access to the files is protected by a lock file, so
+     * multiple processes may share them.  An empty string means wisdom is not saved.  The default value
+     * is taken from the OPENMM_FFTW_WISDOM environment variable.
+     */
+    static void setWisdomPath(const std::string& path);
+    /**
+     * Get whether FFT plans are created with FFTW_PATIENT rather than FFTW_MEASURE.
+     */
+    static bool getUsePatientPlans();
+    /**
+     * Set whether FFT plans are created with FFTW_PATIENT rather than FFTW_MEASURE.  Patient planning
+     * often finds faster plans but takes much longer, so it is mainly useful in combination with
+     * setWisdomPath(): the plans are measured once and then reused.  The default value is true if
+     * the OPENMM_FFTW_PATIENT environment variable is set to anything other than "0" or "false".
+     */
+    static void setUsePatientPlans(bool patient);
+private:
+    /**
+     * Sort the atoms based on which thread's slab of the grid they should be spread onto.
+     */
+    void sortAtomsBySlab();
     /**
      * Select a size for one grid dimension that FFTW can handle efficiently.
      */
     int findFFTDimension(int minimum);
+    /**
+     * Get the file in which to store FFTW wisdom for one precision, or an empty string if it is not stored.
+     */
+    static std::string getWisdomFile(bool doublePrecision);
     static bool hasInitializedThreads;
     static int numThreads;
     int gridx, gridy, gridz, numParticles;
     double alpha;
-    bool hasCreatedPlan, isFinished, isDeleted;
+    bool hasCreatedPlan, hasStartedThreads, isFinished, isDeleted;
+    Precision precision;
     std::vector<float> force;
-    std::vector<float> bsplineModuli[3];
+    std::vector<double> forceDouble;
+    std::vector<double> bsplineModuli[3];
     std::vector<float> recipEterm;
+    std::vector<double> recipEtermDouble;
     Vec3 lastBoxSize;
+    // Single and mixed precision use the single precision grids and plans, while double precision uses the double precision ones.
     float* realGrid;
     fftwf_complex* complexGrid;
     fftwf_plan forwardFFT, backwardFFT;
-    int waitCount;
-    pthread_cond_t startCondition, endCondition;
+    double* realGridDouble;
+    fftw_complex* complexGridDouble;
+    fftw_plan forwardFFTDouble, backwardFFTDouble;
+    std::vector<int> slabStart, planeSlab, atomGridX, slabAtoms, slabAtomStart;
+    std::vector<float*> slabGrids;
+    std::vector<double*> slabGridsDouble;
+    ThreadBarrier* barrier;
     pthread_cond_t mainThreadStartCondition, mainThreadEndCondition;
     pthread_mutex_t lock;
     pthread_t mainThread;
@@ -120,8 +181,9 @@ private:
     std::vector<ThreadData*> threadData;
     // The following variables are used to store information about the calculation currently being performed.
     IO* io;
-    float energy;
+    double energy;
     float* posq;
+    double* posqDouble;
     Vec3 periodicBoxSize;
     bool includeEnergy;
 };
@@ -40,32 +40,53 @@
 #include "openmm/System.h"
 #include "openmm/VerletIntegrator.h"
 #include "openmm/internal/ContextImpl.h"
+#include "ReferencePlatform.h"
 #include "../src/CpuPmeKernels.h"
 #include "SimTKOpenMMRealType.h"
 #include "sfmt/SFMT.h"
+#include <fftw3.h>
+#include <cstdio>
+#include <fstream>
 #include <iostream>
+#include <map>
 #include <vector>
 
 using namespace OpenMM;
 using namespace std;
 
+extern "C" void registerCpuPmeKernelFactories();
+
 class IO : public CalcPmeReciprocalForceKernel::IO {
 public:
     vector<float> posq;
+    vector<double> posqDouble;
     float* force;
+    double* forceDouble;
+    IO() : force(NULL), forceDouble(NULL) {
+    }
     float* getPosq() {
         return &posq[0];
     }
+    double* getPosqDouble() {
+        return &posqDouble[0];
+    }
     void setForce(float* force) {
         this->force = force;
     }
+    void setForceDouble(double* force) {
+        forceDouble = force;
+    }
+    Vec3 getForce(int i) {
+        if (force != NULL)
+            return Vec3(force[4*i], force[4*i+1], force[4*i+2]);
+        return Vec3(forceDouble[4*i], forceDouble[4*i+1], forceDouble[4*i+2]);
+    }
 };
 
-void testPME() {
+void testPME(CalcPmeReciprocalForceKernel::Precision precision, double boxWidth, double tol) {
     // Create a cloud of random point charges.
 
     const int numParticles = 51;
-    const double boxWidth = 5.0;
     const double cutoff = 1.0;
     System system;
     system.setDefaultPeriodicBoxVectors(Vec3(boxWidth, 0, 0), Vec3(0, boxWidth, 0), Vec3(0, 0, boxWidth));
@@ -89,7 +110,9 @@ void testPME() {
     
     Platform& platform = Platform::getPlatformByName("Reference");
     VerletIntegrator integrator(0.01);
-    Context context(system, integrator, platform);
+    map<string, string> properties;
+    properties[ReferencePlatform::ReferenceUseCpuPme()] = "false";
+    Context context(system, integrator, platform, properties);
     context.setPositions(positions);
     State refState = context.getState(State::Forces | State::Energy, false, 1<<1);
     
@@ -102,24 +125,190 @@ void testPME() {
     IO io;
     double sumSquaredCharges = 0;
     for (int i = 0; i < numParticles; i++) {
-        io.posq.push_back(positions[i][0]);
-        io.posq.push_back(positions[i][1]);
-        io.posq.push_back(positions[i][2]);
         double charge, sigma, epsilon;
         force->getParticleParameters(i, charge, sigma, epsilon);
+        for (int j = 0; j < 3; j++) {
+            io.posq.push_back(positions[i][j]);
+            io.posqDouble.push_back(positions[i][j]);
+        }
         io.posq.push_back(charge);
+        io.posqDouble.push_back(charge);
         sumSquaredCharges += charge*charge;
     }
     double ewaldSelfEnergy = -ONE_4PI_EPS0*alpha*sumSquaredCharges/sqrt(M_PI);
-    pme.initialize(gridx, gridy, gridz, numParticles, alpha);
+    pme.initialize(gridx, gridy, gridz, numParticles, alpha, precision);
     pme.beginComputation(io, Vec3(boxWidth, boxWidth, boxWidth), true);
     double energy = pme.finishComputation(io);
     
     // See if they match.
     
-    ASSERT_EQUAL_TOL(refState.getPotentialEnergy(), energy+ewaldSelfEnergy, 1e-3);
+    ASSERT((io.force != NULL) == (precision == CalcPmeReciprocalForceKernel::SinglePrecision));
+    ASSERT_EQUAL_TOL(refState.getPotentialEnergy(), energy+ewaldSelfEnergy, tol);
+    for (int i = 0; i < numParticles; i++)
+        ASSERT_EQUAL_VEC(refState.getForces()[i], io.getForce(i), tol);
+}
+
+void testReferenceUsesCpuPme() {
+    // Once the plugin's kernel factory is registered, the reference platform should use it for reciprocal space.
+
+    registerCpuPmeKernelFactories();
+    const int numParticles = 51;
+    const double boxWidth = 5.0;
+    System system;
+    system.setDefaultPeriodicBoxVectors(Vec3(boxWidth, 0, 0), Vec3(0, boxWidth, 0), Vec3(0, 0, boxWidth));
+    NonbondedForce* force = new NonbondedForce();
+    system.addForce(force);
+    vector<Vec3> positions(numParticles);
+    OpenMM_SFMT::SFMT sfmt;
+    init_gen_rand(0, sfmt);
+    for (int i = 0; i < numParticles; i++) {
+        system.addParticle(1.0);
+        force->addParticle(-1.0+i*2.0/(numParticles-1), 0.2, 0.1);
+        positions[i] = Vec3(boxWidth*genrand_real2(sfmt), boxWidth*genrand_real2(sfmt), boxWidth*genrand_real2(sfmt));
+    }
+    force->setNonbondedMethod(NonbondedForce::PME);
+    force->setCutoffDistance(1.0);
+    force->setReciprocalSpaceForceGroup(1);
+    force->setEwaldErrorTolerance(1e-4);
+    Platform& platform = Platform::getPlatformByName("Reference");
+    VerletIntegrator integrator1(0.01);
+    VerletIntegrator integrator2(0.01);
+    map<string, string> properties;
+    properties[ReferencePlatform::ReferenceUseCpuPme()] = "false";
+    Context context1(system, integrator1, platform, properties);
+    properties[ReferencePlatform::ReferenceUseCpuPme()] = "true";
+    Context context2(system, integrator2, platform, properties);
+    context1.setPositions(positions);
+    context2.setPositions(positions);
+    for (int groups = 1; groups < 4; groups++) {
+        State state1 = context1.getState(State::Forces | State::Energy, false, groups);
+        State state2 = context2.getState(State::Forces | State::Energy, false, groups);
+        ASSERT_EQUAL_TOL(state1.getPotentialEnergy(), state2.getPotentialEnergy(), 1e-3);
+        for (int i = 0; i < numParticles; i++)
+            ASSERT_EQUAL_VEC(state1.getForces()[i], state2.getForces()[i], 1e-3);
+    }
+}
+
+/**
+ * Discard all single precision wisdom held in memory, import it from a file, and see whether that is enough
+ * to create the plans the kernel uses for a cubic grid without measuring anything.
+ */
+bool checkWisdomOnlyPlan(const string& wisdomFile, int gridSize) {
+    fftwf_forget_wisdom();
+    if (!fftwf_import_wisdom_from_filename(wisdomFile.c_str()))
+        return false;
+    float* realGrid = (float*) fftwf_malloc(sizeof(float)*(gridSize*gridSize*gridSize+3));
+    fftwf_complex* complexGrid = (fftwf_complex*) fftwf_malloc(sizeof(fftwf_complex)*gridSize*gridSize*(gridSize/2+1));
+    unsigned int flags = (CpuCalcPmeReciprocalForceKernel::getUsePatientPlans() ? FFTW_PATIENT : FFTW_MEASURE) | FFTW_WISDOM_ONLY;
+    fftwf_plan forward = fftwf_plan_dft_r2c_3d(gridSize, gridSize, gridSize, realGrid, complexGrid, flags);
+    fftwf_plan backward = fftwf_plan_dft_c2r_3d(gridSize, gridSize, gridSize, complexGrid, realGrid, flags);
+    bool success = (forward != NULL && backward != NULL);
+    if (forward != NULL)
+        fftwf_destroy_plan(forward);
+    if (backward != NULL)
+        fftwf_destroy_plan(backward);
+    fftwf_free(realGrid);
+    fftwf_free(complexGrid);
+    return success;
+}
+
+void testWisdom() {
+    // Saving wisdom should create the files, and loading it back should give plans that produce the same results.
+
+    const string wisdomFile = "TestCpuPmeWisdom";
+    const string files[] = {wisdomFile, wisdomFile+".lock", wisdomFile+".double", wisdomFile+".double.lock"};
+    for (int i = 0; i < 4; i++)
+        remove(files[i].c_str());
+    CpuCalcPmeReciprocalForceKernel::setWisdomPath(wisdomFile);
+    ASSERT_EQUAL(wisdomFile, CpuCalcPmeReciprocalForceKernel::getWisdomPath());
+    bool testDouble = CpuCalcPmeReciprocalForceKernel::isPrecisionSupported(CalcPmeReciprocalForceKernel::DoublePrecision);
+    for (int repeat = 0; repeat < 2; repeat++) {
+        testPME(CalcPmeReciprocalForceKernel::SinglePrecision, 5.0, 1e-3);
+        ASSERT(ifstream(wisdomFile.c_str()).good());
+        if (testDouble) {
+            testPME(CalcPmeReciprocalForceKernel::DoublePrecision, 5.2, 1e-8);
+            ASSERT(ifstream((wisdomFile+".double").c_str()).good());
+        }
+    }
+
+    // A new process starts with no wisdom in memory.  Importing the file must be enough to create the plans
+    // without measuring anything.
+
+    Platform& platform = Platform::getPlatformByName("Reference");
+    const int gridSize = 24;
+    {
+        CpuCalcPmeReciprocalForceKernel pme(CalcPmeReciprocalForceKernel::Name(), platform);
+        pme.initialize(gridSize, gridSize, gridSize, 1, 3.0, CalcPmeReciprocalForceKernel::SinglePrecision);
+    }
+    ASSERT(checkWisdomOnlyPlan(wisdomFile, gridSize));
+
+    // A corrupt file should be ignored, with the plans measured again and the file replaced by valid wisdom.
+
+    {
+        ofstream out(wisdomFile.c_str());
+        out << "(not wisdom" << endl;
+    }
+    ASSERT(!checkWisdomOnlyPlan(wisdomFile, gridSize));
+    {
+        CpuCalcPmeReciprocalForceKernel pme(CalcPmeReciprocalForceKernel::Name(), platform);
+        pme.initialize(gridSize, gridSize, gridSize, 1, 3.0, CalcPmeReciprocalForceKernel::SinglePrecision);
+    }
+    ASSERT(checkWisdomOnlyPlan(wisdomFile, gridSize));
+    CpuCalcPmeReciprocalForceKernel::setWisdomPath("");
+    for (int i = 0; i < 4; i++)
+        remove(files[i].c_str());
+}
+
+void testInvalidBoxDiscardsPendingPme() {
+    // If an evaluation fails after reciprocal space was started in the background, the next evaluation must
+    // not reuse its results.
+
+    registerCpuPmeKernelFactories();
+    const int numParticles = 51;
+    const double boxWidth = 5.0;
+    System system;
+    system.setDefaultPeriodicBoxVectors(Vec3(boxWidth, 0, 0), Vec3(0, boxWidth, 0), Vec3(0, 0, boxWidth));
+    NonbondedForce* force = new NonbondedForce();
+    system.addForce(force);
+    vector<Vec3> positions(numParticles);
+    OpenMM_SFMT::SFMT sfmt;
+    init_gen_rand(0, sfmt);
+    for (int i = 0; i < numParticles; i++) {
+        system.addParticle(1.0);
+        force->addParticle(-1.0+i*2.0/(numParticles-1), 0.2, 0.1);
+        positions[i] = Vec3(boxWidth*genrand_real2(sfmt), boxWidth*genrand_real2(sfmt), boxWidth*genrand_real2(sfmt));
+    }
+    force->setNonbondedMethod(NonbondedForce::PME);
+    force->setCutoffDistance(1.0);
+    Platform& platform = Platform::getPlatformByName("Reference");
+    VerletIntegrator integrator1(0.01);
+    VerletIntegrator integrator2(0.01);
+    map<string, string> properties;
+    properties[ReferencePlatform::ReferenceUseCpuPme()] = "false";
+    Context context1(system, integrator1, platform, properties);
+    properties[ReferencePlatform::ReferenceUseCpuPme()] = "true";
+    Context context2(system, integrator2, platform, properties);
+    context2.setPositions(positions);
+    context2.getState(State::Forces);
+    context2.setPeriodicBoxVectors(Vec3(1.5, 0, 0), Vec3(0, 1.5, 0), Vec3(0, 0, 1.5));
+    bool threwException = false;
+    try {
+        context2.getState(State::Forces);
+    }
+    catch (const OpenMMException& ex) {
+        threwException = true;
+    }
+    ASSERT(threwException);
+    context2.setPeriodicBoxVectors(Vec3(boxWidth, 0, 0), Vec3(0, boxWidth, 0), Vec3(0, 0, boxWidth));
+    for (int i = 0; i < numParticles; i++)
+        positions[i] += Vec3(0.1, -0.2, 0.3);
+    context1.setPositions(positions);
+    context2.setPositions(positions);
+    State state1 = context1.getState(State::Forces | State::Energy);
+    State state2 = context2.getState(State::Forces | State::Energy);
+    ASSERT_EQUAL_TOL(state1.getPotentialEnergy(), state2.getPotentialEnergy(), 1e-3);
     for (int i = 0; i < numParticles; i++)
-        ASSERT_EQUAL_VEC(refState.getForces()[i], Vec3(io.force[4*i], io.force[4*i+1], io.force[4*i+2]), 1e-3);
+        ASSERT_EQUAL_VEC(state1.getForces()[i], state2.getForces()[i], 1e-3);
 }
 
 int main(int argc, char* argv[]) {
@@ -128,7 +317,17 @@ int main(int argc, char* argv[]) {
             cout << "CPU is not supported.  Exiting." << endl;
             return 0;
         }
-        testPME();
+        testPME(CalcPmeReciprocalForceKernel::SinglePrecision, 5.0, 1e-3);
+        testPME(CalcPmeReciprocalForceKernel::MixedPrecision, 5.0, 1e-3);
+
+        // Use a box for which the kernel does not need to enlarge the grid, so it can match the reference platform closely.
+
+        testPME(CalcPmeReciprocalForceKernel::MixedPrecision, 5.2, 1e-4);
+        if (CpuCalcPmeReciprocalForceKernel::isPrecisionSupported(CalcPmeReciprocalForceKernel::DoublePrecision))
+            testPME(CalcPmeReciprocalForceKernel::DoublePrecision, 5.2, 1e-8);
+        testReferenceUsesCpuPme();
+        testInvalidBoxDiscardsPendingPme();
+        testWisdom();
     }
     catch(const exception& e) {
         cout << "exception: " << e.what() << endl;
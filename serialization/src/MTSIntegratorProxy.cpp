@@ -0,0 +1,65 @@
+/* -------------------------------------------------------------------------- *
+ *                                   OpenMM                                   *
+ * -------------------------------------------------------------------------- *
+ * This is part of the OpenMM molecular simulation toolkit originating from   *
+ * Simbios, the NIH National Center for Physics-Based Simulation of           *
+ * Biological Structures at Stanford, funded under the NIH Roadmap for        *
+ * Medical Research, grant U54 GM072970. See https://simtk.org.               *
+ *                                                                            *
+ * Portions copyright (c) 2013 Stanford University and the Authors.           *
+ * Authors: Peter Eastman, Yutong Zhao                                        *
+ * Contributors:                                                              *
+ *                                                                            *
+ * Permission is hereby granted, free of charge, to any person obtaining a    *
+ * copy of this software and associated documentation files (the "Software"), *
+ * to deal in the Software without restriction, including without limitation  *
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,   *
+ * and/or sell copies of the Software, and to permit persons to whom the      *
+ * Software is furnished to do so, subject to the following conditions:       *
+ *                                                                            *
+ * The above copyright notice and this permission notice shall be included in *
+ * all copies or substantial portions of the Software.                        *
+ *                                                                            *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR *
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,   *
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL    *
+ * THE AUTHORS, CONTRIBUTORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,    *
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR      *
+ * OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE  *
+ * USE OR OTHER DEALINGS IN THE SOFTWARE.                                     *
+ * -------------------------------------------------------------------------- */
+
+#include "openmm/serialization/MTSIntegratorProxy.h"
+#include <OpenMM.h>
+
+using namespace std;
+using namespace OpenMM;
+
+MTSIntegratorProxy::MTSIntegratorProxy() : SerializationProxy("MTSIntegrator") {
+
+}
+
+void MTSIntegratorProxy::serialize(const void* object, SerializationNode& node) const {
+    node.setIntProperty("version", 1);
+    const MTSIntegrator& integrator = *reinterpret_cast<const MTSIntegrator*>(object);
+    node.setDoubleProperty("stepSize", integrator.getStepSize());
+    node.setDoubleProperty("constraintTolerance", integrator.getConstraintTolerance());
+    SerializationNode& groupsNode = node.createChildNode("Groups");
+    const vector<pair<int, int> >& groups = integrator.getGroups();
+    for (int i = 0; i < (int) groups.size(); i++)
+        groupsNode.createChildNode("Group").setIntProperty("group", groups[i].first).setIntProperty("substeps", groups[i].second);
+}
+
+void* MTSIntegratorProxy::deserialize(const SerializationNode& node) const {
+    if (node.getIntProperty("version") != 1)
+        throw OpenMMException("Unsupported version number");
+    vector<pair<int, int> > groups;
+    const SerializationNode& groupsNode = node.getChildNode("Groups");
+    for (int i = 0; i < (int) groupsNode.getChildren().size(); i++) {
+        const SerializationNode& group = groupsNode.getChildren()[i];
+        groups.push_back(make_pair(group.getIntProperty("group"), group.getIntProperty("substeps")));
+    }
+    MTSIntegrator *integrator = new MTSIntegrator(node.getDoubleProperty("stepSize"), groups);
+    integrator->setConstraintTolerance(node.getDoubleProperty("constraintTolerance"));
+    return integrator;
+}
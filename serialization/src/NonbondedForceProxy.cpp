@@ -42,13 +42,27 @@ NonbondedForceProxy::NonbondedForceProxy() : SerializationProxy("NonbondedForce"
 }
 
 void NonbondedForceProxy::serialize(const void* object, SerializationNode& node) const {
-    node.setIntProperty("version", 1);
+    node.setIntProperty("version", 2);
     const NonbondedForce& force = *reinterpret_cast<const NonbondedForce*>(object);
     node.setIntProperty("method", (int) force.getNonbondedMethod());
     node.setDoubleProperty("cutoff", force.getCutoffDistance());
     node.setDoubleProperty("ewaldTolerance", force.getEwaldErrorTolerance());
     node.setDoubleProperty("rfDielectric", force.getReactionFieldDielectric());
     node.setIntProperty("dispersionCorrection", force.getUseDispersionCorrection());
+    double alpha;
+    int nx, ny, nz;
+    force.getPMEParameters(alpha, nx, ny, nz);
+    node.setDoubleProperty("alpha", alpha);
+    node.setIntProperty("nx", nx);
+    node.setIntProperty("ny", ny);
+    node.setIntProperty("nz", nz);
+    force.getLJPMEParameters(alpha, nx, ny, nz);
+    node.setDoubleProperty("ljAlpha", alpha);
+    node.setIntProperty("ljnx", nx);
+    node.setIntProperty("ljny", ny);
+    node.setIntProperty("ljnz", nz);
+    node.setIntProperty("pmeTuning", force.getUsePMETuning());
+    node.setStringProperty("pmeTuningCacheFile", force.getPMETuningCacheFile());
     SerializationNode& particles = node.createChildNode("Particles");
     for (int i = 0; i < force.getNumParticles(); i++) {
         double charge, sigma, epsilon;
@@ -65,7 +79,8 @@ void NonbondedForceProxy::serialize(const void* object, SerializationNode& node)
 }
 
 void* NonbondedForceProxy::deserialize(const SerializationNode& node) const {
-    if (node.getIntProperty("version") != 1)
+    int version = node.getIntProperty("version");
+    if (version != 1 && version != 2)
         throw OpenMMException("Unsupported version number");
     NonbondedForce* force = new NonbondedForce();
     try {
@@ -74,6 +89,12 @@ void* NonbondedForceProxy::deserialize(const SerializationNode& node) const {
         force->setEwaldErrorTolerance(node.getDoubleProperty("ewaldTolerance"));
         force->setReactionFieldDielectric(node.getDoubleProperty("rfDielectric"));
         force->setUseDispersionCorrection(node.getIntProperty("dispersionCorrection"));
+        if (version >= 2) {
+            force->setPMEParameters(node.getDoubleProperty("alpha"), node.getIntProperty("nx"), node.getIntProperty("ny"), node.getIntProperty("nz"));
+            force->setLJPMEParameters(node.getDoubleProperty("ljAlpha"), node.getIntProperty("ljnx"), node.getIntProperty("ljny"), node.getIntProperty("ljnz"));
+            force->setUsePMETuning(node.getIntProperty("pmeTuning"));
+            force->setPMETuningCacheFile(node.getStringProperty("pmeTuningCacheFile"));
+        }
         const SerializationNode& particles = node.getChildNode("Particles");
         for (int i = 0; i < (int) particles.getChildren().size(); i++) {
             const SerializationNode& particle = particles.getChildren()[i];
@@ -34,6 +34,7 @@
 #include "openmm/BrownianIntegrator.h"
 #include "openmm/CustomIntegrator.h"
 #include "openmm/LangevinIntegrator.h"
+#include "openmm/MTSIntegrator.h"
 #include "openmm/VariableLangevinIntegrator.h"
 #include "openmm/VariableVerletIntegrator.h"
 #include "openmm/VerletIntegrator.h"
@@ -114,6 +115,27 @@ void testSerializeVariableLangevinIntegrator() {
     delete intg2;
 }
 
+void testSerializeMTSIntegrator() {
+    vector<pair<int, int> > groups;
+    groups.push_back(make_pair(3, 1));
+    groups.push_back(make_pair(0, 4));
+    groups.push_back(make_pair(1, 2));
+    MTSIntegrator *intg = new MTSIntegrator(0.0043, groups);
+    intg->setConstraintTolerance(1.5e-6);
+    stringstream ss;
+    XmlSerializer::serialize<Integrator>(intg, "MTSIntegrator", ss);
+    MTSIntegrator *intg2 = dynamic_cast<MTSIntegrator*>(XmlSerializer::deserialize<Integrator>(ss));
+    ASSERT_EQUAL(intg->getConstraintTolerance(), intg2->getConstraintTolerance());
+    ASSERT_EQUAL(intg->getStepSize(), intg2->getStepSize());
+    ASSERT_EQUAL(intg->getNumGroups(), intg2->getNumGroups());
+    for (int i = 0; i < intg->getNumGroups(); i++) {
+        ASSERT_EQUAL(intg->getGroups()[i].first, intg2->getGroups()[i].first);
+        ASSERT_EQUAL(intg->getGroups()[i].second, intg2->getGroups()[i].second);
+    }
+    delete intg;
+    delete intg2;
+}
+
 void testSerializeCustomIntegrator() {
     CustomIntegrator *intg = new CustomIntegrator(0.002234);
     intg->addPerDofVariable("temp",0);
@@ -193,6 +215,7 @@ int main() {
         testSerializeVariableLangevinIntegrator();
         testSerializeVariableVerletIntegrator();
         testSerializeLangevinIntegrator(); 
+        testSerializeMTSIntegrator();
     }
     catch(const exception& e) {
 		return 1;
@@ -42,11 +42,15 @@ void testSerialization() {
     // Create a Force.
 
     NonbondedForce force;
-    force.setNonbondedMethod(NonbondedForce::CutoffPeriodic);
+    force.setNonbondedMethod(NonbondedForce::LJPME);
     force.setCutoffDistance(2.0);
     force.setEwaldErrorTolerance(1e-3);
     force.setReactionFieldDielectric(50.0);
     force.setUseDispersionCorrection(false);
+    force.setPMEParameters(3.2, 20, 22, 24);
+    force.setLJPMEParameters(2.5, 14, 16, 18);
+    force.setUsePMETuning(true);
+    force.setPMETuningCacheFile("pmeTuning.cache");
     force.addParticle(1, 0.1, 0.01);
     force.addParticle(0.5, 0.2, 0.02);
     force.addParticle(-0.5, 0.3, 0.03);
@@ -67,6 +71,22 @@ void testSerialization() {
     ASSERT_EQUAL(force.getEwaldErrorTolerance(), force2.getEwaldErrorTolerance());
     ASSERT_EQUAL(force.getReactionFieldDielectric(), force2.getReactionFieldDielectric());
     ASSERT_EQUAL(force.getUseDispersionCorrection(), force2.getUseDispersionCorrection());
+    double alpha1, alpha2;
+    int nx1, nx2, ny1, ny2, nz1, nz2;
+    force.getPMEParameters(alpha1, nx1, ny1, nz1);
+    force2.getPMEParameters(alpha2, nx2, ny2, nz2);
+    ASSERT_EQUAL(alpha1, alpha2);
+    ASSERT_EQUAL(nx1, nx2);
+    ASSERT_EQUAL(ny1, ny2);
+    ASSERT_EQUAL(nz1, nz2);
+    force.getLJPMEParameters(alpha1, nx1, ny1, nz1);
+    force2.getLJPMEParameters(alpha2, nx2, ny2, nz2);
+    ASSERT_EQUAL(alpha1, alpha2);
+    ASSERT_EQUAL(nx1, nx2);
+    ASSERT_EQUAL(ny1, ny2);
+    ASSERT_EQUAL(nz1, nz2);
+    ASSERT_EQUAL(force.getUsePMETuning(), force2.getUsePMETuning());
+    ASSERT_EQUAL(force.getPMETuningCacheFile(), force2.getPMETuningCacheFile());
     ASSERT_EQUAL(force.getNumParticles(), force2.getNumParticles());
     for (int i = 0; i < force.getNumParticles(); i++) {
         double charge1, sigma1, epsilon1;
@@ -0,0 +1,122 @@
+/* -------------------------------------------------------------------------- *
+ *                                   OpenMM                                   *
+ * -------------------------------------------------------------------------- *
+ * This is part of the OpenMM molecular simulation toolkit originating from   *
+ * Simbios, the NIH National Center for Physics-Based Simulation of           *
+ * Biological Structures at Stanford, funded under the NIH Roadmap for        *
+ * Medical Research, grant U54 GM072970. See https://simtk.org.               *
+ *                                                                            *
+ * Portions copyright (c) 2013 Stanford University and the Authors.           *
+ * Authors: Peter Eastman                                                     *
+ * Contributors:                                                              *
+ *                                                                            *
+ * Permission is hereby granted, free of charge, to any person obtaining a    *
+ * copy of this software and associated documentation files (the "Software"), *
+ * to deal in the Software without restriction, including without limitation  *
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,   *
+ * and/or sell copies of the Software, and to permit persons to whom the      *
+ * Software is furnished to do so, subject to the following conditions:       *
+ *                                                                            *
+ * The above copyright notice and this permission notice shall be included in *
+ * all copies or substantial portions of the Software.                        *
+ *                                                                            *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR *
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,   *
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL    *
+ * THE AUTHORS, CONTRIBUTORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,    *
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR      *
+ * OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE  *
+ * USE OR OTHER DEALINGS IN THE SOFTWARE.                                     *
+ * -------------------------------------------------------------------------- */
+
+/**
+ * This tests the order in which ContextImpl invokes the ForceImpls when computing forces.
+ */
+
+#include "openmm/internal/AssertionUtilities.h"
+#include "openmm/Context.h"
+#include "openmm/Force.h"
+#include "openmm/Platform.h"
+#include "openmm/System.h"
+#include "openmm/VerletIntegrator.h"
+#include "openmm/internal/ContextImpl.h"
+#include "openmm/internal/ForceImpl.h"
+#include <iostream>
+#include <string>
+#include <vector>
+
+using namespace OpenMM;
+using namespace std;
+
+static vector<string> events;
+
+class LoggingForceImpl : public ForceImpl {
+public:
+    LoggingForceImpl(const Force& owner, const string& name) : owner(owner), name(name) {
+    }
+    void initialize(ContextImpl& context) {
+    }
+    const Force& getOwner() const {
+        return owner;
+    }
+    void updateContextState(ContextImpl& context) {
+    }
+    void beginCalcForcesAndEnergy(ContextImpl& context, bool includeForces, bool includeEnergy, int groups) {
+        events.push_back("begin "+name);
+    }
+    double calcForcesAndEnergy(ContextImpl& context, bool includeForces, bool includeEnergy, int groups) {
+        events.push_back("calc "+name);
+        return 1.0;
+    }
+    std::map<std::string, double> getDefaultParameters() {
+        return std::map<std::string, double>();
+    }
+    std::vector<std::string> getKernelNames() {
+        return std::vector<std::string>();
+    }
+private:
+    const Force& owner;
+    string name;
+};
+
+class LoggingForce : public Force {
+public:
+    LoggingForce(const string& name) : name(name) {
+    }
+protected:
+    ForceImpl* createImpl() const {
+        return new LoggingForceImpl(*this, name);
+    }
+private:
+    string name;
+};
+
+void testBeginBeforeCalc() {
+    System system;
+    system.addParticle(1.0);
+    system.addForce(new LoggingForce("A"));
+    system.addForce(new LoggingForce("B"));
+    VerletIntegrator integrator(0.001);
+    Context context(system, integrator, Platform::getPlatformByName("Reference"));
+    context.setPositions(vector<Vec3>(1));
+    events.clear();
+    State state = context.getState(State::Energy);
+    ASSERT_EQUAL_TOL(2.0, state.getPotentialEnergy(), 1e-10);
+    ASSERT_EQUAL(4, events.size());
+    ASSERT_EQUAL("begin A", events[0]);
+    ASSERT_EQUAL("begin B", events[1]);
+    ASSERT_EQUAL("calc A", events[2]);
+    ASSERT_EQUAL("calc B", events[3]);
+}
+
+int main() {
+    try {
+        testBeginBeforeCalc();
+    }
+    catch(const exception& e) {
+        cout << "exception: " << e.what() << endl;
+        return 1;
+    }
+    cout << "Done" << endl;
+    return 0;
+}
@@ -3,6 +3,7 @@
 #include <iostream>
 #include <limits>
 #include <map>
+#include <vector>
 
 using namespace Lepton;
 using namespace std;
@@ -36,6 +37,34 @@ class ExampleFunction : public CustomFunction {
     }
 };
 
+/**
+ * This is a custom function that always throws an exception.
+ */
+
+class ThrowingFunction : public CustomFunction {
+    int getNumArguments() const {
+        return 1;
+    }
+    double evaluate(const double* arguments) const {
+        throw Lepton::Exception("ThrowingFunction");
+    }
+    double evaluateDerivative(const double* arguments, const int* derivOrder) const {
+        throw Lepton::Exception("ThrowingFunction");
+    }
+    CustomFunction* clone() const {
+        return new ThrowingFunction();
+    }
+};
+
+/**
+ * Set the value of a variable in a CompiledExpression, if the expression uses it.
+ */
+
+void setVariable(CompiledExpression& expression, const string& name, double value) {
+    if (expression.getVariables().find(name) != expression.getVariables().end())
+        expression.getVariableReference(name) = value;
+}
+
 /**
  * Verify that an expression gives the correct value.
  */
@@ -56,6 +85,12 @@ void verifyEvaluation(const string& expression, double expectedValue) {
     ExpressionProgram program = parsed.createProgram();
     value = program.evaluate();
     ASSERT_EQUAL_TOL(expectedValue, value, 1e-10);
+
+    // Create a CompiledExpression and see if that also gives the same result.
+
+    CompiledExpression compiled = parsed.createCompiledExpression();
+    value = compiled.evaluate();
+    ASSERT_EQUAL_TOL(expectedValue, value, 1e-10);
 }
 
 /**
@@ -86,6 +121,23 @@ void verifyEvaluation(const string& expression, double x, double y, double expec
     value = program.evaluate(variables);
     ASSERT_EQUAL_TOL(expectedValue, value, 1e-10);
 
+    // Create a CompiledExpression and see if that also gives the same result.  Evaluate a copy of it
+    // too, to make sure copying preserves the variable locations.
+
+    CompiledExpression compiled = parsed.createCompiledExpression();
+    setVariable(compiled, "x", x);
+    setVariable(compiled, "y", y);
+    value = compiled.evaluate();
+    ASSERT_EQUAL_TOL(expectedValue, value, 1e-10);
+    CompiledExpression compiledCopy = compiled;
+    value = compiledCopy.evaluate();
+    ASSERT_EQUAL_TOL(expectedValue, value, 1e-10);
+    CompiledExpression compiledOptimized = parsed.optimize().createCompiledExpression();
+    setVariable(compiledOptimized, "x", x);
+    setVariable(compiledOptimized, "y", y);
+    value = compiledOptimized.evaluate();
+    ASSERT_EQUAL_TOL(expectedValue, value, 1e-10);
+
     // Make sure that variable renaming works.
 
     variables.clear();
@@ -126,6 +178,15 @@ void verifySameValue(const ParsedExpression& exp1, const ParsedExpression& exp2,
         if (val1 != inf || val2 != inf) // Both infinity is also fine.
             if (val1 != -inf || val2 != -inf) // Same for -infinity.
                 ASSERT_EQUAL_TOL(val1, val2, 1e-10);
+
+    // Make sure a CompiledExpression gives the same value as the ParsedExpression.
+
+    CompiledExpression compiled = exp1.createCompiledExpression();
+    setVariable(compiled, "x", x);
+    setVariable(compiled, "y", y);
+    double val3 = compiled.evaluate();
+    if (val1 == val1 && val1 != inf && val1 != -inf)
+        ASSERT_EQUAL_TOL(val1, val3, 1e-10);
 }
 
 /**
@@ -169,6 +230,121 @@ void testCustomFunction(const string& expression, const string& equivalent) {
     verifySameValue(deriv3, deriv4, 2.0, -3.0);
 }
 
+/**
+ * Verify that an exception thrown by a custom function propagates out of CompiledExpression::evaluate().
+ */
+
+void testThrowingCustomFunction() {
+    map<string, CustomFunction*> functions;
+    ThrowingFunction fn;
+    functions["fail"] = &fn;
+    CompiledExpression expression = Parser::parse("2*x+fail(x^2)", functions).createCompiledExpression();
+    setVariable(expression, "x", 1.5);
+    bool threwException = false;
+    try {
+        expression.evaluate();
+    }
+    catch (const Lepton::Exception& ex) {
+        threwException = true;
+    }
+    if (!threwException)
+        throw exception();
+}
+
+/**
+ * Verify that asking a CompiledExpression for a variable it does not use throws an exception.
+ */
+
+void testUnknownVariable() {
+    CompiledExpression expression = Parser::parse("2*x+y").createCompiledExpression();
+    expression.getVariableReference("x") = 1.0;
+    bool threwException = false;
+    try {
+        expression.getVariableReference("z");
+    }
+    catch (const Lepton::Exception& ex) {
+        threwException = true;
+    }
+    if (!threwException)
+        throw exception();
+}
+
+/**
+ * Verify that evaluating a CompiledExpression in batches gives the same values as evaluating it one at a time.
+ */
+
+void testBatchEvaluation(const string& expression) {
+    const int numValues = 150;
+    vector<double> x(numValues), y(numValues), results(numValues);
+    for (int i = 0; i < numValues; i++) {
+        x[i] = 0.1*i-3.0;
+        y[i] = 2.0+0.01*i;
+    }
+    CompiledExpression compiled = Parser::parse(expression).optimize().createCompiledExpression();
+    vector<string> names;
+    names.push_back("x");
+    names.push_back("y");
+    vector<const double*> values;
+    values.push_back(&x[0]);
+    values.push_back(&y[0]);
+    compiled.evaluateBatch(numValues, names, values, vector<double*>(1, &results[0]));
+    for (int i = 0; i < numValues; i++) {
+        setVariable(compiled, "x", x[i]);
+        setVariable(compiled, "y", y[i]);
+        ASSERT_EQUAL_TOL(compiled.evaluate(), results[i], 1e-10);
+    }
+}
+
+/**
+ * Verify that compiling several expressions together gives the same values as compiling them separately.
+ */
+
+void testMultipleExpressions(const string& expression) {
+    vector<ParsedExpression> expressions;
+    expressions.push_back(Parser::parse(expression).optimize());
+    expressions.push_back(expressions[0].differentiate("x").optimize());
+    expressions.push_back(expressions[0].differentiate("y").optimize());
+    CompiledExpression combined(expressions);
+    ASSERT_EQUAL_TOL(3, combined.getNumResults(), 0);
+    setVariable(combined, "x", 1.5);
+    setVariable(combined, "y", -0.7);
+    double value = combined.evaluate();
+    for (int i = 0; i < (int) expressions.size(); i++) {
+        CompiledExpression separate = expressions[i].createCompiledExpression();
+        setVariable(separate, "x", 1.5);
+        setVariable(separate, "y", -0.7);
+        ASSERT_EQUAL_TOL(separate.evaluate(), combined.getResult(i), 1e-10);
+    }
+    ASSERT_EQUAL_TOL(combined.getResult(0), value, 0);
+
+    // Evaluate them as a batch.
+
+    const int numValues = 70;
+    vector<double> x(numValues), y(numValues), energy(numValues), deriv(numValues);
+    for (int i = 0; i < numValues; i++) {
+        x[i] = 0.05*i+0.5;
+        y[i] = 1.0-0.02*i;
+    }
+    vector<string> names;
+    names.push_back("x");
+    names.push_back("y");
+    vector<const double*> values;
+    values.push_back(&x[0]);
+    values.push_back(&y[0]);
+    vector<double*> results;
+    results.push_back(&energy[0]);
+    results.push_back(NULL);
+    results.push_back(&deriv[0]);
+    combined.evaluateBatch(numValues, names, values, results);
+    for (int i = 0; i < numValues; i++) {
+        setVariable(combined, "x", x[i]);
+        setVariable(combined, "y", y[i]);
+        combined.evaluate();
+        ASSERT_EQUAL_TOL(combined.getResult(0), energy[i], 1e-10);
+        ASSERT_EQUAL_TOL(combined.getResult(2), deriv[i], 1e-10);
+    }
+}
+
 int main() {
     try {
         verifyEvaluation("5", 5.0);
@@ -192,6 +368,10 @@ int main() {
         verifyEvaluation("5*(-x)*(-y)", 1.0, 4.0, 20.0);
         verifyEvaluation("5*(-x)*(y)", 1.0, 4.0, -20.0);
         verifyEvaluation("5*(x)*(-y)", 1.0, 4.0, -20.0);
+        verifyEvaluation("exp(x)*log(y)+sqrt(x*y)", 2.0, 3.0, std::exp(2.0)*std::log(3.0)+std::sqrt(6.0));
+        verifyEvaluation("x^y+x^2.5+(x+1)^3+1/(x-y)", 2.0, 3.0, 8.0+std::pow(2.0, 2.5)+27.0-1.0);
+        verifyEvaluation("tanh(x)+acos(y/4)+atan(x*y)+cosh(y)", 2.0, 3.0, std::tanh(2.0)+std::acos(0.75)+std::atan(6.0)+std::cosh(3.0));
+        verifyEvaluation("min(x, -y)+max(x, y)-abs(-x)+step(x-y)", 2.0, 3.0, -3.0+3.0-2.0);
         verifyEvaluation("5*(-x)/(-y)", 1.0, 4.0, 1.25);
         verifyEvaluation("5*(-x)/(y)", 1.0, 4.0, -1.25);
         verifyEvaluation("5*(x)/(-y)", 1.0, 4.0, -1.25);
@@ -239,8 +419,14 @@ int main() {
         verifyDerivative("min(x, 2*x)", "step(x-2*x)*2+(1-step(x-2*x))*1");
         verifyDerivative("max(5, x^2)", "(1-step(5-x^2))*2*x");
         verifyDerivative("abs(3*x)", "step(3*x)*3+(1-step(3*x))*-3");
+        testBatchEvaluation("x^2*sin(y)+max(x, y)/3-exp(-abs(x))");
+        testBatchEvaluation("sqrt(y)*(x+1)^3+erfc(x)/y+step(x)");
+        testMultipleExpressions("4*x*((y/x)^12-(y/x)^6)");
+        testMultipleExpressions("exp(-x*y)*sin(x^2)+y/(x+sqrt(y^2+1))");
         testCustomFunction("custom(x, y)/2", "x*y");
         testCustomFunction("custom(x^2, 1)+custom(2, y-1)", "2*x^2+4*(y-1)");
+        testThrowingCustomFunction();
+        testUnknownVariable();
         cout << Parser::parse("x*x").optimize() << endl;
         cout << Parser::parse("x*(x*x)").optimize() << endl;
         cout << Parser::parse("(x*x)*x").optimize() << endl;
@@ -0,0 +1,193 @@
+/* -------------------------------------------------------------------------- *
+ *                                   OpenMM                                   *
+ * -------------------------------------------------------------------------- *
+ * This is part of the OpenMM molecular simulation toolkit originating from   *
+ * Simbios, the NIH National Center for Physics-Based Simulation of           *
+ * Biological Structures at Stanford, funded under the NIH Roadmap for        *
+ * Medical Research, grant U54 GM072970. See https://simtk.org.               *
+ *                                                                            *
+ * Portions copyright (c) 2013 Stanford University and the Authors.           *
+ * Authors: Peter Eastman                                                     *
+ * Contributors:                                                              *
+ *                                                                            *
+ * Permission is hereby granted, free of charge, to any person obtaining a    *
+ * copy of this software and associated documentation files (the "Software"), *
+ * to deal in the Software without restriction, including without limitation  *
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,   *
+ * and/or sell copies of the Software, and to permit persons to whom the      *
+ * Software is furnished to do so, subject to the following conditions:       *
+ *                                                                            *
+ * The above copyright notice and this permission notice shall be included in *
+ * all copies or substantial portions of the Software.                        *
+ *                                                                            *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR *
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,   *
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL    *
+ * THE AUTHORS, CONTRIBUTORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,    *
+ * DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR      *
+ * OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE  *
+ * USE OR OTHER DEALINGS IN THE SOFTWARE.                                     *
+ * -------------------------------------------------------------------------- */
+
+/**
+ * This tests ThreadBarrier and the ThreadPool built on it.
+ */
+
+#include "openmm/OpenMMException.h"
+#include "openmm/internal/AssertionUtilities.h"
+#include "openmm/internal/ThreadBarrier.h"
+#include "openmm/internal/ThreadPool.h"
+#include <iostream>
+#include <vector>
+
+using namespace OpenMM;
+using namespace std;
+
+/**
+ * Each thread writes its index into one element per phase, then after the barrier checks
+ * that every other thread has written its element for that phase.
+ */
+class PhaseTask : public ThreadPool::Task {
+public:
+    PhaseTask(int numThreads, int numPhases) : numPhases(numPhases), values(numThreads*numPhases, -1), errors(numThreads, 0) {
+    }
+    void execute(ThreadPool& pool, int threadIndex) {
+        int numThreads = pool.getNumThreads();
+        for (int phase = 0; phase < numPhases; phase++) {
+            values[phase*numThreads+threadIndex] = threadIndex;
+            pool.syncThreads();
+            for (int i = 0; i < numThreads; i++)
+                if (values[phase*numThreads+i] != i)
+                    errors[threadIndex]++;
+        }
+    }
+    int numPhases;
+    vector<int> values, errors;
+};
+
+void testPoolPhases(int numThreads) {
+    ThreadPool pool(numThreads);
+    for (int repeat = 0; repeat < 10; repeat++) {
+        PhaseTask task(numThreads, 200);
+        pool.execute(task);
+        for (int i = 0; i < numThreads; i++)
+            ASSERT_EQUAL(0, task.errors[i]);
+        for (int i = 0; i < (int) task.values.size(); i++)
+            ASSERT_EQUAL(i%numThreads, task.values[i]);
+    }
+}
+
+/**
+ * Thread 0 throws an exception, while the other threads record that they ran.
+ */
+class ThrowingTask : public ThreadPool::Task {
+public:
+    ThrowingTask(int numThreads) : ran(numThreads, 0) {
+    }
+    void execute(ThreadPool& pool, int threadIndex) {
+        ran[threadIndex] = 1;
+        if (threadIndex == 0)
+            throw OpenMMException("ThrowingTask");
+    }
+    vector<int> ran;
+};
+
+void testPoolException(int numThreads) {
+    // After a Task throws, every thread must have finished it, and the pool must still work.
+
+    ThreadPool pool(numThreads);
+    for (int repeat = 0; repeat < 10; repeat++) {
+        ThrowingTask task(numThreads);
+        bool threw = false;
+        try {
+            pool.execute(task);
+        }
+        catch (const OpenMMException& ex) {
+            threw = true;
+        }
+        ASSERT(threw);
+        for (int i = 0; i < numThreads; i++)
+            ASSERT_EQUAL(1, task.ran[i]);
+        PhaseTask phases(numThreads, 10);
+        pool.execute(phases);
+        for (int i = 0; i < numThreads; i++)
+            ASSERT_EQUAL(0, phases.errors[i]);
+    }
+}
+
+struct BarrierData {
+    ThreadBarrier* barrier;
+    int index, numThreads, numPhases, numLast, errors;
+    int* counter;
+    pthread_mutex_t* lock;
+};
+
+static void* barrierThread(void* args) {
+    BarrierData& data = *reinterpret_cast<BarrierData*>(args);
+    for (int phase = 0; phase < data.numPhases; phase++) {
+        pthread_mutex_lock(data.lock);
+        (*data.counter)++;
+        pthread_mutex_unlock(data.lock);
+        if (data.barrier->wait())
+            data.numLast++;
+        pthread_mutex_lock(data.lock);
+        if (*data.counter != (phase+1)*data.numThreads)
+            data.errors++;
+        pthread_mutex_unlock(data.lock);
+        data.barrier->wait();
+    }
+    return 0;
+}
+
+void testBarrier(int numThreads, int spinCount) {
+    // A spin count of 0 forces every waiting thread to sleep, which tests the fallback path.
+
+    ThreadBarrier barrier(numThreads, spinCount);
+    ASSERT_EQUAL(numThreads, barrier.getNumThreads());
+    int counter = 0;
+    pthread_mutex_t lock;
+    pthread_mutex_init(&lock, NULL);
+    const int numPhases = 500;
+    vector<BarrierData> data(numThreads);
+    vector<pthread_t> threads(numThreads);
+    for (int i = 0; i < numThreads; i++) {
+        data[i].barrier = &barrier;
+        data[i].index = i;
+        data[i].numThreads = numThreads;
+        data[i].numPhases = numPhases;
+        data[i].numLast = 0;
+        data[i].errors = 0;
+        data[i].counter = &counter;
+        data[i].lock = &lock;
+        pthread_create(&threads[i], NULL, barrierThread, &data[i]);
+    }
+    int totalLast = 0;
+    for (int i = 0; i < numThreads; i++) {
+        pthread_join(threads[i], NULL);
+        ASSERT_EQUAL(0, data[i].errors);
+        totalLast += data[i].numLast;
+    }
+    pthread_mutex_destroy(&lock);
+    ASSERT_EQUAL(numThreads*numPhases, counter);
+    ASSERT_EQUAL(numPhases, totalLast);
+}
+
+int main() {
+    try {
+        testPoolPhases(1);
+        testPoolPhases(2);
+        testPoolPhases(5);
+        testPoolException(1);
+        testPoolException(4);
+        testBarrier(1, 1000);
+        testBarrier(2, 1000);
+        testBarrier(4, 1000);
+        testBarrier(4, 0);
+    }
+    catch(const exception& e) {
+        cout << "exception: " << e.what() << endl;
+        return 1;
+    }
+    cout << "Done" << endl;
+    return 0;
+}
@@ -325,6 +325,7 @@ UNITS = {
 ("AmoebaWcaDispersionForce",              "getShctd")                                      :  ( None, ()),
 
 ("Context", "getParameter") : (None, ()),
+("Context", "getEnergyByGroup") : ('unit.kilojoule_per_mole', ()),
 ("CMAPTorsionForce", "getMapParameters") : (None, ()),
 ("CMAPTorsionForce", "getTorsionParameters") : (None, ()),
 ("CMMotionRemover", "getFrequency") : (None, ()),